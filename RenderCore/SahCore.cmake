@@ -9,6 +9,7 @@ project(sah_renderer)
 option(SAH_USE_FFX "Whether to use AMD's FidelityFX library" 1)
 option(SAH_USE_STREAMLINE "Whether to use Nvidia's Streamline library" 1)
 option(SAH_USE_XESS "Whether to use Intel's XeSS library" 1)
+option(SAH_BUILD_TESTS "Whether to build the CPU-side unit tests" 1)
 
 set(SAH_TOOLS_DIR "${CMAKE_CURRENT_LIST_DIR}/../Tools")
 
@@ -35,6 +36,8 @@ file(GLOB_RECURSE SHADERS CONFIGURE_DEPENDS
 # SAH Core
 
 file(GLOB_RECURSE SOURCES CONFIGURE_DEPENDS ${CMAKE_CURRENT_LIST_DIR}/*.cpp ${CMAKE_CURRENT_LIST_DIR}/*.hpp)
+# The tests are their own executable
+list(FILTER SOURCES EXCLUDE REGEX "^${CMAKE_CURRENT_LIST_DIR}/tests/")
 
 add_library(SahCore STATIC ${SOURCES})
 set(CMAKE_RUNTIME_OUTPUT_DIRECTORY "$<TARGET_FILE_DIR:SahCore>")
@@ -51,6 +54,8 @@ target_compile_definitions(SahCore PUBLIC
         _SILENCE_STDEXT_ARR_ITERS_DEPRECATION_WARNING
         TRACY_ENABLE
         SAH_BINARY_DIR="${CMAKE_RUNTIME_OUTPUT_DIRECTORY}"
+        SAH_SHADER_SOURCE_DIR="${SHADER_DIR}"
+        SAH_TOOLS_DIR="${SAH_TOOLS_DIR}"
         SAH_USE_FFX=${SAH_USE_FFX}
         SAH_USE_STREAMLINE=${SAH_USE_STREAMLINE}
         SAH_USE_XESS=${SAH_USE_XESS}
@@ -152,6 +157,13 @@ if(SAH_USE_XESS)
             $<TARGET_FILE_DIR:SahCore>)
 endif()
 
+#########
+# Tests #
+#########
+if(SAH_BUILD_TESTS AND NOT ANDROID)
+    include(${CMAKE_CURRENT_LIST_DIR}/tests/tests.cmake)
+endif()
+
 #######################
 # Generate VS filters #
 #######################
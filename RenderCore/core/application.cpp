@@ -14,7 +14,7 @@
 
 static std::shared_ptr<spdlog::logger> logger;
 
-Application::Application() : parser{fastgltf::Extensions::KHR_texture_basisu} {
+Application::Application() : parser{fastgltf::Extensions::KHR_texture_basisu | fastgltf::Extensions::KHR_lights_punctual} {
     ZoneScoped;
 
     logger = SystemInterface::get().get_logger("Application");
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cassert>
 #include <compare>
+#include <functional>
 #include <typeindex>
 #include <EASTL/vector.h>
 
@@ -9,10 +11,19 @@
 template <typename ObjectType>
 class ObjectPool;
 
+/**
+ * Handle to an object in an ObjectPool
+ *
+ * The index is the object's slot in the pool. It never changes while the object is alive, so it's safe to use as an
+ * index into GPU buffers. The generation is bumped every time the slot is freed, so a handle to a freed object doesn't
+ * silently refer to whatever object reuses the slot
+ */
 template <typename ObjectType>
 struct PooledObject {
     uint32_t index = 0xFFFFFFFF;
 
+    uint32_t generation = 0;
+
     ObjectPool<ObjectType>* pool = nullptr;
 
     ObjectType* operator->() const;
@@ -25,11 +36,22 @@ struct PooledObject {
 
     bool operator==(const PooledObject& other) const;
 
-    auto operator<=>(const PooledObject<ObjectType>& other) const;
+    std::strong_ordering operator<=>(const PooledObject<ObjectType>& other) const;
 
+    /**
+     * Checks if this handle refers to a live object. Returns false for null handles and for handles to freed objects
+     */
     bool is_valid() const;
 };
 
+/**
+ * Generational slot map
+ *
+ * Objects live in stable slots, so handles and slot indices stay valid until the object is freed. Allocating and
+ * freeing are O(1). Freed slots are reused, with a new generation so that stale handles can be detected
+ *
+ * The pool also keeps a dense list of the live slots, for loops that only care about live objects
+ */
 template <typename ObjectType>
 class ObjectPool {
 public:
@@ -46,12 +68,30 @@ public:
 
     ObjectType& get_object(const PooledObject<ObjectType>& handle);
 
+    /**
+     * Removes the object from the pool, and returns it to the caller
+     */
     ObjectType free_object(const PooledObject<ObjectType>& handle);
 
     ObjectType free_object(uint32_t index);
 
-    PooledObject<ObjectType> make_handle(uint32_t index_in);
+    /**
+     * Makes a handle to the object currently in the given slot
+     */
+    PooledObject<ObjectType> make_handle(uint32_t index_in) const;
+
+    bool is_live(const PooledObject<ObjectType>& handle) const;
+
+    /**
+     * Retrieves the slot indices of all live objects, tightly packed. The order changes when objects are freed
+     */
+    const eastl::vector<uint32_t>& get_live_indices() const;
+
+    uint32_t get_num_live_objects() const;
 
+    /**
+     * Retrieves the storage for every slot, including free slots. Free slots hold default-constructed objects
+     */
     eastl::vector<ObjectType>& get_data();
 
     const eastl::vector<ObjectType>& get_data() const;
@@ -61,31 +101,46 @@ public:
     const ObjectType& operator[](uint32_t index) const;
 
 private:
+    static constexpr uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
     std::function<ObjectType()> creator;
 
     std::function<void(ObjectType&&)> deleter;
 
     eastl::vector<ObjectType> objects;
 
-    eastl::vector<PooledObject<ObjectType>> available_handles;
+    /**
+     * Current generation of each slot
+     */
+    eastl::vector<uint32_t> generations;
+
+    /**
+     * Index of each slot in live_indices, or INVALID_INDEX if the slot is free
+     */
+    eastl::vector<uint32_t> live_positions;
+
+    eastl::vector<uint32_t> live_indices;
+
+    eastl::vector<uint32_t> free_indices;
 };
 
 template <typename ObjectType>
 struct std::hash<PooledObject<ObjectType>> {
     size_t operator()(const PooledObject<ObjectType>& value) const noexcept {
-        // This completely fails for some reason
-        return std::hash<uint32_t>{}(value.index);
+        return std::hash<uint64_t>{}(static_cast<uint64_t>(value.generation) << 32 | value.index);
     }
 };
 
 template <typename ObjectType>
 ObjectType* PooledObject<ObjectType>::operator->() const {
+    assert(is_valid());
     auto& objects = pool->get_data();
     return &objects[index];
 }
 
 template <typename ObjectType>
 ObjectType& PooledObject<ObjectType>::operator*() const {
+    assert(is_valid());
     auto& objects = pool->get_data();
     return objects[index];
 }
@@ -102,42 +157,72 @@ bool PooledObject<ObjectType>::operator!() const {
 
 template <typename ObjectType>
 bool PooledObject<ObjectType>::operator==(const PooledObject& other) const {
-    return other.index == index;
+    return other.index == index && other.generation == generation && other.pool == pool;
 }
 
 template <typename ObjectType>
-auto PooledObject<ObjectType>::operator<=>(const PooledObject<ObjectType>& other) const {
-    return static_cast<int32_t>(static_cast<int64_t>(other.index) - static_cast<int64_t>(index));
+std::strong_ordering PooledObject<ObjectType>::operator<=>(const PooledObject<ObjectType>& other) const {
+    if(const auto order = index <=> other.index; order != 0) {
+        return order;
+    }
+    if(const auto order = generation <=> other.generation; order != 0) {
+        return order;
+    }
+    // Same as operator==, handles from different pools are different
+    return std::compare_three_way{}(pool, other.pool);
 }
 
 template <typename ObjectType>
 bool PooledObject<ObjectType>::is_valid() const {
-    return index != 0xFFFFFFFF && pool != nullptr;
+    return index != 0xFFFFFFFF && pool != nullptr && pool->is_live(*this);
 }
 
 template <typename ObjectType>
 PooledObject<ObjectType> ObjectPool<ObjectType>::add_object(ObjectType&& object) {
-    auto handle = PooledObject<ObjectType>{0u, this};
+    auto index = 0u;
 
-    if (available_handles.empty()) {
-        handle.index = static_cast<uint32_t>(objects.size());
+    if (free_indices.empty()) {
+        index = static_cast<uint32_t>(objects.size());
         objects.emplace_back(std::move(object));
+        generations.emplace_back(0);
+        live_positions.emplace_back(INVALID_INDEX);
 
     } else {
-        handle = available_handles.back();
-        available_handles.pop_back();
+        index = free_indices.back();
+        free_indices.pop_back();
 
-        objects[handle.index] = std::move(object);
+        objects[index] = std::move(object);
     }
 
-    return handle;
+    live_positions[index] = static_cast<uint32_t>(live_indices.size());
+    live_indices.emplace_back(index);
+
+    return {index, generations[index], this};
 }
 
 template <typename ObjectType>
 ObjectType& ObjectPool<ObjectType>::get_object(const PooledObject<ObjectType>& handle) {
+    assert(is_live(handle));
     return objects[handle.index];
 }
 
+template <typename ObjectType>
+bool ObjectPool<ObjectType>::is_live(const PooledObject<ObjectType>& handle) const {
+    return handle.index < objects.size() &&
+        generations[handle.index] == handle.generation &&
+        live_positions[handle.index] != INVALID_INDEX;
+}
+
+template <typename ObjectType>
+const eastl::vector<uint32_t>& ObjectPool<ObjectType>::get_live_indices() const {
+    return live_indices;
+}
+
+template <typename ObjectType>
+uint32_t ObjectPool<ObjectType>::get_num_live_objects() const {
+    return static_cast<uint32_t>(live_indices.size());
+}
+
 template <typename ObjectType>
 eastl::vector<ObjectType>& ObjectPool<ObjectType>::get_data() {
     return objects;
@@ -150,11 +235,12 @@ const eastl::vector<ObjectType>& ObjectPool<ObjectType>::get_data() const {
 
 template <typename ObjectType>
 ObjectType ObjectPool<ObjectType>::free_object(const PooledObject<ObjectType>& handle) {
-    auto object = objects[handle.index];
-    objects[handle.index] = {};
-    available_handles.emplace_back(handle);
+    if(!is_live(handle)) {
+        spdlog::error("Tried to free stale handle {} (generation {})", handle.index, handle.generation);
+        return {};
+    }
 
-    return object;
+    return free_object(handle.index);
 }
 
 template <typename ObjectType>
@@ -169,16 +255,29 @@ const ObjectType& ObjectPool<ObjectType>::operator[](uint32_t index) const {
 
 template <typename ObjectType>
 ObjectType ObjectPool<ObjectType>::free_object(uint32_t index) {
-    auto object = objects[index];
+    assert(live_positions[index] != INVALID_INDEX);
+
+    auto object = std::move(objects[index]);
     objects[index] = {};
-    available_handles.emplace_back(PooledObject<ObjectType>{.index = index, .pool = this});
+
+    // Swap the last live index into the freed position to keep the live list dense
+    const auto live_position = live_positions[index];
+    const auto last_live_index = live_indices.back();
+    live_indices[live_position] = last_live_index;
+    live_positions[last_live_index] = live_position;
+    live_indices.pop_back();
+    live_positions[index] = INVALID_INDEX;
+
+    generations[index]++;
+    free_indices.emplace_back(index);
 
     return object;
 }
 
 template <typename ObjectType>
-PooledObject<ObjectType> ObjectPool<ObjectType>::make_handle(uint32_t index_in) {
-    return { index_in, this };
+PooledObject<ObjectType> ObjectPool<ObjectType>::make_handle(uint32_t index_in) const {
+    // Handles always give mutable access to their object, like the handles that add_object returns
+    return { index_in, generations[index_in], const_cast<ObjectPool*>(this) };
 }
 
 template <typename ObjectType>
@@ -188,19 +287,13 @@ ObjectPool<ObjectType>::ObjectPool(CreateFunc&& creator_in, DestroyFunc&& delete
 
 template <typename ObjectType>
 ObjectPool<ObjectType>::~ObjectPool() {
-    for (auto& obj: objects) {
-        deleter(std::move(obj));
+    for (const auto index : live_indices) {
+        deleter(std::move(objects[index]));
     }
 }
 
 template <typename ObjectType>
 PooledObject<ObjectType> ObjectPool<ObjectType>::create_object() {
-    if (!available_handles.empty()) {
-        auto obj = available_handles.back();
-        available_handles.pop_back();
-        return obj;
-    }
-
     return add_object(creator());
 }
 
@@ -108,25 +108,13 @@ void GltfModel::add_primitives(RenderScene& scene, RenderGraph& graph) {
                         gltf_primitive.materialIndex.value_or(0)
                     );
 
-                    const auto& bounds = imported_mesh->bounds;
-                    const auto radius = glm::max(
-                        glm::max(bounds.max.x - bounds.min.x, bounds.max.y - bounds.min.y),
-                        bounds.max.z - bounds.min.z
-                    );
-
                     auto handle = scene.add_primitive(
                         graph,
                         {
-                            .data = PrimitiveDataGPU{
-                                .model = node_to_world,
-                                .inverse_model = glm::inverse(node_to_world),
-                                .bounds_min_and_radius = {bounds.min, radius},
-                                .bounds_max = {bounds.max, 0.f},
-                                .mesh_id = imported_mesh.index,
-                            },
                             .mesh = imported_mesh,
                             .material = imported_material,
-                        }
+                        },
+                        node_to_world
                     );
 
                     node_primitives.emplace_back(handle);
@@ -138,12 +126,52 @@ void GltfModel::add_primitives(RenderScene& scene, RenderGraph& graph) {
     logger->info("Added nodes to the render scene");
 }
 
+void GltfModel::add_lights(RenderScene& scene) const {
+    // KHR_lights_punctual lights without a range have infinite range. Cut them off where they fall below this much
+    // illuminance, in lux
+    constexpr auto min_illuminance = 0.01f;
+
+    auto num_lights = 0u;
+    traverse_nodes(
+        [&](const fastgltf::Node& node, const glm::mat4& node_to_world) {
+            if(!node.lightIndex) {
+                return;
+            }
+
+            const auto& light = model.lights[*node.lightIndex];
+            const auto color = glm::make_vec3(light.color.data()) * light.intensity;
+            const auto range = light.range.value_or(glm::sqrt(light.intensity / min_illuminance));
+            const auto position = float3{node_to_world[3]};
+
+            if(light.type == fastgltf::LightType::Point) {
+                scene.add_point_light(position, color, range);
+                num_lights++;
+
+            } else if(light.type == fastgltf::LightType::Spot) {
+                // Lights point down their node's -Z axis
+                const auto direction = glm::normalize(float3{node_to_world * glm::vec4{0, 0, -1, 0}});
+                scene.add_spot_light(
+                    position,
+                    direction,
+                    color,
+                    range,
+                    light.innerConeAngle.value_or(0.f),
+                    light.outerConeAngle.value_or(glm::quarter_pi<float>()));
+                num_lights++;
+            }
+        }
+    );
+    logger->info("Added {} punctual lights to the render scene", num_lights);
+}
+
 void GltfModel::add_to_scene(RenderScene& scene) {
     auto& backend = RenderBackend::get();
     auto graph = RenderGraph{backend};
 
     add_primitives(scene, graph);
 
+    add_lights(scene);
+
     graph.finish();
     backend.execute_graph(graph);
 }
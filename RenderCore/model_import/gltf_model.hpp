@@ -48,6 +48,12 @@ public:
      */
     void add_primitives(RenderScene& scene, RenderGraph& graph);
 
+    /**
+     * Adds the point and spot lights from KHR_lights_punctual to the scene. Directional lights are ignored - the scene
+     * has its own sun
+     */
+    void add_lights(RenderScene& scene) const;
+
     void add_to_scene(RenderScene& scene);
 
 private:
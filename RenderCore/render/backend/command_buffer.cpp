@@ -237,9 +237,9 @@ void CommandBuffer::set_scissor_rect(const glm::ivec2& upper_left, const glm::iv
     vkCmdSetScissor(commands, 0, 1, &scissor_rect);
 }
 
-void CommandBuffer::bind_vertex_buffer(const uint32_t binding_index, const BufferHandle buffer) const {
-    constexpr auto offset = VkDeviceSize{0};
-
+void CommandBuffer::bind_vertex_buffer(
+    const uint32_t binding_index, const BufferHandle buffer, const VkDeviceSize offset
+) const {
     vkCmdBindVertexBuffers(commands, binding_index, 1, &buffer->buffer, &offset);
 }
 
@@ -255,6 +255,11 @@ void CommandBuffer::draw(
     const uint32_t num_vertices, const uint32_t num_instances, const uint32_t first_vertex,
     const uint32_t first_instance
 ) {
+    if(is_graphics_pipeline_missing || is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
     commit_bindings();
 
     vkCmdDraw(commands, num_vertices, num_instances, first_vertex, first_instance);
@@ -265,6 +270,11 @@ void CommandBuffer::draw_indexed(
     const uint32_t first_index,
     const uint32_t first_vertex, const uint32_t first_instance
 ) {
+    if(is_graphics_pipeline_missing || is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
     commit_bindings();
 
     vkCmdDrawIndexed(
@@ -278,12 +288,44 @@ void CommandBuffer::draw_indexed(
 }
 
 void CommandBuffer::draw_indirect(const BufferHandle indirect_buffer) {
+    if(is_graphics_pipeline_missing || is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
     commit_bindings();
 
     vkCmdDrawIndirect(commands, indirect_buffer->buffer, 0, 1, 0);
 }
 
+void CommandBuffer::draw_indirect(
+    const BufferHandle indirect_buffer, const uint32_t indirect_offset, const BufferHandle count_buffer,
+    const uint32_t count_offset, const uint32_t max_count
+) {
+    if(is_graphics_pipeline_missing || is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
+    commit_bindings();
+
+    vkCmdDrawIndirectCount(
+        commands,
+        indirect_buffer->buffer,
+        indirect_offset,
+        count_buffer->buffer,
+        count_offset,
+        max_count,
+        sizeof(VkDrawIndirectCommand)
+    );
+}
+
 void CommandBuffer::draw_indexed_indirect(const BufferHandle indirect_buffer) {
+    if(is_graphics_pipeline_missing || is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
     commit_bindings();
 
     vkCmdDrawIndexedIndirect(commands, indirect_buffer->buffer, 0, 1, 0);
@@ -292,6 +334,11 @@ void CommandBuffer::draw_indexed_indirect(const BufferHandle indirect_buffer) {
 void CommandBuffer::draw_indexed_indirect(
     const BufferHandle indirect_buffer, const BufferHandle count_buffer, const uint32_t max_count
 ) {
+    if(is_graphics_pipeline_missing || is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
     commit_bindings();
 
     vkCmdDrawIndexedIndirectCount(
@@ -305,7 +352,34 @@ void CommandBuffer::draw_indexed_indirect(
     );
 }
 
+void CommandBuffer::draw_indexed_indirect(
+    const BufferHandle indirect_buffer, const uint32_t indirect_offset, const BufferHandle count_buffer,
+    const uint32_t count_offset, const uint32_t max_count
+) {
+    if(is_graphics_pipeline_missing || is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
+    commit_bindings();
+
+    vkCmdDrawIndexedIndirectCount(
+        commands,
+        indirect_buffer->buffer,
+        indirect_offset,
+        count_buffer->buffer,
+        count_offset,
+        max_count,
+        sizeof(VkDrawIndexedIndirectCommand)
+    );
+}
+
 void CommandBuffer::draw_triangle() {
+    if(is_graphics_pipeline_missing || is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
     set_cull_mode(VK_CULL_MODE_NONE);
 
     commit_bindings();
@@ -318,6 +392,11 @@ void CommandBuffer::dispatch_rays(const glm::uvec2 dispatch_size) {
 }
 
 void CommandBuffer::dispatch_rays(const glm::uvec3 dispatch_size) {
+    if(is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
     commit_bindings();
 
     constexpr auto callable_shader_table = VkStridedDeviceAddressRegionKHR{};
@@ -377,6 +456,12 @@ void CommandBuffer::bind_pipeline(const GraphicsPipelineHandle& pipeline) {
         bound_view_mask,
         using_fragment_shading_rate_attachment);
 
+    // The PSO is still compiling in the background. Skip draws until it's ready, rather than waiting for it
+    is_graphics_pipeline_missing = vk_pipeline == VK_NULL_HANDLE;
+    if(is_graphics_pipeline_missing) {
+        return;
+    }
+
     vkCmdBindPipeline(commands, current_bind_point, vk_pipeline);
 
     are_bindings_dirty = true;
@@ -395,6 +480,10 @@ void CommandBuffer::bind_pipeline(const RayTracingPipelineHandle pipeline) {
     are_bindings_dirty = true;
 }
 
+uint32_t CommandBuffer::get_num_skipped_draws() const {
+    return num_skipped_draws;
+}
+
 void CommandBuffer::set_push_constant(const uint32_t index, const uint32_t data) {
     push_constants[index] = data;
 
@@ -421,22 +510,45 @@ void CommandBuffer::bind_descriptor_set(const uint32_t set_index, const Descript
 void CommandBuffer::bind_descriptor_set(const uint32_t set_index, const VkDescriptorSet set) {
     descriptor_sets[set_index] = set;
 
+    // A null set here means that building it failed. Use clear_descriptor_set to unbind a set on purpose
+    if(set == VK_NULL_HANDLE) {
+        missing_descriptor_sets |= 1u << set_index;
+    } else {
+        missing_descriptor_sets &= ~(1u << set_index);
+    }
+
     are_bindings_dirty = true;
 }
 
 void CommandBuffer::clear_descriptor_set(const uint32_t set_index) {
     descriptor_sets[set_index] = VK_NULL_HANDLE;
+    missing_descriptor_sets &= ~(1u << set_index);
 
     are_bindings_dirty = true;
 }
 
+bool CommandBuffer::is_descriptor_set_missing() const {
+    const auto used_sets_mask = (1u << num_descriptor_sets_in_current_pipeline) - 1;
+    return (missing_descriptor_sets & used_sets_mask) != 0;
+}
+
 void CommandBuffer::dispatch(const uint32_t width, const uint32_t height, const uint32_t depth) {
+    if(is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
     commit_bindings();
 
     vkCmdDispatch(commands, width, height, depth);
 }
 
 void CommandBuffer::dispatch_indirect(const BufferHandle indirect_buffer) {
+    if(is_descriptor_set_missing()) {
+        num_skipped_draws++;
+        return;
+    }
+
     commit_bindings();
 
     vkCmdDispatchIndirect(commands, indirect_buffer->buffer, 0);
@@ -599,24 +711,72 @@ void CommandBuffer::commit_bindings() {
         );
     }
 
-    for(uint32_t i = 0; i < descriptor_sets.size(); i++) {
-        if(descriptor_sets[i] != VK_NULL_HANDLE && num_descriptor_sets_in_current_pipeline > i) {
-            vkCmdBindDescriptorSets(
-                commands,
-                current_bind_point,
-                current_pipeline_layout,
-                i,
-                1,
-                &descriptor_sets[i],
-                0,
-                nullptr
-            );
+    if(backend->use_descriptor_buffers()) {
+        commit_descriptor_buffer_offsets();
+    } else {
+        for(uint32_t i = 0; i < descriptor_sets.size(); i++) {
+            if(descriptor_sets[i] != VK_NULL_HANDLE && num_descriptor_sets_in_current_pipeline > i) {
+                vkCmdBindDescriptorSets(
+                    commands,
+                    current_bind_point,
+                    current_pipeline_layout,
+                    i,
+                    1,
+                    &descriptor_sets[i],
+                    0,
+                    nullptr
+                );
+            }
         }
     }
 
     are_bindings_dirty = false;
 }
 
+void CommandBuffer::commit_descriptor_buffer_offsets() {
+    if(!is_descriptor_buffer_bound) {
+        const auto& descriptor_buffer = backend->get_descriptor_buffer();
+        const auto binding_info = VkDescriptorBufferBindingInfoEXT{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT,
+            .address = descriptor_buffer.get_device_address(),
+            .usage = descriptor_buffer.get_usage(),
+        };
+        vkCmdBindDescriptorBuffersEXT(commands, 1, &binding_info);
+
+        is_descriptor_buffer_bound = true;
+    }
+
+    // Every set lives in the same buffer. Set the offsets of each run of consecutive sets in one call
+    constexpr auto buffer_indices = eastl::array<uint32_t, 8>{};
+    auto offsets = eastl::array<VkDeviceSize, 8>{};
+
+    const auto num_sets = std::min(static_cast<uint32_t>(descriptor_sets.size()), num_descriptor_sets_in_current_pipeline);
+    auto first_set = 0u;
+    while(first_set < num_sets) {
+        if(descriptor_sets[first_set] == VK_NULL_HANDLE) {
+            first_set++;
+            continue;
+        }
+
+        auto set_count = 0u;
+        while(first_set + set_count < num_sets && descriptor_sets[first_set + set_count] != VK_NULL_HANDLE) {
+            offsets[set_count] = DescriptorBuffer::get_offset(descriptor_sets[first_set + set_count]);
+            set_count++;
+        }
+
+        vkCmdSetDescriptorBufferOffsetsEXT(
+            commands,
+            current_bind_point,
+            current_pipeline_layout,
+            first_set,
+            set_count,
+            buffer_indices.data(),
+            offsets.data());
+
+        first_set += set_count;
+    }
+}
+
 VkCommandBuffer CommandBuffer::get_vk_commands() const {
     return commands;
 }
@@ -121,7 +121,7 @@ public:
      * @param binding_index Index of the vertex input to bind to
      * @param buffer Buffer to bind
      */
-    void bind_vertex_buffer(uint32_t binding_index, BufferHandle buffer) const;
+    void bind_vertex_buffer(uint32_t binding_index, BufferHandle buffer, VkDeviceSize offset = 0) const;
 
     template <typename IndexType = uint32_t>
     void bind_index_buffer(BufferHandle buffer) const;
@@ -144,6 +144,19 @@ public:
      */
     void draw_indirect(BufferHandle indirect_buffer);
 
+    /**
+     * \brief Draws many non-indexed meshes, pulling draw commands from a region of the indirect buffer
+     * \param indirect_buffer Buffer of indirect draw commands
+     * \param indirect_offset Byte offset of the first draw command in indirect_buffer
+     * \param count_buffer Buffer with the count of objects to draw
+     * \param count_offset Byte offset of the draw count in count_buffer
+     * \param max_count Maximum number of objects to draw
+     */
+    void draw_indirect(
+        BufferHandle indirect_buffer, uint32_t indirect_offset, BufferHandle count_buffer, uint32_t count_offset,
+        uint32_t max_count
+    );
+
     /**
      * Draws one mesh, pulling draw arguments from the given indirect buffer
      */
@@ -157,6 +170,19 @@ public:
      */
     void draw_indexed_indirect(BufferHandle indirect_buffer, BufferHandle count_buffer, uint32_t max_count);
 
+    /**
+     * \brief Draws many meshes, pulling draw commands from a region of the indirect buffer
+     * \param indirect_buffer Buffer of indirect draw commands
+     * \param indirect_offset Byte offset of the first draw command in indirect_buffer
+     * \param count_buffer Buffer with the count of objects to draw
+     * \param count_offset Byte offset of the draw count in count_buffer
+     * \param max_count Maximum number of objects to draw
+     */
+    void draw_indexed_indirect(
+        BufferHandle indirect_buffer, uint32_t indirect_offset, BufferHandle count_buffer, uint32_t count_offset,
+        uint32_t max_count
+    );
+
     /**
      * Draws a single triangle
      *
@@ -180,6 +206,13 @@ public:
 
     void bind_pipeline(RayTracingPipelineHandle pipeline);
 
+    /**
+     * Number of draws and dispatches that were skipped because their PSO was still compiling or one of their descriptor
+     * sets couldn't be allocated. Passes whose results are cached across frames compare this before and after they
+     * draw, and don't keep results that are missing geometry
+     */
+    uint32_t get_num_skipped_draws() const;
+
     void set_push_constant(uint32_t index, uint32_t data);
 
     void set_push_constant(uint32_t index, float data);
@@ -256,6 +289,24 @@ private:
 
     bool are_bindings_dirty = false;
 
+    /**
+     * Whether we've bound the descriptor buffer. Only used when the backend uses descriptor buffers
+     */
+    bool is_descriptor_buffer_bound = false;
+
+    /**
+     * True when the bound graphics pipeline's PSO hasn't finished compiling. Draws are skipped until a usable pipeline
+     * is bound
+     */
+    bool is_graphics_pipeline_missing = false;
+
+    uint32_t num_skipped_draws = 0;
+
+    /**
+     * Bit i is set when set i was bound as VK_NULL_HANDLE because it couldn't be allocated
+     */
+    uint32_t missing_descriptor_sets = 0;
+
     /**
      * Cache of buffer barriers for events
      *
@@ -271,7 +322,17 @@ private:
 
     void bind_index_buffer(BufferHandle buffer, VkIndexType index_type) const;
 
+    /**
+     * Whether the current pipeline uses a descriptor set that couldn't be allocated
+     */
+    bool is_descriptor_set_missing() const;
+
     void commit_bindings();
+
+    /**
+     * Binds the descriptor sets as offsets into the descriptor buffer
+     */
+    void commit_descriptor_buffer_offsets();
 };
 
 template <typename DataType>
@@ -0,0 +1,343 @@
+#include "descriptor_buffer.hpp"
+
+#include <stdexcept>
+
+#include <spdlog/fmt/bundled/format.h>
+#include <tracy/Tracy.hpp>
+#include <vulkan/vk_enum_string_helper.h>
+
+#include "console/cvars.hpp"
+#include "core/system_interface.hpp"
+#include "render/backend/render_backend.hpp"
+
+static std::shared_ptr<spdlog::logger> logger;
+
+static auto cvar_persistent_size = AutoCVar_Int{
+    "r.RHI.DescriptorBuffer.PersistentSizeMB",
+    "Size of the descriptor buffer region for persistent descriptor sets and the bindless textures, in MB",
+    64
+};
+
+static auto cvar_frame_size = AutoCVar_Int{
+    "r.RHI.DescriptorBuffer.FrameSizeMB",
+    "Size of the descriptor buffer region for each frame's transient descriptor sets, in MB",
+    16
+};
+
+static VkDeviceSize align(const VkDeviceSize value, const VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t DescriptorBuffer::get_frame_region(const uint32_t frame_idx) {
+    return frame_idx + 1;
+}
+
+VkDeviceSize DescriptorBuffer::get_offset(const VkDescriptorSet set) {
+    // Handles are offset by one so that the set at the start of the buffer isn't VK_NULL_HANDLE
+    return reinterpret_cast<VkDeviceSize>(set) - 1;
+}
+
+void DescriptorBuffer::init(RenderBackend& backend_in, const VkPhysicalDeviceDescriptorBufferPropertiesEXT& properties_in) {
+    ZoneScoped;
+
+    if(logger == nullptr) {
+        logger = SystemInterface::get().get_logger("DescriptorBuffer");
+    }
+
+    backend = &backend_in;
+    device = backend_in.get_device().device;
+    vma = backend_in.get_global_allocator().get_vma();
+    properties = properties_in;
+
+    constexpr auto bytes_per_mb = VkDeviceSize{1024 * 1024};
+    const auto alignment = properties.descriptorBufferOffsetAlignment;
+
+    auto size = VkDeviceSize{0};
+    regions[persistent_region] = Region{
+        .begin = size,
+        .end = align(size + cvar_persistent_size.Get() * bytes_per_mb, alignment),
+    };
+    size = regions[persistent_region].end;
+
+    for(auto frame_idx = 0u; frame_idx < num_in_flight_frames; frame_idx++) {
+        auto& region = regions[get_frame_region(frame_idx)];
+        region = Region{
+            .begin = size,
+            .end = align(size + cvar_frame_size.Get() * bytes_per_mb, alignment),
+        };
+        region.next_free = region.begin;
+        size = region.end;
+    }
+
+    // We bind one buffer for both resources and samplers, so it has to fit in both address ranges
+    const auto max_size = std::min(properties.maxResourceDescriptorBufferRange, properties.maxSamplerDescriptorBufferRange);
+    if(size > max_size) {
+        throw std::runtime_error{
+            fmt::format("Descriptor buffer size {} exceeds the device's limit of {}", size, max_size)
+        };
+    }
+
+    const auto create_info = VkBufferCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = get_usage(),
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    const auto allocation_info = VmaAllocationCreateInfo{
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+        .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+        // We write descriptors whenever we want and never flush, so the memory must be coherent
+        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    };
+    auto allocation_result_info = VmaAllocationInfo{};
+    const auto result = vmaCreateBuffer(
+        vma,
+        &create_info,
+        &allocation_info,
+        &buffer,
+        &allocation,
+        &allocation_result_info);
+    if(result != VK_SUCCESS) {
+        throw std::runtime_error{fmt::format("Could not create descriptor buffer: {}", string_VkResult(result))};
+    }
+
+    backend_in.set_object_name(buffer, "Descriptor buffer");
+
+    mapped_data = static_cast<uint8_t*>(allocation_result_info.pMappedData);
+
+    const auto address_info = VkBufferDeviceAddressInfo{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .buffer = buffer
+    };
+    device_address = vkGetBufferDeviceAddress(device, &address_info);
+
+    logger->info("Created a {} MB descriptor buffer", size / bytes_per_mb);
+}
+
+bool DescriptorBuffer::is_initialized() const {
+    return buffer != VK_NULL_HANDLE;
+}
+
+VkDescriptorSet DescriptorBuffer::allocate(const uint32_t region_idx, const VkDescriptorSetLayout layout) {
+    auto& region = regions[region_idx];
+    const auto& layout_info = get_layout_info(layout);
+
+    if(region_idx == persistent_region) {
+        if(const auto itr = free_blocks.find(layout_info.size); itr != free_blocks.end() && !itr->second.empty()) {
+            const auto offset = itr->second.back();
+            itr->second.pop_back();
+            return reinterpret_cast<VkDescriptorSet>(offset + 1);
+        }
+    }
+
+    const auto offset = align(region.next_free, properties.descriptorBufferOffsetAlignment);
+    if(offset + layout_info.size > region.end) {
+        logger->error("Descriptor buffer region {} is full! Consider increasing its size", region_idx);
+        return VK_NULL_HANDLE;
+    }
+
+    region.next_free = offset + layout_info.size;
+
+    return reinterpret_cast<VkDescriptorSet>(offset + 1);
+}
+
+void DescriptorBuffer::free(const VkDescriptorSet set, const VkDescriptorSetLayout layout) {
+    const auto offset = get_offset(set);
+    const auto& region = regions[persistent_region];
+    if(offset < region.begin || offset >= region.end) {
+        logger->error("Descriptor set at offset {} is not in the persistent region, it can't be freed", offset);
+        return;
+    }
+
+    zombie_blocks[backend->get_current_gpu_frame()].emplace_back(
+        FreedBlock{
+            .offset = offset,
+            .size = get_layout_info(layout).size
+        });
+}
+
+void DescriptorBuffer::free_resources_for_frame(const uint32_t frame_idx) {
+    auto& blocks = zombie_blocks[frame_idx];
+    for(const auto& block : blocks) {
+        free_blocks[block.size].emplace_back(block.offset);
+    }
+    blocks.clear();
+}
+
+void DescriptorBuffer::reset_region(const uint32_t region_idx) {
+    auto& region = regions[region_idx];
+
+    TracyPlot("Descriptor buffer bytes used", static_cast<int64_t>(region.next_free - region.begin));
+
+    region.next_free = region.begin;
+}
+
+void DescriptorBuffer::write(const std::span<const VkWriteDescriptorSet> writes, const VkDescriptorSetLayout layout) {
+    ZoneScoped;
+
+    auto& layout_info = get_layout_info(layout);
+
+    for(const auto& write : writes) {
+        const auto descriptor_size = get_descriptor_size(write.descriptorType);
+        if(descriptor_size == 0) {
+            logger->error(
+                "Descriptor type {} is not supported with descriptor buffers",
+                string_VkDescriptorType(write.descriptorType));
+            continue;
+        }
+
+        auto* binding_data = mapped_data + get_offset(write.dstSet) +
+            get_binding_offset(layout_info, layout, write.dstBinding);
+        for(auto element = 0u; element < write.descriptorCount; element++) {
+            write_descriptor(write, element, binding_data + (write.dstArrayElement + element) * descriptor_size);
+        }
+    }
+}
+
+uint32_t DescriptorBuffer::get_max_descriptors(const VkDescriptorType type, const VkDeviceSize num_bytes) const {
+    return static_cast<uint32_t>(num_bytes / get_descriptor_size(type));
+}
+
+VkDeviceSize DescriptorBuffer::get_region_size(const uint32_t region) const {
+    return regions[region].end - regions[region].begin;
+}
+
+VkDeviceAddress DescriptorBuffer::get_device_address() const {
+    return device_address;
+}
+
+VkBufferUsageFlags DescriptorBuffer::get_usage() const {
+    return VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT |
+        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+}
+
+DescriptorBuffer::LayoutInfo& DescriptorBuffer::get_layout_info(const VkDescriptorSetLayout layout) {
+    if(const auto itr = layouts.find(layout); itr != layouts.end()) {
+        return itr->second;
+    }
+
+    auto layout_info = LayoutInfo{};
+    vkGetDescriptorSetLayoutSizeEXT(device, layout, &layout_info.size);
+
+    return layouts.emplace(layout, eastl::move(layout_info)).first->second;
+}
+
+VkDeviceSize DescriptorBuffer::get_binding_offset(
+    LayoutInfo& layout_info, const VkDescriptorSetLayout layout, const uint32_t binding
+) const {
+    constexpr auto unknown_offset = ~VkDeviceSize{0};
+
+    if(binding >= layout_info.binding_offsets.size()) {
+        layout_info.binding_offsets.resize(binding + 1, unknown_offset);
+    }
+
+    auto& offset = layout_info.binding_offsets[binding];
+    if(offset == unknown_offset) {
+        vkGetDescriptorSetLayoutBindingOffsetEXT(device, layout, binding, &offset);
+    }
+
+    return offset;
+}
+
+size_t DescriptorBuffer::get_descriptor_size(const VkDescriptorType type) const {
+    switch(type) {
+    case VK_DESCRIPTOR_TYPE_SAMPLER:
+        return properties.samplerDescriptorSize;
+
+    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+        return properties.combinedImageSamplerDescriptorSize;
+
+    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+        return properties.sampledImageDescriptorSize;
+
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+        return properties.storageImageDescriptorSize;
+
+    case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+        return properties.inputAttachmentDescriptorSize;
+
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        return properties.uniformBufferDescriptorSize;
+
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        return properties.storageBufferDescriptorSize;
+
+    case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+        return properties.accelerationStructureDescriptorSize;
+
+    default:
+        // Texel buffers need a format, and dynamic buffers don't exist with descriptor buffers
+        return 0;
+    }
+}
+
+void DescriptorBuffer::write_descriptor(const VkWriteDescriptorSet& write, const uint32_t element, uint8_t* dst) const {
+    auto get_info = VkDescriptorGetInfoEXT{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
+        .type = write.descriptorType,
+    };
+
+    auto address_info = VkDescriptorAddressInfoEXT{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT,
+    };
+
+    switch(write.descriptorType) {
+    case VK_DESCRIPTOR_TYPE_SAMPLER:
+        get_info.data.pSampler = &write.pImageInfo[element].sampler;
+        break;
+
+    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+        get_info.data.pCombinedImageSampler = &write.pImageInfo[element];
+        break;
+
+    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+        get_info.data.pSampledImage = &write.pImageInfo[element];
+        break;
+
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+        get_info.data.pStorageImage = &write.pImageInfo[element];
+        break;
+
+    case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+        get_info.data.pInputAttachmentImage = &write.pImageInfo[element];
+        break;
+
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        [[fallthrough]];
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: {
+        const auto& buffer_info = write.pBufferInfo[element];
+        const auto buffer_address_info = VkBufferDeviceAddressInfo{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .buffer = buffer_info.buffer
+        };
+        // All our buffers have device addresses
+        address_info.address = vkGetBufferDeviceAddress(device, &buffer_address_info) + buffer_info.offset;
+        address_info.range = buffer_info.range;
+        if(write.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+            get_info.data.pUniformBuffer = &address_info;
+        } else {
+            get_info.data.pStorageBuffer = &address_info;
+        }
+    }
+    break;
+
+    case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR: {
+        const auto* as_write = static_cast<const VkWriteDescriptorSetAccelerationStructureKHR*>(write.pNext);
+        if(as_write == nullptr || as_write->accelerationStructureCount == 0) {
+            // Null descriptor. Leave the memory alone, shaders shouldn't access it
+            return;
+        }
+        const auto as_address_info = VkAccelerationStructureDeviceAddressInfoKHR{
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+            .accelerationStructure = as_write->pAccelerationStructures[element]
+        };
+        get_info.data.accelerationStructure = vkGetAccelerationStructureDeviceAddressKHR(device, &as_address_info);
+    }
+    break;
+
+    default:
+        return;
+    }
+
+    vkGetDescriptorEXT(device, &get_info, get_descriptor_size(write.descriptorType), dst);
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <EASTL/array.h>
+#include <EASTL/unordered_map.h>
+#include <EASTL/vector.h>
+#include <volk.h>
+#include <vk_mem_alloc.h>
+
+#include "render/backend/constants.hpp"
+
+class RenderBackend;
+
+/**
+ * Stores descriptors in a persistently mapped buffer, using VK_EXT_descriptor_buffer
+ *
+ * This is an alternate backend for vkutil::DescriptorAllocator. Instead of allocating sets from descriptor pools and
+ * writing them with vkUpdateDescriptorSets, we sub-allocate sets from the buffer and write descriptors straight into
+ * it with vkGetDescriptorEXT
+ *
+ * The buffer has a persistent region for sets that live for a while, and one region per frame in flight for transient
+ * sets. Each region is a linear allocator. A frame's region is reset when the GPU is done with that frame, so the
+ * frame regions form a ring. Persistent sets can be freed one at a time. Their space goes on a free list, and new sets
+ * of the same size reuse it
+ *
+ * There are no descriptor set objects in this mode. The VkDescriptorSet handles that we hand out hold the set's offset
+ * in the buffer instead. That way, code that passes sets around doesn't need to know which backend is active. Never
+ * give these handles to Vulkan! CommandBuffer binds them with vkCmdSetDescriptorBufferOffsetsEXT
+ */
+class DescriptorBuffer {
+public:
+    static constexpr uint32_t persistent_region = 0;
+
+    static uint32_t get_frame_region(uint32_t frame_idx);
+
+    /**
+     * Retrieves a set's offset in the descriptor buffer
+     */
+    static VkDeviceSize get_offset(VkDescriptorSet set);
+
+    void init(RenderBackend& backend, const VkPhysicalDeviceDescriptorBufferPropertiesEXT& properties_in);
+
+    bool is_initialized() const;
+
+    /**
+     * Allocates space for a set with the given layout. Returns VK_NULL_HANDLE if the region is full
+     */
+    VkDescriptorSet allocate(uint32_t region, VkDescriptorSetLayout layout);
+
+    /**
+     * Frees a set from the persistent region. Its space is reused once the GPU is done with the current frame
+     */
+    void free(VkDescriptorSet set, VkDescriptorSetLayout layout);
+
+    /**
+     * Makes the space of the sets that were freed during the given frame available again
+     */
+    void free_resources_for_frame(uint32_t frame_idx);
+
+    /**
+     * Frees every set in the region. The GPU must be done with them
+     */
+    void reset_region(uint32_t region);
+
+    /**
+     * Writes descriptors into sets from this buffer. Works like vkUpdateDescriptorSets, except that all the writes must
+     * be for sets with the given layout
+     */
+    void write(std::span<const VkWriteDescriptorSet> writes, VkDescriptorSetLayout layout);
+
+    /**
+     * Maximum number of descriptors of the given type that fit in the given number of bytes
+     */
+    uint32_t get_max_descriptors(VkDescriptorType type, VkDeviceSize num_bytes) const;
+
+    VkDeviceSize get_region_size(uint32_t region) const;
+
+    VkDeviceAddress get_device_address() const;
+
+    VkBufferUsageFlags get_usage() const;
+
+private:
+    struct Region {
+        VkDeviceSize begin = 0;
+
+        VkDeviceSize end = 0;
+
+        VkDeviceSize next_free = 0;
+    };
+
+    struct FreedBlock {
+        VkDeviceSize offset = 0;
+
+        VkDeviceSize size = 0;
+    };
+
+    struct LayoutInfo {
+        VkDeviceSize size = 0;
+
+        /**
+         * Offset of each binding, by binding index. Queried when a binding is first written
+         */
+        eastl::vector<VkDeviceSize> binding_offsets;
+    };
+
+    RenderBackend* backend = nullptr;
+
+    VkDevice device = VK_NULL_HANDLE;
+
+    VmaAllocator vma = VK_NULL_HANDLE;
+
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT properties = {};
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+
+    VmaAllocation allocation = VK_NULL_HANDLE;
+
+    uint8_t* mapped_data = nullptr;
+
+    VkDeviceAddress device_address = 0;
+
+    eastl::array<Region, num_in_flight_frames + 1> regions = {};
+
+    /**
+     * Offsets of free blocks in the persistent region, by size. Sets that get rebuilt keep their layout, so exact sizes
+     * match well
+     */
+    eastl::unordered_map<VkDeviceSize, eastl::vector<VkDeviceSize>> free_blocks;
+
+    /**
+     * Blocks that were freed during each frame. The GPU may still use them until that frame finishes
+     */
+    eastl::array<eastl::vector<FreedBlock>, num_in_flight_frames> zombie_blocks;
+
+    eastl::unordered_map<VkDescriptorSetLayout, LayoutInfo> layouts;
+
+    LayoutInfo& get_layout_info(VkDescriptorSetLayout layout);
+
+    VkDeviceSize get_binding_offset(LayoutInfo& layout_info, VkDescriptorSetLayout layout, uint32_t binding) const;
+
+    size_t get_descriptor_size(VkDescriptorType type) const;
+
+    void write_descriptor(const VkWriteDescriptorSet& write, uint32_t element, uint8_t* dst) const;
+};
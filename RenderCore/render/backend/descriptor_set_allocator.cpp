@@ -4,7 +4,8 @@
 
 #include "render/backend/ray_tracing_pipeline.hpp"
 
-DescriptorSetAllocator::DescriptorSetAllocator(RenderBackend& backend_in) : backend{&backend_in} {}
+DescriptorSetAllocator::DescriptorSetAllocator(RenderBackend& backend_in, DescriptorSetCache* set_cache_in) :
+    backend{&backend_in}, set_cache{set_cache_in} {}
 
 DescriptorSetBuilder DescriptorSetAllocator::build_set(
     const GraphicsPipelineHandle pipeline, const uint32_t set_index
@@ -26,3 +27,7 @@ DescriptorSetBuilder DescriptorSetAllocator::build_set(const RayTracingPipelineH
     const auto name = eastl::string{ eastl::string::CtorSprintf(), "%s set %d", pipeline->name.c_str(), set_index };
     return build_set(pipeline->descriptor_sets[set_index], std::string_view{name.data(), name.size()});
 }
+
+DescriptorSetCache* DescriptorSetAllocator::get_set_cache() const {
+    return set_cache;
+}
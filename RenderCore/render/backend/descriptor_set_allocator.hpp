@@ -5,9 +5,14 @@
 #include "render/backend/descriptor_set_builder.hpp"
 #include "render/backend/vk_descriptors.hpp"
 
+class DescriptorSetCache;
+
 class DescriptorSetAllocator : public vkutil::DescriptorAllocator {
 public:
-    explicit DescriptorSetAllocator(RenderBackend& backend_in);
+    /**
+     * \param set_cache_in Cache to look sets up in before allocating them. Only useful for transient allocators
+     */
+    explicit DescriptorSetAllocator(RenderBackend& backend_in, DescriptorSetCache* set_cache_in = nullptr);
 
     DescriptorSetBuilder build_set(GraphicsPipelineHandle pipeline, uint32_t set_index);
 
@@ -17,7 +22,11 @@ public:
 
     DescriptorSetBuilder build_set(RayTracingPipelineHandle pipeline, uint32_t set_index);
 
+    DescriptorSetCache* get_set_cache() const;
+
 private:
     RenderBackend* backend;
+
+    DescriptorSetCache* set_cache = nullptr;
 };
 
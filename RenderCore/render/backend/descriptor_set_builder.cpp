@@ -2,10 +2,14 @@
 
 #include <spdlog/fmt/bundled/format.h>
 
+#include "core/system_interface.hpp"
 #include "render/backend/descriptor_set_allocator.hpp"
+#include "render/backend/descriptor_set_cache.hpp"
 #include "render/backend/render_backend.hpp"
 #include "render/backend/utils.hpp"
 
+static std::shared_ptr<spdlog::logger> logger;
+
 
 static VkAccessFlags2 to_vk_access(const VkDescriptorType& descriptor_type, bool is_read_only);
 
@@ -21,6 +25,72 @@ static bool is_combined_image_sampler(VkDescriptorType vk_type);
 
 static bool is_acceleration_structure(VkDescriptorType vk_type);
 
+/**
+ * Collects everything that goes into the descriptor set, and the handles of the resources that it references
+ */
+static void make_key(
+    const DescriptorSetInfo& set_info, const eastl::fixed_vector<detail::BoundResource, 16>& bindings,
+    DescriptorSetKey& key, eastl::fixed_vector<uint64_t, 16>& resources
+);
+
+static void add_writes(
+    vkutil::DescriptorBuilder& builder, const DescriptorSetInfo& set_info,
+    const eastl::fixed_vector<detail::BoundResource, 16>& bindings
+);
+
+/**
+ * Writes a descriptor set builder's bindings for the descriptor set cache. Only sets up the Vulkan writes if the cache
+ * misses
+ */
+class CachedSetWriter final : public DescriptorSetWriter {
+public:
+    CachedSetWriter(
+        RenderBackend& backend_in, vkutil::DescriptorAllocator& allocator_in, const DescriptorSetInfo& set_info_in,
+        const eastl::fixed_vector<detail::BoundResource, 16>& bindings_in, const std::string& name_in
+    ) : backend{backend_in}, allocator{allocator_in}, set_info{set_info_in}, bindings{bindings_in}, name{name_in} {}
+
+    VkDescriptorSetLayout get_layout() override {
+        return get_builder().get_layout();
+    }
+
+    VkDescriptorSet allocate_and_write() override {
+        auto layout = VkDescriptorSetLayout{};
+        const auto set = get_builder().build(layout).value_or(VK_NULL_HANDLE);
+        if(set != VK_NULL_HANDLE) {
+            backend.set_object_name(set, name);
+        }
+
+        return set;
+    }
+
+    void write(const VkDescriptorSet set) override {
+        get_builder().update(set);
+        backend.set_object_name(set, name);
+    }
+
+private:
+    RenderBackend& backend;
+
+    vkutil::DescriptorAllocator& allocator;
+
+    const DescriptorSetInfo& set_info;
+
+    const eastl::fixed_vector<detail::BoundResource, 16>& bindings;
+
+    const std::string& name;
+
+    tl::optional<vkutil::DescriptorBuilder> builder;
+
+    vkutil::DescriptorBuilder& get_builder() {
+        if(!builder) {
+            builder.emplace(vkutil::DescriptorBuilder::begin(backend, allocator));
+            add_writes(*builder, set_info, bindings);
+        }
+
+        return *builder;
+    }
+};
+
 void DescriptorSet::get_resource_usage_information(
     TextureUsageList& texture_usages,
     BufferUsageList& buffer_usages
@@ -220,7 +290,96 @@ DescriptorSetBuilder& DescriptorSetBuilder::next_binding(const uint32_t binding_
 DescriptorSet DescriptorSetBuilder::build() {
     ZoneScoped;
 
-    auto builder = vkutil::DescriptorBuilder::begin(*backend, *allocator);
+    auto* set_cache = allocator->get_set_cache();
+    if(set_cache == nullptr || !set_cache->is_enabled()) {
+        auto builder = vkutil::DescriptorBuilder::begin(*backend, *allocator);
+        add_writes(builder, set_info, bindings);
+
+        VkDescriptorSetLayout layout;
+        const auto descriptor_set = builder.build(layout);
+        if(!descriptor_set) {
+            report_allocation_failure();
+            return DescriptorSet{VK_NULL_HANDLE, layout, std::move(set_info), std::move(bindings)};
+        }
+
+        backend->set_object_name(*descriptor_set, name);
+
+        return DescriptorSet{
+            *descriptor_set, layout, std::move(set_info), std::move(bindings)
+        };
+    }
+
+    // Transient sets are usually the same from frame to frame, so look them up by their contents before writing a new
+    // one
+    auto key = DescriptorSetKey{};
+    auto resources = eastl::fixed_vector<uint64_t, 16>{};
+    make_key(set_info, bindings, key, resources);
+
+    auto writer = CachedSetWriter{*backend, set_cache->get_allocator(), set_info, bindings, name};
+    const auto cached_set = set_cache->get_or_write(key, resources, writer);
+    if(!cached_set) {
+        report_allocation_failure();
+        return DescriptorSet{VK_NULL_HANDLE, writer.get_layout(), std::move(set_info), std::move(bindings)};
+    }
+
+    return DescriptorSet{
+        cached_set->set, cached_set->layout, std::move(set_info), std::move(bindings)
+    };
+}
+
+void DescriptorSetBuilder::report_allocation_failure() const {
+    if(logger == nullptr) {
+        logger = SystemInterface::get().get_logger("DescriptorSetBuilder");
+    }
+
+    logger->error("Could not allocate descriptor set {}. Draws and dispatches that use it will be skipped", name);
+}
+
+template <typename HandleType>
+static uint64_t to_key(const HandleType handle) {
+    return reinterpret_cast<uint64_t>(handle);
+}
+
+void make_key(
+    const DescriptorSetInfo& set_info, const eastl::fixed_vector<detail::BoundResource, 16>& bindings,
+    DescriptorSetKey& key, eastl::fixed_vector<uint64_t, 16>& resources
+) {
+    auto binding_idx = 0u;
+    for(const auto& resource : bindings) {
+        const auto& binding_info = set_info.bindings.at(binding_idx);
+        key.push_back(static_cast<uint64_t>(binding_info.descriptorType) << 32 | binding_info.stageFlags);
+        key.push_back(static_cast<uint64_t>(binding_idx) << 32 | binding_info.descriptorCount);
+
+        if(is_buffer_type(binding_info.descriptorType)) {
+            key.push_back(to_key(resource.buffer->buffer));
+            key.push_back(resource.buffer->create_info.size);
+            resources.push_back(to_key(resource.buffer->buffer));
+
+        } else if(is_texture_type(binding_info.descriptorType)) {
+            key.push_back(to_key(resource.texture->image_view));
+            resources.push_back(to_key(resource.texture->image_view));
+
+        } else if(is_combined_image_sampler(binding_info.descriptorType)) {
+            key.push_back(to_key(resource.combined_image_sampler.texture->image_view));
+            key.push_back(to_key(resource.combined_image_sampler.sampler));
+            resources.push_back(to_key(resource.combined_image_sampler.texture->image_view));
+
+        } else if(is_acceleration_structure(binding_info.descriptorType)) {
+            const auto as = resource.acceleration_structure ?
+                                to_key(resource.acceleration_structure->acceleration_structure) :
+                                0ull;
+            key.push_back(as);
+            resources.push_back(as);
+        }
+
+        binding_idx++;
+    }
+}
+
+void add_writes(
+    vkutil::DescriptorBuilder& builder, const DescriptorSetInfo& set_info,
+    const eastl::fixed_vector<detail::BoundResource, 16>& bindings
+) {
     auto binding_idx = 0u;
     for(const auto& resource : bindings) {
         const auto& binding_info = set_info.bindings.at(binding_idx);
@@ -265,15 +424,6 @@ DescriptorSet DescriptorSetBuilder::build() {
 
         binding_idx++;
     }
-
-    VkDescriptorSetLayout layout;
-    const auto descriptor_set = *builder.build(layout);
-
-    backend->set_object_name(descriptor_set, name);
-
-    return DescriptorSet{
-        descriptor_set, layout, std::move(set_info), std::move(bindings)
-    };
 }
 
 VkAccessFlags2 to_vk_access(const VkDescriptorType& descriptor_type, const bool is_read_only) {
@@ -68,7 +68,8 @@ public:
 
     /**
      * \brief Creates the Vulkan descriptor set 
-     * \return 
+     * \return The set. Its handle is VK_NULL_HANDLE if it couldn't be allocated, and CommandBuffer skips the draws and
+     * dispatches that use it
      */
     DescriptorSet build();
 
@@ -84,4 +85,6 @@ private:
     eastl::fixed_vector<detail::BoundResource, 16> bindings;
 
     std::string name;
+
+    void report_allocation_failure() const;
 };
@@ -0,0 +1,183 @@
+#include "descriptor_set_cache.hpp"
+
+#include <tracy/Tracy.hpp>
+
+#include "console/cvars.hpp"
+#include "extern/cityhash/city_hash.hpp"
+#include "render/backend/constants.hpp"
+
+static auto cvar_enable_descriptor_set_cache = AutoCVar_Int{
+    "r.RHI.DescriptorSetCache.Enable",
+    "Whether to reuse transient descriptor sets whose contents haven't changed",
+    1
+};
+
+static auto cvar_max_descriptor_set_age = AutoCVar_Int{
+    "r.RHI.DescriptorSetCache.MaxAge",
+    "Number of frames a cached descriptor set may go unused before it's evicted",
+    8
+};
+
+static uint64_t hash_key(const DescriptorSetKey& key) {
+    return CityHash64(reinterpret_cast<const char*>(key.data()), key.size() * sizeof(uint64_t));
+}
+
+void DescriptorSetCache::init(const VkDevice device) {
+    allocator.init(device);
+}
+
+bool DescriptorSetCache::is_enabled() const {
+    return cvar_enable_descriptor_set_cache.Get() != 0;
+}
+
+tl::optional<DescriptorSetCache::CachedSet> DescriptorSetCache::get_or_write(
+    const DescriptorSetKey& key, const std::span<const uint64_t> resources, DescriptorSetWriter& writer
+) {
+    if(const auto cached_set = find(key)) {
+        return cached_set;
+    }
+
+    const auto layout = writer.get_layout();
+    auto set = take_free_set(layout);
+    if(set != VK_NULL_HANDLE) {
+        writer.write(set);
+    } else {
+        set = writer.allocate_and_write();
+        if(set == VK_NULL_HANDLE) {
+            return tl::nullopt;
+        }
+    }
+
+    const auto new_set = CachedSet{.set = set, .layout = layout};
+    add(key, new_set, resources);
+
+    return new_set;
+}
+
+tl::optional<DescriptorSetCache::CachedSet> DescriptorSetCache::find(const DescriptorSetKey& key) {
+    const auto itr = entries.find(hash_key(key));
+    if(itr == entries.end() || itr->second.key != key) {
+        current_stats.num_misses++;
+        return tl::nullopt;
+    }
+
+    current_stats.num_hits++;
+    itr->second.last_used_frame = current_frame;
+
+    return itr->second.set;
+}
+
+VkDescriptorSet DescriptorSetCache::take_free_set(const VkDescriptorSetLayout layout) {
+    const auto itr = free_sets.find(layout);
+    if(itr == free_sets.end()) {
+        return VK_NULL_HANDLE;
+    }
+
+    auto& sets = itr->second;
+    for(auto i = 0u; i < sets.size(); i++) {
+        // The frame that last used the set must have finished before we can write to it
+        if(sets[i].last_used_frame + num_in_flight_frames <= current_frame) {
+            const auto set = sets[i].set;
+            sets[i] = sets.back();
+            sets.pop_back();
+            return set;
+        }
+    }
+
+    return VK_NULL_HANDLE;
+}
+
+void DescriptorSetCache::add(const DescriptorSetKey& key, const CachedSet set, const std::span<const uint64_t> resources) {
+    const auto hash = hash_key(key);
+
+    // Two keys with the same hash. The old set may still be in use, so retire it like an unused set
+    if(const auto itr = entries.find(hash); itr != entries.end()) {
+        evict(itr->second);
+        entries.erase(itr);
+    }
+
+    auto entry = Entry{
+        .key = key,
+        .set = set,
+        .last_used_frame = current_frame
+    };
+    entry.resources.assign(resources.begin(), resources.end());
+
+    entries.emplace(hash, eastl::move(entry));
+}
+
+vkutil::DescriptorAllocator& DescriptorSetCache::get_allocator() {
+    return allocator;
+}
+
+void DescriptorSetCache::notify_resource_destroyed(const uint64_t vk_handle) {
+    if(!entries.empty()) {
+        destroyed_resources.insert(vk_handle);
+    }
+}
+
+void DescriptorSetCache::begin_frame(const uint64_t frame_number) {
+    ZoneScoped;
+
+    current_frame = frame_number;
+
+    const auto max_age = static_cast<uint64_t>(
+        std::max(cvar_max_descriptor_set_age.Get(), static_cast<int32_t>(num_in_flight_frames)));
+
+    for(auto itr = entries.begin(); itr != entries.end();) {
+        auto& entry = itr->second;
+
+        auto should_evict = entry.last_used_frame + max_age < current_frame;
+        if(!should_evict && !destroyed_resources.empty()) {
+            for(const auto resource : entry.resources) {
+                if(destroyed_resources.find(resource) != destroyed_resources.end()) {
+                    should_evict = true;
+                    break;
+                }
+            }
+        }
+
+        if(should_evict) {
+            evict(entry);
+            itr = entries.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+
+    destroyed_resources.clear();
+
+    // A burst of unique sets shouldn't keep its descriptor memory forever. Free the evicted sets that nothing reused
+    for(auto& [layout, sets] : free_sets) {
+        for(auto i = 0u; i < sets.size();) {
+            if(sets[i].last_used_frame + max_age * 2 < current_frame && allocator.free(sets[i].set, layout)) {
+                sets[i] = sets.back();
+                sets.pop_back();
+            } else {
+                i++;
+            }
+        }
+    }
+
+    last_frame_stats = current_stats;
+    last_frame_stats.num_cached_sets = static_cast<uint32_t>(entries.size());
+    current_stats = {};
+
+    TracyPlot("Descriptor set cache hits", static_cast<int64_t>(last_frame_stats.num_hits));
+    TracyPlot("Descriptor set cache misses", static_cast<int64_t>(last_frame_stats.num_misses));
+    TracyPlot("Cached descriptor sets", static_cast<int64_t>(last_frame_stats.num_cached_sets));
+}
+
+const DescriptorSetCacheStats& DescriptorSetCache::get_stats() const {
+    return last_frame_stats;
+}
+
+void DescriptorSetCache::evict(Entry& entry) {
+    free_sets[entry.set.layout].emplace_back(
+        FreeSet{
+            .set = entry.set.set,
+            .last_used_frame = entry.last_used_frame
+        });
+
+    current_stats.num_evictions++;
+}
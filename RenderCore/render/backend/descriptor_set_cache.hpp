@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <EASTL/fixed_vector.h>
+#include <EASTL/unordered_map.h>
+#include <EASTL/unordered_set.h>
+#include <EASTL/vector.h>
+#include <tl/optional.hpp>
+#include <volk.h>
+
+#include "render/backend/vk_descriptors.hpp"
+
+/**
+ * Everything that goes into a descriptor set: the type, stages, and count of each binding, and the Vulkan handles of
+ * the resources bound to it
+ */
+using DescriptorSetKey = eastl::fixed_vector<uint64_t, 64>;
+
+struct DescriptorSetCacheStats {
+    uint32_t num_hits = 0;
+
+    uint32_t num_misses = 0;
+
+    /**
+     * Number of sets that were evicted because they went unused or because one of their resources was destroyed
+     */
+    uint32_t num_evictions = 0;
+
+    uint32_t num_cached_sets = 0;
+};
+
+/**
+ * Writes the contents of one descriptor set. Lets DescriptorSetCache make or recycle sets without knowing how they're
+ * written
+ */
+class DescriptorSetWriter {
+public:
+    virtual ~DescriptorSetWriter() = default;
+
+    virtual VkDescriptorSetLayout get_layout() = 0;
+
+    /**
+     * Allocates a new set with the writer's layout and writes to it. Returns VK_NULL_HANDLE if allocation failed
+     */
+    virtual VkDescriptorSet allocate_and_write() = 0;
+
+    /**
+     * Writes to an existing set with the writer's layout
+     */
+    virtual void write(VkDescriptorSet set) = 0;
+};
+
+/**
+ * Content-addressed cache for transient descriptor sets
+ *
+ * Most passes build the same descriptor sets every frame. Rather than allocating a new set from the frame's allocator
+ * and writing every binding again, DescriptorSetBuilder looks up transient sets by their contents. Sets that went
+ * unused for a while are evicted, as are sets that reference a destroyed resource. Evicted sets are recycled for new
+ * sets with the same layout, once the GPU is done with them
+ *
+ * The cache allocates its sets from its own pools, which are never reset. With descriptor buffers, evicted sets that
+ * aren't recycled for a while are freed back to the buffer
+ */
+class DescriptorSetCache {
+public:
+    struct CachedSet {
+        VkDescriptorSet set = VK_NULL_HANDLE;
+
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    };
+
+    void init(VkDevice device);
+
+    bool is_enabled() const;
+
+    /**
+     * Finds the set with the given contents, or writes a new one and adds it to the cache. The writer is only used on a
+     * miss. New sets reuse an evicted set with the same layout if the GPU is done with one
+     *
+     * \param resources Vulkan handles of the resources that the set references. The set is evicted when any of them
+     * is destroyed
+     * \return The set, or nullopt if the writer couldn't allocate a new one
+     */
+    tl::optional<CachedSet> get_or_write(
+        const DescriptorSetKey& key, std::span<const uint64_t> resources, DescriptorSetWriter& writer
+    );
+
+    /**
+     * Finds the set with the given contents, and marks it as used this frame
+     */
+    tl::optional<CachedSet> find(const DescriptorSetKey& key);
+
+    /**
+     * Retrieves an evicted set with the given layout that the GPU is done with, or VK_NULL_HANDLE if there's none
+     */
+    VkDescriptorSet take_free_set(VkDescriptorSetLayout layout);
+
+    /**
+     * Adds a newly written set to the cache
+     *
+     * \param resources Vulkan handles of the resources that the set references. The set is evicted when any of them
+     * is destroyed
+     */
+    void add(const DescriptorSetKey& key, CachedSet set, std::span<const uint64_t> resources);
+
+    /**
+     * Allocator for new sets. Its pools are never reset
+     */
+    vkutil::DescriptorAllocator& get_allocator();
+
+    /**
+     * Tells the cache that a resource was destroyed, so it can evict the sets that use it
+     */
+    void notify_resource_destroyed(uint64_t vk_handle);
+
+    /**
+     * Evicts stale sets and resets the per-frame statistics. Must be called after the previous frame with the same
+     * frame index has finished on the GPU
+     */
+    void begin_frame(uint64_t frame_number);
+
+    /**
+     * Retrieves the statistics of the previous frame
+     */
+    const DescriptorSetCacheStats& get_stats() const;
+
+private:
+    struct Entry {
+        DescriptorSetKey key;
+
+        CachedSet set;
+
+        eastl::fixed_vector<uint64_t, 16> resources;
+
+        uint64_t last_used_frame = 0;
+    };
+
+    struct FreeSet {
+        VkDescriptorSet set = VK_NULL_HANDLE;
+
+        uint64_t last_used_frame = 0;
+    };
+
+    vkutil::DescriptorAllocator allocator;
+
+    /**
+     * Entries by the hash of their key
+     */
+    eastl::unordered_map<uint64_t, Entry> entries;
+
+    /**
+     * Evicted sets, by layout
+     */
+    eastl::unordered_map<VkDescriptorSetLayout, eastl::vector<FreeSet>> free_sets;
+
+    /**
+     * Resources that were destroyed since the last call to begin_frame
+     */
+    eastl::unordered_set<uint64_t> destroyed_resources;
+
+    uint64_t current_frame = 0;
+
+    DescriptorSetCacheStats current_stats;
+
+    DescriptorSetCacheStats last_frame_stats;
+
+    void evict(Entry& entry);
+};
@@ -0,0 +1,81 @@
+#include "gpu_frame_timer.hpp"
+
+#include <tracy/Tracy.hpp>
+
+#include "render/backend/render_backend.hpp"
+#include "render/backend/render_graph.hpp"
+
+GpuFrameTimer::GpuFrameTimer() : backend{RenderBackend::get()} {
+    const auto& physical_device = backend.get_physical_device();
+    timestamp_period = physical_device.properties.limits.timestampPeriod;
+
+    const auto create_info = VkQueryPoolCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = num_in_flight_frames * 2,
+    };
+    vkCreateQueryPool(backend.get_device(), &create_info, nullptr, &query_pool);
+}
+
+GpuFrameTimer::~GpuFrameTimer() {
+    vkDestroyQueryPool(backend.get_device(), query_pool, nullptr);
+}
+
+void GpuFrameTimer::begin_frame(RenderGraph& graph) {
+    ZoneScoped;
+
+    const auto frame = backend.get_current_gpu_frame();
+    const auto first_query = frame * 2;
+
+    if(has_queries[frame]) {
+        auto timestamps = eastl::array<uint64_t, 2>{};
+        const auto result = vkGetQueryPoolResults(
+            backend.get_device(),
+            query_pool,
+            first_query,
+            2,
+            sizeof(timestamps),
+            timestamps.data(),
+            sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT);
+        if(result == VK_SUCCESS && timestamps[1] > timestamps[0]) {
+            frame_time_ms = static_cast<float>(timestamps[1] - timestamps[0]) * timestamp_period / 1000000.f;
+            TracyPlot("GPU frame time (ms)", frame_time_ms);
+        }
+    }
+
+    graph.add_pass(
+        {
+            .name = "Begin frame timer",
+            .execute = [&, first_query](const CommandBuffer& commands) {
+                vkCmdResetQueryPool(commands.get_vk_commands(), query_pool, first_query, 2);
+                vkCmdWriteTimestamp2(
+                    commands.get_vk_commands(),
+                    VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
+                    query_pool,
+                    first_query);
+            }
+        });
+
+    has_queries[frame] = true;
+}
+
+void GpuFrameTimer::end_frame(RenderGraph& graph) {
+    const auto first_query = backend.get_current_gpu_frame() * 2;
+
+    graph.add_pass(
+        {
+            .name = "End frame timer",
+            .execute = [&, first_query](const CommandBuffer& commands) {
+                vkCmdWriteTimestamp2(
+                    commands.get_vk_commands(),
+                    VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
+                    query_pool,
+                    first_query + 1);
+            }
+        });
+}
+
+float GpuFrameTimer::get_frame_time_ms() const {
+    return frame_time_ms;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <EASTL/array.h>
+#include <volk.h>
+
+#include "render/backend/constants.hpp"
+
+class RenderGraph;
+class RenderBackend;
+
+/**
+ * Measures how long the GPU spends on each frame, with a pair of timestamp queries per in-flight frame
+ *
+ * We read a frame's timestamps when we begin recording the next frame that uses the same queries. The backend has
+ * waited on that frame's fence by then, so the results are ready without stalling. That means the time we report is
+ * num_in_flight_frames old
+ */
+class GpuFrameTimer {
+public:
+    GpuFrameTimer();
+
+    ~GpuFrameTimer();
+
+    GpuFrameTimer(const GpuFrameTimer& other) = delete;
+    GpuFrameTimer& operator=(const GpuFrameTimer& other) = delete;
+
+    /**
+     * Reads back the results from the last time we used this frame's queries, and writes the frame's start timestamp
+     *
+     * Call at the start of the frame's render graph, after the backend has advanced to the frame
+     */
+    void begin_frame(RenderGraph& graph);
+
+    /**
+     * Writes the frame's end timestamp
+     */
+    void end_frame(RenderGraph& graph);
+
+    /**
+     * GPU time of the most recent frame whose results we have, in milliseconds. 0 if we don't have any results yet
+     */
+    float get_frame_time_ms() const;
+
+private:
+    RenderBackend& backend;
+
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+
+    /**
+     * Nanoseconds per timestamp tick
+     */
+    float timestamp_period = 1.f;
+
+    /**
+     * Whether each frame's queries have been written since they were created
+     */
+    eastl::array<bool, num_in_flight_frames> has_queries = {};
+
+    float frame_time_ms = 0.f;
+};
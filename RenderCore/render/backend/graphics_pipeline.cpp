@@ -1,6 +1,19 @@
 #include "graphics_pipeline.hpp"
 
+#include <EASTL/algorithm.h>
+
 VkPipeline GraphicsPipeline::get_pipeline() const {
     return pipeline;
 }
 
+
+bool GraphicsPipelineVariant::operator==(const GraphicsPipelineVariant& other) const {
+    return color_attachment_formats.size() == other.color_attachment_formats.size() &&
+        eastl::equal(
+            color_attachment_formats.begin(),
+            color_attachment_formats.end(),
+            other.color_attachment_formats.begin()) &&
+        depth_attachment_format == other.depth_attachment_format &&
+        view_mask == other.view_mask &&
+        use_fragment_shading_rate_attachment == other.use_fragment_shading_rate_attachment;
+}
@@ -2,12 +2,43 @@
 
 #include <EASTL/fixed_vector.h>
 #include <EASTL/vector.h>
+#include <EASTL/utility.h>
 #include <cstdint>
 
 #include "render/backend/pipeline_interface.hpp"
 
 class RenderBackend;
 
+/**
+ * Render pass state that a graphics PSO is compiled for. Vulkan requires the PSO's attachment formats and view mask to
+ * match the render pass that it's used in
+ */
+struct GraphicsPipelineVariant {
+    eastl::fixed_vector<VkFormat, 8> color_attachment_formats;
+
+    VkFormat depth_attachment_format = VK_FORMAT_UNDEFINED;
+
+    uint32_t view_mask = 0;
+
+    bool use_fragment_shading_rate_attachment = false;
+
+    bool operator==(const GraphicsPipelineVariant& other) const;
+};
+
+/**
+ * Pipeline libraries with a graphics pipeline's shaders. The pre-rasterization and fragment shader state depend on the
+ * view mask and on whether the render pass has a shading rate image, so we build one pair of libraries for each
+ */
+struct GraphicsPipelineShaderLibraries {
+    uint32_t view_mask = 0;
+
+    bool use_fragment_shading_rate_attachment = false;
+
+    VkPipeline pre_rasterization = VK_NULL_HANDLE;
+
+    VkPipeline fragment_shader = VK_NULL_HANDLE;
+};
+
 /**
  * Simple pipeline abstraction
  *
@@ -33,6 +64,15 @@ struct GraphicsPipeline : PipelineBase {
 
     eastl::vector<std::byte> fragment_shader;
 
+    /**
+     * Paths of the compiled shaders, so that we can reload them. Empty for shaders that weren't loaded from a file
+     */
+    std::string vertex_shader_path;
+
+    std::string geometry_shader_path;
+
+    std::string fragment_shader_path;
+
     VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {};
 
     VkPipelineRasterizationStateCreateInfo raster_state = {};
@@ -42,4 +82,25 @@ struct GraphicsPipeline : PipelineBase {
     eastl::fixed_vector<VkPipelineColorBlendAttachmentState, 8> blends = {};
 
     uint32_t group_index;
+
+    /**
+     * Every PSO compiled for this pipeline, along with the render pass state it was compiled for. `pipeline` is the
+     * first PSO to finish compiling
+     *
+     * A null PSO means that the variant is still compiling on a worker thread. Guarded by PipelineCache's variant mutex
+     */
+    eastl::fixed_vector<eastl::pair<GraphicsPipelineVariant, VkPipeline>, 4> variants;
+
+    /**
+     * Set when a background compile of one of this pipeline's variants failed. From then on, its variants are compiled
+     * on the recording thread when they're bound, so a failure is logged where it happens instead of dropping draws
+     * forever. Guarded by PipelineCache's variant mutex
+     */
+    bool has_failed_background_compile = false;
+
+    /**
+     * Shader libraries that this pipeline's variants are linked from, when we use VK_EXT_graphics_pipeline_library.
+     * Every variant with the same view mask shares them. Guarded by PipelineCache's library mutex
+     */
+    eastl::fixed_vector<GraphicsPipelineShaderLibraries, 2> shader_libraries;
 };
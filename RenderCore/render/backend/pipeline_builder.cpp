@@ -5,7 +5,6 @@
 
 #include <imgui.h>
 #include <spdlog/spdlog.h>
-#include <spirv_reflect.h>
 #include <tracy/Tracy.hpp>
 #include <vulkan/vk_enum_string_helper.h>
 
@@ -122,34 +121,32 @@ static auto imgui_vertex_layout = VertexLayout{
     },
 };
 
-static VkDescriptorType to_vk_type(SpvReflectDescriptorType type);
-
 /**
- * Collects the descriptor sets from the provided list of descriptor sets. Performs basic validation that the sets
- * match the sets that have already been collected
+ * Collects the descriptor sets from a shader's bindings. Performs basic validation that the sets match the sets that
+ * have already been collected
  *
- * @param sets The descriptor sets to collect
+ * @param bindings The bindings to collect
  * @param shader_stage The shader stage these descriptor sets came from
  * @param descriptor_sets Information about the descriptor sets that the shader uses. We make an effort to add bindings
  * to existing sets when possible
  * @return True if there was an error, false if everything's fine
  */
 static bool collect_descriptor_sets(
-    const eastl::vector<SpvReflectDescriptorSet*>& sets,
+    const eastl::vector<ShaderReflection::Binding>& bindings,
     VkShaderStageFlags shader_stage,
     eastl::fixed_vector<DescriptorSetInfo, 8>& descriptor_sets
 );
 
 static bool collect_push_constants(
     std::string_view shader_name,
-    const eastl::vector<SpvReflectBlockVariable*>& spv_push_constants,
+    const eastl::vector<ShaderReflection::PushConstantRange>& shader_push_constants,
     VkShaderStageFlags shader_stage,
     eastl::fixed_vector<VkPushConstantRange, 4>& push_constants
 );
 
 static void collect_vertex_attributes(
     const VertexLayout& vertex_layout,
-    const eastl::vector<SpvReflectInterfaceVariable*>& inputs,
+    const eastl::vector<ShaderReflection::Input>& inputs,
     eastl::fixed_vector<VkVertexInputAttributeDescription, 8>& vertex_attributes,
     bool& needs_position_buffer,
     bool& needs_data_buffer,
@@ -217,37 +214,22 @@ GraphicsPipelineBuilder& GraphicsPipelineBuilder::set_vertex_shader(const std::f
     vertex_shader = *vertex_shader_maybe;
     vertex_shader_name = vertex_path.string().c_str();
 
-    const auto shader_module = spv_reflect::ShaderModule{
-        vertex_shader->size(),
-        vertex_shader->data(),
-        SPV_REFLECT_MODULE_FLAG_NO_COPY
-    };
-    if(shader_module.GetResult() != SPV_REFLECT_RESULT_SUCCESS) {
-        throw std::runtime_error{"Could not perform reflection on vertex shader"};
-    }
+    const auto& reflection = cache.get_reflection_cache().get_reflection(*vertex_shader);
 
     bool has_error = false;
 
     logger->trace("Beginning reflection on vertex shader {}", vertex_shader_name);
 
-    collect_bindings(
-        *vertex_shader_maybe,
+    has_error |= collect_bindings(
+        reflection,
         vertex_shader_name,
         VK_SHADER_STAGE_VERTEX_BIT,
         descriptor_sets,
         push_constants);
 
-    // Collect inputs
-    uint32_t input_count;
-    auto result = shader_module.EnumerateInputVariables(&input_count, nullptr);
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
-    auto spv_vertex_inputs = eastl::vector<SpvReflectInterfaceVariable*>{input_count};
-    result = shader_module.EnumerateInputVariables(&input_count, spv_vertex_inputs.data());
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
     collect_vertex_attributes(
         *vertex_layout,
-        spv_vertex_inputs,
+        reflection.inputs,
         vertex_attributes,
         need_position_buffer,
         need_data_buffer,
@@ -274,19 +256,10 @@ GraphicsPipelineBuilder& GraphicsPipelineBuilder::set_geometry_shader(const std:
     geometry_shader = *geometry_shader_maybe;
     geometry_shader_name = geometry_path.string().c_str();
 
-    const auto shader_module = spv_reflect::ShaderModule{
-        geometry_shader->size(),
-        geometry_shader->data(),
-        SPV_REFLECT_MODULE_FLAG_NO_COPY
-    };
-    if(shader_module.GetResult() != SpvReflectResult::SPV_REFLECT_RESULT_SUCCESS) {
-        throw std::runtime_error{"Could not perform reflection on geometry shader"};
-    }
-
     logger->trace("Beginning reflection on geometry shader {}", geometry_shader_name);
 
     collect_bindings(
-        *geometry_shader,
+        cache.get_reflection_cache().get_reflection(*geometry_shader),
         geometry_shader_name,
         VK_SHADER_STAGE_GEOMETRY_BIT,
         descriptor_sets,
@@ -312,7 +285,7 @@ GraphicsPipelineBuilder& GraphicsPipelineBuilder::set_fragment_shader(const std:
     logger->trace("Beginning reflection on fragment shader {}", fragment_shader_name);
 
     collect_bindings(
-        *fragment_shader,
+        cache.get_reflection_cache().get_reflection(*fragment_shader),
         fragment_shader_name,
         VK_SHADER_STAGE_FRAGMENT_BIT,
         descriptor_sets,
@@ -449,7 +422,7 @@ GraphicsPipelineHandle GraphicsPipelineBuilder::build() {
 }
 
 bool collect_descriptor_sets(
-    const eastl::vector<SpvReflectDescriptorSet*>& sets,
+    const eastl::vector<ShaderReflection::Binding>& bindings,
     const VkShaderStageFlags shader_stage,
     eastl::fixed_vector<DescriptorSetInfo, 8>& descriptor_sets
 ) {
@@ -460,44 +433,42 @@ bool collect_descriptor_sets(
     const auto texture_array_size = static_cast<uint32_t>(*CVarSystem::Get()->GetIntCVar("r.RHI.SampledImageCount"));
 
     bool has_error = false;
-    for(const auto* set : sets) {
-        auto num_bindings = 0u;
-        if(descriptor_sets.size() <= set->set) {
-            descriptor_sets.resize(set->set + 1);
+    for(const auto& binding : bindings) {
+        if(descriptor_sets.size() <= binding.set) {
+            descriptor_sets.resize(binding.set + 1);
         }
-        auto& set_info = descriptor_sets[set->set];
-
-        for(auto* binding : std::span{set->bindings, set->bindings + set->binding_count}) {
-            logger->trace(
-                "Adding new descriptor {}.{} of type {} with count {} for shader stage {}",
-                set->set,
-                binding->binding,
-                string_VkDescriptorType(to_vk_type(binding->descriptor_type)),
-                binding->count,
-                string_VkShaderStageFlags(shader_stage)
-            );
-            if(set_info.bindings.size() <= binding->binding) {
-                set_info.bindings.resize(binding->binding + 1);
-            }
-            const auto old_stage_flags = set_info.bindings[binding->binding].stageFlags;
-            set_info.bindings[binding->binding] =
-                DescriptorInfo{
-                    {
-                        .binding = binding->binding,
-                        .descriptorType = to_vk_type(binding->descriptor_type),
-                        .descriptorCount = binding->count > 0 ? binding->count : texture_array_size,
-                        .stageFlags = static_cast<VkShaderStageFlags>(shader_stage) | old_stage_flags,
-                        .pImmutableSamplers = nullptr
-                    },
-                    (binding->decoration_flags & SPV_REFLECT_DECORATION_NON_WRITABLE) != 0
-                };
-            num_bindings = std::max(num_bindings, binding->binding + 1);
-
-            if(binding->count == 0) {
-                set_info.has_variable_count_binding = true;
-            }
+        auto& set_info = descriptor_sets[binding.set];
+
+        logger->trace(
+            "Adding new descriptor {}.{} of type {} with count {} for shader stage {}",
+            binding.set,
+            binding.binding,
+            string_VkDescriptorType(binding.type),
+            binding.count,
+            string_VkShaderStageFlags(shader_stage)
+        );
+        if(set_info.bindings.size() <= binding.binding) {
+            set_info.bindings.resize(binding.binding + 1);
         }
+        const auto old_stage_flags = set_info.bindings[binding.binding].stageFlags;
+        set_info.bindings[binding.binding] =
+            DescriptorInfo{
+                {
+                    .binding = binding.binding,
+                    .descriptorType = binding.type,
+                    .descriptorCount = binding.count > 0 ? binding.count : texture_array_size,
+                    .stageFlags = static_cast<VkShaderStageFlags>(shader_stage) | old_stage_flags,
+                    .pImmutableSamplers = nullptr
+                },
+                binding.is_read_only
+            };
 
+        if(binding.count == 0) {
+            set_info.has_variable_count_binding = true;
+        }
+    }
+
+    for(auto& set_info : descriptor_sets) {
         auto binding_index = 0;
         for(auto& binding : set_info.bindings) {
             binding.binding = binding_index;
@@ -510,33 +481,33 @@ bool collect_descriptor_sets(
 
 bool collect_push_constants(
     const std::string_view shader_name,
-    const eastl::vector<SpvReflectBlockVariable*>& spv_push_constants,
+    const eastl::vector<ShaderReflection::PushConstantRange>& shader_push_constants,
     const VkShaderStageFlags shader_stage,
     eastl::fixed_vector<VkPushConstantRange, 4>& push_constants
 ) {
     bool has_error = false;
 
-    for(const auto& constant_range : spv_push_constants) {
+    for(const auto& constant_range : shader_push_constants) {
         auto existing_constant = std::find_if(
             push_constants.begin(),
             push_constants.end(),
             [&](const VkPushConstantRange& existing_range) {
-                return existing_range.offset == constant_range->offset;
+                return existing_range.offset == constant_range.offset;
             }
         );
         if(existing_constant != push_constants.end()) {
-            if(existing_constant->size != constant_range->size) {
+            if(existing_constant->size != constant_range.size) {
                 logger->error(
                     "Push constant range at offset {} has size {} in shader {}, but it had size {} earlier",
-                    constant_range->offset,
-                    constant_range->size,
+                    constant_range.offset,
+                    constant_range.size,
                     std::string_view{shader_name.data(), shader_name.size()},
                     existing_constant->size
                 );
                 has_error = true;
 
                 // Expand the size - is this correct?
-                existing_constant->size = std::max(existing_constant->size, constant_range->size);
+                existing_constant->size = std::max(existing_constant->size, constant_range.size);
             }
 
             // Make the range visible to this stage
@@ -546,8 +517,8 @@ bool collect_push_constants(
             push_constants.emplace_back(
                 VkPushConstantRange{
                     .stageFlags = static_cast<VkShaderStageFlags>(shader_stage),
-                    .offset = constant_range->offset,
-                    .size = constant_range->size
+                    .offset = constant_range.offset,
+                    .size = constant_range.size
                 }
             );
         }
@@ -557,7 +528,7 @@ bool collect_push_constants(
 }
 
 bool collect_bindings(
-    const eastl::vector<std::byte>& shader_instructions, const std::string_view shader_name,
+    const ShaderReflection& reflection, const std::string_view shader_name,
     const VkShaderStageFlags shader_stage,
     eastl::fixed_vector<DescriptorSetInfo, 8>& descriptor_sets,
     eastl::fixed_vector<VkPushConstantRange, 4>& push_constants
@@ -566,38 +537,13 @@ bool collect_bindings(
         init_logger();
     }
 
-    const auto shader_module = spv_reflect::ShaderModule{
-        shader_instructions.size(),
-        shader_instructions.data(),
-        SPV_REFLECT_MODULE_FLAG_NO_COPY
-    };
-    if(shader_module.GetResult() != SpvReflectResult::SPV_REFLECT_RESULT_SUCCESS) {
-        throw std::runtime_error{"Could not perform reflection on shader"};
-    }
-
     bool has_error = false;
 
-    // Collect descriptor set info
-    uint32_t set_count;
-    auto result = shader_module.EnumerateDescriptorSets(&set_count, nullptr);
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
-    auto sets = eastl::vector<SpvReflectDescriptorSet*>{set_count};
-    result = shader_module.EnumerateDescriptorSets(&set_count, sets.data());
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-    has_error |= collect_descriptor_sets(sets, shader_stage, descriptor_sets);
-
-    // Collect push constant info
-    uint32_t constant_count;
-    result = shader_module.EnumeratePushConstantBlocks(&constant_count, nullptr);
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
-    auto spv_push_constants = eastl::vector<SpvReflectBlockVariable*>{constant_count};
-    result = shader_module.EnumeratePushConstantBlocks(&constant_count, spv_push_constants.data());
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+    has_error |= collect_descriptor_sets(reflection.bindings, shader_stage, descriptor_sets);
 
     has_error |= collect_push_constants(
         shader_name,
-        spv_push_constants,
+        reflection.push_constants,
         shader_stage,
         push_constants
     );
@@ -607,7 +553,7 @@ bool collect_bindings(
 
 void collect_vertex_attributes(
     const VertexLayout& vertex_layout,
-    const eastl::vector<SpvReflectInterfaceVariable*>& inputs,
+    const eastl::vector<ShaderReflection::Input>& inputs,
     eastl::fixed_vector<VkVertexInputAttributeDescription, 8>& vertex_attributes,
     bool& needs_position_buffer,
     bool& needs_data_buffer,
@@ -615,16 +561,13 @@ void collect_vertex_attributes(
 ) {
     needs_position_buffer = false;
     needs_data_buffer = false;
-    for(const auto* input : inputs) {
-        if(input->name == nullptr) {
-            continue; // UGH
-        }
-        if(auto itr = vertex_layout.attributes.find(input->name); itr != vertex_layout.attributes.end()) {
+    for(const auto& input : inputs) {
+        if(auto itr = vertex_layout.attributes.find(input.name); itr != vertex_layout.attributes.end()) {
             auto& attribute = vertex_attributes.emplace_back(itr->second);
-            attribute.location = input->location;
+            attribute.location = input.location;
         }
 
-        const auto string_name = std::string{input->name};
+        const auto string_name = std::string{input.name.c_str()};
 
         if(string_name.find(POSITION_VERTEX_ATTRIBUTE_NAME.c_str()) != std::string::npos) {
             needs_position_buffer = true;
@@ -638,54 +581,10 @@ void collect_vertex_attributes(
             needs_data_buffer = true;
         } else if(string_name.find(PRIMITIVE_ID_VERTEX_ATTRIBUTE_NAME.c_str()) != std::string::npos) {
             needs_primitive_id_buffer = true;
-        } else if(input->location != 0xFFFFFFFF) {
+        } else if(input.location != 0xFFFFFFFF) {
             // -1 is used for some builtin things i guess
             // I can't
-            logger->error("Vertex input {} unrecognized", input->location);
+            logger->error("Vertex input {} unrecognized", input.location);
         }
     }
 }
-
-VkDescriptorType to_vk_type(SpvReflectDescriptorType type) {
-    switch(type) {
-    case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLER:
-        return VK_DESCRIPTOR_TYPE_SAMPLER;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
-        return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
-        return VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_IMAGE:
-        return VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
-        return VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
-        return VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
-        return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER:
-        return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
-        return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
-        return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
-        return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-
-    case SPV_REFLECT_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
-        return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
-
-    default:
-        spdlog::error("Unknown descriptor type {}", type);
-        return VK_DESCRIPTOR_TYPE_MAX_ENUM;
-    }
-}
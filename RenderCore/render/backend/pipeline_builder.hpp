@@ -10,17 +10,17 @@
 
 #include "render/backend/graphics_pipeline.hpp"
 #include "render/backend/handles.hpp"
+#include "render/backend/shader_reflection_cache.hpp"
 
 class PipelineCache;
 
 class RenderBackend;
 
-struct SpvReflectDescriptorSet;
-struct SpvReflectBlockVariable;
-struct SpvReflectInterfaceVariable;
-
+/**
+ * Adds a shader's descriptor bindings and push constants to the pipeline's. Returns true if there was an error
+ */
 bool collect_bindings(
-    const eastl::vector<std::byte>& shader_instructions,
+    const ShaderReflection& reflection,
     std::string_view shader_name,
     VkShaderStageFlags shader_stage,
     eastl::fixed_vector<DescriptorSetInfo, 8>& descriptor_sets,
@@ -1,70 +1,303 @@
+#include <chrono>
+#include <sstream>
+
+#include <EASTL/algorithm.h>
+#include <EASTL/unordered_set.h>
+#include <magic_enum.hpp>
 #include <vulkan/vk_enum_string_helper.h>
+#include <tracy/Tracy.hpp>
 
 #include "render/backend/pipeline_cache.hpp"
 #include "render/backend/pipeline_builder.hpp"
 #include "render/backend/ray_tracing_pipeline.hpp"
 #include "render/backend/render_backend.hpp"
+#include "console/cvars.hpp"
 #include "core/system_interface.hpp"
+#include "extern/cityhash/city_hash.hpp"
 
 static std::shared_ptr<spdlog::logger> logger;
 
+static auto cvar_num_compile_threads = AutoCVar_Int{
+    "r.PSO.NumCompileThreads",
+    "Number of worker threads that compile PSOs in the background. Only read at startup",
+    2
+};
+
+static auto cvar_async_compile = AutoCVar_Int{
+    "r.PSO.AsyncCompile",
+    "Whether to compile PSO variants that aren't in the manifest in the background. Draws are skipped until the PSO is ready, so one-shot passes may be lost",
+    0
+};
+
+static auto cvar_pipeline_libraries = AutoCVar_Int{
+    "r.PSO.PipelineLibrary",
+    "Whether to link graphics PSOs from pipeline libraries, if the device supports VK_EXT_graphics_pipeline_library. New variants are fast-linked, then optimized in the background",
+    1
+};
+
+static auto cvar_warm_up = AutoCVar_Int{
+    "r.PSO.WarmUp",
+    "Whether to compile the PSO variants that previous runs used when their pipeline is created",
+    1
+};
+
+static auto cvar_shader_reload = AutoCVar_Int{
+    "r.ShaderReload.Enable",
+    "Whether to recompile shaders when their source changes, and rebuild the pipelines that use them. Only read at startup",
+    1
+};
+
+static auto cvar_python = AutoCVar_String{
+    "r.ShaderReload.Python",
+    "Python interpreter to run the shader compile script with",
+    "python"
+};
+
+/**
+ * Manifest of the graphics PSO variants that we've compiled. One variant per line: view mask, whether the variant uses
+ * a shading rate image, depth format, number of color formats, the color formats, then the pipeline's name
+ */
+constexpr auto PSO_MANIFEST_PATH = "cache/pso_manifest";
+
+/**
+ * Pipelines that read descriptors from descriptor buffers must say so
+ */
+static VkPipelineCreateFlags get_descriptor_model_flags(const RenderBackend& backend) {
+    return backend.use_descriptor_buffers() ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+}
+
+/**
+ * Shader stages of a graphics pipeline. The stages point to their module create infos, so this can't be copied
+ */
+struct GraphicsShaderStages {
+    eastl::array<VkShaderModuleCreateInfo, 3> modules = {};
+
+    eastl::fixed_vector<VkPipelineShaderStageCreateInfo, 3> stages;
+
+    GraphicsShaderStages() = default;
+
+    GraphicsShaderStages(const GraphicsShaderStages& other) = delete;
+
+    GraphicsShaderStages& operator=(const GraphicsShaderStages& other) = delete;
+
+    /**
+     * Adds a stage, if it has code
+     */
+    void add(const eastl::vector<std::byte>& code, const VkShaderStageFlagBits stage) {
+        if(code.empty()) {
+            return;
+        }
+
+        auto& module = modules[stages.size()];
+        module = VkShaderModuleCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = static_cast<uint32_t>(code.size()),
+            .pCode = reinterpret_cast<const uint32_t*>(code.data()),
+        };
+
+        stages.emplace_back(
+            VkPipelineShaderStageCreateInfo{
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .pNext = &module,
+                .stage = stage,
+                .pName = "main",
+            });
+    }
+};
+
+// ReSharper disable CppVariableCanBeMadeConstexpr
+static const auto graphics_viewport_state = VkPipelineViewportStateCreateInfo{
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+    .viewportCount = 1,
+    .scissorCount = 1,
+    // Dynamic viewport and scissor state
+};
+
+static const auto graphics_multisample_state = VkPipelineMultisampleStateCreateInfo{
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+    .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+};
+
+static const auto graphics_dynamic_states = eastl::array{
+    VK_DYNAMIC_STATE_VIEWPORT,
+    VK_DYNAMIC_STATE_SCISSOR,
+    VK_DYNAMIC_STATE_FRONT_FACE,
+    VK_DYNAMIC_STATE_CULL_MODE
+};
+
+static const auto graphics_dynamic_state = VkPipelineDynamicStateCreateInfo{
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+    .dynamicStateCount = static_cast<uint32_t>(graphics_dynamic_states.size()),
+    .pDynamicStates = graphics_dynamic_states.data(),
+};
+
+static const auto graphics_shading_rate_state = VkPipelineFragmentShadingRateStateCreateInfoKHR{
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_FRAGMENT_SHADING_RATE_STATE_CREATE_INFO_KHR,
+    .pNext = nullptr,
+    .fragmentSize = {1, 1},
+    .combinerOps = {
+        VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR, VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR
+    }
+};
+// ReSharper restore CppVariableCanBeMadeConstexpr
+
+/**
+ * Appends the bytes of some plain data to a pipeline library key
+ */
+template <typename DataType>
+static void append_to_key(eastl::string& key, const DataType& data) {
+    key.append(reinterpret_cast<const char*>(&data), sizeof(DataType));
+}
+
+template <typename DataType, size_t Capacity>
+static void append_to_key(eastl::string& key, const eastl::fixed_vector<DataType, Capacity>& data) {
+    append_to_key(key, static_cast<uint32_t>(data.size()));
+    for(const auto& element : data) {
+        append_to_key(key, element);
+    }
+}
+
 PipelineCache::PipelineCache(RenderBackend& backend_in) : backend{backend_in} {
     if(logger == nullptr) {
         logger = SystemInterface::get().get_logger("PipelineCache");
         logger->set_level(spdlog::level::debug);
     }
 
-    const auto& physical_device = backend.get_physical_device();
-    const auto data = SystemInterface::get()
-                      .load_file("cache/pipeline_cache")
-                      .and_then(
-                          [&](const auto& cache_data) -> tl::optional<eastl::vector<std::byte>> {
-                              const auto* header = reinterpret_cast<const VkPipelineCacheHeaderVersionOne*>(cache_data.
-                                  data());
-                              if(header->vendorID == physical_device.properties.vendorID &&
-                                  header->deviceID == physical_device.properties.deviceID &&
-                                  std::memcmp(
-                                      header->pipelineCacheUUID,
-                                      physical_device.properties.pipelineCacheUUID,
-                                      16) == 0) {
-                                  return cache_data;
-                              }
-
-                              return tl::nullopt;
-                          }
-                      );
+    const auto startup_start_time = std::chrono::steady_clock::now();
 
-    const auto create_info = VkPipelineCacheCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
-        .initialDataSize = data ? data->size() : 0,
-        .pInitialData = data ? data->data() : nullptr,
-    };
+    cache_key = make_cache_key();
+
+    auto graphics_cache_data = tl::optional<eastl::vector<std::byte>>{};
+    for(const auto kind : magic_enum::enum_values<PipelineKind>()) {
+        const auto data = load_cache_data(kind);
+        is_cache_warm[static_cast<uint32_t>(kind)] = data.has_value();
+
+        vk_pipeline_caches[static_cast<uint32_t>(kind)] = create_vk_pipeline_cache(data);
+
+        if(kind == PipelineKind::Graphics) {
+            graphics_cache_data = data;
+        }
+    }
+
+    const auto num_threads = static_cast<uint32_t>(std::max(cvar_num_compile_threads.Get(), 1));
+
+    // Each compile thread gets its own cache, so that they don't contend on the driver's cache lock. They're merged into
+    // the graphics cache at shutdown
+    thread_pipeline_caches.reserve(num_threads);
+    for(auto i = 0u; i < num_threads; i++) {
+        thread_pipeline_caches.emplace_back(create_vk_pipeline_cache(graphics_cache_data));
+    }
 
-    vkCreatePipelineCache(backend.get_device(), &create_info, nullptr, &vk_pipeline_cache);
+    cache_load_time_ms = std::chrono::duration<double, std::milli>{
+        std::chrono::steady_clock::now() - startup_start_time
+    }.count();
+
+    reflection_cache.load();
+
+    load_manifest();
+
+    compile_threads.reserve(num_threads);
+    for(auto i = 0u; i < num_threads; i++) {
+        compile_threads.emplace_back([this, i] { run_compile_thread(thread_pipeline_caches[i]); });
+    }
+
+    // Shipping builds don't have the shader source, so there's nothing to watch
+    const auto shader_source_dir = std::filesystem::path{SAH_SHADER_SOURCE_DIR};
+    if(cvar_shader_reload.Get() != 0 && std::filesystem::exists(shader_source_dir)) {
+        const auto shader_output_dir = std::filesystem::path{"shaders"};
+        const auto compile_script = std::filesystem::path{SAH_TOOLS_DIR} / "compile_shaders.py";
+        auto compile_command = fmt::format(
+            "{} \"{}\" \"{}\" \"{}\"",
+            cvar_python.Get(),
+            compile_script.string(),
+            shader_source_dir.string(),
+            std::filesystem::absolute(shader_output_dir).string());
+        shader_reloader = std::make_unique<ShaderReloader>(
+            shader_source_dir,
+            shader_output_dir,
+            std::move(compile_command));
+    }
 }
 
 PipelineCache::~PipelineCache() {
-    if(vk_pipeline_cache != VK_NULL_HANDLE) {
-        auto pipeline_cache_size = size_t{};
-        vkGetPipelineCacheData(backend.get_device(), vk_pipeline_cache, &pipeline_cache_size, nullptr);
+    {
+        auto lock = std::unique_lock{compile_job_mutex};
+        should_stop_compile_threads = true;
+        compile_jobs.clear();
+    }
+    compile_job_condition.notify_all();
+    for(auto& thread : compile_threads) {
+        thread.join();
+    }
+    compile_threads.clear();
+
+    shader_reloader = nullptr;
+
+    save_manifest();
+
+    reflection_cache.save();
 
-        auto pipeline_cache_data = eastl::vector<uint8_t>{};
-        pipeline_cache_data.resize(pipeline_cache_size);
-        vkGetPipelineCacheData(
-            backend.get_device(),
-            vk_pipeline_cache,
-            &pipeline_cache_size,
-            pipeline_cache_data.data()
-        );
+    const auto device = backend.get_device();
 
-        SystemInterface::get().write_file(
-            "cache/pipeline_cache",
-            pipeline_cache_data.data(),
-            static_cast<uint32_t>(pipeline_cache_data.size())
-        );
+    for(const auto& optimized : optimized_pipelines) {
+        vkDestroyPipeline(device, optimized.vk_pipeline, nullptr);
+    }
+    optimized_pipelines.clear();
+
+    for(auto& pipeline : pipelines) {
+        // PipelineBase destroys the main PSO
+        for(const auto& [variant, vk_pipeline] : pipeline.variants) {
+            if(vk_pipeline != VK_NULL_HANDLE && vk_pipeline != pipeline.pipeline) {
+                vkDestroyPipeline(device, vk_pipeline, nullptr);
+            }
+        }
+        pipeline.variants.clear();
+
+        for(const auto& libraries : pipeline.shader_libraries) {
+            vkDestroyPipeline(device, libraries.pre_rasterization, nullptr);
+            vkDestroyPipeline(device, libraries.fragment_shader, nullptr);
+        }
+        pipeline.shader_libraries.clear();
+    }
+
+    for(const auto& [key, library] : vertex_input_libraries) {
+        vkDestroyPipeline(device, library, nullptr);
+    }
+    vertex_input_libraries.clear();
+
+    for(const auto& [key, library] : fragment_output_libraries) {
+        vkDestroyPipeline(device, library, nullptr);
+    }
+    fragment_output_libraries.clear();
+
+    for(auto frame_idx = 0u; frame_idx < num_in_flight_frames; frame_idx++) {
+        free_resources_for_frame(frame_idx);
+    }
 
-        vkDestroyPipelineCache(backend.get_device(), vk_pipeline_cache, nullptr);
-        vk_pipeline_cache = VK_NULL_HANDLE;
+    auto& graphics_cache = vk_pipeline_caches[static_cast<uint32_t>(PipelineKind::Graphics)];
+    if(graphics_cache != VK_NULL_HANDLE && !thread_pipeline_caches.empty()) {
+        const auto result = vkMergePipelineCaches(
+            device,
+            graphics_cache,
+            static_cast<uint32_t>(thread_pipeline_caches.size()),
+            thread_pipeline_caches.data());
+        if(result != VK_SUCCESS) {
+            logger->error("Could not merge thread pipeline caches: {}", string_VkResult(result));
+        }
+    }
+    for(const auto thread_cache : thread_pipeline_caches) {
+        vkDestroyPipelineCache(device, thread_cache, nullptr);
+    }
+    thread_pipeline_caches.clear();
+
+    for(const auto kind : magic_enum::enum_values<PipelineKind>()) {
+        auto& cache = vk_pipeline_caches[static_cast<uint32_t>(kind)];
+        if(cache != VK_NULL_HANDLE) {
+            save_cache_data(kind, cache);
+
+            vkDestroyPipelineCache(device, cache, nullptr);
+            cache = VK_NULL_HANDLE;
+        }
     }
 }
 
@@ -77,6 +310,8 @@ GraphicsPipelineHandle PipelineCache::create_pipeline(const GraphicsPipelineBuil
         pipeline.flags |= VK_PIPELINE_CREATE_INDIRECT_BINDABLE_BIT_NV;
     }
 
+    pipeline.flags |= get_descriptor_model_flags(backend);
+
     if(!pipeline_builder.vertex_shader) {
         throw std::runtime_error{"Vertex shader is required!"};
     }
@@ -87,6 +322,9 @@ GraphicsPipelineHandle PipelineCache::create_pipeline(const GraphicsPipelineBuil
     if(pipeline_builder.fragment_shader) {
         pipeline.fragment_shader = *pipeline_builder.fragment_shader;
     }
+    pipeline.vertex_shader_path = pipeline_builder.vertex_shader_name;
+    pipeline.geometry_shader_path = pipeline_builder.geometry_shader_name;
+    pipeline.fragment_shader_path = pipeline_builder.fragment_shader_name;
 
     pipeline.depth_stencil_state = pipeline_builder.depth_stencil_state;
     pipeline.raster_state = pipeline_builder.raster_state;
@@ -109,7 +347,11 @@ GraphicsPipelineHandle PipelineCache::create_pipeline(const GraphicsPipelineBuil
         // Assumption that all shader stages will use the same push constants. If this is not true, I have a headache and I need to lie down
     }
 
-    return &(*pipelines.emplace(std::move(pipeline)));
+    const auto handle = &(*pipelines.emplace(std::move(pipeline)));
+
+    warm_up_pipeline(handle);
+
+    return handle;
 }
 
 ComputePipelineHandle PipelineCache::create_pipeline(const std::filesystem::path& shader_file_path) {
@@ -117,276 +359,1363 @@ ComputePipelineHandle PipelineCache::create_pipeline(const std::filesystem::path
 
     const auto instructions = *SystemInterface::get().load_file(shader_file_path);
 
+    auto pipeline = ComputePipeline{};
+
+    pipeline.name = shader_file_path.string();
+    pipeline.push_constant_stages = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    eastl::fixed_vector<VkPushConstantRange, 4> push_constants;
+    collect_bindings(
+        reflection_cache.get_reflection(instructions),
+        pipeline.name,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        pipeline.descriptor_sets,
+        push_constants);
+
+    // Find the greatest offset + size in the push constant ranges, assume that every other push constant is used
+    for(const auto& range : push_constants) {
+        const auto max_used_byte = range.offset + range.size;
+        pipeline.num_push_constants = std::max(pipeline.num_push_constants, max_used_byte / 4u);
+    }
+
+    pipeline.create_pipeline_layout(backend, pipeline.descriptor_sets, push_constants);
+
+    logger->trace("Created pipeline layout");
+
+    pipeline.pipeline = compile_compute_pipeline(pipeline, instructions);
+    if(pipeline.pipeline == VK_NULL_HANDLE) {
+        return {};
+    }
+
+    logger->trace("Created pipeline");
+
+    const auto layout_name = fmt::format("{} Layout", shader_file_path.string());
+
+    backend.set_object_name(pipeline.pipeline, pipeline.name);
+    backend.set_object_name(pipeline.layout, layout_name);
+
+    logger->trace("Named pipeline and pipeline layout");
+
+    return &(*compute_pipelines.emplace(std::move(pipeline)));
+}
+
+VkPipeline PipelineCache::compile_compute_pipeline(
+    const ComputePipeline& pipeline, const std::span<const std::byte> instructions
+) {
     const auto module_create_info = VkShaderModuleCreateInfo{
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
         .codeSize = instructions.size(),
         .pCode = reinterpret_cast<const uint32_t*>(instructions.data()),
     };
 
-    auto pipeline = ComputePipeline{};
+    const auto create_info = VkComputePipelineCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .flags = get_descriptor_model_flags(backend),
+        .stage = VkPipelineShaderStageCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext = &module_create_info,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pName = "main",
+        },
+        .layout = pipeline.layout
+    };
+
+    auto vk_pipeline = VkPipeline{VK_NULL_HANDLE};
+
+    const auto start_time = std::chrono::steady_clock::now();
+    const auto result = vkCreateComputePipelines(
+        backend.get_device(),
+        vk_pipeline_caches[static_cast<uint32_t>(PipelineKind::Compute)],
+        1,
+        &create_info,
+        nullptr,
+        &vk_pipeline);
+    if(result != VK_SUCCESS) {
+        logger->error("Could not create pipeline {}: Vulkan error {}", pipeline.name, result);
+        return VK_NULL_HANDLE;
+    }
+
+    const auto compile_time = std::chrono::duration<double, std::milli>{std::chrono::steady_clock::now() - start_time};
+    record_compile_time(pipeline.name, PipelineKind::Compute, compile_time.count(), false);
+
+    return vk_pipeline;
+}
+
+GraphicsPipelineHandle PipelineCache::create_pipeline_group(const std::span<GraphicsPipelineHandle> pipelines_in) {
+    auto graphics_pipeline = GraphicsPipeline{};
+
+    auto vk_pipelines = eastl::vector<VkPipeline>{};
+    vk_pipelines.reserve(pipelines_in.size());
+    for(const auto& pipeline : pipelines_in) {
+        vk_pipelines.emplace_back(pipeline->pipeline);
+    }
+    const auto group_info = VkGraphicsPipelineShaderGroupsCreateInfoNV{
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_SHADER_GROUPS_CREATE_INFO_NV,
+        .pipelineCount = static_cast<uint32_t>(pipelines_in.size()),
+        .pPipelines = vk_pipelines.data()
+    };
+    const auto create_info = VkGraphicsPipelineCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+
+        .pNext = &group_info,
+    };
+    vkCreateGraphicsPipelines(
+        backend.get_device(),
+        vk_pipeline_caches[static_cast<uint32_t>(PipelineKind::Graphics)],
+        1,
+        &create_info,
+        nullptr,
+        &graphics_pipeline.pipeline);
+
+    return &(*pipelines.emplace(std::move(graphics_pipeline)));
+}
+
+VkPipeline PipelineCache::get_pipeline(
+    const GraphicsPipelineHandle pipeline, const std::span<const VkFormat> color_attachment_formats,
+    const std::optional<VkFormat> depth_format, const uint32_t view_mask, const bool use_fragment_shading_rate_attachment
+) {
+    ZoneScoped;
+
+    auto variant = GraphicsPipelineVariant{
+        .depth_attachment_format = depth_format.value_or(VK_FORMAT_UNDEFINED),
+        .view_mask = view_mask,
+        .use_fragment_shading_rate_attachment = use_fragment_shading_rate_attachment
+    };
+    variant.color_attachment_formats.assign(color_attachment_formats.begin(), color_attachment_formats.end());
+
+    {
+        auto lock = std::unique_lock{variant_mutex};
+        for(const auto& [existing_variant, vk_pipeline] : pipeline->variants) {
+            if(existing_variant == variant) {
+                // Null if the variant is still compiling
+                return vk_pipeline;
+            }
+        }
+
+        // Fast linking is quick enough to do while recording, so it doesn't need to skip draws
+        if(cvar_async_compile.Get() != 0 && !pipeline->has_failed_background_compile &&
+            !should_use_pipeline_libraries(*pipeline)) {
+            queue_compile_job(pipeline, variant);
+            return VK_NULL_HANDLE;
+        }
+    }
+
+    if(should_use_pipeline_libraries(*pipeline)) {
+        if(const auto vk_pipeline = link_variant(pipeline, variant); vk_pipeline != VK_NULL_HANDLE) {
+            return vk_pipeline;
+        }
+
+        logger->warn("Could not link PSO {} from pipeline libraries, compiling it instead", pipeline->name);
+    }
+
+    const auto vk_pipeline = compile_variant(
+        *pipeline,
+        variant,
+        vk_pipeline_caches[static_cast<uint32_t>(PipelineKind::Graphics)],
+        false);
+    add_variant(pipeline, variant, vk_pipeline);
+
+    return vk_pipeline;
+}
+
+ShaderReflectionCache& PipelineCache::get_reflection_cache() {
+    return reflection_cache;
+}
+
+eastl::vector<PipelineCompileTiming> PipelineCache::get_compile_timings() const {
+    auto lock = std::unique_lock{timing_mutex};
+    return compile_timings;
+}
+
+uint32_t PipelineCache::get_num_pending_compiles() const {
+    auto lock = std::unique_lock{compile_job_mutex};
+    return static_cast<uint32_t>(compile_jobs.size() + running_job_pipelines.size());
+}
+
+void PipelineCache::free_resources_for_frame(const uint32_t frame_idx) {
+    const auto device = backend.get_device();
+
+    auto& zombie_pipelines = pipeline_zombie_lists[frame_idx];
+    for(const auto vk_pipeline : zombie_pipelines) {
+        vkDestroyPipeline(device, vk_pipeline, nullptr);
+    }
+    zombie_pipelines.clear();
+
+    auto& zombie_layouts = pipeline_layout_zombie_lists[frame_idx];
+    for(const auto layout : zombie_layouts) {
+        vkDestroyPipelineLayout(device, layout, nullptr);
+    }
+    zombie_layouts.clear();
+}
+
+void PipelineCache::apply_shader_reloads() {
+    if(shader_reloader == nullptr) {
+        return;
+    }
+
+    const auto changed_shader_list = shader_reloader->take_changed_shaders();
+    if(changed_shader_list.empty()) {
+        return;
+    }
+
+    ZoneScoped;
+
+    auto changed_shaders = eastl::unordered_set<eastl::string>{};
+    changed_shaders.insert(changed_shader_list.begin(), changed_shader_list.end());
+
+    const auto is_changed = [&](const std::string& path) {
+        return !path.empty() && changed_shaders.find(normalize_shader_path(path)) != changed_shaders.end();
+    };
+
+    auto graphics_pipelines_to_reload = eastl::vector<GraphicsPipelineHandle>{};
+    for(auto& pipeline : pipelines) {
+        if(is_changed(pipeline.vertex_shader_path) || is_changed(pipeline.geometry_shader_path) ||
+            is_changed(pipeline.fragment_shader_path)) {
+            graphics_pipelines_to_reload.push_back(&pipeline);
+        }
+    }
+
+    // Background compiles read the shaders of the pipelines that we're about to reload, and would overwrite their new
+    // PSOs
+    drain_compile_jobs(graphics_pipelines_to_reload);
+
+    // Optimized PSOs that finished after the start of the frame were linked from the old shaders. Swap them in now, so
+    // that the reload replaces them
+    apply_optimized_pipelines();
+
+    for(const auto pipeline : graphics_pipelines_to_reload) {
+        reload_graphics_pipeline(*pipeline, changed_shaders);
+    }
+
+    for(auto& pipeline : compute_pipelines) {
+        if(is_changed(pipeline.name)) {
+            reload_compute_pipeline(pipeline);
+        }
+    }
+
+    for(auto& pipeline : ray_tracing_pipelines) {
+        if(is_changed(pipeline.raygen_shader_path)) {
+            reload_ray_tracing_pipeline(pipeline);
+        }
+    }
+}
+
+void PipelineCache::drain_compile_jobs(const std::span<const GraphicsPipelineHandle> pipelines_to_drain) {
+    if(pipelines_to_drain.empty()) {
+        return;
+    }
+
+    const auto is_draining = [&](const GraphicsPipelineHandle pipeline) {
+        return eastl::find(pipelines_to_drain.begin(), pipelines_to_drain.end(), pipeline) != pipelines_to_drain.end();
+    };
+
+    // Lock the variants before the jobs, like queue_compile_job does
+    {
+        auto variant_lock = std::unique_lock{variant_mutex};
+        auto job_lock = std::unique_lock{compile_job_mutex};
+
+        auto num_dropped_jobs = 0u;
+        for(auto itr = compile_jobs.begin(); itr != compile_jobs.end();) {
+            if(!is_draining(itr->pipeline)) {
+                ++itr;
+                continue;
+            }
+
+            // Library jobs optimize a variant that already has a fast-linked PSO. Other jobs left a placeholder
+            if(!itr->libraries) {
+                auto& variants = itr->pipeline->variants;
+                const auto variant_itr = eastl::find_if(
+                    variants.begin(),
+                    variants.end(),
+                    [&](const auto& existing) {
+                        return existing.first == itr->variant && existing.second == VK_NULL_HANDLE;
+                    });
+                if(variant_itr != variants.end()) {
+                    variants.erase(variant_itr);
+                }
+            }
+
+            itr = compile_jobs.erase(itr);
+            num_dropped_jobs++;
+        }
+
+        if(num_dropped_jobs > 0) {
+            logger->info("Dropped {} queued PSO compiles of pipelines that are being reloaded", num_dropped_jobs);
+        }
+    }
+
+    // The compile threads take the variant mutex when they finish a job, so don't hold it while we wait
+    auto job_lock = std::unique_lock{compile_job_mutex};
+    const auto is_compiling = [&] {
+        return eastl::any_of(running_job_pipelines.begin(), running_job_pipelines.end(), is_draining);
+    };
+    if(is_compiling()) {
+        ZoneScopedN("Wait for PSO compiles");
+        logger->info("Waiting for background PSO compiles of pipelines that are being reloaded");
+        compile_job_finished_condition.wait(job_lock, [&] { return !is_compiling(); });
+    }
+}
+
+/**
+ * Checks if shaders with the new descriptor sets can use a pipeline layout that was made for the old descriptor sets
+ */
+static bool is_layout_compatible(
+    const eastl::fixed_vector<DescriptorSetInfo, 8>& old_sets, const eastl::fixed_vector<DescriptorSetInfo, 8>& new_sets
+) {
+    for(auto set_index = 0u; set_index < new_sets.size(); set_index++) {
+        for(const auto& new_binding : new_sets[set_index].bindings) {
+            if(set_index >= old_sets.size()) {
+                return false;
+            }
+
+            const auto& old_bindings = old_sets[set_index].bindings;
+            const auto itr = eastl::find_if(
+                old_bindings.begin(),
+                old_bindings.end(),
+                [&](const DescriptorInfo& old_binding) { return old_binding.binding == new_binding.binding; });
+            if(itr == old_bindings.end()) {
+                return false;
+            }
+
+            if(itr->descriptorType != new_binding.descriptorType ||
+                itr->descriptorCount != new_binding.descriptorCount ||
+                (new_binding.stageFlags & ~itr->stageFlags) != 0) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static uint32_t get_num_push_constants(const eastl::fixed_vector<VkPushConstantRange, 4>& push_constants) {
+    auto num_push_constants = 0u;
+    for(const auto& range : push_constants) {
+        num_push_constants = std::max(num_push_constants, (range.offset + range.size) / 4u);
+    }
+
+    return num_push_constants;
+}
+
+void PipelineCache::reload_graphics_pipeline(
+    GraphicsPipeline& pipeline, const eastl::unordered_set<eastl::string>& changed_shaders
+) {
+    ZoneScoped;
+
+    // Pipeline groups reference the PSOs of their pipelines, so we can't replace them
+    if((pipeline.flags & VK_PIPELINE_CREATE_INDIRECT_BINDABLE_BIT_NV) != 0) {
+        logger->warn("Can't reload pipeline {}, it may be part of a pipeline group", pipeline.name);
+        return;
+    }
+
+    // Load the stages that changed, and keep the code of the others
+    auto vertex_shader = pipeline.vertex_shader;
+    auto geometry_shader = pipeline.geometry_shader;
+    auto fragment_shader = pipeline.fragment_shader;
+
+    const auto load_if_changed = [&](const std::string& path, eastl::vector<std::byte>& code) {
+        if(path.empty() || changed_shaders.find(normalize_shader_path(path)) == changed_shaders.end()) {
+            return true;
+        }
+
+        auto new_code = SystemInterface::get().load_file(path);
+        if(!new_code) {
+            return false;
+        }
+
+        code = eastl::move(*new_code);
+        return true;
+    };
+    if(!load_if_changed(pipeline.vertex_shader_path, vertex_shader) ||
+        !load_if_changed(pipeline.geometry_shader_path, geometry_shader) ||
+        !load_if_changed(pipeline.fragment_shader_path, fragment_shader)) {
+        logger->error("Could not load the new shaders for pipeline {}", pipeline.name);
+        return;
+    }
+
+    // The new shaders must fit the pipeline's layout and vertex inputs
+    auto descriptor_sets = eastl::fixed_vector<DescriptorSetInfo, 8>{};
+    auto push_constants = eastl::fixed_vector<VkPushConstantRange, 4>{};
+    auto has_error = collect_bindings(
+        reflection_cache.get_reflection(vertex_shader),
+        pipeline.vertex_shader_path,
+        VK_SHADER_STAGE_VERTEX_BIT,
+        descriptor_sets,
+        push_constants);
+    if(!geometry_shader.empty()) {
+        has_error |= collect_bindings(
+            reflection_cache.get_reflection(geometry_shader),
+            pipeline.geometry_shader_path,
+            VK_SHADER_STAGE_GEOMETRY_BIT,
+            descriptor_sets,
+            push_constants);
+    }
+    if(!fragment_shader.empty()) {
+        has_error |= collect_bindings(
+            reflection_cache.get_reflection(fragment_shader),
+            pipeline.fragment_shader_path,
+            VK_SHADER_STAGE_FRAGMENT_BIT,
+            descriptor_sets,
+            push_constants);
+    }
+
+    const auto old_inputs = reflection_cache.get_reflection(pipeline.vertex_shader).inputs;
+    const auto new_inputs = reflection_cache.get_reflection(vertex_shader).inputs;
+    const auto inputs_match = old_inputs.size() == new_inputs.size() && eastl::equal(
+        old_inputs.begin(),
+        old_inputs.end(),
+        new_inputs.begin(),
+        [](const ShaderReflection::Input& a, const ShaderReflection::Input& b) {
+            return a.name == b.name && a.location == b.location;
+        });
+
+    if(has_error || !inputs_match || !is_layout_compatible(pipeline.descriptor_sets, descriptor_sets) ||
+        get_num_push_constants(push_constants) > pipeline.num_push_constants) {
+        logger->error(
+            "The new shaders for pipeline {} don't match its layout. Restart the application to use them",
+            pipeline.name);
+        return;
+    }
+
+    // Compile every variant that the pipeline already has. If any of them fails, keep the old PSOs
+    eastl::swap(pipeline.vertex_shader, vertex_shader);
+    eastl::swap(pipeline.geometry_shader, geometry_shader);
+    eastl::swap(pipeline.fragment_shader, fragment_shader);
+
+    const auto graphics_cache = vk_pipeline_caches[static_cast<uint32_t>(PipelineKind::Graphics)];
+
+    auto new_pipelines = eastl::fixed_vector<VkPipeline, 4>{};
+    for(const auto& [variant, old_pipeline] : pipeline.variants) {
+        const auto vk_pipeline = compile_variant(pipeline, variant, graphics_cache, false);
+        if(vk_pipeline == VK_NULL_HANDLE) {
+            break;
+        }
+        new_pipelines.emplace_back(vk_pipeline);
+    }
+
+    if(new_pipelines.size() != pipeline.variants.size()) {
+        for(const auto vk_pipeline : new_pipelines) {
+            vkDestroyPipeline(backend.get_device(), vk_pipeline, nullptr);
+        }
+
+        eastl::swap(pipeline.vertex_shader, vertex_shader);
+        eastl::swap(pipeline.geometry_shader, geometry_shader);
+        eastl::swap(pipeline.fragment_shader, fragment_shader);
+
+        logger->error("Could not compile the new shaders for pipeline {}, keeping the old PSOs", pipeline.name);
+        return;
+    }
+
+    auto lock = std::unique_lock{variant_mutex};
+
+    const auto old_main_pipeline = pipeline.pipeline;
+    for(auto i = 0u; i < pipeline.variants.size(); i++) {
+        auto& vk_pipeline = pipeline.variants[i].second;
+        if(vk_pipeline == old_main_pipeline) {
+            pipeline.pipeline = new_pipelines[i];
+        }
+
+        destroy_pipeline_later(vk_pipeline);
+        vk_pipeline = new_pipelines[i];
+    }
+
+    // The shader libraries have the old shaders. New variants will build new ones
+    {
+        auto library_lock = std::unique_lock{library_mutex};
+        destroy_shader_libraries_later(pipeline);
+    }
+
+    logger->info("Reloaded pipeline {}", pipeline.name);
+}
+
+void PipelineCache::reload_compute_pipeline(ComputePipeline& pipeline) {
+    ZoneScoped;
+
+    const auto instructions = SystemInterface::get().load_file(pipeline.name);
+    if(!instructions) {
+        logger->error("Could not load the new shader for pipeline {}", pipeline.name);
+        return;
+    }
+
+    auto descriptor_sets = eastl::fixed_vector<DescriptorSetInfo, 8>{};
+    auto push_constants = eastl::fixed_vector<VkPushConstantRange, 4>{};
+    const auto has_error = collect_bindings(
+        reflection_cache.get_reflection(*instructions),
+        pipeline.name,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        descriptor_sets,
+        push_constants);
+
+    if(has_error || !is_layout_compatible(pipeline.descriptor_sets, descriptor_sets) ||
+        get_num_push_constants(push_constants) > pipeline.num_push_constants) {
+        logger->error(
+            "The new shader for pipeline {} doesn't match its layout. Restart the application to use it",
+            pipeline.name);
+        return;
+    }
+
+    const auto vk_pipeline = compile_compute_pipeline(pipeline, *instructions);
+    if(vk_pipeline == VK_NULL_HANDLE) {
+        logger->error("Could not compile the new shader for pipeline {}, keeping the old PSO", pipeline.name);
+        return;
+    }
+
+    backend.set_object_name(vk_pipeline, pipeline.name);
+
+    destroy_pipeline_later(pipeline.pipeline);
+    pipeline.pipeline = vk_pipeline;
+
+    logger->info("Reloaded pipeline {}", pipeline.name);
+}
+
+void PipelineCache::reload_ray_tracing_pipeline(RayTracingPipeline& pipeline) {
+    ZoneScoped;
+
+    auto new_pipeline = build_ray_tracing_pipeline(pipeline.raygen_shader_path, pipeline.skip_gi_miss_shader);
+    if(!new_pipeline) {
+        logger->error("Could not compile the new shaders for pipeline {}, keeping the old PSO", pipeline.raygen_shader_path);
+        return;
+    }
+
+    if(!is_layout_compatible(pipeline.descriptor_sets, new_pipeline->descriptor_sets) ||
+        new_pipeline->num_push_constants > pipeline.num_push_constants) {
+        backend.get_global_allocator().destroy_buffer(new_pipeline->shader_tables_buffer);
+        logger->error(
+            "The new shaders for pipeline {} don't match its layout. Restart the application to use them",
+            pipeline.raygen_shader_path);
+        return;
+    }
+
+    // The new pipeline has its own layout and shader tables. Retire the old ones once the GPU is done with them
+    destroy_pipeline_later(pipeline.pipeline);
+    pipeline_layout_zombie_lists[backend.get_current_gpu_frame()].emplace_back(pipeline.layout);
+    backend.get_global_allocator().destroy_buffer(pipeline.shader_tables_buffer);
+
+    pipeline.pipeline = VK_NULL_HANDLE;
+    pipeline.layout = VK_NULL_HANDLE;
+    pipeline = std::move(*new_pipeline);
+
+    logger->info("Reloaded pipeline {}", pipeline.raygen_shader_path);
+}
+
+void PipelineCache::destroy_pipeline_later(const VkPipeline vk_pipeline) {
+    if(vk_pipeline != VK_NULL_HANDLE) {
+        pipeline_zombie_lists[backend.get_current_gpu_frame()].emplace_back(vk_pipeline);
+    }
+}
+
+void PipelineCache::load_manifest() {
+    const auto manifest_data = SystemInterface::get().load_file(PSO_MANIFEST_PATH);
+    if(!manifest_data) {
+        logger->info("No PSO manifest, graphics PSOs will be compiled when they're first used");
+        return;
+    }
+
+    auto stream = std::istringstream{
+        std::string{reinterpret_cast<const char*>(manifest_data->data()), manifest_data->size()}
+    };
+    auto line = std::string{};
+    while(std::getline(stream, line)) {
+        auto line_stream = std::istringstream{line};
+
+        auto entry = ManifestEntry{};
+        auto use_shading_rate_image = 0u;
+        auto depth_format = 0u;
+        auto num_color_formats = 0u;
+        line_stream >> entry.variant.view_mask >> use_shading_rate_image >> depth_format >> num_color_formats;
+        if(!line_stream || num_color_formats > entry.variant.color_attachment_formats.max_size()) {
+            logger->warn("Skipping malformed PSO manifest line {}", line);
+            continue;
+        }
+
+        entry.variant.use_fragment_shading_rate_attachment = use_shading_rate_image != 0;
+        entry.variant.depth_attachment_format = static_cast<VkFormat>(depth_format);
+        for(auto i = 0u; i < num_color_formats; i++) {
+            auto color_format = 0u;
+            line_stream >> color_format;
+            entry.variant.color_attachment_formats.push_back(static_cast<VkFormat>(color_format));
+        }
+
+        line_stream >> std::ws;
+        std::getline(line_stream, entry.pipeline_name);
+        if(!line_stream || entry.pipeline_name.empty()) {
+            logger->warn("Skipping malformed PSO manifest line {}", line);
+            continue;
+        }
+
+        manifest.emplace_back(std::move(entry));
+    }
+
+    logger->info("Loaded {} PSO variants from the manifest", manifest.size());
+}
+
+void PipelineCache::save_manifest() {
+    auto manifest_text = std::string{};
+
+    for(const auto& pipeline : pipelines) {
+        // We find pipelines by name on the next run
+        if(pipeline.name.empty()) {
+            continue;
+        }
+
+        for(const auto& [variant, vk_pipeline] : pipeline.variants) {
+            if(vk_pipeline == VK_NULL_HANDLE) {
+                continue;
+            }
+
+            manifest_text += fmt::format(
+                "{} {} {} {}",
+                variant.view_mask,
+                variant.use_fragment_shading_rate_attachment ? 1 : 0,
+                static_cast<uint32_t>(variant.depth_attachment_format),
+                variant.color_attachment_formats.size());
+            for(const auto format : variant.color_attachment_formats) {
+                manifest_text += fmt::format(" {}", static_cast<uint32_t>(format));
+            }
+            manifest_text += fmt::format(" {}\n", pipeline.name);
+        }
+    }
+
+    SystemInterface::get().write_file(
+        PSO_MANIFEST_PATH,
+        manifest_text.data(),
+        static_cast<uint32_t>(manifest_text.size()));
+}
+
+void PipelineCache::warm_up_pipeline(const GraphicsPipelineHandle pipeline) {
+    if(cvar_warm_up.Get() == 0 || pipeline->name.empty()) {
+        return;
+    }
+
+    auto lock = std::unique_lock{variant_mutex};
+    for(const auto& entry : manifest) {
+        if(entry.pipeline_name != pipeline->name) {
+            continue;
+        }
+
+        // Several pipelines may share a name. Don't compile the same variant twice
+        const auto is_queued = eastl::any_of(
+            pipeline->variants.begin(),
+            pipeline->variants.end(),
+            [&](const auto& existing) { return existing.first == entry.variant; });
+        if(!is_queued) {
+            queue_compile_job(pipeline, entry.variant);
+        }
+    }
+}
+
+void PipelineCache::queue_compile_job(const GraphicsPipelineHandle pipeline, const GraphicsPipelineVariant& variant) {
+    pipeline->variants.emplace_back(variant, VK_NULL_HANDLE);
+
+    {
+        auto lock = std::unique_lock{compile_job_mutex};
+        compile_jobs.push_back(CompileJob{.pipeline = pipeline, .variant = variant});
+    }
+    compile_job_condition.notify_one();
+}
+
+void PipelineCache::run_compile_thread(const VkPipelineCache thread_cache) {
+    tracy::SetThreadName("PSO compile");
+
+    while(true) {
+        auto job = CompileJob{};
+        {
+            auto lock = std::unique_lock{compile_job_mutex};
+            compile_job_condition.wait(lock, [&] { return should_stop_compile_threads || !compile_jobs.empty(); });
+            if(should_stop_compile_threads) {
+                return;
+            }
+
+            job = std::move(compile_jobs.front());
+            compile_jobs.pop_front();
+            running_job_pipelines.push_back(job.pipeline);
+        }
+
+        {
+            ZoneScopedN("Compile PSO");
+            ZoneText(job.pipeline->name.c_str(), job.pipeline->name.size());
+
+            if(job.libraries) {
+                // The variant already has a fast-linked PSO. Swap in the optimized PSO between frames
+                const auto vk_pipeline = link_pipeline_libraries(
+                    *job.pipeline,
+                    job.variant,
+                    *job.libraries,
+                    thread_cache,
+                    true);
+                if(vk_pipeline != VK_NULL_HANDLE) {
+                    auto lock = std::unique_lock{optimized_pipeline_mutex};
+                    optimized_pipelines.emplace_back(
+                        OptimizedPipeline{
+                            .pipeline = job.pipeline,
+                            .variant = job.variant,
+                            .vk_pipeline = vk_pipeline
+                        });
+                }
+            } else {
+                const auto vk_pipeline = compile_variant(*job.pipeline, job.variant, thread_cache, true);
+                if(vk_pipeline != VK_NULL_HANDLE) {
+                    add_variant(job.pipeline, job.variant, vk_pipeline);
+                } else {
+                    remove_failed_variant(job.pipeline, job.variant);
+                }
+            }
+        }
+
+        {
+            auto lock = std::unique_lock{compile_job_mutex};
+            running_job_pipelines.erase(
+                eastl::find(running_job_pipelines.begin(), running_job_pipelines.end(), job.pipeline));
+        }
+        compile_job_finished_condition.notify_all();
+    }
+}
+
+VkPipeline PipelineCache::compile_variant(
+    const GraphicsPipeline& pipeline, const GraphicsPipelineVariant& variant, const VkPipelineCache vk_cache,
+    const bool is_background_compile
+) {
+    auto stages = GraphicsShaderStages{};
+    stages.add(pipeline.vertex_shader, VK_SHADER_STAGE_VERTEX_BIT);
+    stages.add(pipeline.geometry_shader, VK_SHADER_STAGE_GEOMETRY_BIT);
+    stages.add(pipeline.fragment_shader, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+    // ReSharper disable CppVariableCanBeMadeConstexpr
+    const auto vertex_input_stage = VkPipelineVertexInputStateCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = static_cast<uint32_t>(pipeline.vertex_inputs.size()),
+        .pVertexBindingDescriptions = pipeline.vertex_inputs.data(),
+        .vertexAttributeDescriptionCount = static_cast<uint32_t>(pipeline.vertex_attributes.size()),
+        .pVertexAttributeDescriptions = pipeline.vertex_attributes.data(),
+    };
+
+    const auto input_assembly_state = VkPipelineInputAssemblyStateCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = pipeline.topology,
+    };
+
+    const auto color_blend_state = VkPipelineColorBlendStateCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .flags = pipeline.blend_flags,
+        .attachmentCount = static_cast<uint32_t>(pipeline.blends.size()),
+        .pAttachments = pipeline.blends.data(),
+    };
+
+    auto rendering_info = VkPipelineRenderingCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .viewMask = variant.view_mask,
+        .colorAttachmentCount = static_cast<uint32_t>(variant.color_attachment_formats.size()),
+        .pColorAttachmentFormats = variant.color_attachment_formats.data(),
+        .depthAttachmentFormat = variant.depth_attachment_format,
+    };
+    // ReSharper restore CppVariableCanBeMadeConstexpr
+
+    auto create_info = VkGraphicsPipelineCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &rendering_info,
+
+        .flags = pipeline.flags,
+
+        .stageCount = static_cast<uint32_t>(stages.stages.size()),
+        .pStages = stages.stages.data(),
+
+        .pVertexInputState = &vertex_input_stage,
+        .pInputAssemblyState = &input_assembly_state,
 
-    pipeline.name = shader_file_path.string();
-    pipeline.push_constant_stages = VK_SHADER_STAGE_COMPUTE_BIT;
+        .pViewportState = &graphics_viewport_state,
 
-    eastl::fixed_vector<VkPushConstantRange, 4> push_constants;
-    collect_bindings(
-        instructions,
-        pipeline.name,
-        VK_SHADER_STAGE_COMPUTE_BIT,
-        pipeline.descriptor_sets,
-        push_constants);
+        .pRasterizationState = &pipeline.raster_state,
+        .pMultisampleState = &graphics_multisample_state,
 
-    // Find the greatest offset + size in the push constant ranges, assume that every other push constant is used
-    for(const auto& range : push_constants) {
-        const auto max_used_byte = range.offset + range.size;
-        pipeline.num_push_constants = std::max(pipeline.num_push_constants, max_used_byte / 4u);
-    }
+        .pDepthStencilState = &pipeline.depth_stencil_state,
 
-    pipeline.create_pipeline_layout(backend, pipeline.descriptor_sets, push_constants);
+        .pColorBlendState = &color_blend_state,
 
-    logger->trace("Created pipeline layout");
+        .pDynamicState = &graphics_dynamic_state,
 
-    const auto create_info = VkComputePipelineCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-        .stage = VkPipelineShaderStageCreateInfo{
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .pNext = &module_create_info,
-            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-            .pName = "main",
-        },
         .layout = pipeline.layout
     };
 
-    auto result = vkCreateComputePipelines(
-        backend.get_device(),
-        VK_NULL_HANDLE,
+    if(variant.use_fragment_shading_rate_attachment) {
+        create_info.flags |= VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+        rendering_info.pNext = &graphics_shading_rate_state;
+    }
+
+    const auto& device = backend.get_device();
+    logger->trace("About to compile PSO {}", pipeline.name);
+    const auto start_time = std::chrono::steady_clock::now();
+    auto vk_pipeline = VkPipeline{VK_NULL_HANDLE};
+    const auto result = vkCreateGraphicsPipelines(
+        device,
+        vk_cache,
         1,
         &create_info,
         nullptr,
-        &pipeline.pipeline);
+        &vk_pipeline
+    );
     if(result != VK_SUCCESS) {
-        logger->error("Could not create pipeline {}: Vulkan error {}", shader_file_path.string(), result);
-        return {};
+        logger->error("Could not create pipeline {}: {}", pipeline.name, string_VkResult(result));
+        return VK_NULL_HANDLE;
     }
 
-    logger->trace("Created pipeline");
+    const auto compile_time = std::chrono::duration<double, std::milli>{std::chrono::steady_clock::now() - start_time};
+    record_compile_time(pipeline.name, PipelineKind::Graphics, compile_time.count(), is_background_compile);
 
-    const auto layout_name = fmt::format("{} Layout", shader_file_path.string());
+    if(!pipeline.name.empty()) {
+        backend.set_object_name(vk_pipeline, pipeline.name);
+    }
 
-    backend.set_object_name(pipeline.pipeline, pipeline.name);
-    backend.set_object_name(pipeline.layout, layout_name);
+    return vk_pipeline;
+}
 
-    logger->trace("Named pipeline and pipeline layout");
+void PipelineCache::add_variant(
+    const GraphicsPipelineHandle pipeline, const GraphicsPipelineVariant& variant, const VkPipeline vk_pipeline
+) {
+    auto lock = std::unique_lock{variant_mutex};
 
-    return &(*compute_pipelines.emplace(std::move(pipeline)));
-}
+    if(pipeline->pipeline == VK_NULL_HANDLE) {
+        pipeline->pipeline = vk_pipeline;
+    }
 
-GraphicsPipelineHandle PipelineCache::create_pipeline_group(const std::span<GraphicsPipelineHandle> pipelines_in) {
-    auto graphics_pipeline = GraphicsPipeline{};
+    for(auto& [existing_variant, existing_pipeline] : pipeline->variants) {
+        if(existing_variant == variant) {
+            existing_pipeline = vk_pipeline;
+            return;
+        }
+    }
 
-    auto vk_pipelines = eastl::vector<VkPipeline>{};
-    vk_pipelines.reserve(pipelines_in.size());
-    for(const auto& pipeline : pipelines_in) {
-        vk_pipelines.emplace_back(pipeline->pipeline);
+    pipeline->variants.emplace_back(variant, vk_pipeline);
+}
+
+void PipelineCache::remove_failed_variant(
+    const GraphicsPipelineHandle pipeline, const GraphicsPipelineVariant& variant
+) {
+    auto lock = std::unique_lock{variant_mutex};
+
+    // Drop the placeholder, so that the next bind compiles the variant on the recording thread rather than skipping
+    // its draws forever
+    const auto itr = eastl::find_if(
+        pipeline->variants.begin(),
+        pipeline->variants.end(),
+        [&](const auto& existing) { return existing.first == variant && existing.second == VK_NULL_HANDLE; });
+    if(itr != pipeline->variants.end()) {
+        pipeline->variants.erase(itr);
     }
-    const auto group_info = VkGraphicsPipelineShaderGroupsCreateInfoNV{
-        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_SHADER_GROUPS_CREATE_INFO_NV,
-        .pipelineCount = static_cast<uint32_t>(pipelines_in.size()),
-        .pPipelines = vk_pipelines.data()
-    };
-    const auto create_info = VkGraphicsPipelineCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
 
-        .pNext = &group_info,
-    };
-    vkCreateGraphicsPipelines(
-        backend.get_device(),
-        vk_pipeline_cache,
-        1,
-        &create_info,
-        nullptr,
-        &graphics_pipeline.pipeline);
+    pipeline->has_failed_background_compile = true;
 
-    return &(*pipelines.emplace(std::move(graphics_pipeline)));
+    logger->warn("Background compile of PSO {} failed. Compiling it when it's next bound instead", pipeline->name);
 }
 
-VkPipeline PipelineCache::get_pipeline(
-    GraphicsPipelineHandle pipeline, std::span<const VkFormat> color_attachment_formats,
-    std::optional<VkFormat> depth_format, const uint32_t view_mask, const bool use_fragment_shading_rate_attachment
-) const {
+void PipelineCache::apply_optimized_pipelines() {
+    auto pipelines_to_apply = eastl::vector<OptimizedPipeline>{};
+    {
+        auto lock = std::unique_lock{optimized_pipeline_mutex};
+        if(optimized_pipelines.empty()) {
+            return;
+        }
+        eastl::swap(pipelines_to_apply, optimized_pipelines);
+    }
 
     ZoneScoped;
 
-    if(pipeline->pipeline != VK_NULL_HANDLE) {
-        return pipeline->pipeline;
+    auto lock = std::unique_lock{variant_mutex};
+    for(const auto& optimized : pipelines_to_apply) {
+        auto& variants = optimized.pipeline->variants;
+        const auto itr = eastl::find_if(
+            variants.begin(),
+            variants.end(),
+            [&](const auto& existing) { return existing.first == optimized.variant; });
+        if(itr == variants.end()) {
+            destroy_pipeline_later(optimized.vk_pipeline);
+            continue;
+        }
+
+        if(optimized.pipeline->pipeline == itr->second) {
+            optimized.pipeline->pipeline = optimized.vk_pipeline;
+        }
+
+        // In-flight frames may have recorded draws with the fast-linked PSO
+        destroy_pipeline_later(itr->second);
+        itr->second = optimized.vk_pipeline;
     }
 
-    auto stages = eastl::vector<VkPipelineShaderStageCreateInfo>{};
-    stages.reserve(3);
+    logger->trace("Swapped in {} optimized PSOs", pipelines_to_apply.size());
+}
 
-    const auto vertex_module = VkShaderModuleCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = static_cast<uint32_t>(pipeline->vertex_shader.size()),
-        .pCode = reinterpret_cast<const uint32_t*>(pipeline->vertex_shader.data()),
-    };
+bool PipelineCache::should_use_pipeline_libraries(const GraphicsPipeline& pipeline) const {
+    // DGC pipeline groups are built from the pipelines' main PSOs, which must be monolithic
+    return cvar_pipeline_libraries.Get() != 0 &&
+        backend.supports_graphics_pipeline_library() &&
+        (pipeline.flags & VK_PIPELINE_CREATE_INDIRECT_BINDABLE_BIT_NV) == 0;
+}
 
-    stages.emplace_back(
-        VkPipelineShaderStageCreateInfo{
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .pNext = &vertex_module,
-            .stage = VK_SHADER_STAGE_VERTEX_BIT,
-            .pName = "main",
-        });
+VkPipeline PipelineCache::link_variant(const GraphicsPipelineHandle pipeline, const GraphicsPipelineVariant& variant) {
+    ZoneScoped;
 
-    VkShaderModuleCreateInfo geometry_module;
-    if(!pipeline->geometry_shader.empty()) {
-        geometry_module = VkShaderModuleCreateInfo{
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .codeSize = static_cast<uint32_t>(pipeline->geometry_shader.size()),
-            .pCode = reinterpret_cast<const uint32_t*>(pipeline->geometry_shader.data()),
-        };
+    const auto libraries = get_pipeline_libraries(*pipeline, variant);
+    if(!libraries) {
+        return VK_NULL_HANDLE;
+    }
 
-        stages.emplace_back(
-            VkPipelineShaderStageCreateInfo{
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                .pNext = &geometry_module,
-                .stage = VK_SHADER_STAGE_GEOMETRY_BIT,
-                .pName = "main",
-            });
+    const auto vk_pipeline = link_pipeline_libraries(
+        *pipeline,
+        variant,
+        *libraries,
+        vk_pipeline_caches[static_cast<uint32_t>(PipelineKind::Graphics)],
+        false);
+    if(vk_pipeline == VK_NULL_HANDLE) {
+        return VK_NULL_HANDLE;
     }
 
-    VkShaderModuleCreateInfo fragment_module;
-    if(!pipeline->fragment_shader.empty()) {
-        fragment_module = VkShaderModuleCreateInfo{
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .codeSize = static_cast<uint32_t>(pipeline->fragment_shader.size()),
-            .pCode = reinterpret_cast<const uint32_t*>(pipeline->fragment_shader.data()),
-        };
+    add_variant(pipeline, variant, vk_pipeline);
 
-        stages.emplace_back(
-            VkPipelineShaderStageCreateInfo{
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                .pNext = &fragment_module,
-                .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-                .pName = "main",
-            });
+    {
+        auto lock = std::unique_lock{compile_job_mutex};
+        compile_jobs.push_back(CompileJob{.pipeline = pipeline, .variant = variant, .libraries = libraries});
+    }
+    compile_job_condition.notify_one();
+
+    return vk_pipeline;
+}
+
+tl::optional<PipelineCache::PipelineLibraries> PipelineCache::get_pipeline_libraries(
+    GraphicsPipeline& pipeline, const GraphicsPipelineVariant& variant
+) {
+    auto lock = std::unique_lock{library_mutex};
+
+    auto libraries = PipelineLibraries{};
+
+    auto vertex_input_key = eastl::string{};
+    append_to_key(vertex_input_key, pipeline.flags);
+    append_to_key(vertex_input_key, pipeline.topology);
+    append_to_key(vertex_input_key, pipeline.vertex_inputs);
+    append_to_key(vertex_input_key, pipeline.vertex_attributes);
+    if(const auto itr = vertex_input_libraries.find(vertex_input_key); itr != vertex_input_libraries.end()) {
+        libraries[0] = itr->second;
+    } else {
+        libraries[0] = create_vertex_input_library(pipeline);
+        if(libraries[0] == VK_NULL_HANDLE) {
+            return tl::nullopt;
+        }
+        vertex_input_libraries.emplace(vertex_input_key, libraries[0]);
+    }
+
+    auto shader_itr = eastl::find_if(
+        pipeline.shader_libraries.begin(),
+        pipeline.shader_libraries.end(),
+        [&](const GraphicsPipelineShaderLibraries& existing) {
+            return existing.view_mask == variant.view_mask &&
+                existing.use_fragment_shading_rate_attachment == variant.use_fragment_shading_rate_attachment;
+        });
+    if(shader_itr == pipeline.shader_libraries.end()) {
+        const auto shader_libraries = create_shader_libraries(pipeline, variant);
+        if(!shader_libraries) {
+            return tl::nullopt;
+        }
+        shader_itr = &pipeline.shader_libraries.emplace_back(*shader_libraries);
+    }
+    libraries[1] = shader_itr->pre_rasterization;
+    libraries[2] = shader_itr->fragment_shader;
+
+    auto fragment_output_key = eastl::string{};
+    append_to_key(fragment_output_key, pipeline.flags);
+    append_to_key(fragment_output_key, variant.color_attachment_formats);
+    append_to_key(fragment_output_key, variant.depth_attachment_format);
+    append_to_key(fragment_output_key, variant.view_mask);
+    append_to_key(fragment_output_key, variant.use_fragment_shading_rate_attachment);
+    append_to_key(fragment_output_key, pipeline.blend_flags);
+    append_to_key(fragment_output_key, pipeline.blends);
+    if(const auto itr = fragment_output_libraries.find(fragment_output_key); itr != fragment_output_libraries.end()) {
+        libraries[3] = itr->second;
+    } else {
+        libraries[3] = create_fragment_output_library(pipeline, variant);
+        if(libraries[3] == VK_NULL_HANDLE) {
+            return tl::nullopt;
+        }
+        fragment_output_libraries.emplace(fragment_output_key, libraries[3]);
     }
 
+    return libraries;
+}
+
+VkPipeline PipelineCache::create_vertex_input_library(const GraphicsPipeline& pipeline) {
     // ReSharper disable CppVariableCanBeMadeConstexpr
     const auto vertex_input_stage = VkPipelineVertexInputStateCreateInfo{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = static_cast<uint32_t>(pipeline->vertex_inputs.size()),
-        .pVertexBindingDescriptions = pipeline->vertex_inputs.data(),
-        .vertexAttributeDescriptionCount = static_cast<uint32_t>(pipeline->vertex_attributes.size()),
-        .pVertexAttributeDescriptions = pipeline->vertex_attributes.data(),
+        .vertexBindingDescriptionCount = static_cast<uint32_t>(pipeline.vertex_inputs.size()),
+        .pVertexBindingDescriptions = pipeline.vertex_inputs.data(),
+        .vertexAttributeDescriptionCount = static_cast<uint32_t>(pipeline.vertex_attributes.size()),
+        .pVertexAttributeDescriptions = pipeline.vertex_attributes.data(),
     };
 
     const auto input_assembly_state = VkPipelineInputAssemblyStateCreateInfo{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = pipeline->topology,
+        .topology = pipeline.topology,
     };
+    // ReSharper restore CppVariableCanBeMadeConstexpr
 
-    const auto viewport_state = VkPipelineViewportStateCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-        .viewportCount = 1,
-        .scissorCount = 1,
-        // Dynamic viewport and scissor state
+    auto create_info = VkGraphicsPipelineCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .flags = pipeline.flags,
+        .pVertexInputState = &vertex_input_stage,
+        .pInputAssemblyState = &input_assembly_state,
     };
 
-    const auto multisample_state = VkPipelineMultisampleStateCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
-    };
+    return create_pipeline_library(
+        pipeline,
+        create_info,
+        VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT);
+}
 
-    const auto color_blend_state = VkPipelineColorBlendStateCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-        .flags = pipeline->blend_flags,
-        .attachmentCount = static_cast<uint32_t>(pipeline->blends.size()),
-        .pAttachments = pipeline->blends.data(),
+tl::optional<GraphicsPipelineShaderLibraries> PipelineCache::create_shader_libraries(
+    const GraphicsPipeline& pipeline, const GraphicsPipelineVariant& variant
+) {
+    auto rendering_info = VkPipelineRenderingCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .viewMask = variant.view_mask,
     };
 
-    const auto dynamic_states = eastl::array{
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR,
-        VK_DYNAMIC_STATE_FRONT_FACE,
-        VK_DYNAMIC_STATE_CULL_MODE
+    auto flags = pipeline.flags;
+    if(variant.use_fragment_shading_rate_attachment) {
+        flags |= VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+        rendering_info.pNext = &graphics_shading_rate_state;
+    }
+
+    auto libraries = GraphicsPipelineShaderLibraries{
+        .view_mask = variant.view_mask,
+        .use_fragment_shading_rate_attachment = variant.use_fragment_shading_rate_attachment,
     };
 
-    const auto dynamic_state = VkPipelineDynamicStateCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-        .dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
-        .pDynamicStates = dynamic_states.data(),
+    {
+        auto stages = GraphicsShaderStages{};
+        stages.add(pipeline.vertex_shader, VK_SHADER_STAGE_VERTEX_BIT);
+        stages.add(pipeline.geometry_shader, VK_SHADER_STAGE_GEOMETRY_BIT);
+
+        auto create_info = VkGraphicsPipelineCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .pNext = &rendering_info,
+            .flags = flags,
+            .stageCount = static_cast<uint32_t>(stages.stages.size()),
+            .pStages = stages.stages.data(),
+            .pViewportState = &graphics_viewport_state,
+            .pRasterizationState = &pipeline.raster_state,
+            .pDynamicState = &graphics_dynamic_state,
+            .layout = pipeline.layout
+        };
+
+        libraries.pre_rasterization = create_pipeline_library(
+            pipeline,
+            create_info,
+            VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+        if(libraries.pre_rasterization == VK_NULL_HANDLE) {
+            return tl::nullopt;
+        }
+    }
+
+    {
+        // Depth-only pipelines have no fragment shader, but they still need the fragment shader state
+        auto stages = GraphicsShaderStages{};
+        stages.add(pipeline.fragment_shader, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+        auto create_info = VkGraphicsPipelineCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .pNext = &rendering_info,
+            .flags = flags,
+            .stageCount = static_cast<uint32_t>(stages.stages.size()),
+            .pStages = stages.stages.data(),
+            .pMultisampleState = &graphics_multisample_state,
+            .pDepthStencilState = &pipeline.depth_stencil_state,
+            .layout = pipeline.layout
+        };
+
+        libraries.fragment_shader = create_pipeline_library(
+            pipeline,
+            create_info,
+            VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+        if(libraries.fragment_shader == VK_NULL_HANDLE) {
+            vkDestroyPipeline(backend.get_device(), libraries.pre_rasterization, nullptr);
+            return tl::nullopt;
+        }
+    }
+
+    return libraries;
+}
+
+VkPipeline PipelineCache::create_fragment_output_library(
+    const GraphicsPipeline& pipeline, const GraphicsPipelineVariant& variant
+) {
+    // ReSharper disable CppVariableCanBeMadeConstexpr
+    const auto color_blend_state = VkPipelineColorBlendStateCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .flags = pipeline.blend_flags,
+        .attachmentCount = static_cast<uint32_t>(pipeline.blends.size()),
+        .pAttachments = pipeline.blends.data(),
     };
 
-    auto rendering_info = VkPipelineRenderingCreateInfo{
+    const auto rendering_info = VkPipelineRenderingCreateInfo{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
-        .viewMask = view_mask,
-        .colorAttachmentCount = static_cast<uint32_t>(color_attachment_formats.size()),
-        .pColorAttachmentFormats = color_attachment_formats.data(),
-        .depthAttachmentFormat = depth_format.value_or(VK_FORMAT_UNDEFINED),
+        .viewMask = variant.view_mask,
+        .colorAttachmentCount = static_cast<uint32_t>(variant.color_attachment_formats.size()),
+        .pColorAttachmentFormats = variant.color_attachment_formats.data(),
+        .depthAttachmentFormat = variant.depth_attachment_format,
     };
     // ReSharper restore CppVariableCanBeMadeConstexpr
 
     auto create_info = VkGraphicsPipelineCreateInfo{
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
         .pNext = &rendering_info,
+        .flags = pipeline.flags,
+        .pMultisampleState = &graphics_multisample_state,
+        .pColorBlendState = &color_blend_state,
+    };
+    if(variant.use_fragment_shading_rate_attachment) {
+        create_info.flags |= VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+    }
 
-        .flags = pipeline->flags,
-
-        .stageCount = static_cast<uint32_t>(stages.size()),
-        .pStages = stages.data(),
+    return create_pipeline_library(
+        pipeline,
+        create_info,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT);
+}
 
-        .pVertexInputState = &vertex_input_stage,
-        .pInputAssemblyState = &input_assembly_state,
+VkPipeline PipelineCache::link_pipeline_libraries(
+    const GraphicsPipeline& pipeline, const GraphicsPipelineVariant& variant, const PipelineLibraries& libraries,
+    const VkPipelineCache vk_cache, const bool optimize
+) {
+    const auto library_info = VkPipelineLibraryCreateInfoKHR{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+        .libraryCount = static_cast<uint32_t>(libraries.size()),
+        .pLibraries = libraries.data(),
+    };
 
-        .pViewportState = &viewport_state,
+    auto create_info = VkGraphicsPipelineCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &library_info,
+        .flags = pipeline.flags,
+        .layout = pipeline.layout
+    };
+    if(optimize) {
+        create_info.flags |= VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+    }
+    if(variant.use_fragment_shading_rate_attachment) {
+        create_info.flags |= VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+    }
 
-        .pRasterizationState = &pipeline->raster_state,
-        .pMultisampleState = &multisample_state,
+    const auto start_time = std::chrono::steady_clock::now();
+    auto vk_pipeline = VkPipeline{VK_NULL_HANDLE};
+    const auto result = vkCreateGraphicsPipelines(
+        backend.get_device(),
+        vk_cache,
+        1,
+        &create_info,
+        nullptr,
+        &vk_pipeline);
+    if(result != VK_SUCCESS) {
+        logger->error("Could not link pipeline {}: {}", pipeline.name, string_VkResult(result));
+        return VK_NULL_HANDLE;
+    }
 
-        .pDepthStencilState = &pipeline->depth_stencil_state,
+    const auto link_time = std::chrono::duration<double, std::milli>{std::chrono::steady_clock::now() - start_time};
+    record_compile_time(pipeline.name, PipelineKind::Graphics, link_time.count(), optimize);
 
-        .pColorBlendState = &color_blend_state,
+    if(!pipeline.name.empty()) {
+        backend.set_object_name(vk_pipeline, pipeline.name);
+    }
 
-        .pDynamicState = &dynamic_state,
+    return vk_pipeline;
+}
 
-        .layout = pipeline->layout
+VkPipeline PipelineCache::create_pipeline_library(
+    const GraphicsPipeline& pipeline, VkGraphicsPipelineCreateInfo& create_info,
+    const VkGraphicsPipelineLibraryFlagsEXT library_flags
+) {
+    const auto library_info = VkGraphicsPipelineLibraryCreateInfoEXT{
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+        .pNext = create_info.pNext,
+        .flags = library_flags,
     };
+    create_info.pNext = &library_info;
 
-    auto shading_rate_create_info = VkPipelineFragmentShadingRateStateCreateInfoKHR{};
-    if(use_fragment_shading_rate_attachment) {
-        create_info.flags |= VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
-
-        shading_rate_create_info = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_FRAGMENT_SHADING_RATE_STATE_CREATE_INFO_KHR,
-            .pNext = nullptr,
-            .fragmentSize = {1, 1},
-            .combinerOps = {
-                VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR, VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR
-            }
-        };
-        rendering_info.pNext = &shading_rate_create_info;
-    }
+    // Keep the information that the optimized link needs
+    create_info.flags |= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR |
+        VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
 
-    const auto& device = backend.get_device();
-    logger->trace("About to compile PSO {}", pipeline->name);
+    auto library = VkPipeline{VK_NULL_HANDLE};
     const auto result = vkCreateGraphicsPipelines(
-        device,
-        vk_pipeline_cache,
+        backend.get_device(),
+        vk_pipeline_caches[static_cast<uint32_t>(PipelineKind::Graphics)],
         1,
         &create_info,
         nullptr,
-        &pipeline->pipeline
-    );
+        &library);
     if(result != VK_SUCCESS) {
-        logger->error("Could not create pipeline {}: {}", pipeline->name, string_VkResult(result));
+        logger->error("Could not create pipeline library for {}: {}", pipeline.name, string_VkResult(result));
+        return VK_NULL_HANDLE;
+    }
+
+    return library;
+}
+
+void PipelineCache::destroy_shader_libraries_later(GraphicsPipeline& pipeline) {
+    for(const auto& libraries : pipeline.shader_libraries) {
+        destroy_pipeline_later(libraries.pre_rasterization);
+        destroy_pipeline_later(libraries.fragment_shader);
+    }
+    pipeline.shader_libraries.clear();
+}
+
+void PipelineCache::record_compile_time(
+    const std::string_view name, const PipelineKind kind, const double milliseconds, const bool is_background_compile
+) {
+    logger->debug(
+        "Compiled {} PSO {} in {:.2f} ms{}",
+        magic_enum::enum_name(kind),
+        name,
+        milliseconds,
+        is_background_compile ? " in the background" : "");
+
+    auto lock = std::unique_lock{timing_mutex};
+    compile_timings.push_back(
+        PipelineCompileTiming{
+            .name = std::string{name},
+            .kind = kind,
+            .milliseconds = milliseconds,
+            .was_background_compile = is_background_compile
+        });
+}
+
+void PipelineCache::report_startup_times() const {
+    const auto timings = get_compile_timings();
+
+    logger->info("Loaded pipeline caches in {:.2f} ms", cache_load_time_ms);
+
+    for(const auto kind : magic_enum::enum_values<PipelineKind>()) {
+        auto num_pipelines = 0u;
+        auto total_ms = 0.0;
+        for(const auto& timing : timings) {
+            if(timing.kind == kind) {
+                num_pipelines++;
+                total_ms += timing.milliseconds;
+            }
+        }
+
+        logger->info(
+            "{} pipelines: {} cache, compiled {} PSOs in {:.2f} ms",
+            magic_enum::enum_name(kind),
+            is_cache_warm[static_cast<uint32_t>(kind)] ? "warm" : "cold",
+            num_pipelines,
+            total_ms);
+    }
+}
+
+std::string PipelineCache::make_cache_key() const {
+    const auto& physical_device = backend.get_physical_device();
+
+    auto id_properties = VkPhysicalDeviceIDProperties{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES
+    };
+    auto properties = VkPhysicalDeviceProperties2{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &id_properties
+    };
+    vkGetPhysicalDeviceProperties2(physical_device.physical_device, &properties);
+
+    // Driver updates change the driver UUID and usually the pipeline cache UUID, so old caches are never loaded
+    auto key_data = eastl::array<uint8_t, VK_UUID_SIZE * 3>{};
+    std::memcpy(key_data.data(), id_properties.deviceUUID, VK_UUID_SIZE);
+    std::memcpy(key_data.data() + VK_UUID_SIZE, id_properties.driverUUID, VK_UUID_SIZE);
+    std::memcpy(key_data.data() + VK_UUID_SIZE * 2, properties.properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    return fmt::format("{:016x}", CityHash64(reinterpret_cast<const char*>(key_data.data()), key_data.size()));
+}
+
+std::filesystem::path PipelineCache::get_cache_path(const PipelineKind kind) const {
+    // Flat paths, because not every platform's write_file creates directories
+    return fmt::format("cache/pipeline_cache_{}_{}", cache_key, magic_enum::enum_name(kind));
+}
+
+tl::optional<eastl::vector<std::byte>> PipelineCache::load_cache_data(const PipelineKind kind) const {
+    const auto path = get_cache_path(kind);
+    auto file_data = SystemInterface::get().load_file(path);
+    if(!file_data) {
+        logger->info("No {} pipeline cache at {}, starting cold", magic_enum::enum_name(kind), path.string());
+        return tl::nullopt;
+    }
+
+    if(file_data->size() < sizeof(PipelineCacheFileHeader)) {
+        logger->warn("{} is too small to be a pipeline cache, ignoring it", path.string());
+        return tl::nullopt;
+    }
+
+    auto header = PipelineCacheFileHeader{};
+    std::memcpy(&header, file_data->data(), sizeof(PipelineCacheFileHeader));
+
+    const auto* cache_data = reinterpret_cast<const char*>(file_data->data()) + sizeof(PipelineCacheFileHeader);
+    const auto cache_size = file_data->size() - sizeof(PipelineCacheFileHeader);
+    if(header.magic != PipelineCacheFileHeader::MAGIC ||
+        header.data_size != cache_size ||
+        header.data_hash != CityHash64(cache_data, cache_size)) {
+        logger->warn("Pipeline cache {} is corrupt, ignoring it", path.string());
+        return tl::nullopt;
+    }
+
+    // The driver validates this too, but some drivers are better at it than others
+    const auto& physical_device = backend.get_physical_device();
+    auto vk_header = VkPipelineCacheHeaderVersionOne{};
+    if(cache_size < sizeof(VkPipelineCacheHeaderVersionOne)) {
+        return tl::nullopt;
+    }
+    std::memcpy(&vk_header, cache_data, sizeof(VkPipelineCacheHeaderVersionOne));
+    if(vk_header.vendorID != physical_device.properties.vendorID ||
+        vk_header.deviceID != physical_device.properties.deviceID ||
+        std::memcmp(vk_header.pipelineCacheUUID, physical_device.properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        logger->warn("Pipeline cache {} is for a different device or driver, ignoring it", path.string());
+        return tl::nullopt;
     }
 
-    if(!pipeline->name.empty()) {
-        backend.set_object_name(pipeline->pipeline, pipeline->name);
+    auto data = eastl::vector<std::byte>(cache_size);
+    std::memcpy(data.data(), cache_data, cache_size);
+    return data;
+}
+
+VkPipelineCache PipelineCache::create_vk_pipeline_cache(const tl::optional<eastl::vector<std::byte>>& data) const {
+    const auto create_info = VkPipelineCacheCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = data ? data->size() : 0,
+        .pInitialData = data ? data->data() : nullptr,
+    };
+
+    auto vk_cache = VkPipelineCache{VK_NULL_HANDLE};
+    const auto result = vkCreatePipelineCache(backend.get_device(), &create_info, nullptr, &vk_cache);
+    if(result != VK_SUCCESS) {
+        logger->error("Could not create pipeline cache: {}", string_VkResult(result));
     }
 
-    return pipeline->pipeline;
+    return vk_cache;
+}
+
+void PipelineCache::save_cache_data(const PipelineKind kind, const VkPipelineCache vk_cache) const {
+    const auto device = backend.get_device();
+
+    auto cache_size = size_t{};
+    vkGetPipelineCacheData(device, vk_cache, &cache_size, nullptr);
+
+    auto file_data = eastl::vector<uint8_t>(sizeof(PipelineCacheFileHeader) + cache_size);
+    auto* cache_data = file_data.data() + sizeof(PipelineCacheFileHeader);
+    vkGetPipelineCacheData(device, vk_cache, &cache_size, cache_data);
+
+    const auto header = PipelineCacheFileHeader{
+        .magic = PipelineCacheFileHeader::MAGIC,
+        .data_size = cache_size,
+        .data_hash = CityHash64(reinterpret_cast<const char*>(cache_data), cache_size)
+    };
+    std::memcpy(file_data.data(), &header, sizeof(PipelineCacheFileHeader));
+
+    SystemInterface::get().write_file(
+        get_cache_path(kind),
+        file_data.data(),
+        static_cast<uint32_t>(sizeof(PipelineCacheFileHeader) + cache_size));
 }
 
 void PipelineCache::add_miss_shaders(
@@ -426,12 +1755,25 @@ static uint32_t round_up(const uint32_t num, const uint32_t multiple) {
 
 RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
     const std::filesystem::path& raygen_shader_path, bool skip_gi_miss_shader
+) {
+    auto pipeline = build_ray_tracing_pipeline(raygen_shader_path, skip_gi_miss_shader);
+    if(!pipeline) {
+        return nullptr;
+    }
+
+    return &(*ray_tracing_pipelines.emplace(std::move(*pipeline)));
+}
+
+tl::optional<RayTracingPipeline> PipelineCache::build_ray_tracing_pipeline(
+    const std::filesystem::path& raygen_shader_path, const bool skip_gi_miss_shader
 ) {
     ZoneScoped;
 
     logger->debug("Creating RT PSO {}", raygen_shader_path.string());
 
     auto pipeline = RayTracingPipeline{};
+    pipeline.raygen_shader_path = raygen_shader_path.string();
+    pipeline.skip_gi_miss_shader = skip_gi_miss_shader;
 
     const auto& device = backend.get_device();
 
@@ -476,7 +1818,7 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
                     });
 
                 collect_bindings(
-                    occlusion_anyhit_shader,
+                    reflection_cache.get_reflection(occlusion_anyhit_shader),
                     shader_group.name,
                     VK_SHADER_STAGE_ANY_HIT_BIT_KHR,
                     pipeline.descriptor_sets,
@@ -503,7 +1845,7 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
                     });
 
                 collect_bindings(
-                    occlusion_closesthit_shader,
+                    reflection_cache.get_reflection(occlusion_closesthit_shader),
                     shader_group.name,
                     VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
                     pipeline.descriptor_sets,
@@ -549,7 +1891,7 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
                     });
 
                 collect_bindings(
-                    gi_anyhit_shader,
+                    reflection_cache.get_reflection(gi_anyhit_shader),
                     shader_group.name,
                     VK_SHADER_STAGE_ANY_HIT_BIT_KHR,
                     pipeline.descriptor_sets,
@@ -576,7 +1918,7 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
                     });
 
                 collect_bindings(
-                    gi_closesthit_shader,
+                    reflection_cache.get_reflection(gi_closesthit_shader),
                     shader_group.name,
                     VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
                     pipeline.descriptor_sets,
@@ -627,7 +1969,7 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
             });
 
         collect_bindings(
-            occlusion_miss_shader,
+            reflection_cache.get_reflection(occlusion_miss_shader),
             "Occlusion miss shader",
             VK_SHADER_STAGE_MISS_BIT_KHR,
             pipeline.descriptor_sets,
@@ -664,7 +2006,7 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
             });
 
         collect_bindings(
-            gi_miss_shader,
+            reflection_cache.get_reflection(gi_miss_shader),
             "GI miss shader",
             VK_SHADER_STAGE_MISS_BIT_KHR,
             pipeline.descriptor_sets,
@@ -705,7 +2047,7 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
 
     const auto raygen_shader_name = raygen_shader_path.string();
     collect_bindings(
-        *raygen_shader_maybe,
+        reflection_cache.get_reflection(*raygen_shader_maybe),
         std::string_view{raygen_shader_name.c_str()},
         VK_SHADER_STAGE_RAYGEN_BIT_KHR,
         pipeline.descriptor_sets,
@@ -728,6 +2070,7 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
 
     const auto create_info = VkRayTracingPipelineCreateInfoKHR{
         .sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR,
+        .flags = get_descriptor_model_flags(backend),
         .stageCount = static_cast<uint32_t>(stages.size()),
         .pStages = stages.data(),
         .groupCount = static_cast<uint32_t>(groups.size()),
@@ -737,10 +2080,11 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
         .layout = pipeline.layout
     };
 
+    const auto start_time = std::chrono::steady_clock::now();
     auto result = vkCreateRayTracingPipelinesKHR(
         device,
         VK_NULL_HANDLE,
-        vk_pipeline_cache,
+        vk_pipeline_caches[static_cast<uint32_t>(PipelineKind::RayTracing)],
         1,
         &create_info,
         nullptr,
@@ -750,9 +2094,12 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
             "Could not create ray tracing pipeline {}: {}",
             raygen_shader_path.string(),
             string_VkResult(result));
-        return nullptr;
+        return tl::nullopt;
     }
 
+    const auto compile_time = std::chrono::duration<double, std::milli>{std::chrono::steady_clock::now() - start_time};
+    record_compile_time(raygen_shader_path.string(), PipelineKind::RayTracing, compile_time.count(), false);
+
     const auto shader_group_handle_size = backend.get_shader_group_handle_size();
     const auto shader_group_alignment = backend.get_shader_group_alignment();
 
@@ -833,5 +2180,5 @@ RayTracingPipelineHandle PipelineCache::create_ray_tracing_pipeline(
         .size = shader_group_handle_size
     };
 
-    return &(*ray_tracing_pipelines.emplace(std::move(pipeline)));
+    return pipeline;
 }
@@ -1,17 +1,77 @@
 #pragma once
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <span>
+#include <string>
+#include <thread>
 
+#include <EASTL/array.h>
+#include <EASTL/deque.h>
+#include <EASTL/string.h>
+#include <EASTL/unordered_map.h>
+#include <EASTL/unordered_set.h>
+#include <EASTL/vector.h>
 #include <plf_colony.h>
+#include <tl/optional.hpp>
 
 #include "ray_tracing_pipeline.hpp"
 #include "render/backend/hit_group_builder.hpp"
 #include "render/backend/compute_shader.hpp"
+#include "render/backend/constants.hpp"
 #include "render/backend/graphics_pipeline.hpp"
 #include "render/backend/pipeline_builder.hpp"
+#include "render/backend/shader_reflection_cache.hpp"
+#include "render/backend/shader_reloader.hpp"
 
 class RenderBackend;
 
+enum class PipelineKind {
+    Graphics,
+    Compute,
+    RayTracing,
+};
+
+/**
+ * How long one PSO took to compile
+ */
+struct PipelineCompileTiming {
+    std::string name;
+
+    PipelineKind kind = PipelineKind::Graphics;
+
+    double milliseconds = 0;
+
+    /**
+     * Whether the PSO was compiled on a worker thread. If false, something waited for it to compile
+     */
+    bool was_background_compile = false;
+};
+
+/**
+ * Creates and owns all the pipelines
+ *
+ * Graphics PSOs depend on the render pass that they're used in, so we compile them the first time they're bound. To
+ * avoid hitches, the cache records every graphics PSO variant it compiles in a manifest. On the next run, it compiles
+ * the variants in the manifest on worker threads as soon as their pipeline is created. Draws that use a variant that's
+ * still compiling are skipped, rather than waiting for it. CommandBuffer counts skipped draws, so that passes which
+ * cache their output can tell that it's incomplete. If a background compile fails, the variant is compiled on the
+ * recording thread the next time it's bound
+ *
+ * When the device supports VK_EXT_graphics_pipeline_library, we compile each pipeline's shaders once, into
+ * pre-rasterization and fragment shader libraries. Vertex input and fragment output libraries hold no shaders, so
+ * pipelines with the same vertex layout or the same attachment formats and blending share them. A new variant is a
+ * fast link of four libraries. A worker thread then links them again with link-time optimization, and the optimized PSO
+ * replaces the fast-linked one at the start of a later frame
+ *
+ * Each kind of pipeline has its own VkPipelineCache, saved to its own file. Cache files are keyed by the device and
+ * driver, and carry a size and hash so that we don't hand the driver a truncated or corrupt blob
+ *
+ * When the shader source tree is available, the cache also hot-reloads shaders. A ShaderReloader recompiles changed
+ * shaders in the background, and at the start of each frame we rebuild the pipelines that use them. A pipeline is only
+ * rebuilt if its new shaders fit its existing pipeline layout, and it keeps its old PSOs if the rebuild fails
+ */
 class PipelineCache {
 public:
     explicit PipelineCache(RenderBackend& backend_in);
@@ -24,13 +84,35 @@ public:
 
     GraphicsPipelineHandle create_pipeline_group(std::span<GraphicsPipelineHandle> pipelines_in);
 
+    /**
+     * Retrieves the PSO for the given render pass state, compiling it if needed
+     *
+     * Returns VK_NULL_HANDLE if the PSO is compiling on a worker thread. The caller should skip its draws
+     */
     VkPipeline get_pipeline(
         GraphicsPipelineHandle pipeline,
         std::span<const VkFormat> color_attachment_formats,
         std::optional<VkFormat> depth_format = std::nullopt,
         uint32_t view_mask = 0xFF,
         bool use_fragment_shading_rate_attachment = false
-    ) const;
+    );
+
+    ShaderReflectionCache& get_reflection_cache();
+
+    /**
+     * Retrieves how long each PSO took to compile, in the order they finished
+     */
+    eastl::vector<PipelineCompileTiming> get_compile_timings() const;
+
+    /**
+     * Retrieves the number of PSOs waiting for or in the middle of a background compile
+     */
+    uint32_t get_num_pending_compiles() const;
+
+    /**
+     * Logs whether each kind of pipeline started with a warm or cold cache, and how long its PSOs took to compile
+     */
+    void report_startup_times() const;
 
     /**
      * Registers global miss shaders, to be used for all RT pipelines
@@ -45,10 +127,152 @@ public:
 
     RayTracingPipelineHandle create_ray_tracing_pipeline(const std::filesystem::path& raygen_shader_path, bool skip_gi_miss_shader = false);
 
+    /**
+     * Destroys the PSOs that were replaced the last time this frame index was recorded
+     */
+    void free_resources_for_frame(uint32_t frame_idx);
+
+    /**
+     * Rebuilds the pipelines whose shaders were recompiled since the last call. Must be called at the start of a frame,
+     * before anything records commands
+     *
+     * Background compiles of the reloaded graphics pipelines read their old shaders. Queued compiles of those pipelines
+     * are dropped, since the reload compiles every variant itself, and running compiles are waited for. Compiles of
+     * other pipelines carry on
+     */
+    void apply_shader_reloads();
+
+    /**
+     * Replaces fast-linked PSOs with the optimized PSOs that finished linking since the last call. Must be called at the
+     * start of a frame, before anything records commands
+     */
+    void apply_optimized_pipelines();
+
 private:
+    /**
+     * Vertex input, pre-rasterization, fragment shader, and fragment output libraries, in that order
+     */
+    using PipelineLibraries = eastl::array<VkPipeline, 4>;
+
+    /**
+     * A graphics PSO variant that a previous run compiled
+     */
+    struct ManifestEntry {
+        std::string pipeline_name;
+
+        GraphicsPipelineVariant variant;
+    };
+
+    struct CompileJob {
+        GraphicsPipelineHandle pipeline = nullptr;
+
+        GraphicsPipelineVariant variant;
+
+        /**
+         * If set, the job links these libraries with link-time optimization, rather than compiling the variant from
+         * scratch. The variant already has a fast-linked PSO
+         */
+        tl::optional<PipelineLibraries> libraries;
+    };
+
+    /**
+     * A link-time optimized PSO, waiting to replace its variant's fast-linked PSO
+     */
+    struct OptimizedPipeline {
+        GraphicsPipelineHandle pipeline = nullptr;
+
+        GraphicsPipelineVariant variant;
+
+        VkPipeline vk_pipeline = VK_NULL_HANDLE;
+    };
+
+    /**
+     * Header of our pipeline cache files. The driver's cache data follows it
+     */
+    struct PipelineCacheFileHeader {
+        static constexpr uint32_t MAGIC = 0x50434853; // "SHCP"
+
+        uint32_t magic = 0;
+
+        uint32_t padding = 0;
+
+        uint64_t data_size = 0;
+
+        uint64_t data_hash = 0;
+    };
+
     RenderBackend& backend;
 
-    VkPipelineCache vk_pipeline_cache = VK_NULL_HANDLE;
+    /**
+     * Hash of the device and driver UUIDs. Part of the cache file names
+     */
+    std::string cache_key;
+
+    /**
+     * One VkPipelineCache per PipelineKind
+     */
+    eastl::array<VkPipelineCache, 3> vk_pipeline_caches = {};
+
+    eastl::array<bool, 3> is_cache_warm = {};
+
+    /**
+     * Caches for the compile threads. Merged into the graphics cache when we shut down
+     */
+    eastl::vector<VkPipelineCache> thread_pipeline_caches;
+
+    double cache_load_time_ms = 0;
+
+    ShaderReflectionCache reflection_cache;
+
+    eastl::vector<ManifestEntry> manifest;
+
+    /**
+     * Guards the variants of every graphics pipeline
+     */
+    std::mutex variant_mutex;
+
+    mutable std::mutex compile_job_mutex;
+
+    std::condition_variable compile_job_condition;
+
+    /**
+     * Signaled when a compile thread finishes a job
+     */
+    std::condition_variable compile_job_finished_condition;
+
+    eastl::deque<CompileJob> compile_jobs;
+
+    /**
+     * Pipeline of each job that a compile thread is working on
+     */
+    eastl::vector<GraphicsPipelineHandle> running_job_pipelines;
+
+    bool should_stop_compile_threads = false;
+
+    eastl::vector<std::thread> compile_threads;
+
+    /**
+     * Guards the pipeline libraries, including the shader libraries of each graphics pipeline
+     */
+    std::mutex library_mutex;
+
+    /**
+     * Vertex input libraries, by their vertex layout and topology
+     */
+    eastl::unordered_map<eastl::string, VkPipeline> vertex_input_libraries;
+
+    /**
+     * Fragment output libraries, by their attachment formats, view mask, and blend state
+     */
+    eastl::unordered_map<eastl::string, VkPipeline> fragment_output_libraries;
+
+    std::mutex optimized_pipeline_mutex;
+
+    eastl::vector<OptimizedPipeline> optimized_pipelines;
+
+    mutable std::mutex timing_mutex;
+
+    eastl::vector<PipelineCompileTiming> compile_timings;
 
     plf::colony<GraphicsPipeline> pipelines;
 
@@ -61,4 +285,144 @@ private:
     eastl::vector<std::byte> gi_miss_shader;
 
     plf::colony<RayTracingPipeline> ray_tracing_pipelines;
+
+    std::unique_ptr<ShaderReloader> shader_reloader;
+
+    /**
+     * PSOs and layouts that were replaced by a shader reload, but that in-flight frames may still use
+     */
+    eastl::array<eastl::vector<VkPipeline>, num_in_flight_frames> pipeline_zombie_lists;
+
+    eastl::array<eastl::vector<VkPipelineLayout>, num_in_flight_frames> pipeline_layout_zombie_lists;
+
+    void load_manifest();
+
+    void save_manifest();
+
+    /**
+     * Queues background compiles for all the variants of this pipeline that are in the manifest
+     */
+    void warm_up_pipeline(GraphicsPipelineHandle pipeline);
+
+    /**
+     * Adds a placeholder for the variant and queues a compile job for it. Must be called with variant_mutex held
+     */
+    void queue_compile_job(GraphicsPipelineHandle pipeline, const GraphicsPipelineVariant& variant);
+
+    void run_compile_thread(VkPipelineCache thread_cache);
+
+    /**
+     * Compiles a PSO for the variant. Thread-safe, as long as each thread uses its own VkPipelineCache or the main
+     * graphics cache
+     */
+    VkPipeline compile_variant(
+        const GraphicsPipeline& pipeline, const GraphicsPipelineVariant& variant, VkPipelineCache vk_cache,
+        bool is_background_compile
+    );
+
+    /**
+     * Saves a compiled variant in its pipeline, replacing its placeholder if it has one
+     */
+    void add_variant(GraphicsPipelineHandle pipeline, const GraphicsPipelineVariant& variant, VkPipeline vk_pipeline);
+
+    /**
+     * Removes the placeholder of a variant whose background compile failed, and makes the pipeline compile its variants
+     * on the recording thread from now on
+     */
+    void remove_failed_variant(GraphicsPipelineHandle pipeline, const GraphicsPipelineVariant& variant);
+
+    /**
+     * Drops the queued compile jobs of these pipelines, and waits for the compile threads to finish their running jobs
+     * of them. Variants whose compile was dropped lose their placeholder, so they're compiled again when they're next
+     * bound
+     */
+    void drain_compile_jobs(std::span<const GraphicsPipelineHandle> pipelines_to_drain);
+
+    /**
+     * Whether to link this pipeline's variants from pipeline libraries
+     */
+    bool should_use_pipeline_libraries(const GraphicsPipeline& pipeline) const;
+
+    /**
+     * Fast-links a PSO for the variant from pipeline libraries, and queues a link-time optimized link of the same
+     * libraries. Returns VK_NULL_HANDLE if we couldn't build the libraries
+     */
+    VkPipeline link_variant(GraphicsPipelineHandle pipeline, const GraphicsPipelineVariant& variant);
+
+    /**
+     * Finds or builds the libraries for a variant. Returns nullopt if the driver couldn't build one of them
+     */
+    tl::optional<PipelineLibraries> get_pipeline_libraries(
+        GraphicsPipeline& pipeline, const GraphicsPipelineVariant& variant
+    );
+
+    VkPipeline create_vertex_input_library(const GraphicsPipeline& pipeline);
+
+    /**
+     * Compiles the pipeline's shaders into pre-rasterization and fragment shader libraries. Returns nullopt if either
+     * fails to compile
+     */
+    tl::optional<GraphicsPipelineShaderLibraries> create_shader_libraries(
+        const GraphicsPipeline& pipeline, const GraphicsPipelineVariant& variant
+    );
+
+    VkPipeline create_fragment_output_library(const GraphicsPipeline& pipeline, const GraphicsPipelineVariant& variant);
+
+    /**
+     * Links a complete PSO from libraries. Link-time optimization makes a faster PSO, but takes about as long as a
+     * monolithic compile
+     */
+    VkPipeline link_pipeline_libraries(
+        const GraphicsPipeline& pipeline, const GraphicsPipelineVariant& variant, const PipelineLibraries& libraries,
+        VkPipelineCache vk_cache, bool optimize
+    );
+
+    /**
+     * Creates one pipeline library. Returns VK_NULL_HANDLE on failure
+     */
+    VkPipeline create_pipeline_library(
+        const GraphicsPipeline& pipeline, VkGraphicsPipelineCreateInfo& create_info,
+        VkGraphicsPipelineLibraryFlagsEXT library_flags
+    );
+
+    /**
+     * Destroys the pipeline's shader libraries once the frames that may use them have finished. Must be called with
+     * library_mutex held
+     */
+    void destroy_shader_libraries_later(GraphicsPipeline& pipeline);
+
+    VkPipeline compile_compute_pipeline(const ComputePipeline& pipeline, std::span<const std::byte> instructions);
+
+    /**
+     * Builds a ray tracing pipeline and its shader tables. Returns nullopt if the driver can't compile it
+     */
+    tl::optional<RayTracingPipeline> build_ray_tracing_pipeline(
+        const std::filesystem::path& raygen_shader_path, bool skip_gi_miss_shader
+    );
+
+    void reload_graphics_pipeline(GraphicsPipeline& pipeline, const eastl::unordered_set<eastl::string>& changed_shaders);
+
+    void reload_compute_pipeline(ComputePipeline& pipeline);
+
+    void reload_ray_tracing_pipeline(RayTracingPipeline& pipeline);
+
+    /**
+     * Queues a replaced PSO for destruction once the frames that may use it have finished
+     */
+    void destroy_pipeline_later(VkPipeline vk_pipeline);
+
+    void record_compile_time(std::string_view name, PipelineKind kind, double milliseconds, bool is_background_compile);
+
+    std::string make_cache_key() const;
+
+    std::filesystem::path get_cache_path(PipelineKind kind) const;
+
+    /**
+     * Loads the cache data for one kind of pipeline, if it exists and passes validation
+     */
+    tl::optional<eastl::vector<std::byte>> load_cache_data(PipelineKind kind) const;
+
+    VkPipelineCache create_vk_pipeline_cache(const tl::optional<eastl::vector<std::byte>>& data) const;
+
+    void save_cache_data(PipelineKind kind, VkPipelineCache vk_cache) const;
 };
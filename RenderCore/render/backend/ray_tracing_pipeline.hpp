@@ -41,6 +41,10 @@ struct HitGroup {
 
 struct RayTracingPipeline : PipelineBase
 {
+    std::string raygen_shader_path;
+
+    bool skip_gi_miss_shader = false;
+
     BufferHandle shader_tables_buffer = nullptr;
 
     VkStridedDeviceAddressRegionKHR raygen_table = {};
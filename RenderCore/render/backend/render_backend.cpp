@@ -34,6 +34,12 @@
     0 // Keep this off until we have material functions working
 };
 
+static auto cvar_use_descriptor_buffers = AutoCVar_Int{
+    "r.RHI.DescriptorBuffer.Enable",
+    "Whether to store descriptors in descriptor buffers with VK_EXT_descriptor_buffer, instead of in descriptor pools. Read at startup",
+    0
+};
+
 static std::shared_ptr<spdlog::logger> logger;
 
 RenderBackend& RenderBackend::get() {
@@ -74,7 +80,8 @@ static void* replace_driver(const std::string& path, const char* hooksDir, const
 
 RenderBackend::RenderBackend() : resource_access_synchronizer{*this}, global_descriptor_allocator{*this},
                                  frame_descriptor_allocators{
-                                     DescriptorSetAllocator{*this}, DescriptorSetAllocator{*this}
+                                     DescriptorSetAllocator{*this, &descriptor_set_cache},
+                                     DescriptorSetAllocator{*this, &descriptor_set_cache}
                                  } {
     ZoneScoped;
 
@@ -155,15 +162,33 @@ RenderBackend::RenderBackend() : resource_access_synchronizer{*this}, global_des
 
     create_tracy_context();
 
-    global_descriptor_allocator.init(device.device);
+    // Persistent sets live until their owner rebuilds them, so they need to be freed one at a time
+    global_descriptor_allocator.init(device.device, true);
     for(auto& frame_allocator : frame_descriptor_allocators) {
         frame_allocator.init(device.device);
     }
-    descriptor_layout_cache.init(device.device);
+    descriptor_set_cache.init(device.device);
+    descriptor_layout_cache.init(device.device, supports_descriptor_buffer);
 
     allocator = std::make_unique<ResourceAllocator>(*this);
     g_global_allocator = allocator.get();
 
+    if(supports_descriptor_buffer) {
+        descriptor_buffer.init(*this, descriptor_buffer_properties);
+
+        global_descriptor_allocator.use_descriptor_buffer(&descriptor_buffer, DescriptorBuffer::persistent_region);
+        for(auto frame_idx = 0u; frame_idx < num_in_flight_frames; frame_idx++) {
+            frame_descriptor_allocators[frame_idx].use_descriptor_buffer(
+                &descriptor_buffer,
+                DescriptorBuffer::get_frame_region(frame_idx));
+        }
+        descriptor_set_cache.get_allocator().use_descriptor_buffer(
+            &descriptor_buffer,
+            DescriptorBuffer::persistent_region);
+
+        logger->info("Using descriptor buffers");
+    }
+
     upload_queue = std::make_unique<ResourceUploadQueue>(*this);
 
     blas_build_queue = std::make_unique<BlasBuildQueue>();
@@ -384,6 +409,14 @@ void RenderBackend::create_instance_and_device() {
         logger->debug("{} is supported", VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
     }
 
+    if(cvar_use_descriptor_buffers.Get() != 0) {
+        supports_descriptor_buffer = physical_device.enable_extension_if_present(
+            VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+    }
+
+    // VK_KHR_pipeline_library is enabled above, if it's present. Graphics pipeline libraries require it
+    supports_gpl = physical_device.enable_extension_if_present(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+
     const auto supports_dr = physical_device.enable_extension_if_present(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
     logger->info("Supports DR extension: {}", supports_dr);
 
@@ -427,6 +460,14 @@ void RenderBackend::create_instance_and_device() {
         device_builder.add_pNext(&shading_rate_image_features);
     }
 
+    if(supports_descriptor_buffer) {
+        device_builder.add_pNext(&descriptor_buffer_features);
+    }
+
+    if(supports_gpl) {
+        device_builder.add_pNext(&graphics_pipeline_library_features);
+    }
+
     // Set up device creation info for Aftermath feature flag configuration.
     auto aftermath_flags = static_cast<VkDeviceDiagnosticsConfigFlagsNV>(
         VK_DEVICE_DIAGNOSTICS_CONFIG_ENABLE_RESOURCE_TRACKING_BIT_NV |
@@ -494,6 +535,20 @@ void RenderBackend::query_physical_device_features() {
         physical_device_features.add_extension(&shading_rate_image_features);
     }
 
+    if(supports_descriptor_buffer) {
+        descriptor_buffer_features = VkPhysicalDeviceDescriptorBufferFeaturesEXT{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT,
+        };
+        physical_device_features.add_extension(&descriptor_buffer_features);
+    }
+
+    if(supports_gpl) {
+        graphics_pipeline_library_features = VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+        };
+        physical_device_features.add_extension(&graphics_pipeline_library_features);
+    }
+
     vkGetPhysicalDeviceFeatures2(physical_device, *physical_device_features);
 
     device_features = **physical_device_features;
@@ -514,6 +569,14 @@ void RenderBackend::query_physical_device_features() {
 
     supports_dgc = device_generated_commands_features.deviceGeneratedCommands == VK_TRUE;
 
+    supports_descriptor_buffer = descriptor_buffer_features.descriptorBuffer == VK_TRUE;
+    // We only want the core feature
+    descriptor_buffer_features.descriptorBufferCaptureReplay = VK_FALSE;
+    descriptor_buffer_features.descriptorBufferImageLayoutIgnored = VK_FALSE;
+    descriptor_buffer_features.descriptorBufferPushDescriptors = VK_FALSE;
+
+    supports_gpl = graphics_pipeline_library_features.graphicsPipelineLibrary == VK_TRUE;
+
     supports_shading_rate_image = shading_rate_image_features.attachmentFragmentShadingRate == VK_TRUE;
     if(supports_shading_rate_image) {
         logger->debug("Shading rate attachment is supported!");
@@ -554,8 +617,28 @@ void RenderBackend::query_physical_device_properties() {
         physical_device_properties.add_extension(&ray_tracing_pipeline_properties);
     }
 
+    if(supports_descriptor_buffer) {
+        physical_device_properties.add_extension(&descriptor_buffer_properties);
+    }
+
+    if(supports_gpl) {
+        physical_device_properties.add_extension(&graphics_pipeline_library_properties);
+    }
+
     vkGetPhysicalDeviceProperties2(physical_device, *physical_device_properties);
 
+    // Without fast linking, linking libraries at draw time could take as long as compiling a monolithic PSO
+    if(supports_gpl && !graphics_pipeline_library_properties.graphicsPipelineLibraryFastLinking) {
+        logger->info("Device doesn't support fast linking of graphics pipeline libraries. Using monolithic PSOs");
+        supports_gpl = false;
+    }
+
+    // Some devices store combined image samplers as separate image and sampler arrays. We don't handle that
+    if(supports_descriptor_buffer && !descriptor_buffer_properties.combinedImageSamplerDescriptorSingleArray) {
+        logger->warn("Device stores combined image samplers in two arrays. Falling back to descriptor pools");
+        supports_descriptor_buffer = false;
+    }
+
     logger->debug(
         "Max supported texel size: {}x{}",
         shading_rate_properties.maxFragmentShadingRateAttachmentTexelSize.width,
@@ -599,6 +682,14 @@ bool RenderBackend::supports_device_generated_commands() const {
     return supports_dgc;
 }
 
+bool RenderBackend::use_descriptor_buffers() const {
+    return supports_descriptor_buffer;
+}
+
+bool RenderBackend::supports_graphics_pipeline_library() const {
+    return supports_gpl;
+}
+
 const eastl::vector<glm::uvec2>& RenderBackend::get_shading_rates() const {
     return supported_shading_rates;
 }
@@ -719,11 +810,27 @@ void RenderBackend::advance_frame() {
 
         allocator->free_resources_for_frame(cur_frame_idx);
 
+        pipeline_cache->free_resources_for_frame(cur_frame_idx);
+
+        texture_descriptor_pool->free_resources_for_frame(cur_frame_idx);
+
         frame_descriptor_allocators[cur_frame_idx].reset_pools();
+
+        global_descriptor_allocator.free_resources_for_frame(cur_frame_idx);
+
+        if(use_descriptor_buffers()) {
+            descriptor_buffer.free_resources_for_frame(cur_frame_idx);
+        }
     }
 
+    descriptor_set_cache.begin_frame(total_num_frames);
+
     vkResetFences(device, 1, &frame_fences[cur_frame_idx]);
 
+    // Swap in optimized PSOs and reloaded shaders before anything records commands for this frame
+    pipeline_cache->apply_optimized_pipelines();
+    pipeline_cache->apply_shader_reloads();
+
     is_first_frame = false;
 }
 
@@ -1045,6 +1152,18 @@ DescriptorSetAllocator& RenderBackend::get_transient_descriptor_allocator() {
     return frame_descriptor_allocators[cur_frame_idx];
 }
 
+DescriptorSetCache& RenderBackend::get_descriptor_set_cache() {
+    return descriptor_set_cache;
+}
+
+DescriptorBuffer& RenderBackend::get_descriptor_buffer() {
+    return descriptor_buffer;
+}
+
+const DescriptorBuffer& RenderBackend::get_descriptor_buffer() const {
+    return descriptor_buffer;
+}
+
 VkSemaphore RenderBackend::create_transient_semaphore(const std::string& name) {
     auto semaphore = VkSemaphore{};
 
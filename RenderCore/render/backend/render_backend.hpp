@@ -8,7 +8,9 @@
 
 #include "streamline_adapter.hpp"
 #include "render/backend/hit_group_builder.hpp"
+#include "render/backend/descriptor_buffer.hpp"
 #include "render/backend/descriptor_set_allocator.hpp"
+#include "render/backend/descriptor_set_cache.hpp"
 #include "render/backend/resource_access_synchronizer.hpp"
 #include "render/backend/texture_descriptor_pool.hpp"
 #include "render/backend/resource_allocator.hpp"
@@ -60,6 +62,16 @@ public:
 
     bool supports_device_generated_commands() const;
 
+    /**
+     * Whether descriptor sets live in a descriptor buffer rather than in descriptor pools. Decided at startup
+     */
+    bool use_descriptor_buffers() const;
+
+    /**
+     * Whether the device can build graphics PSOs from pipeline libraries, and link them quickly
+     */
+    bool supports_graphics_pipeline_library() const;
+
     const eastl::vector<glm::uvec2>& get_shading_rates() const;
 
     glm::vec2 get_max_shading_rate_texel_size() const;
@@ -140,6 +152,15 @@ public:
      */
     DescriptorSetAllocator& get_transient_descriptor_allocator();
 
+    DescriptorSetCache& get_descriptor_set_cache();
+
+    /**
+     * Retrieves the buffer that holds all descriptor sets. Only valid when use_descriptor_buffers() is true
+     */
+    DescriptorBuffer& get_descriptor_buffer();
+
+    const DescriptorBuffer& get_descriptor_buffer() const;
+
     CommandBuffer create_graphics_command_buffer(const std::string& name);
 
     /**
@@ -212,6 +233,10 @@ private:
 
     bool supports_dgc = false;
 
+    bool supports_descriptor_buffer = false;
+
+    bool supports_gpl = false;
+
     VkQueue graphics_queue;
     uint32_t graphics_queue_family_index;
 
@@ -238,10 +263,14 @@ private:
 
     DescriptorSetAllocator global_descriptor_allocator;
 
+    DescriptorSetCache descriptor_set_cache;
+
     eastl::array<DescriptorSetAllocator, num_in_flight_frames> frame_descriptor_allocators;
 
     vkutil::DescriptorLayoutCache descriptor_layout_cache;
 
+    DescriptorBuffer descriptor_buffer;
+
     VkPipelineCache vk_pipeline_cache = VK_NULL_HANDLE;
 
     TextureHandle white_texture_handle = nullptr;
@@ -285,6 +314,12 @@ private:
     VkPhysicalDeviceFragmentShadingRateFeaturesKHR shading_rate_image_features = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR,
     };
+    VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT,
+    };
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphics_pipeline_library_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+    };
     VkPhysicalDeviceFeatures2 device_features = {};
 
     VkPhysicalDeviceRayTracingPipelinePropertiesKHR  ray_tracing_pipeline_properties = {
@@ -293,6 +328,12 @@ private:
     VkPhysicalDeviceFragmentShadingRatePropertiesKHR shading_rate_properties = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR
     };
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptor_buffer_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT
+    };
+    VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphics_pipeline_library_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT
+    };
 
     void create_instance_and_device();
 
@@ -349,6 +390,10 @@ void RenderBackend::set_object_name(VulkanType object, const std::string& name)
     } else if constexpr(std::is_same_v<VulkanType, VkCommandBuffer>) {
         object_type = VK_OBJECT_TYPE_COMMAND_BUFFER;
     } else if constexpr(std::is_same_v<VulkanType, VkDescriptorSet>) {
+        // Descriptor buffer sets aren't Vulkan objects
+        if(use_descriptor_buffers()) {
+            return;
+        }
         object_type = VK_OBJECT_TYPE_DESCRIPTOR_SET;
     } else {
         throw std::runtime_error{"Invalid object type"};
@@ -201,6 +201,9 @@ void RenderGraph::add_render_pass(DynamicRenderingPass pass) {
                 pass.color_attachments[0].image->create_info.extent.height
             };
         }
+        if(pass.render_area) {
+            render_area_size = glm::min(render_area_size, *pass.render_area);
+        }
 
         auto rendering_info = RenderingInfo{
             .render_area_begin = {},
@@ -310,6 +313,10 @@ void RenderGraph::finish() const {
     cmds.end();
 }
 
+uint32_t RenderGraph::get_num_skipped_draws() const {
+    return cmds.get_num_skipped_draws();
+}
+
 CommandBuffer&& RenderGraph::extract_command_buffer() {
     return std::move(cmds);
 }
@@ -67,6 +67,12 @@ public:
 
     void finish() const;
 
+    /**
+     * Number of draws and dispatches so far that were skipped because their PSO or a descriptor set was missing. See
+     * CommandBuffer::get_num_skipped_draws
+     */
+    uint32_t get_num_skipped_draws() const;
+
     // Kinda-internal API, useful only to Backend
 
     /**
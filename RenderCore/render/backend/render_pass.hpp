@@ -5,6 +5,7 @@
 #include <optional>
 #include <EASTL/vector.h>
 
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 
@@ -202,6 +203,15 @@ struct DynamicRenderingPass {
 
     std::optional<uint32_t> view_mask;
 
+    /**
+     * Size of the area to render to, starting at the upper left of the attachments. The viewport and scissor cover
+     * this area. Defaults to the whole attachments
+     *
+     * Dynamic resolution uses this to render into part of the scene render targets, so that changing the resolution
+     * doesn't reallocate them
+     */
+    std::optional<glm::uvec2> render_area;
+
     std::function<void(CommandBuffer&)> execute;    
 };
 
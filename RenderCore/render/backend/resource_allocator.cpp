@@ -377,7 +377,8 @@ BufferHandle ResourceAllocator::create_buffer(const std::string& name, const siz
 
     switch(usage) {
     case BufferUsage::StagingBuffer:
-        vk_usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        vk_usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
         if(backend.supports_ray_tracing()) {
             vk_usage |= VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
         }
@@ -558,8 +559,12 @@ void ResourceAllocator::free_resources_for_frame(const uint32_t frame_idx) {
 
     const auto& device = backend.get_device();
 
+    // Cached descriptor sets that reference the resources we're about to destroy must not be used again
+    auto& set_cache = backend.get_descriptor_set_cache();
+
     auto& zombie_ases = as_zombie_lists[frame_idx];
     for(const auto& as : zombie_ases) {
+        set_cache.notify_resource_destroyed(reinterpret_cast<uint64_t>(as->acceleration_structure));
         vkDestroyAccelerationStructureKHR(device, as->acceleration_structure, nullptr);
 
         std::erase(acceleration_structures, *as);
@@ -568,6 +573,7 @@ void ResourceAllocator::free_resources_for_frame(const uint32_t frame_idx) {
 
     auto& zombie_buffers = buffer_zombie_lists[frame_idx];
     for(auto handle : zombie_buffers) {
+        set_cache.notify_resource_destroyed(reinterpret_cast<uint64_t>(handle->buffer));
         vmaDestroyBuffer(vma, handle->buffer, handle->allocation);
 
         std::erase(buffers, *handle);
@@ -577,6 +583,7 @@ void ResourceAllocator::free_resources_for_frame(const uint32_t frame_idx) {
 
     auto& zombie_textures = texture_zombie_lists[frame_idx];
     for(auto handle : zombie_textures) {
+        set_cache.notify_resource_destroyed(reinterpret_cast<uint64_t>(handle->image_view));
         vkDestroyImageView(device, handle->image_view, nullptr);
 
         switch(handle->type) {
@@ -59,7 +59,7 @@ inline const char* to_string(const TextureUsage e) {
  */
 enum class BufferUsage {
     /**
-     * CPU writes to the buffer, it's copied to another resource
+     * CPU writes to the buffer, it's copied to another resource. May also be read directly as per-instance vertex data
      */
     StagingBuffer,
 
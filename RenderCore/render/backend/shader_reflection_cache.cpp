@@ -0,0 +1,427 @@
+#include "shader_reflection_cache.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <EASTL/algorithm.h>
+#include <spdlog/spdlog.h>
+#include <spirv_reflect.h>
+#include <tracy/Tracy.hpp>
+
+#include "core/system_interface.hpp"
+#include "extern/cityhash/city_hash.hpp"
+
+static std::shared_ptr<spdlog::logger> logger;
+
+constexpr auto REFLECTION_CACHE_PATH = "cache/shader_reflection";
+
+constexpr uint32_t REFLECTION_CACHE_MAGIC = 0x52484353; // "SCHR"
+
+/**
+ * Bump this when the file format or the contents of ShaderReflection change
+ */
+constexpr uint32_t REFLECTION_CACHE_VERSION = 1;
+
+static VkDescriptorType to_vk_type(SpvReflectDescriptorType type);
+
+/**
+ * Appends plain values to a byte array
+ */
+class BinaryWriter {
+public:
+    explicit BinaryWriter(eastl::vector<uint8_t>& data_in) : data{data_in} {}
+
+    void write(const uint32_t value) {
+        write_bytes(&value, sizeof(value));
+    }
+
+    void write(const uint64_t value) {
+        write_bytes(&value, sizeof(value));
+    }
+
+    void write(const eastl::string& value) {
+        write(static_cast<uint32_t>(value.size()));
+        write_bytes(value.data(), value.size());
+    }
+
+private:
+    eastl::vector<uint8_t>& data;
+
+    void write_bytes(const void* bytes, const size_t size) {
+        const auto* begin = static_cast<const uint8_t*>(bytes);
+        data.insert(data.end(), begin, begin + size);
+    }
+};
+
+/**
+ * Reads plain values from a byte array. Reading past the end fails the reader, rather than reading garbage
+ */
+class BinaryReader {
+public:
+    explicit BinaryReader(const std::span<const uint8_t> data_in) : data{data_in} {}
+
+    bool read(uint32_t& value) {
+        return read_bytes(&value, sizeof(value));
+    }
+
+    bool read(uint64_t& value) {
+        return read_bytes(&value, sizeof(value));
+    }
+
+    bool read(eastl::string& value) {
+        auto size = 0u;
+        if(!read(size) || offset + size > data.size()) {
+            return false;
+        }
+
+        value.assign(reinterpret_cast<const char*>(data.data() + offset), size);
+        offset += size;
+        return true;
+    }
+
+    bool is_at_end() const {
+        return offset == data.size();
+    }
+
+private:
+    std::span<const uint8_t> data;
+
+    size_t offset = 0;
+
+    bool read_bytes(void* bytes, const size_t size) {
+        if(offset + size > data.size()) {
+            return false;
+        }
+
+        std::memcpy(bytes, data.data() + offset, size);
+        offset += size;
+        return true;
+    }
+};
+
+bool ShaderReflection::operator==(const ShaderReflection& other) const {
+    if(bindings.size() != other.bindings.size() ||
+        push_constants.size() != other.push_constants.size() ||
+        inputs.size() != other.inputs.size()) {
+        return false;
+    }
+
+    return eastl::equal(
+            bindings.begin(),
+            bindings.end(),
+            other.bindings.begin(),
+            [](const Binding& a, const Binding& b) {
+                return a.set == b.set && a.binding == b.binding && a.type == b.type && a.count == b.count &&
+                    a.is_read_only == b.is_read_only;
+            }) &&
+        eastl::equal(
+            push_constants.begin(),
+            push_constants.end(),
+            other.push_constants.begin(),
+            [](const PushConstantRange& a, const PushConstantRange& b) {
+                return a.offset == b.offset && a.size == b.size;
+            }) &&
+        eastl::equal(
+            inputs.begin(),
+            inputs.end(),
+            other.inputs.begin(),
+            [](const Input& a, const Input& b) {
+                return a.name == b.name && a.location == b.location;
+            });
+}
+
+ShaderReflection reflect_shader(const std::span<const std::byte> spirv) {
+    ZoneScoped;
+
+    const auto shader_module = spv_reflect::ShaderModule{
+        spirv.size(),
+        spirv.data(),
+        SPV_REFLECT_MODULE_FLAG_NO_COPY
+    };
+    if(shader_module.GetResult() != SPV_REFLECT_RESULT_SUCCESS) {
+        throw std::runtime_error{"Could not perform reflection on shader"};
+    }
+
+    auto reflection = ShaderReflection{};
+
+    uint32_t set_count;
+    auto result = shader_module.EnumerateDescriptorSets(&set_count, nullptr);
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+    auto sets = eastl::vector<SpvReflectDescriptorSet*>{set_count};
+    result = shader_module.EnumerateDescriptorSets(&set_count, sets.data());
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+    for(const auto* set : sets) {
+        for(const auto* binding : std::span{set->bindings, set->bindings + set->binding_count}) {
+            reflection.bindings.push_back(
+                ShaderReflection::Binding{
+                    .set = set->set,
+                    .binding = binding->binding,
+                    .type = to_vk_type(binding->descriptor_type),
+                    .count = binding->count,
+                    .is_read_only = (binding->decoration_flags & SPV_REFLECT_DECORATION_NON_WRITABLE) != 0
+                });
+        }
+    }
+
+    uint32_t constant_count;
+    result = shader_module.EnumeratePushConstantBlocks(&constant_count, nullptr);
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+    auto spv_push_constants = eastl::vector<SpvReflectBlockVariable*>{constant_count};
+    result = shader_module.EnumeratePushConstantBlocks(&constant_count, spv_push_constants.data());
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+    for(const auto* constant_range : spv_push_constants) {
+        reflection.push_constants.push_back({.offset = constant_range->offset, .size = constant_range->size});
+    }
+
+    // Only vertex shaders care about inputs, but spirv_reflect gives us everyone's
+    if(shader_module.GetShaderStage() == SPV_REFLECT_SHADER_STAGE_VERTEX_BIT) {
+        uint32_t input_count;
+        result = shader_module.EnumerateInputVariables(&input_count, nullptr);
+        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+        auto spv_inputs = eastl::vector<SpvReflectInterfaceVariable*>{input_count};
+        result = shader_module.EnumerateInputVariables(&input_count, spv_inputs.data());
+        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+        for(const auto* input : spv_inputs) {
+            if(input->name == nullptr) {
+                continue;
+            }
+
+            reflection.inputs.push_back({.name = input->name, .location = input->location});
+        }
+    }
+
+    return reflection;
+}
+
+void ShaderReflectionCache::load() {
+    if(logger == nullptr) {
+        logger = SystemInterface::get().get_logger("ShaderReflectionCache");
+    }
+
+    const auto file_data = SystemInterface::get().load_file(REFLECTION_CACHE_PATH);
+    if(!file_data) {
+        logger->info("No shader reflection cache, all shaders will be reflected");
+        return;
+    }
+
+    if(!deserialize({reinterpret_cast<const uint8_t*>(file_data->data()), file_data->size()})) {
+        logger->warn("Shader reflection cache is malformed or out of date, ignoring it");
+        return;
+    }
+
+    logger->info("Loaded reflection data for {} shaders", entries.size());
+}
+
+void ShaderReflectionCache::save() {
+    if(logger == nullptr) {
+        logger = SystemInterface::get().get_logger("ShaderReflectionCache");
+    }
+
+    logger->info("{} reflection cache hits, {} misses", num_hits, num_misses);
+
+    if(!is_dirty) {
+        return;
+    }
+
+    const auto data = serialize();
+    SystemInterface::get().write_file(REFLECTION_CACHE_PATH, data.data(), static_cast<uint32_t>(data.size()));
+
+    is_dirty = false;
+}
+
+const ShaderReflection& ShaderReflectionCache::get_reflection(const std::span<const std::byte> spirv) {
+    const auto hash = CityHash64(reinterpret_cast<const char*>(spirv.data()), spirv.size());
+
+    if(auto itr = entries.find(hash); itr != entries.end()) {
+        num_hits++;
+
+        itr->second.was_used = true;
+
+        return itr->second.reflection;
+    }
+
+    num_misses++;
+    is_dirty = true;
+
+    auto& entry = entries[hash];
+    entry.reflection = reflect_shader(spirv);
+    entry.was_used = true;
+
+    return entry.reflection;
+}
+
+eastl::vector<uint8_t> ShaderReflectionCache::serialize() const {
+    auto data = eastl::vector<uint8_t>{};
+    auto writer = BinaryWriter{data};
+
+    auto num_used_entries = 0u;
+    for(const auto& [hash, entry] : entries) {
+        if(entry.was_used) {
+            num_used_entries++;
+        }
+    }
+
+    writer.write(REFLECTION_CACHE_MAGIC);
+    writer.write(REFLECTION_CACHE_VERSION);
+    writer.write(num_used_entries);
+
+    for(const auto& [hash, entry] : entries) {
+        if(!entry.was_used) {
+            continue;
+        }
+
+        const auto& reflection = entry.reflection;
+
+        writer.write(hash);
+
+        writer.write(static_cast<uint32_t>(reflection.bindings.size()));
+        for(const auto& binding : reflection.bindings) {
+            writer.write(binding.set);
+            writer.write(binding.binding);
+            writer.write(static_cast<uint32_t>(binding.type));
+            writer.write(binding.count);
+            writer.write(binding.is_read_only ? 1u : 0u);
+        }
+
+        writer.write(static_cast<uint32_t>(reflection.push_constants.size()));
+        for(const auto& range : reflection.push_constants) {
+            writer.write(range.offset);
+            writer.write(range.size);
+        }
+
+        writer.write(static_cast<uint32_t>(reflection.inputs.size()));
+        for(const auto& input : reflection.inputs) {
+            writer.write(input.name);
+            writer.write(input.location);
+        }
+    }
+
+    return data;
+}
+
+bool ShaderReflectionCache::deserialize(const std::span<const uint8_t> data) {
+    entries.clear();
+
+    auto reader = BinaryReader{data};
+
+    auto magic = 0u;
+    auto version = 0u;
+    auto num_entries = 0u;
+    if(!reader.read(magic) || !reader.read(version) || !reader.read(num_entries) ||
+        magic != REFLECTION_CACHE_MAGIC || version != REFLECTION_CACHE_VERSION) {
+        return false;
+    }
+
+    for(auto entry_index = 0u; entry_index < num_entries; entry_index++) {
+        auto hash = uint64_t{};
+        auto reflection = ShaderReflection{};
+
+        auto num_bindings = 0u;
+        if(!reader.read(hash) || !reader.read(num_bindings)) {
+            entries.clear();
+            return false;
+        }
+        for(auto i = 0u; i < num_bindings; i++) {
+            auto& binding = reflection.bindings.emplace_back();
+            auto type = 0u;
+            auto is_read_only = 0u;
+            if(!reader.read(binding.set) || !reader.read(binding.binding) || !reader.read(type) ||
+                !reader.read(binding.count) || !reader.read(is_read_only)) {
+                entries.clear();
+                return false;
+            }
+            binding.type = static_cast<VkDescriptorType>(type);
+            binding.is_read_only = is_read_only != 0;
+        }
+
+        auto num_push_constants = 0u;
+        if(!reader.read(num_push_constants)) {
+            entries.clear();
+            return false;
+        }
+        for(auto i = 0u; i < num_push_constants; i++) {
+            auto& range = reflection.push_constants.emplace_back();
+            if(!reader.read(range.offset) || !reader.read(range.size)) {
+                entries.clear();
+                return false;
+            }
+        }
+
+        auto num_inputs = 0u;
+        if(!reader.read(num_inputs)) {
+            entries.clear();
+            return false;
+        }
+        for(auto i = 0u; i < num_inputs; i++) {
+            auto& input = reflection.inputs.emplace_back();
+            if(!reader.read(input.name) || !reader.read(input.location)) {
+                entries.clear();
+                return false;
+            }
+        }
+
+        entries[hash] = Entry{.reflection = std::move(reflection)};
+    }
+
+    if(!reader.is_at_end()) {
+        entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t ShaderReflectionCache::get_num_hits() const {
+    return num_hits;
+}
+
+uint32_t ShaderReflectionCache::get_num_misses() const {
+    return num_misses;
+}
+
+VkDescriptorType to_vk_type(SpvReflectDescriptorType type) {
+    switch(type) {
+    case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLER:
+        return VK_DESCRIPTOR_TYPE_SAMPLER;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+        return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+        return VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+        return VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+        return VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+        return VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+        return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+        return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+        return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+
+    case SPV_REFLECT_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+        return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+
+    default:
+        spdlog::error("Unknown descriptor type {}", static_cast<uint32_t>(type));
+        return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+    }
+}
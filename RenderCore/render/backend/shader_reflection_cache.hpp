@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <EASTL/string.h>
+#include <EASTL/unordered_map.h>
+#include <EASTL/vector.h>
+#include <volk.h>
+
+/**
+ * Everything we need from a shader module's reflection data. Stage-independent, so that one module may be used in
+ * several stages
+ */
+struct ShaderReflection {
+    struct Binding {
+        uint32_t set = 0;
+
+        uint32_t binding = 0;
+
+        VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+
+        /**
+         * Number of descriptors. 0 for a runtime-sized array
+         */
+        uint32_t count = 0;
+
+        bool is_read_only = false;
+    };
+
+    struct PushConstantRange {
+        uint32_t offset = 0;
+
+        uint32_t size = 0;
+    };
+
+    struct Input {
+        eastl::string name;
+
+        uint32_t location = 0;
+    };
+
+    eastl::vector<Binding> bindings;
+
+    eastl::vector<PushConstantRange> push_constants;
+
+    /**
+     * Named input variables. Only used for vertex shaders
+     */
+    eastl::vector<Input> inputs;
+
+    bool operator==(const ShaderReflection& other) const;
+};
+
+/**
+ * Runs spirv_reflect on a shader module
+ */
+ShaderReflection reflect_shader(std::span<const std::byte> spirv);
+
+/**
+ * Caches the reflection data of shader modules between runs
+ *
+ * Entries are keyed by the CityHash of the module's SPIR-V, so changing a shader's code automatically invalidates its
+ * entry. Only entries that were used this run are saved, so entries for old versions of shaders don't pile up
+ */
+class ShaderReflectionCache {
+public:
+    /**
+     * Loads the cache file, if there is one
+     */
+    void load();
+
+    /**
+     * Saves the cache file, if anything changed
+     */
+    void save();
+
+    /**
+     * Retrieves the reflection data for a shader module, reflecting it if it's not in the cache
+     */
+    const ShaderReflection& get_reflection(std::span<const std::byte> spirv);
+
+    /**
+     * Serializes the entries used this run, in the same format that `load` reads
+     */
+    eastl::vector<uint8_t> serialize() const;
+
+    /**
+     * Replaces the cache's contents with the serialized entries. Returns false if the data is malformed, in which case
+     * the cache is empty
+     */
+    bool deserialize(std::span<const uint8_t> data);
+
+    uint32_t get_num_hits() const;
+
+    uint32_t get_num_misses() const;
+
+private:
+    struct Entry {
+        ShaderReflection reflection;
+
+        bool was_used = false;
+    };
+
+    eastl::unordered_map<uint64_t, Entry> entries;
+
+    bool is_dirty = false;
+
+    uint32_t num_hits = 0;
+
+    uint32_t num_misses = 0;
+};
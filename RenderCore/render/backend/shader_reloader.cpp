@@ -0,0 +1,334 @@
+#include "shader_reloader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <EASTL/algorithm.h>
+#include <tracy/Tracy.hpp>
+
+#include "console/cvars.hpp"
+#include "core/system_interface.hpp"
+
+static std::shared_ptr<spdlog::logger> logger;
+
+static auto cvar_poll_interval = AutoCVar_Int{
+    "r.ShaderReload.PollIntervalMs",
+    "How often to check the shader source tree for changes, in milliseconds",
+    500
+};
+
+eastl::string normalize_shader_path(const std::filesystem::path& path) {
+    std::error_code error;
+    auto absolute_path = std::filesystem::absolute(path, error);
+    if(error) {
+        absolute_path = path;
+    }
+
+    return absolute_path.lexically_normal().generic_string().c_str();
+}
+
+namespace {
+    /**
+     * The real file system, and the real compile script
+     */
+    class FilesystemShaderReloadEnvironment final : public ShaderReloadEnvironment {
+    public:
+        eastl::vector<ShaderFileInfo> find_files(const std::filesystem::path& directory) override {
+            auto files = eastl::vector<ShaderFileInfo>{};
+
+            std::error_code error;
+            for(const auto& entry : std::filesystem::recursive_directory_iterator{directory, error}) {
+                if(!entry.is_regular_file(error)) {
+                    continue;
+                }
+
+                const auto write_time = entry.last_write_time(error);
+                if(error) {
+                    continue;
+                }
+
+                files.emplace_back(ShaderFileInfo{.path = entry.path(), .write_time = write_time});
+            }
+
+            return files;
+        }
+
+        tl::optional<std::string> read_file(const std::filesystem::path& file) override {
+            auto stream = std::ifstream{file};
+            if(!stream) {
+                return tl::nullopt;
+            }
+
+            auto contents = std::ostringstream{};
+            contents << stream.rdbuf();
+            return contents.str();
+        }
+
+        int run_compile_command(const std::string& command) override {
+            ZoneScopedN("Run compile script");
+            return std::system(command.c_str());
+        }
+    };
+}
+
+ShaderDependencyGraph::ShaderDependencyGraph(const std::filesystem::path& output_dir_in) : output_dir{output_dir_in} {}
+
+void ShaderDependencyGraph::rebuild(ShaderReloadEnvironment& environment) {
+    ZoneScoped;
+
+    dependents.clear();
+    dependencies_of_output.clear();
+    output_write_times.clear();
+
+    for(const auto& file : environment.find_files(output_dir)) {
+        if(file.path.extension() == ".spv") {
+            output_write_times[normalize_shader_path(file.path)] = file.write_time;
+            continue;
+        }
+
+        if(file.path.extension() != ".deps") {
+            continue;
+        }
+
+        const auto deps_data = environment.read_file(file.path);
+        if(!deps_data) {
+            continue;
+        }
+
+        // The compile script names the .deps file by replacing the compiled shader's last extension
+        const auto output = std::filesystem::path{file.path}.replace_extension(".spv");
+
+        auto dependencies = eastl::vector<std::filesystem::path>{};
+        auto stream = std::istringstream{*deps_data};
+        auto line = std::string{};
+        while(std::getline(stream, line)) {
+            while(!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+                line.pop_back();
+            }
+            if(!line.empty()) {
+                dependencies.emplace_back(line);
+            }
+        }
+
+        set_dependencies(output, dependencies);
+    }
+}
+
+void ShaderDependencyGraph::set_dependencies(
+    const std::filesystem::path& output, const eastl::vector<std::filesystem::path>& dependencies
+) {
+    const auto output_name = normalize_shader_path(output);
+
+    auto& output_dependencies = dependencies_of_output[output_name];
+    for(const auto& dependency : output_dependencies) {
+        auto& outputs = dependents[dependency];
+        outputs.erase(eastl::remove(outputs.begin(), outputs.end(), output_name), outputs.end());
+    }
+    output_dependencies.clear();
+
+    for(const auto& dependency : dependencies) {
+        const auto dependency_name = normalize_shader_path(dependency);
+        if(eastl::find(output_dependencies.begin(), output_dependencies.end(), dependency_name) !=
+            output_dependencies.end()) {
+            continue;
+        }
+
+        output_dependencies.emplace_back(dependency_name);
+        dependents[dependency_name].emplace_back(output_name);
+    }
+}
+
+eastl::vector<eastl::string> ShaderDependencyGraph::get_affected_outputs(const std::filesystem::path& source) const {
+    if(const auto itr = dependents.find(normalize_shader_path(source)); itr != dependents.end()) {
+        return itr->second;
+    }
+
+    return {};
+}
+
+tl::optional<std::filesystem::file_time_type> ShaderDependencyGraph::get_write_time(
+    const eastl::string& output
+) const {
+    if(const auto itr = output_write_times.find(output); itr != output_write_times.end()) {
+        return itr->second;
+    }
+
+    return tl::nullopt;
+}
+
+ShaderReloadScheduler::ShaderReloadScheduler(
+    const std::filesystem::path& source_dir_in, const std::filesystem::path& output_dir_in,
+    std::string compile_command_in, ShaderReloadEnvironment& environment_in
+) : source_dir{source_dir_in},
+    compile_command{std::move(compile_command_in)},
+    environment{environment_in},
+    dependency_graph{output_dir_in} {}
+
+void ShaderReloadScheduler::start() {
+    dependency_graph.rebuild(environment);
+
+    source_write_times.clear();
+    pending_sources.clear();
+    find_modified_sources();
+}
+
+tl::optional<ShaderRecompileResult> ShaderReloadScheduler::poll() {
+    const auto modified_sources = find_modified_sources();
+    if(!modified_sources.empty()) {
+        for(const auto& source : modified_sources) {
+            if(eastl::find(pending_sources.begin(), pending_sources.end(), source) == pending_sources.end()) {
+                pending_sources.emplace_back(source);
+            }
+        }
+
+        // Still changing, wait for the next poll
+        return tl::nullopt;
+    }
+
+    if(pending_sources.empty()) {
+        return tl::nullopt;
+    }
+
+    return recompile();
+}
+
+eastl::vector<std::filesystem::path> ShaderReloadScheduler::find_modified_sources() {
+    ZoneScoped;
+
+    auto modified_sources = eastl::vector<std::filesystem::path>{};
+
+    for(const auto& file : environment.find_files(source_dir)) {
+        const auto path_name = normalize_shader_path(file.path);
+        if(const auto itr = source_write_times.find(path_name); itr != source_write_times.end()) {
+            if(itr->second == file.write_time) {
+                continue;
+            }
+            itr->second = file.write_time;
+        } else {
+            source_write_times.emplace(path_name, file.write_time);
+        }
+
+        modified_sources.emplace_back(file.path);
+    }
+
+    return modified_sources;
+}
+
+ShaderRecompileResult ShaderReloadScheduler::recompile() {
+    ZoneScoped;
+
+    auto result = ShaderRecompileResult{};
+    result.modified_sources = eastl::move(pending_sources);
+    pending_sources.clear();
+
+    // Remember when each affected shader was last written, so that we can tell which ones the script rewrote
+    auto write_times = eastl::unordered_map<eastl::string, tl::optional<std::filesystem::file_time_type>>{};
+    for(const auto& source : result.modified_sources) {
+        for(const auto& output : dependency_graph.get_affected_outputs(source)) {
+            write_times.emplace(output, dependency_graph.get_write_time(output));
+        }
+    }
+
+    result.compile_exit_code = environment.run_compile_command(compile_command);
+
+    // The changes may have added or removed includes, or added new shaders
+    dependency_graph.rebuild(environment);
+
+    for(const auto& source : result.modified_sources) {
+        for(const auto& output : dependency_graph.get_affected_outputs(source)) {
+            const auto write_time = dependency_graph.get_write_time(output);
+            if(!write_time) {
+                continue;
+            }
+
+            const auto itr = write_times.find(output);
+            const auto was_rewritten = itr == write_times.end() || itr->second != write_time;
+            if(was_rewritten && eastl::find(result.rewritten_shaders.begin(), result.rewritten_shaders.end(), output)
+                == result.rewritten_shaders.end()) {
+                result.rewritten_shaders.emplace_back(output);
+            }
+        }
+    }
+
+    return result;
+}
+
+ShaderReloader::ShaderReloader(
+    const std::filesystem::path& source_dir_in, const std::filesystem::path& output_dir_in,
+    std::string compile_command_in
+) : environment{std::make_unique<FilesystemShaderReloadEnvironment>()},
+    scheduler{source_dir_in, output_dir_in, std::move(compile_command_in), *environment} {
+    if(logger == nullptr) {
+        logger = SystemInterface::get().get_logger("ShaderReloader");
+    }
+
+    logger->info("Watching {} for shader changes", source_dir_in.string());
+
+    watch_thread = std::thread{[this] { run_watch_thread(); }};
+}
+
+ShaderReloader::~ShaderReloader() {
+    {
+        auto lock = std::unique_lock{stop_mutex};
+        should_stop = true;
+    }
+    stop_condition.notify_all();
+
+    if(watch_thread.joinable()) {
+        watch_thread.join();
+    }
+}
+
+eastl::vector<eastl::string> ShaderReloader::take_changed_shaders() {
+    auto lock = std::unique_lock{changed_shaders_mutex};
+    auto shaders = eastl::move(changed_shaders);
+    changed_shaders.clear();
+    return shaders;
+}
+
+void ShaderReloader::run_watch_thread() {
+    tracy::SetThreadName("Shader reload");
+
+    scheduler.start();
+
+    while(wait_for_next_poll()) {
+        if(const auto result = scheduler.poll()) {
+            report(*result);
+        }
+    }
+}
+
+bool ShaderReloader::wait_for_next_poll() {
+    const auto interval = std::chrono::milliseconds{std::max(cvar_poll_interval.Get(), 10)};
+
+    auto lock = std::unique_lock{stop_mutex};
+    stop_condition.wait_for(lock, interval, [&] { return should_stop; });
+    return !should_stop;
+}
+
+void ShaderReloader::report(const ShaderRecompileResult& result) {
+    for(const auto& source : result.modified_sources) {
+        logger->info("{} changed", source.string());
+    }
+
+    if(result.compile_exit_code != 0) {
+        logger->error("Shader compile command failed with code {}", result.compile_exit_code);
+    }
+
+    if(result.rewritten_shaders.empty()) {
+        logger->warn("No shaders were rebuilt. Check the compile output for errors");
+        return;
+    }
+
+    logger->info("Rebuilt {} shaders", result.rewritten_shaders.size());
+
+    auto lock = std::unique_lock{changed_shaders_mutex};
+    for(const auto& shader : result.rewritten_shaders) {
+        if(eastl::find(changed_shaders.begin(), changed_shaders.end(), shader) == changed_shaders.end()) {
+            changed_shaders.emplace_back(shader);
+        }
+    }
+}
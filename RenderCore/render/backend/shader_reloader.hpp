@@ -0,0 +1,218 @@
+#pragma once
+
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <EASTL/string.h>
+#include <EASTL/unordered_map.h>
+#include <EASTL/vector.h>
+#include <tl/optional.hpp>
+
+/**
+ * Converts a shader path to the form that the dependency graph and the shader reloader use: absolute, normalized, with
+ * forward slashes
+ */
+eastl::string normalize_shader_path(const std::filesystem::path& path);
+
+struct ShaderFileInfo {
+    std::filesystem::path path;
+
+    std::filesystem::file_time_type write_time;
+};
+
+/**
+ * The files and the compiler that shader reloading works with. Lets tests run the reloader against fake files and a
+ * fake compiler
+ */
+class ShaderReloadEnvironment {
+public:
+    virtual ~ShaderReloadEnvironment() = default;
+
+    /**
+     * Lists every file in the directory and its subdirectories
+     */
+    virtual eastl::vector<ShaderFileInfo> find_files(const std::filesystem::path& directory) = 0;
+
+    /**
+     * Reads a text file in its entirety, or returns nullopt if it can't be read
+     */
+    virtual tl::optional<std::string> read_file(const std::filesystem::path& file) = 0;
+
+    /**
+     * Runs the shader compile command, and returns its exit code
+     */
+    virtual int run_compile_command(const std::string& command) = 0;
+};
+
+/**
+ * Which compiled shaders depend on which source files
+ *
+ * Built from the .deps files that the shader compile script writes next to each compiled shader. Each one lists the
+ * shader's source file and every file that the source includes, directly or not
+ */
+class ShaderDependencyGraph {
+public:
+    explicit ShaderDependencyGraph(const std::filesystem::path& output_dir_in);
+
+    /**
+     * Re-reads every .deps file in the output directory, and the modification time of every compiled shader
+     */
+    void rebuild(ShaderReloadEnvironment& environment);
+
+    /**
+     * Records that the compiled shader depends on the given files, replacing its previous dependencies
+     */
+    void set_dependencies(
+        const std::filesystem::path& output, const eastl::vector<std::filesystem::path>& dependencies
+    );
+
+    /**
+     * Finds every compiled shader that depends on the source file, either because it was compiled from it or because
+     * it includes it
+     */
+    eastl::vector<eastl::string> get_affected_outputs(const std::filesystem::path& source) const;
+
+    /**
+     * Retrieves the modification time of a compiled shader as of the last rebuild, or nullopt if it didn't exist
+     */
+    tl::optional<std::filesystem::file_time_type> get_write_time(const eastl::string& output) const;
+
+private:
+    std::filesystem::path output_dir;
+
+    /**
+     * Source file -> compiled shaders that depend on it
+     */
+    eastl::unordered_map<eastl::string, eastl::vector<eastl::string>> dependents;
+
+    /**
+     * Compiled shader -> files that it depends on. Lets us remove stale edges when a shader's includes change
+     */
+    eastl::unordered_map<eastl::string, eastl::vector<eastl::string>> dependencies_of_output;
+
+    eastl::unordered_map<eastl::string, std::filesystem::file_time_type> output_write_times;
+};
+
+/**
+ * What happened when the reload scheduler recompiled shaders
+ */
+struct ShaderRecompileResult {
+    eastl::vector<std::filesystem::path> modified_sources;
+
+    int compile_exit_code = 0;
+
+    /**
+     * Compiled shaders that the modified sources affect and that the compile command rewrote, as normalized paths
+     */
+    eastl::vector<eastl::string> rewritten_shaders;
+};
+
+/**
+ * Decides when to recompile shaders, and which compiled shaders changed
+ *
+ * Each poll compares the modification times of the source files with the previous poll. Editors often write a file
+ * several times when saving it, so the scheduler waits until a poll finds nothing new before it runs the compile
+ * command, once for everything that changed. The compile script only recompiles shaders that are out of date, and
+ * leaves a shader's old SPIR-V in place if it fails to compile. Afterwards, the scheduler looks up which compiled
+ * shaders the changed files affect, and reports the ones that the script rewrote
+ */
+class ShaderReloadScheduler {
+public:
+    ShaderReloadScheduler(
+        const std::filesystem::path& source_dir_in, const std::filesystem::path& output_dir_in,
+        std::string compile_command_in, ShaderReloadEnvironment& environment_in
+    );
+
+    /**
+     * Reads the dependency graph and records the current state of the source tree. Must be called before the first
+     * poll. Changes from before this aren't reported
+     */
+    void start();
+
+    /**
+     * Checks the source tree for changes, and recompiles once they've settled
+     *
+     * \return What the recompile did, or nullopt if this poll didn't recompile
+     */
+    tl::optional<ShaderRecompileResult> poll();
+
+private:
+    std::filesystem::path source_dir;
+
+    std::string compile_command;
+
+    ShaderReloadEnvironment& environment;
+
+    ShaderDependencyGraph dependency_graph;
+
+    /**
+     * Last modification time of each source file
+     */
+    eastl::unordered_map<eastl::string, std::filesystem::file_time_type> source_write_times;
+
+    /**
+     * Sources that changed since the last recompile
+     */
+    eastl::vector<std::filesystem::path> pending_sources;
+
+    /**
+     * Scans the source tree, and returns the files that were added or modified since the last scan
+     */
+    eastl::vector<std::filesystem::path> find_modified_sources();
+
+    ShaderRecompileResult recompile();
+};
+
+/**
+ * Watches the shader source tree, and recompiles shaders when their source or one of their includes changes
+ *
+ * A worker thread polls a ShaderReloadScheduler, which runs the shader compile script
+ */
+class ShaderReloader {
+public:
+    ShaderReloader(
+        const std::filesystem::path& source_dir_in, const std::filesystem::path& output_dir_in,
+        std::string compile_command_in
+    );
+
+    ~ShaderReloader();
+
+    ShaderReloader(const ShaderReloader& other) = delete;
+
+    ShaderReloader& operator=(const ShaderReloader& other) = delete;
+
+    /**
+     * Retrieves the compiled shaders that changed since the last call, as normalized paths
+     */
+    eastl::vector<eastl::string> take_changed_shaders();
+
+private:
+    std::unique_ptr<ShaderReloadEnvironment> environment;
+
+    ShaderReloadScheduler scheduler;
+
+    std::mutex changed_shaders_mutex;
+
+    eastl::vector<eastl::string> changed_shaders;
+
+    std::mutex stop_mutex;
+
+    std::condition_variable stop_condition;
+
+    bool should_stop = false;
+
+    std::thread watch_thread;
+
+    void run_watch_thread();
+
+    /**
+     * Sleeps for the poll interval. Returns false if the reloader is shutting down
+     */
+    bool wait_for_next_poll();
+
+    void report(const ShaderRecompileResult& result);
+};
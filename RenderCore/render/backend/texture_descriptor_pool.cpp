@@ -1,33 +1,45 @@
 #include "texture_descriptor_pool.hpp"
 
-#include <numeric>
+#include <chrono>
+
+#include <EASTL/sort.h>
+#include <tracy/Tracy.hpp>
 
 #include "console/cvars.hpp"
+#include "core/system_interface.hpp"
+#include "render/backend/descriptor_buffer.hpp"
 #include "render/backend/render_backend.hpp"
 
+static std::shared_ptr<spdlog::logger> logger;
+
 static AutoCVar_Int cvar_sampled_image_count{
     "r.RHI.SampledImageCount", "Maximum number of sampled images that the GPU can access", 65536
 };
 
+static auto cvar_max_writes_per_frame = AutoCVar_Int{
+    "r.RHI.TextureDescriptorPool.MaxWritesPerFrame",
+    "Maximum number of new texture descriptors to write each frame. Textures that miss the budget are white until they're written. 0 means no limit",
+    4096
+};
+
 TextureDescriptorPool::TextureDescriptorPool(RenderBackend& backend_in) : backend{ backend_in } {
+    if(logger == nullptr) {
+        logger = SystemInterface::get().get_logger("TextureDescriptorPool");
+    }
+
     auto sampled_image_count = backend.get_physical_device().properties.limits.maxDescriptorSetSampledImages;
     cvar_sampled_image_count.Set(sampled_image_count > INT_MAX ? INT_MAX : static_cast<int32_t>(sampled_image_count / 2));
     sampled_image_count = cvar_sampled_image_count.Get();
 
-    const auto& device = backend_in.get_device();
-
-    const auto pool_sizes = VkDescriptorPoolSize{
-        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-        .descriptorCount = sampled_image_count,
-    };
-    const auto pool_create_info = VkDescriptorPoolCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
-        .maxSets = 1,
-        .poolSizeCount = 1,
-        .pPoolSizes = &pool_sizes,
-    };
-    vkCreateDescriptorPool(device, &pool_create_info, nullptr, &descriptor_pool);
+    if(backend.use_descriptor_buffers()) {
+        // The textures share the persistent region with the other persistent sets. Give them half of it
+        const auto& descriptor_buffer = backend.get_descriptor_buffer();
+        const auto max_descriptors = descriptor_buffer.get_max_descriptors(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            descriptor_buffer.get_region_size(DescriptorBuffer::persistent_region) / 2);
+        sampled_image_count = std::min(sampled_image_count, max_descriptors);
+        cvar_sampled_image_count.Set(static_cast<int32_t>(sampled_image_count));
+    }
 
     const auto binding = VkDescriptorSetLayoutBinding{
         .binding = 0,
@@ -44,6 +56,36 @@ TextureDescriptorPool::TextureDescriptorPool(RenderBackend& backend_in) : backen
     auto& cache = backend.get_descriptor_cache();
     descriptor_set.layout = cache.create_descriptor_layout(&create_info);
 
+    if(backend.use_descriptor_buffers()) {
+        descriptor_set.descriptor_set = backend.get_descriptor_buffer().allocate(
+            DescriptorBuffer::persistent_region,
+            descriptor_set.layout);
+
+    } else {
+        create_descriptor_pool_and_set(sampled_image_count);
+    }
+
+    slot_allocator.emplace(sampled_image_count);
+    slots_holding_default_descriptor.resize(sampled_image_count, true);
+    stats.num_slots = sampled_image_count;
+}
+
+void TextureDescriptorPool::create_descriptor_pool_and_set(const uint32_t sampled_image_count) {
+    const auto& device = backend.get_device();
+
+    const auto pool_sizes = VkDescriptorPoolSize{
+        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = sampled_image_count,
+    };
+    const auto pool_create_info = VkDescriptorPoolCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = &pool_sizes,
+    };
+    vkCreateDescriptorPool(device, &pool_create_info, nullptr, &descriptor_pool);
+
     const auto set_counts = VkDescriptorSetVariableDescriptorCountAllocateInfo{
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
         .descriptorSetCount = 1,
@@ -57,62 +99,189 @@ TextureDescriptorPool::TextureDescriptorPool(RenderBackend& backend_in) : backen
         .pSetLayouts = &descriptor_set.layout,
     };
     vkAllocateDescriptorSets(device, &allocate_info, &descriptor_set.descriptor_set);
-
-    available_handles.resize(sampled_image_count);
-    std::iota(available_handles.begin(), available_handles.end(), 0);
 }
 
 TextureDescriptorPool::~TextureDescriptorPool() {
     const auto& device = backend.get_device();
     
     vkDestroyDescriptorSetLayout(device, descriptor_set.layout, nullptr);
-    vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+    if(descriptor_pool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+    }
 }
 
 uint32_t TextureDescriptorPool::create_texture_srv(const TextureHandle texture, const VkSampler sampler) {
-    const auto handle = available_handles.back();
-    available_handles.pop_back();
+    auto is_new_slot = false;
+    const auto handle = slot_allocator->acquire(texture->image_view, sampler, is_new_slot);
+    update_slot_stats();
 
-    auto image_info = std::make_unique<VkDescriptorImageInfo>(
+    if(is_new_slot) {
+        queue_write(
+            handle,
+            VkDescriptorImageInfo{
+                .sampler = sampler,
+                .imageView = texture->image_view,
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            });
+    }
+
+    return handle;
+}
+
+void TextureDescriptorPool::free_descriptor(const uint32_t handle) {
+    if(!slot_allocator->is_allocated(handle)) {
+        logger->error("Slot {} was freed more times than it was created", handle);
+        return;
+    }
+
+    if(slot_allocator->release(handle, backend.get_current_gpu_frame())) {
+        // The texture may be destroyed before we get to the write
+        pending_writes.erase(handle);
+    }
+
+    update_slot_stats();
+}
+
+void TextureDescriptorPool::free_resources_for_frame(const uint32_t frame_idx) {
+    slot_allocator->free_slots_for_frame(frame_idx);
+    update_slot_stats();
+
+    TracyPlot("Bindless texture slots used", static_cast<int64_t>(stats.num_used_slots));
+    TracyPlot("Bindless texture slots pending free", static_cast<int64_t>(stats.num_pending_free_slots));
+}
+
+const TextureDescriptorPoolStats& TextureDescriptorPool::get_stats() const {
+    return stats;
+}
+
+void TextureDescriptorPool::queue_write(const uint32_t slot, const VkDescriptorImageInfo& image_info) {
+    // Only the last write to a slot matters
+    const auto [itr, is_new] = pending_writes.insert_or_assign(slot, image_info);
+    if(!is_new) {
+        stats.num_collapsed_writes++;
+    }
+}
+
+void TextureDescriptorPool::update_slot_stats() {
+    stats.num_used_slots = slot_allocator->get_num_used_slots();
+    stats.num_pending_free_slots = slot_allocator->get_num_pending_free_slots();
+    stats.num_shared_srvs = slot_allocator->get_num_shared_slots();
+}
+
+void TextureDescriptorPool::write_default_descriptors() {
+    ZoneScoped;
+
+    const auto default_texture = backend.get_white_texture_handle();
+    if(default_texture == nullptr) {
+        return;
+    }
+
+    const auto image_infos = eastl::vector<VkDescriptorImageInfo>(
+        slots_holding_default_descriptor.size(),
         VkDescriptorImageInfo{
-            .sampler = sampler,
-            .imageView = texture->image_view,
+            .sampler = backend.get_default_sampler(),
+            .imageView = default_texture->image_view,
             .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        }
-    );
-
+        });
     const auto write = VkWriteDescriptorSet{
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .dstSet = descriptor_set.descriptor_set,
         .dstBinding = 0,
-        .dstArrayElement = handle,
-        .descriptorCount = 1,
+        .dstArrayElement = 0,
+        .descriptorCount = static_cast<uint32_t>(image_infos.size()),
         .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-        .pImageInfo = image_info.get()
+        .pImageInfo = image_infos.data()
     };
+    write_descriptors({&write, 1});
 
-    image_infos.emplace_back(std::move(image_info));
-    pending_writes.push_back(write);
-
-    return handle;
+    are_default_descriptors_written = true;
 }
 
-void TextureDescriptorPool::free_descriptor(const uint32_t handle) {
-    available_handles.push_back(handle);
+void TextureDescriptorPool::write_descriptors(const std::span<const VkWriteDescriptorSet> writes) const {
+    if(writes.empty()) {
+        return;
+    }
+
+    if(backend.use_descriptor_buffers()) {
+        backend.get_descriptor_buffer().write(writes, descriptor_set.layout);
+    } else {
+        const auto& device = backend.get_device();
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
 }
 
 void TextureDescriptorPool::commit_descriptors() {
-    if (pending_writes.empty()) {
+    if(!are_default_descriptors_written) {
+        write_default_descriptors();
+    }
+
+    if(pending_writes.empty()) {
         return;
     }
 
     ZoneScoped;
 
-    const auto& device = backend.get_device();
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(pending_writes.size()), pending_writes.data(), 0, nullptr);
+    const auto start_time = std::chrono::steady_clock::now();
+
+    auto slots_to_write = eastl::vector<uint32_t>{};
+    slots_to_write.reserve(pending_writes.size());
+    for(const auto& [slot, image_info] : pending_writes) {
+        slots_to_write.push_back(slot);
+    }
+    eastl::sort(slots_to_write.begin(), slots_to_write.end());
+
+    // The bindless set is update-after-bind and partially bound, so we can leave writes for later frames. Slots that
+    // were never written still hold the default texture, which is safe to read. Recycled slots hold a stale descriptor
+    // and must be written now
+    const auto max_writes = cvar_max_writes_per_frame.Get() > 0 ?
+                                static_cast<uint32_t>(cvar_max_writes_per_frame.Get()) :
+                                UINT32_MAX;
+
+    auto image_infos = eastl::vector<VkDescriptorImageInfo>{};
+    // The writes point into this, so it must not reallocate
+    image_infos.reserve(slots_to_write.size());
+    auto writes = eastl::vector<VkWriteDescriptorSet>{};
+    auto num_deferred_writes = 0u;
+
+    for(const auto slot : slots_to_write) {
+        if(image_infos.size() >= max_writes && slots_holding_default_descriptor[slot]) {
+            num_deferred_writes++;
+            continue;
+        }
+
+        const auto itr = pending_writes.find(slot);
+        image_infos.push_back(itr->second);
+        pending_writes.erase(itr);
+        slots_holding_default_descriptor[slot] = false;
+
+        // Merge runs of consecutive slots into one array write
+        if(!writes.empty() && writes.back().dstArrayElement + writes.back().descriptorCount == slot) {
+            writes.back().descriptorCount++;
+        } else {
+            writes.emplace_back(
+                VkWriteDescriptorSet{
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = descriptor_set.descriptor_set,
+                    .dstBinding = 0,
+                    .dstArrayElement = slot,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    .pImageInfo = &image_infos.back()
+                });
+        }
+    }
+
+    write_descriptors(writes);
+
+    const auto commit_time = std::chrono::duration<double, std::milli>{std::chrono::steady_clock::now() - start_time};
+
+    stats.num_descriptors_written = static_cast<uint32_t>(image_infos.size());
+    stats.num_write_calls = static_cast<uint32_t>(writes.size());
+    stats.num_deferred_writes = num_deferred_writes;
+    stats.commit_time_ms = commit_time.count();
 
-    pending_writes.clear();
-    image_infos.clear();
+    TracyPlot("Texture descriptors written", static_cast<int64_t>(stats.num_descriptors_written));
+    TracyPlot("Texture descriptor writes deferred", static_cast<int64_t>(stats.num_deferred_writes));
 }
 
 const DescriptorSet& TextureDescriptorPool::get_descriptor_set() const { return descriptor_set; }
@@ -1,16 +1,68 @@
 #pragma once
 
 #include <memory>
+#include <span>
+#include <EASTL/array.h>
+#include <EASTL/unordered_map.h>
 #include <EASTL/vector.h>
+#include <tl/optional.hpp>
 #include <volk.h>
 
 #include "descriptor_set_builder.hpp"
+#include "render/backend/constants.hpp"
 #include "render/backend/handles.hpp"
+#include "render/backend/texture_slot_allocator.hpp"
 
 class ResourceAllocator;
 class RenderBackend;
+
+struct TextureDescriptorPoolStats {
+    uint32_t num_slots = 0;
+
+    /**
+     * Slots that at least one SRV references
+     */
+    uint32_t num_used_slots = 0;
+
+    /**
+     * Slots that were freed, but that in-flight frames may still read
+     */
+    uint32_t num_pending_free_slots = 0;
+
+    /**
+     * Number of create_texture_srv calls that returned an existing slot, since startup
+     */
+    uint64_t num_shared_srvs = 0;
+
+    /**
+     * Number of writes that replaced a pending write to the same slot, since startup
+     */
+    uint64_t num_collapsed_writes = 0;
+
+    /**
+     * Number of descriptors that the last commit wrote
+     */
+    uint32_t num_descriptors_written = 0;
+
+    /**
+     * Number of VkWriteDescriptorSets that the last commit wrote. Runs of consecutive slots share one
+     */
+    uint32_t num_write_calls = 0;
+
+    /**
+     * Number of pending writes that the last commit left for later frames
+     */
+    uint32_t num_deferred_writes = 0;
+
+    double commit_time_ms = 0;
+};
+
 /**
  * \brief A pool for texture descriptors
+ *
+ * SRVs are deduplicated by image view and sampler. Creating an SRV that already exists returns the existing slot and
+ * adds a reference to it. A slot is freed when its last reference is, and is only reused once the frames that may read
+ * it have finished. TextureSlotAllocator does that bookkeeping, this class writes the descriptors
  */
 class TextureDescriptorPool {
 public:
@@ -18,13 +70,32 @@ public:
 
     ~TextureDescriptorPool();
 
+    /**
+     * Retrieves the slot for the texture and sampler, creating it if needed. Each call must be matched by a call to
+     * free_descriptor
+     */
     uint32_t create_texture_srv(TextureHandle texture, VkSampler sampler);
 
+    /**
+     * Releases a reference to the slot
+     */
     void free_descriptor(uint32_t handle);
 
+    /**
+     * Makes the slots that were freed during the given frame available again. Must be called after the GPU has
+     * finished that frame
+     */
+    void free_resources_for_frame(uint32_t frame_idx);
+
+    const TextureDescriptorPoolStats& get_stats() const;
+
     /**
      * \brief Commits pending descriptor writes
      *
+     * Writes are sorted by slot, and runs of consecutive slots are merged into one write. If there are more writes than
+     * r.RHI.TextureDescriptorPool.MaxWritesPerFrame, the writes to slots that hold the default texture are left for
+     * later frames
+     *
      * Should be called at start of frame
      */
     void commit_descriptors();
@@ -34,12 +105,40 @@ public:
 private:
     RenderBackend& backend;
 
-    VkDescriptorPool descriptor_pool;
+    /**
+     * Only used when we're not using descriptor buffers
+     */
+    VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
 
     DescriptorSet descriptor_set;
 
-    eastl::vector<uint32_t> available_handles;
+    tl::optional<TextureSlotAllocator> slot_allocator;
+
+    /**
+     * Whether each slot still holds the descriptor that we filled the set with. Until it's written, reading the slot
+     * gives the default texture
+     */
+    eastl::vector<bool> slots_holding_default_descriptor;
+
+    TextureDescriptorPoolStats stats;
+
+    /**
+     * Descriptors to write, by slot
+     */
+    eastl::unordered_map<uint32_t, VkDescriptorImageInfo> pending_writes;
+
+    bool are_default_descriptors_written = false;
+
+    void create_descriptor_pool_and_set(uint32_t sampled_image_count);
+
+    void queue_write(uint32_t slot, const VkDescriptorImageInfo& image_info);
+
+    void update_slot_stats();
+
+    /**
+     * Fills every slot with the default texture, so that it's safe to read slots whose write hasn't happened yet
+     */
+    void write_default_descriptors();
 
-    eastl::vector<std::unique_ptr<VkDescriptorImageInfo>> image_infos;
-    eastl::vector<VkWriteDescriptorSet> pending_writes;
+    void write_descriptors(std::span<const VkWriteDescriptorSet> writes) const;
 };
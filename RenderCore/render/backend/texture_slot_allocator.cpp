@@ -0,0 +1,91 @@
+#include "texture_slot_allocator.hpp"
+
+#include <numeric>
+#include <stdexcept>
+
+TextureSlotAllocator::TextureSlotAllocator(const uint32_t num_slots_in) {
+    available_slots.resize(num_slots_in);
+    std::iota(available_slots.begin(), available_slots.end(), 0);
+
+    slots.resize(num_slots_in);
+}
+
+uint32_t TextureSlotAllocator::acquire(const VkImageView image_view, const VkSampler sampler, bool& is_new_slot) {
+    const auto key = SlotKey{.image_view = image_view, .sampler = sampler};
+    if(const auto itr = slots_by_key.find(key); itr != slots_by_key.end()) {
+        slots[itr->second].ref_count++;
+        num_shared_slots++;
+        is_new_slot = false;
+        return itr->second;
+    }
+
+    if(available_slots.empty()) {
+        throw std::runtime_error{"Out of texture descriptors! Consider increasing r.RHI.SampledImageCount"};
+    }
+
+    const auto slot = available_slots.back();
+    available_slots.pop_back();
+
+    slots[slot] = Slot{.key = key, .ref_count = 1};
+    slots_by_key.emplace(key, slot);
+    num_used_slots++;
+
+    is_new_slot = true;
+    return slot;
+}
+
+bool TextureSlotAllocator::release(const uint32_t slot, const uint32_t frame_idx) {
+    if(!is_allocated(slot)) {
+        return false;
+    }
+
+    auto& slot_info = slots[slot];
+    slot_info.ref_count--;
+    if(slot_info.ref_count > 0) {
+        return false;
+    }
+
+    slots_by_key.erase(slot_info.key);
+    slot_info.key = {};
+
+    // The frames in flight may still read the old descriptor
+    zombie_slots[frame_idx].push_back(slot);
+
+    num_used_slots--;
+    num_pending_free_slots++;
+
+    return true;
+}
+
+void TextureSlotAllocator::free_slots_for_frame(const uint32_t frame_idx) {
+    auto& freed_slots = zombie_slots[frame_idx];
+    available_slots.insert(available_slots.end(), freed_slots.begin(), freed_slots.end());
+    num_pending_free_slots -= static_cast<uint32_t>(freed_slots.size());
+    freed_slots.clear();
+}
+
+bool TextureSlotAllocator::is_allocated(const uint32_t slot) const {
+    return slot < slots.size() && slots[slot].ref_count > 0;
+}
+
+uint32_t TextureSlotAllocator::get_num_slots() const {
+    return static_cast<uint32_t>(slots.size());
+}
+
+uint32_t TextureSlotAllocator::get_num_used_slots() const {
+    return num_used_slots;
+}
+
+uint32_t TextureSlotAllocator::get_num_pending_free_slots() const {
+    return num_pending_free_slots;
+}
+
+uint64_t TextureSlotAllocator::get_num_shared_slots() const {
+    return num_shared_slots;
+}
+
+size_t TextureSlotAllocator::SlotKeyHash::operator()(const SlotKey& key) const {
+    const auto view_hash = eastl::hash<uint64_t>{}(reinterpret_cast<uint64_t>(key.image_view));
+    const auto sampler_hash = eastl::hash<uint64_t>{}(reinterpret_cast<uint64_t>(key.sampler));
+    return view_hash ^ (sampler_hash + 0x9e3779b9 + (view_hash << 6) + (view_hash >> 2));
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+
+#include <EASTL/array.h>
+#include <EASTL/unordered_map.h>
+#include <EASTL/vector.h>
+#include <volk.h>
+
+#include "render/backend/constants.hpp"
+
+/**
+ * Hands out the slots of the bindless texture array
+ *
+ * Slots are deduplicated by image view and sampler. Acquiring a slot for a view and sampler that already have one
+ * returns that slot and adds a reference to it. A slot is freed when its last reference is released, and is only
+ * reused once the frame that released it has finished on the GPU
+ *
+ * This only does the bookkeeping. TextureDescriptorPool writes the descriptors
+ */
+class TextureSlotAllocator {
+public:
+    explicit TextureSlotAllocator(uint32_t num_slots_in);
+
+    /**
+     * Retrieves the slot for the image view and sampler, taking a free slot if there's none. Each call must be matched
+     * by a call to release
+     *
+     * \param is_new_slot Set to true if the slot was just taken, and needs its descriptor written
+     */
+    uint32_t acquire(VkImageView image_view, VkSampler sampler, bool& is_new_slot);
+
+    /**
+     * Releases a reference to the slot
+     *
+     * \param frame_idx Index of the current frame. If this was the last reference, the slot becomes available again
+     * when free_slots_for_frame is called for this index
+     * \return True if this was the last reference. False if there are more, or if the slot isn't allocated
+     */
+    bool release(uint32_t slot, uint32_t frame_idx);
+
+    /**
+     * Whether at least one reference holds the slot
+     */
+    bool is_allocated(uint32_t slot) const;
+
+    /**
+     * Makes the slots that were freed during the given frame available again. Must be called after the GPU has
+     * finished that frame
+     */
+    void free_slots_for_frame(uint32_t frame_idx);
+
+    uint32_t get_num_slots() const;
+
+    /**
+     * Slots that at least one reference holds
+     */
+    uint32_t get_num_used_slots() const;
+
+    /**
+     * Slots that were freed, but that in-flight frames may still read
+     */
+    uint32_t get_num_pending_free_slots() const;
+
+    /**
+     * Number of acquire calls that returned an existing slot, since startup
+     */
+    uint64_t get_num_shared_slots() const;
+
+private:
+    struct SlotKey {
+        VkImageView image_view = VK_NULL_HANDLE;
+
+        VkSampler sampler = VK_NULL_HANDLE;
+
+        bool operator==(const SlotKey& other) const = default;
+    };
+
+    struct SlotKeyHash {
+        size_t operator()(const SlotKey& key) const;
+    };
+
+    struct Slot {
+        SlotKey key;
+
+        uint32_t ref_count = 0;
+    };
+
+    eastl::vector<uint32_t> available_slots;
+
+    /**
+     * Contents and reference count of every slot
+     */
+    eastl::vector<Slot> slots;
+
+    eastl::unordered_map<SlotKey, uint32_t, SlotKeyHash> slots_by_key;
+
+    /**
+     * Slots that were freed during each frame. They return to available_slots once that frame has finished
+     */
+    eastl::array<eastl::vector<uint32_t>, num_in_flight_frames> zombie_slots;
+
+    uint32_t num_used_slots = 0;
+
+    uint32_t num_pending_free_slots = 0;
+
+    uint64_t num_shared_slots = 0;
+};
@@ -4,6 +4,7 @@
 #include <tracy/Tracy.hpp>
 
 #include "console/cvars.hpp"
+#include "render/backend/descriptor_buffer.hpp"
 #include "render/backend/render_backend.hpp"
 
 namespace vkutil {
@@ -42,10 +43,21 @@ namespace vkutil {
     }
 
     void DescriptorAllocator::reset_pools() {
+        if(descriptor_buffer != nullptr) {
+            descriptor_buffer->reset_region(descriptor_buffer_region);
+            return;
+        }
+
         for(auto p : usedPools) {
             vkResetDescriptorPool(device, p, 0);
         }
 
+        // Resetting the pools freed every set
+        set_pools.clear();
+        for(auto& sets : zombie_sets) {
+            sets.clear();
+        }
+
         freePools = usedPools;
         usedPools.clear();
         currentPool = VK_NULL_HANDLE;
@@ -55,6 +67,12 @@ namespace vkutil {
         VkDescriptorSet* set, VkDescriptorSetLayout layout,
         const VkDescriptorSetVariableDescriptorCountAllocateInfo* variable_count_info
     ) {
+        if(descriptor_buffer != nullptr) {
+            // Descriptor buffer sets are always as large as the variable-count binding allows
+            *set = descriptor_buffer->allocate(descriptor_buffer_region, layout);
+            return *set != VK_NULL_HANDLE;
+        }
+
         if(currentPool == VK_NULL_HANDLE) {
             currentPool = grab_pool();
             usedPools.push_back(currentPool);
@@ -75,6 +93,9 @@ namespace vkutil {
         switch(alloc_result) {
         case VK_SUCCESS:
             //all good, return
+            if(can_free_sets) {
+                set_pools.emplace(*set, currentPool);
+            }
             return true;
 
         case VK_ERROR_FRAGMENTED_POOL:
@@ -96,6 +117,9 @@ namespace vkutil {
 
             //if it still fails then we have big issues
             if(alloc_result == VK_SUCCESS) {
+                if(can_free_sets) {
+                    set_pools.emplace(*set, currentPool);
+                }
                 return true;
             }
         }
@@ -103,8 +127,51 @@ namespace vkutil {
         return false;
     }
 
-    void DescriptorAllocator::init(VkDevice newDevice) {
+    bool DescriptorAllocator::free(const VkDescriptorSet set, const VkDescriptorSetLayout layout) {
+        if(descriptor_buffer != nullptr) {
+            if(descriptor_buffer_region != DescriptorBuffer::persistent_region) {
+                return false;
+            }
+
+            descriptor_buffer->free(set, layout);
+            return true;
+        }
+
+        if(!can_free_sets) {
+            return false;
+        }
+
+        const auto itr = set_pools.find(set);
+        if(itr == set_pools.end()) {
+            return false;
+        }
+
+        zombie_sets[current_frame_idx].emplace_back(set, itr->second);
+        set_pools.erase(itr);
+        return true;
+    }
+
+    void DescriptorAllocator::free_resources_for_frame(const uint32_t frame_idx) {
+        for(const auto& [set, pool] : zombie_sets[frame_idx]) {
+            vkFreeDescriptorSets(device, pool, 1, &set);
+        }
+        zombie_sets[frame_idx].clear();
+
+        current_frame_idx = frame_idx;
+    }
+
+    void DescriptorAllocator::init(VkDevice newDevice, const bool can_free_sets_in) {
         device = newDevice;
+        can_free_sets = can_free_sets_in;
+    }
+
+    void DescriptorAllocator::use_descriptor_buffer(DescriptorBuffer* descriptor_buffer_in, const uint32_t region) {
+        descriptor_buffer = descriptor_buffer_in;
+        descriptor_buffer_region = region;
+    }
+
+    DescriptorBuffer* DescriptorAllocator::get_descriptor_buffer() const {
+        return descriptor_buffer;
     }
 
     void DescriptorAllocator::cleanup() {
@@ -123,13 +190,18 @@ namespace vkutil {
             freePools.pop_back();
             return pool;
         } else {
-            return createPool(device, descriptorSizes, 100000, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
+            auto flags = VkDescriptorPoolCreateFlags{VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT};
+            if(can_free_sets) {
+                flags |= VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+            }
+            return createPool(device, descriptorSizes, 100000, flags);
         }
     }
 
 
-    void DescriptorLayoutCache::init(VkDevice newDevice) {
+    void DescriptorLayoutCache::init(VkDevice newDevice, const bool use_descriptor_buffers_in) {
         device = newDevice;
+        use_descriptor_buffers = use_descriptor_buffers_in;
     }
 
     VkDescriptorSetLayout
@@ -175,6 +247,28 @@ namespace vkutil {
             }
         }
 
+        // Descriptor buffers can't be used with update-after-bind pools. We don't need them, the descriptors are plain
+        // memory that we can write whenever the GPU isn't reading them
+        auto descriptor_buffer_binding_flags = eastl::vector<VkDescriptorBindingFlags>{};
+        auto descriptor_buffer_flags_create_info = VkDescriptorSetLayoutBindingFlagsCreateInfo{};
+        if(use_descriptor_buffers) {
+            info->flags &= ~VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+            info->flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+
+            const auto* binding_flags_info = static_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfo*>(info->pNext);
+            if(binding_flags_info != nullptr) {
+                descriptor_buffer_binding_flags.assign(
+                    binding_flags_info->pBindingFlags,
+                    binding_flags_info->pBindingFlags + binding_flags_info->bindingCount);
+                for(auto& binding_flags : descriptor_buffer_binding_flags) {
+                    binding_flags &= ~VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+                }
+                descriptor_buffer_flags_create_info = *binding_flags_info;
+                descriptor_buffer_flags_create_info.pBindingFlags = descriptor_buffer_binding_flags.data();
+                info->pNext = &descriptor_buffer_flags_create_info;
+            }
+        }
+
         auto it = layoutCache.find(layout_info);
         if(it != layoutCache.end()) {
             return (*it).second;
@@ -395,28 +489,15 @@ namespace vkutil {
     }
 
     std::optional<VkDescriptorSet> DescriptorBuilder::build(VkDescriptorSetLayout& layout) {
-        const auto variable_descriptor_array_max_size = static_cast<uint32_t>(*CVarSystem::Get()->GetIntCVar(
-            "r.RHI.SampledImageCount"));
-
-        if(is_descriptor_array(bindings.back())) {
-            bindings.back().descriptorCount = variable_descriptor_array_max_size;
-        }
-
-        //build layout first
-        VkDescriptorSetLayoutCreateInfo layoutInfo{};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.pNext = nullptr;
-
-        layoutInfo.pBindings = bindings.data();
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-
-        layout = cache.create_descriptor_layout(&layoutInfo);
+        layout = get_layout();
 
         auto success = false;
         VkDescriptorSet set;
 
         //allocate descriptor
         if(is_descriptor_array(bindings.back())) {
+            const auto variable_descriptor_array_max_size = static_cast<uint32_t>(*CVarSystem::Get()->GetIntCVar(
+                "r.RHI.SampledImageCount"));
             const auto count_info = VkDescriptorSetVariableDescriptorCountAllocateInfo{
                 .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
                 .descriptorSetCount = 1,
@@ -431,24 +512,47 @@ namespace vkutil {
             return std::nullopt;
         }
 
-        //write descriptor
+        update(set);
 
+        return set;
+    }
+
+    VkDescriptorSetLayout DescriptorBuilder::get_layout() {
+        const auto variable_descriptor_array_max_size = static_cast<uint32_t>(*CVarSystem::Get()->GetIntCVar(
+            "r.RHI.SampledImageCount"));
+
+        if(is_descriptor_array(bindings.back())) {
+            bindings.back().descriptorCount = variable_descriptor_array_max_size;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = nullptr;
+
+        layoutInfo.pBindings = bindings.data();
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+
+        return cache.create_descriptor_layout(&layoutInfo);
+    }
+
+    void DescriptorBuilder::update(const VkDescriptorSet set) {
         for(VkWriteDescriptorSet& w : writes) {
             w.dstSet = set;
         }
 
-        {
-            ZoneScopedN("vkUpdateDescriptorSets");
-            vkUpdateDescriptorSets(
-                alloc.device,
-                static_cast<uint32_t>(writes.size()),
-                writes.data(),
-                0,
-                nullptr
-            );
+        if(auto* descriptor_buffer = alloc.get_descriptor_buffer()) {
+            descriptor_buffer->write(writes, get_layout());
+            return;
         }
 
-        return set;
+        ZoneScopedN("vkUpdateDescriptorSets");
+        vkUpdateDescriptorSets(
+            alloc.device,
+            static_cast<uint32_t>(writes.size()),
+            writes.data(),
+            0,
+            nullptr
+        );
     }
 
     std::optional<VkDescriptorSet> DescriptorBuilder::build() {
@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include <EASTL/array.h>
 #include <EASTL/vector.h>
 #include <optional>
 #include <EASTL/unordered_map.h>
@@ -8,9 +9,11 @@
 
 #include "EASTL/span.h"
 #include "render/backend/acceleration_structure.hpp"
+#include "render/backend/constants.hpp"
 #include "render/backend/handles.hpp"
 
 class RenderBackend;
+class DescriptorBuffer;
 
 namespace vkutil {
     class DescriptorAllocator {
@@ -39,7 +42,34 @@ namespace vkutil {
             const VkDescriptorSetVariableDescriptorCountAllocateInfo* variable_count_info = nullptr
         );
 
-        void init(VkDevice newDevice);
+        /**
+         * Frees a single set once the GPU is done with the current frame. Sets can be freed on their own if they came
+         * from the descriptor buffer's persistent region, or from an allocator that was initialized with
+         * can_free_sets_in
+         *
+         * \return False if the set can't be freed. It lives until the allocator's pools are reset
+         */
+        bool free(VkDescriptorSet set, VkDescriptorSetLayout layout);
+
+        /**
+         * Frees the pool sets that were freed during the given frame, and collects the sets freed from now on for
+         * that frame. Must be called after the GPU has finished that frame
+         */
+        void free_resources_for_frame(uint32_t frame_idx);
+
+        /**
+         * \param can_free_sets_in Whether sets from descriptor pools can be freed one at a time. The pools are created
+         * with VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, and we remember which pool each set came from
+         */
+        void init(VkDevice newDevice, bool can_free_sets_in = false);
+
+        /**
+         * Allocates sets from a region of the descriptor buffer instead of from descriptor pools. reset_pools resets the
+         * region
+         */
+        void use_descriptor_buffer(DescriptorBuffer* descriptor_buffer_in, uint32_t region);
+
+        DescriptorBuffer* get_descriptor_buffer() const;
 
         void cleanup();
 
@@ -48,15 +78,37 @@ namespace vkutil {
     private:
         VkDescriptorPool grab_pool();
 
+        DescriptorBuffer* descriptor_buffer = nullptr;
+        uint32_t descriptor_buffer_region = 0;
+
         VkDescriptorPool currentPool{VK_NULL_HANDLE};
         PoolSizes descriptorSizes;
         eastl::vector<VkDescriptorPool> usedPools;
         eastl::vector<VkDescriptorPool> freePools;
+
+        bool can_free_sets = false;
+
+        /**
+         * Pool that each set came from. Only filled in if we can free sets
+         */
+        eastl::unordered_map<VkDescriptorSet, VkDescriptorPool> set_pools;
+
+        /**
+         * Sets that were freed during each frame, with the pools they came from. The GPU may still use them until that
+         * frame finishes
+         */
+        eastl::array<eastl::vector<std::pair<VkDescriptorSet, VkDescriptorPool>>, num_in_flight_frames> zombie_sets;
+
+        uint32_t current_frame_idx = 0;
     };
 
     class DescriptorLayoutCache {
     public:
-        void init(VkDevice newDevice);
+        /**
+         * \param use_descriptor_buffers_in Whether to create layouts for descriptor buffers rather than for descriptor
+         * pools
+         */
+        void init(VkDevice newDevice, bool use_descriptor_buffers_in = false);
 
         void cleanup();
 
@@ -80,6 +132,7 @@ namespace vkutil {
 
         eastl::unordered_map<DescriptorLayoutInfo, VkDescriptorSetLayout, DescriptorLayoutHash> layoutCache;
         VkDevice device;
+        bool use_descriptor_buffers = false;
     };
 
     class DescriptorBuilder {
@@ -139,6 +192,17 @@ namespace vkutil {
 
         std::optional<VkDescriptorSet> build();
 
+        /**
+         * Retrieves the layout of the set that this builder describes
+         */
+        VkDescriptorSetLayout get_layout();
+
+        /**
+         * Writes the bindings into an existing set, instead of allocating a new one. The set must have the layout that
+         * `get_layout` returns, and the GPU must be done with it
+         */
+        void update(VkDescriptorSet set);
+
     private:
         RenderBackend& backend;
 
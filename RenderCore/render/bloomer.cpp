@@ -1,6 +1,10 @@
 #include "bloomer.hpp"
 
+#define A_CPU
 #include "backend/pipeline_cache.hpp"
+#include "extern/spd/ffx_a.h"
+#include "extern/spd/ffx_spd.h"
+
 #include "console/cvars.hpp"
 #include "render/backend/render_graph.hpp"
 #include "render/backend/render_backend.hpp"
@@ -33,232 +37,135 @@ Bloomer::Bloomer() {
             .maxLod = VK_LOD_CLAMP_NONE,
         }
     );
+
+    counter_buffer = backend.get_global_allocator().create_buffer(
+        "Bloom SPD Counter",
+        sizeof(uint32_t),
+        BufferUsage::StorageBuffer);
+    backend.get_upload_queue().upload_to_buffer(counter_buffer, 0u);
 }
 
 void Bloomer::fill_bloom_tex(RenderGraph& graph, const TextureHandle scene_color) {
     ZoneScoped;
 
-    if(bloom_tex == nullptr) {
+    if(bloom_source != scene_color) {
         create_bloom_tex(scene_color);
+        create_descriptor_sets(scene_color);
+        bloom_source = scene_color;
     }
 
-    auto& backend = RenderBackend::get();
-    const auto bloom_0_set = backend.get_transient_descriptor_allocator().build_set(downsample_shader, 0)
-                                    .bind(scene_color, bilinear_sampler)
-                                    .bind(bloom_tex)
-                                    .build();
-    graph.add_compute_dispatch(
-        {
-            .name = "Bloom 0",
-            .descriptor_sets = {bloom_0_set},
-            .num_workgroups = {(bloom_tex_resolution.x + 7) / 8, (bloom_tex_resolution.y + 7) / 8, 1},
-            .compute_shader = downsample_shader
-        }
-    );
+    const auto num_mips = bloom_tex->create_info.mipLevels;
 
     graph.add_pass(
         {
-            .name = "Bloom",
-            .execute = [&](CommandBuffer& commands) {
-                auto dispatch_size = bloom_tex_resolution;
+            .name = "Bloom downsample",
+            .textures = {
+                {
+                    scene_color,
+                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_2_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                },
+                {
+                    bloom_tex,
+                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL
+                }
+            },
+            .buffers = {
+                {
+                    counter_buffer,
+                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+                }
+            },
+            .execute = [=, this](CommandBuffer& commands) {
+                commands.bind_descriptor_set(0, downsample_set);
 
                 commands.bind_pipeline(downsample_shader);
 
-                // We gonna rock down to electric avenue
-                for(auto pass = 0u; pass < cvar_num_bloom_mips.Get() - 1; pass++) {
-                    dispatch_size /= glm::uvec2{2};
-
-                    logger->trace("Bloom downsample pass {}", pass);
-                    logger->trace(
-                        "Transitioning mip {} of bloom tex from layout VK_IMAGE_LAYOUT_GENERAL to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL",
-                        pass
-                    );
-                    logger->trace(
-                        "Transitioning mip {} of bloom tex from layout VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_GENERAL",
-                        pass + 1
-                    );
-                    commands.barrier(
-                        {},
-                        {},
-                        {
-                            VkImageMemoryBarrier2{
-                                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-                                .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                                .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
-                                .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                                .dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT,
-                                .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
-                                .newLayout = VK_IMAGE_LAYOUT_GENERAL,
-                                .image = bloom_tex->image,
-                                .subresourceRange = {
-                                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                                    .baseMipLevel = pass,
-                                    .levelCount = 1,
-                                    .baseArrayLayer = 0,
-                                    .layerCount = 1
-                                }
-                            },
-                            VkImageMemoryBarrier2{
-                                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-                                .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-                                .srcAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
-                                .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                                .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
-                                .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
-                                .newLayout = VK_IMAGE_LAYOUT_GENERAL,
-                                .image = bloom_tex->image,
-                                .subresourceRange = {
-                                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                                    .baseMipLevel = pass + 1,
-                                    .levelCount = 1,
-                                    .baseArrayLayer = 0,
-                                    .layerCount = 1
-                                }
-                            }
-                        }
-                    );
-
-                    auto set = *vkutil::DescriptorBuilder::begin(
-                                    backend,
-                                    backend.get_transient_descriptor_allocator()
-                                )
-                                .bind_image(
-                                    0,
-                                    {
-                                        .sampler = bilinear_sampler, .image = bloom_tex,
-                                        .image_layout = VK_IMAGE_LAYOUT_GENERAL,
-                                        .mip_level = pass
-                                    },
-                                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                    VK_SHADER_STAGE_COMPUTE_BIT
-                                )
-                                .bind_image(
-                                    1,
-                                    {
-                                        .image = bloom_tex, .image_layout = VK_IMAGE_LAYOUT_GENERAL,
-                                        .mip_level = pass + 1
-                                    },
-                                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                                    VK_SHADER_STAGE_COMPUTE_BIT
-                                )
-                                .build();
-
-                    commands.bind_descriptor_set(0, set);
+                varAU2(dispatch_thread_group_count_xy);
+                varAU2(work_group_offset);
+                varAU2(num_work_groups_and_mips);
+                varAU4(rect_info) = initAU4(
+                    0,
+                    0,
+                    scene_color->create_info.extent.width,
+                    scene_color->create_info.extent.height
+                );
+                SpdSetup(
+                    dispatch_thread_group_count_xy,
+                    work_group_offset,
+                    num_work_groups_and_mips,
+                    rect_info,
+                    static_cast<int32_t>(num_mips));
 
-                    commands.dispatch((dispatch_size.x + 7) / 8, (dispatch_size.y + 7) / 8, 1);
+                commands.set_push_constant(0, num_work_groups_and_mips[0]);
+                commands.set_push_constant(1, num_work_groups_and_mips[1]);
+                commands.set_push_constant(2, work_group_offset[0]);
+                commands.set_push_constant(3, work_group_offset[1]);
+                commands.bind_buffer_reference(4, counter_buffer);
 
-                    commands.clear_descriptor_set(0);
-                }
-
-                // And then we take it higher
-                // commands.bind_shader(upsample_shader);
-                // 
-                // for (auto pass = static_cast<uint32_t>(cvar_num_bloom_mips.Get() - 1); pass > 0; pass--) {
-                //     dispatch_size *= glm::uvec2{2};
-                // 
-                //     logger->trace("Bloom upsample pass {}", pass);
-                //     logger->trace("Transitioning mip {} of bloom tex from layout VK_IMAGE_LAYOUT_GENERAL to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL", pass);
-                //     logger->trace("Transitioning mip {} of bloom tex from layout VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL to VK_IMAGE_LAYOUT_GENERAL", pass - 1);
-                //     commands.barrier(
-                //         {}, {}, {
-                //             VkImageMemoryBarrier2{
-                //                 .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-                //                 .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                //                 .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
-                //                 .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                //                 .dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT,
-                //                 .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
-                //                 .newLayout = VK_IMAGE_LAYOUT_GENERAL,
-                //                 .image = bloom_texture_actual.image,
-                //                 .subresourceRange = {
-                //                     .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                //                     .baseMipLevel = pass,
-                //                     .levelCount = 1,
-                //                     .baseArrayLayer = 0,
-                //                     .layerCount = 1
-                //                 }
-                //             },
-                //             VkImageMemoryBarrier2{
-                //                 .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-                //                 .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                //                 .srcAccessMask = VK_ACCESS_2_SHADER_READ_BIT,
-                //                 .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                //                 .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
-                //                 .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
-                //                 .newLayout = VK_IMAGE_LAYOUT_GENERAL,
-                //                 .image = bloom_texture_actual.image,
-                //                 .subresourceRange = {
-                //                     .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                //                     .baseMipLevel = pass - 1,
-                //                     .levelCount = 1,
-                //                     .baseArrayLayer = 0,
-                //                     .layerCount = 1
-                //                 }
-                //             }
-                //         }
-                //     );
-                // 
-                // 
-                //     backend.create_frame_descriptor_builder()
-                //            .bind_image(
-                //                0, {
-                //                    .sampler = bilinear_sampler, .image = bloom_tex,
-                //                    .image_layout = VK_IMAGE_LAYOUT_GENERAL,
-                //                    .mip_level = pass
-                //                }, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT
-                //            )
-                //            .bind_image(
-                //                1, {
-                //                    .image = bloom_tex, .image_layout = VK_IMAGE_LAYOUT_GENERAL,
-                //                    .mip_level = pass - 1
-                //                },
-                //                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT
-                //            )
-                //            .build(set);
-                // 
-                //     commands.bind_descriptor_set(0, set);
-                // 
-                //     commands.dispatch((dispatch_size.x + 7) / 8, (dispatch_size.y + 7) / 8, 1);
-                // }
+                commands.dispatch(dispatch_thread_group_count_xy[0], dispatch_thread_group_count_xy[1], 1);
 
                 commands.clear_descriptor_set(0);
+            }
+        });
+
+    graph.add_pass(
+        {
+            .name = "Bloom upsample",
+            .textures = {
+                {
+                    bloom_tex,
+                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL
+                }
+            },
+            .execute = [=, this](CommandBuffer& commands) {
+                commands.bind_pipeline(upsample_shader);
 
-                // Put the top mip in shader read
-                commands.barrier(
-                    {},
-                    {},
-                    {
-                        VkImageMemoryBarrier2{
-                            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-                            .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                            .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_SHADER_READ_BIT,
-                            .dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
-                            .dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT,
-                            .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
-                            .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                            .image = bloom_tex->image,
-                            .subresourceRange = {
-                                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                                .baseMipLevel = 0,
-                                .levelCount = 6,
-                                .baseArrayLayer = 0,
-                                .layerCount = 1
+                // And then we take it higher
+                for(auto mip = static_cast<int32_t>(num_mips) - 2; mip >= 0; mip--) {
+                    if(mip < static_cast<int32_t>(num_mips) - 2) {
+                        // The last pass wrote to the mip that this pass reads from
+                        commands.barrier(
+                            {},
+                            {},
+                            {
+                                VkImageMemoryBarrier2{
+                                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                                    .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                    .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                                    .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                    .dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT,
+                                    .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+                                    .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+                                    .image = bloom_tex->image,
+                                    .subresourceRange = {
+                                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                        .baseMipLevel = static_cast<uint32_t>(mip + 1),
+                                        .levelCount = 1,
+                                        .baseArrayLayer = 0,
+                                        .layerCount = 1
+                                    }
+                                }
                             }
-                        }
+                        );
                     }
-                );
-            }
-        }
-    );
 
-    graph.set_resource_usage(
-        TextureUsageToken{
-            .texture = bloom_tex,
-            .stage = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
-            .access = VK_ACCESS_2_SHADER_READ_BIT,
-            .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-        }
-    );
+                    commands.bind_descriptor_set(0, upsample_sets[mip]);
+
+                    const auto dispatch_size = glm::max(bloom_tex_resolution >> glm::uvec2{mip}, glm::uvec2{1});
+                    commands.dispatch((dispatch_size.x + 7) / 8, (dispatch_size.y + 7) / 8, 1);
+                }
+
+                commands.clear_descriptor_set(0);
+            }
+        });
 }
 
 TextureHandle Bloomer::get_bloom_tex() const {
@@ -269,6 +176,10 @@ void Bloomer::create_bloom_tex(const TextureHandle scene_color) {
     auto& backend = RenderBackend::get();
     auto& allocator = backend.get_global_allocator();
 
+    if(bloom_tex != nullptr) {
+        allocator.destroy_texture(bloom_tex);
+    }
+
     const auto& create_info = scene_color->create_info;
 
     bloom_tex_resolution = glm::uvec2{create_info.extent.width, create_info.extent.height} / glm::uvec2{2};
@@ -283,3 +194,85 @@ void Bloomer::create_bloom_tex(const TextureHandle scene_color) {
         }
     );
 }
+
+void Bloomer::create_descriptor_sets(const TextureHandle scene_color) {
+    auto& backend = RenderBackend::get();
+    auto& allocator = backend.get_persistent_descriptor_allocator();
+
+    free_descriptor_sets();
+
+    const auto num_mips = bloom_tex->create_info.mipLevels;
+
+    // SPD wants all 12 of its mips bound. Point the ones we don't use at the last real mip. SPD doesn't write to them
+    auto uavs = eastl::fixed_vector<VkDescriptorImageInfo, 12>{};
+    for(auto mip_level = 0u; mip_level < 12; mip_level++) {
+        uavs.emplace_back(
+            VkDescriptorImageInfo{
+                .imageView = bloom_tex->mip_views[glm::min(mip_level, num_mips - 1)],
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+            });
+    }
+
+    downsample_set = vkutil::DescriptorBuilder::begin(backend, allocator)
+                      .bind_image(
+                          0,
+                          {
+                              .sampler = bilinear_sampler,
+                              .image = scene_color,
+                              .image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                          },
+                          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                          VK_SHADER_STAGE_COMPUTE_BIT
+                      )
+                      .bind_image(
+                          1,
+                          uavs.data(),
+                          VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                          VK_SHADER_STAGE_COMPUTE_BIT,
+                          static_cast<uint32_t>(uavs.size())
+                      )
+                      .build(downsample_set_layout).value_or(VK_NULL_HANDLE);
+
+    for(auto mip = 0u; mip + 1 < num_mips; mip++) {
+        upsample_sets.emplace_back(
+            vkutil::DescriptorBuilder::begin(backend, allocator)
+             .bind_image(
+                 0,
+                 {
+                     .sampler = bilinear_sampler,
+                     .image = bloom_tex,
+                     .image_layout = VK_IMAGE_LAYOUT_GENERAL,
+                     .mip_level = mip + 1
+                 },
+                 VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                 VK_SHADER_STAGE_COMPUTE_BIT
+             )
+             .bind_image(
+                 1,
+                 {
+                     .image = bloom_tex,
+                     .image_layout = VK_IMAGE_LAYOUT_GENERAL,
+                     .mip_level = mip
+                 },
+                 VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                 VK_SHADER_STAGE_COMPUTE_BIT
+             )
+             .build(upsample_set_layout).value_or(VK_NULL_HANDLE));
+    }
+}
+
+void Bloomer::free_descriptor_sets() {
+    auto& allocator = RenderBackend::get().get_persistent_descriptor_allocator();
+
+    if(downsample_set != VK_NULL_HANDLE && !allocator.free(downsample_set, downsample_set_layout)) {
+        logger->warn("Could not free the bloom downsample descriptor set");
+    }
+    downsample_set = VK_NULL_HANDLE;
+
+    for(const auto set : upsample_sets) {
+        if(set != VK_NULL_HANDLE && !allocator.free(set, upsample_set_layout)) {
+            logger->warn("Could not free a bloom upsample descriptor set");
+        }
+    }
+    upsample_sets.clear();
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <EASTL/fixed_vector.h>
 #include <glm/vec2.hpp>
 
 #include "render/backend/compute_shader.hpp"
@@ -8,6 +9,16 @@
 class RenderGraph;
 class RenderBackend;
 
+/**
+ * Builds the bloom chain for the scene
+ *
+ * The downsample chain is built in one dispatch with AMD's single pass downsampler, with a Karis average on the first
+ * reduction. Then the upsample chain walks back up the mips, tent-filtering each mip and adding it to the next larger
+ * one. Mip 0 of the bloom texture ends up with the whole chain
+ *
+ * The descriptor sets for every pass are built once, when the bloom texture is created. When the scene color texture
+ * changes, we free the old sets and build new ones
+ */
 class Bloomer {
 public:
     explicit Bloomer();
@@ -19,13 +30,42 @@ public:
 private:
     TextureHandle bloom_tex = nullptr;
 
+    /**
+     * Scene color texture that the descriptor sets read from
+     */
+    TextureHandle bloom_source = nullptr;
+
     ComputePipelineHandle downsample_shader;
     ComputePipelineHandle upsample_shader;
 
     VkSampler bilinear_sampler;
 
+    /**
+     * SPD's global atomic counter. SPD resets it at the end of each dispatch, so we only clear it once
+     */
+    BufferHandle counter_buffer = nullptr;
+
     glm::uvec2 bloom_tex_resolution = {};
 
+    VkDescriptorSet downsample_set = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout downsample_set_layout = VK_NULL_HANDLE;
+
+    /**
+     * Upsample descriptor set for each mip, indexed by the mip that the pass writes to
+     */
+    eastl::fixed_vector<VkDescriptorSet, 12> upsample_sets;
+
+    VkDescriptorSetLayout upsample_set_layout = VK_NULL_HANDLE;
+
     void create_bloom_tex(TextureHandle scene_color);
+
+    void create_descriptor_sets(TextureHandle scene_color);
+
+    /**
+     * Returns the descriptor sets to the persistent allocator. The GPU may still be using them, so the allocator waits
+     * until the current frame has finished
+     */
+    void free_descriptor_sets();
 };
 
@@ -0,0 +1,235 @@
+#include "clustered_light_culler.hpp"
+
+#include <tracy/Tracy.hpp>
+
+#include "console/cvars.hpp"
+#include "render/render_scene.hpp"
+#include "render/scene_view.hpp"
+#include "render/backend/pipeline_cache.hpp"
+#include "render/backend/render_backend.hpp"
+#include "render/backend/render_graph.hpp"
+
+static auto cvar_enable_punctual_lights = AutoCVar_Int{
+    "r.Lights.Punctual", "Whether to shade with the scene's point and spot lights", 1
+};
+
+static auto cvar_cluster_far_plane = AutoCVar_Float{
+    "r.Lights.ClusterFarPlane",
+    "View depth where the light clusters end, in meters. Punctual lights don't light anything past it",
+    200.f
+};
+
+static float3 unproject(const ViewDataGPU& view, const float z_near, const float2 ndc_xy, const float view_depth) {
+    // Infinite reversed-z, so the NDC depth is z_near / view depth
+    const auto viewspace_position = view.inverse_projection * float4{ndc_xy, z_near / view_depth, 1.f};
+    return float3{viewspace_position} / viewspace_position.w;
+}
+
+static bool does_light_touch_cluster(
+    const PunctualLightGPU& light, const ViewDataGPU& view, const float3& cluster_min, const float3& cluster_max
+) {
+    const auto light_position = float3{view.view * float4{light.position, 1.f}};
+
+    // Sphere vs AABB
+    const auto closest_point = glm::clamp(light_position, cluster_min, cluster_max);
+    const auto to_closest_point = closest_point - light_position;
+    if(glm::dot(to_closest_point, to_closest_point) > light.range * light.range) {
+        return false;
+    }
+
+    if(light.type != PUNCTUAL_LIGHT_TYPE_SPOT) {
+        return true;
+    }
+
+    // Cone vs the cluster's bounding sphere. See https://bartwronski.com/2017/04/13/cull-that-cone/
+    const auto light_direction = glm::normalize(float3{view.view * float4{light.direction, 0.f}});
+    const auto sphere_center = (cluster_min + cluster_max) * 0.5f;
+    const auto sphere_radius = glm::length(cluster_max - cluster_min) * 0.5f;
+
+    const auto to_center = sphere_center - light_position;
+    const auto distance_along_axis = glm::dot(to_center, light_direction);
+    const auto distance_from_axis = glm::sqrt(
+        glm::max(glm::dot(to_center, to_center) - distance_along_axis * distance_along_axis, 0.f));
+    const auto sin_outer_angle = glm::sqrt(glm::max(1.f - light.cos_outer_angle * light.cos_outer_angle, 0.f));
+
+    const auto distance_to_cone = light.cos_outer_angle * distance_from_axis - distance_along_axis * sin_outer_angle;
+
+    return distance_to_cone <= sphere_radius && distance_along_axis >= -sphere_radius;
+}
+
+LightClusterConstants ClusteredLightCuller::get_cluster_constants(const SceneView& view, const uint32_t num_lights) {
+    const auto z_near = view.get_near();
+    const auto z_far = glm::max(cvar_cluster_far_plane.GetFloat(), z_near * 2.f);
+    return LightClusterConstants{
+        .z_near = z_near,
+        .z_far = z_far,
+        .slice_scale = static_cast<float>(LIGHT_CLUSTERS_Z) / glm::log(z_far / z_near),
+        .num_lights = num_lights,
+    };
+}
+
+void ClusteredLightCuller::cull_lights_cpu(
+    const std::span<const PunctualLightGPU> lights, const ViewDataGPU& view, const LightClusterConstants& constants,
+    eastl::vector<uint32_t>& cluster_light_counts, eastl::vector<uint32_t>& cluster_light_indices
+) {
+    ZoneScoped;
+
+    cluster_light_counts.clear();
+    cluster_light_counts.resize(NUM_LIGHT_CLUSTERS, 0);
+    cluster_light_indices.clear();
+    cluster_light_indices.resize(NUM_LIGHT_CLUSTERS * MAX_LIGHTS_PER_CLUSTER, 0);
+
+    const auto num_tiles = float2{LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y};
+    const auto depth_ratio = constants.z_far / constants.z_near;
+
+    for(auto z = 0u; z < LIGHT_CLUSTERS_Z; z++) {
+        const auto slice_near = constants.z_near * glm::pow(depth_ratio, static_cast<float>(z) / LIGHT_CLUSTERS_Z);
+        const auto slice_far = constants.z_near * glm::pow(depth_ratio, static_cast<float>(z + 1) / LIGHT_CLUSTERS_Z);
+
+        for(auto y = 0u; y < LIGHT_CLUSTERS_Y; y++) {
+            for(auto x = 0u; x < LIGHT_CLUSTERS_X; x++) {
+                const auto tile_min = float2{x, y} / num_tiles * 2.f - 1.f;
+                const auto tile_max = float2{x + 1, y + 1} / num_tiles * 2.f - 1.f;
+
+                auto cluster_min = unproject(view, constants.z_near, tile_min, slice_near);
+                auto cluster_max = cluster_min;
+                for(auto corner = 1u; corner < 8; corner++) {
+                    const auto ndc_xy = float2{
+                        (corner & 1) != 0 ? tile_max.x : tile_min.x,
+                        (corner & 2) != 0 ? tile_max.y : tile_min.y
+                    };
+                    const auto position = unproject(
+                        view, constants.z_near, ndc_xy, (corner & 4) != 0 ? slice_far : slice_near);
+                    cluster_min = glm::min(cluster_min, position);
+                    cluster_max = glm::max(cluster_max, position);
+                }
+
+                const auto cluster_index = x + y * LIGHT_CLUSTERS_X + z * LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y;
+                const auto first_slot = cluster_index * MAX_LIGHTS_PER_CLUSTER;
+                auto& count = cluster_light_counts[cluster_index];
+
+                for(auto light_index = 0u; light_index < lights.size(); light_index++) {
+                    if(count == MAX_LIGHTS_PER_CLUSTER) {
+                        break;
+                    }
+                    if(does_light_touch_cluster(lights[light_index], view, cluster_min, cluster_max)) {
+                        cluster_light_indices[first_slot + count] = light_index;
+                        count++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+ClusteredLightCuller::ClusteredLightCuller() {
+    auto& backend = RenderBackend::get();
+
+    cull_pipeline = backend.get_pipeline_cache().create_pipeline("shaders/lighting/cull_punctual_lights.comp.spv");
+
+    shading_pipeline = backend.begin_building_pipeline("Punctual Lighting")
+                              .set_vertex_shader("shaders/common/fullscreen.vert.spv")
+                              .set_fragment_shader("shaders/lighting/punctual_lights.frag.spv")
+                              .set_depth_state(
+                                  DepthStencilState{
+                                      .enable_depth_write = false,
+                                      .compare_op = VK_COMPARE_OP_LESS
+                                  }
+                              )
+                              .set_blend_mode(BlendMode::Additive)
+                              .build();
+
+    auto& allocator = backend.get_global_allocator();
+    cluster_light_counts = allocator.create_buffer(
+        "Cluster light counts",
+        NUM_LIGHT_CLUSTERS * sizeof(uint32_t),
+        BufferUsage::StorageBuffer);
+    cluster_light_indices = allocator.create_buffer(
+        "Cluster light indices",
+        NUM_LIGHT_CLUSTERS * MAX_LIGHTS_PER_CLUSTER * sizeof(uint32_t),
+        BufferUsage::StorageBuffer);
+}
+
+ClusteredLightCuller::~ClusteredLightCuller() {
+    auto& allocator = RenderBackend::get().get_global_allocator();
+    allocator.destroy_buffer(cluster_light_counts);
+    allocator.destroy_buffer(cluster_light_indices);
+}
+
+void ClusteredLightCuller::cull_lights(RenderGraph& graph, const SceneView& view, const RenderScene& scene) {
+    ZoneScoped;
+
+    const auto num_lights = scene.get_num_punctual_lights();
+    if(num_lights == 0 || cvar_enable_punctual_lights.Get() == 0) {
+        lights_buffer = nullptr;
+        return;
+    }
+
+    lights_buffer = scene.get_punctual_lights_buffer();
+    constants = get_cluster_constants(view, num_lights);
+
+    const auto set = RenderBackend::get().get_transient_descriptor_allocator()
+                                         .build_set(cull_pipeline, 0)
+                                         .bind(view.get_buffer())
+                                         .bind(lights_buffer)
+                                         .bind(cluster_light_counts)
+                                         .bind(cluster_light_indices)
+                                         .build();
+
+    graph.add_compute_dispatch(
+        ComputeDispatch<LightClusterConstants>{
+            .name = "Cull punctual lights",
+            .descriptor_sets = {set},
+            .push_constants = constants,
+            .num_workgroups = {LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z},
+            .compute_shader = cull_pipeline
+        });
+}
+
+void ClusteredLightCuller::get_lighting_resource_usages(BufferUsageList& buffers) const {
+    if(lights_buffer == nullptr) {
+        return;
+    }
+
+    for(const auto buffer : {lights_buffer, cluster_light_counts, cluster_light_indices}) {
+        buffers.emplace_back(
+            BufferUsageToken{
+                .buffer = buffer,
+                .stage = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                .access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+            });
+    }
+}
+
+void ClusteredLightCuller::add_to_lit_scene(CommandBuffer& commands, const BufferHandle view_buffer) const {
+    ZoneScoped;
+
+    if(lights_buffer == nullptr) {
+        return;
+    }
+
+    const auto set = RenderBackend::get().get_transient_descriptor_allocator()
+                                         .build_set(shading_pipeline, 1)
+                                         .bind(view_buffer)
+                                         .bind(lights_buffer)
+                                         .bind(cluster_light_counts)
+                                         .bind(cluster_light_indices)
+                                         .build();
+
+    commands.begin_label("Punctual Lighting");
+
+    commands.bind_pipeline(shading_pipeline);
+
+    commands.bind_descriptor_set(1, set);
+
+    commands.set_push_constant(0, constants.z_near);
+    commands.set_push_constant(1, constants.z_far);
+    commands.set_push_constant(2, constants.slice_scale);
+    commands.set_push_constant(3, constants.num_lights);
+
+    commands.draw_triangle();
+
+    commands.clear_descriptor_set(1);
+
+    commands.end_label();
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <span>
+
+#include <EASTL/vector.h>
+
+#include "render/backend/buffer_usage_token.hpp"
+#include "render/backend/handles.hpp"
+#include "shared/punctual_lights.hpp"
+#include "shared/view_data.hpp"
+
+class CommandBuffer;
+class RenderGraph;
+class RenderScene;
+class SceneView;
+
+/**
+ * Culls the scene's punctual lights to a froxel grid, and shades the lit scene with them
+ *
+ * The grid is LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y tiles in screen space, and LIGHT_CLUSTERS_Z slices in view depth.
+ * The slices are spaced exponentially between the near plane and r.Lights.ClusterFarPlane, so that near clusters are
+ * about as deep as they are wide. A compute pass tests every light against every cluster's viewspace bounds and writes
+ * each cluster's light indices to its own MAX_LIGHTS_PER_CLUSTER slots. The shading pass then reads the list for each
+ * pixel's cluster, so the cost of a pixel depends on how many lights are near it rather than on how many lights are in
+ * the scene
+ */
+class ClusteredLightCuller {
+public:
+    /**
+     * Computes the cluster grid's constants for a view
+     */
+    static LightClusterConstants get_cluster_constants(const SceneView& view, uint32_t num_lights);
+
+    /**
+     * Culls lights on the CPU. Reference implementation of the GPU culling, for validating it
+     *
+     * Writes the same layout as the GPU: one count per cluster, and MAX_LIGHTS_PER_CLUSTER index slots per cluster.
+     * Each cluster gets the same set of lights as on the GPU, but the GPU doesn't write them in any particular order
+     */
+    static void cull_lights_cpu(
+        std::span<const PunctualLightGPU> lights, const ViewDataGPU& view, const LightClusterConstants& constants,
+        eastl::vector<uint32_t>& cluster_light_counts, eastl::vector<uint32_t>& cluster_light_indices
+    );
+
+    ClusteredLightCuller();
+
+    ~ClusteredLightCuller();
+
+    /**
+     * Builds the light list for each cluster. Does nothing if the scene has no punctual lights
+     */
+    void cull_lights(RenderGraph& graph, const SceneView& view, const RenderScene& scene);
+
+    void get_lighting_resource_usages(BufferUsageList& buffers) const;
+
+    /**
+     * Adds the light from the punctual lights to the lit scene. Expects the gbuffer descriptor set to be bound to set 0
+     */
+    void add_to_lit_scene(CommandBuffer& commands, BufferHandle view_buffer) const;
+
+private:
+    ComputePipelineHandle cull_pipeline = nullptr;
+
+    GraphicsPipelineHandle shading_pipeline = nullptr;
+
+    /**
+     * Number of lights in each cluster
+     */
+    BufferHandle cluster_light_counts = nullptr;
+
+    /**
+     * MAX_LIGHTS_PER_CLUSTER indices into the scene's light buffer for each cluster
+     */
+    BufferHandle cluster_light_indices = nullptr;
+
+    /**
+     * The scene's light buffer, as of the most recent cull. Null if the scene has no lights
+     */
+    BufferHandle lights_buffer = nullptr;
+
+    LightClusterConstants constants = {};
+};
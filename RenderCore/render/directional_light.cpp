@@ -13,6 +13,7 @@
 #include "render/backend/render_backend.hpp"
 #include "render/backend/resource_allocator.hpp"
 #include "render/backend/command_buffer.hpp"
+#include "render/backend/render_graph.hpp"
 #include "render/scene_view.hpp"
 #include "console/cvars.hpp"
 #include "core/system_interface.hpp"
@@ -39,10 +40,47 @@ static auto cvar_shadow_cascade_split_lambda = AutoCVar_Float{
     "Factor to use when calculating shadow cascade splits", 0.95
 };
 
+static auto cvar_shadow_cull_receivers = AutoCVar_Int{
+    "r.Shadow.CSM.CullReceivers",
+    "Whether to cull shadow casters whose shadows can't reach the visible part of the scene", 1
+};
+
+static auto cvar_shadow_cache_static_casters = AutoCVar_Int{
+    "r.Shadow.CSM.CacheStaticCasters",
+    "Whether to cache the depth of static shadow casters, and only re-render dynamic casters on top of it", 1
+};
+
+static auto cvar_shadow_far_cascade_update_interval = AutoCVar_Int{
+    "r.Shadow.CSM.FarCascadeUpdateInterval",
+    "Number of frames between updates of the far shadow cascades. 1 updates them every frame", 4
+};
+
+static auto cvar_shadow_first_staggered_cascade = AutoCVar_Int{
+    "r.Shadow.CSM.FirstStaggeredCascade",
+    "Index of the first cascade that's only updated every r.Shadow.CSM.FarCascadeUpdateInterval frames", 2
+};
+
 static auto cvar_shadow_samples = AutoCVar_Int{
     "r.Shadow.RT.NumSamples", "Number of rays to send for ray traced shadows", 8
 };
 
+/**
+ * Push constants for the shadow culling shader. Must match shaders/culling/shadow_culling.comp.slang
+ */
+struct ShadowCullingConstants {
+    eastl::array<glm::vec4, 6> receiver_frustum;
+    uint32_t num_primitives;
+    uint32_t num_cascades;
+    uint32_t receiver_cull_cascade_mask;
+    uint32_t static_cascade_mask;
+    uint32_t dynamic_cascade_mask;
+    uint32_t separate_dynamic_casters;
+};
+
+static glm::vec4 normalize_plane(const glm::vec4 plane) {
+    return plane / glm::length(glm::vec3{plane});
+}
+
 DirectionalLight::DirectionalLight() {
     logger = SystemInterface::get().get_logger("SunLight");
 
@@ -79,6 +117,18 @@ DirectionalLight::DirectionalLight() {
                           }
                       )
                       .build();
+
+    shadow_culling_pipeline = backend.get_pipeline_cache()
+                                     .create_pipeline("shaders/culling/shadow_culling.comp.spv");
+
+    copy_static_shadows_pso = backend.begin_building_pipeline("Copy static shadows")
+                                     .set_vertex_shader("shaders/common/fullscreen.vert.spv")
+                                     .set_fragment_shader("shaders/util/copy_depth_array_layer.frag.spv")
+                                     .set_depth_state(
+                                         {
+                                             .compare_op = VK_COMPARE_OP_ALWAYS
+                                         })
+                                     .build();
 }
 
 void DirectionalLight::update_shadow_cascades(const SceneView& view) {
@@ -90,6 +140,11 @@ void DirectionalLight::update_shadow_cascades(const SceneView& view) {
             allocator.destroy_texture(shadowmap_handle);
             shadowmap_handle = nullptr;
         }
+        if(static_shadowmap_handle != nullptr) {
+            allocator.destroy_texture(static_shadowmap_handle);
+            static_shadowmap_handle = nullptr;
+        }
+        invalidate_shadow_cache();
         return;
     }
 
@@ -107,11 +162,37 @@ void DirectionalLight::update_shadow_cascades(const SceneView& view) {
                 static_cast<uint32_t>(cvar_num_shadow_cascades.Get())
             }
         );
+        invalidate_shadow_cache();
+    }
+
+    const auto cache_static_casters = cvar_shadow_cache_static_casters.Get() != 0;
+    if(cache_static_casters && static_shadowmap_handle == nullptr) {
+        static_shadowmap_handle = allocator.create_texture(
+            "Sun static shadow cache",
+            {
+                VK_FORMAT_D16_UNORM,
+                glm::uvec2{
+                    cvar_shadow_cascade_resolution.Get(),
+                    cvar_shadow_cascade_resolution.Get()
+                },
+                1,
+                TextureUsage::RenderTarget,
+                static_cast<uint32_t>(cvar_num_shadow_cascades.Get())
+            }
+        );
+        invalidate_shadow_cache();
+    } else if(!cache_static_casters && static_shadowmap_handle != nullptr) {
+        allocator.destroy_texture(static_shadowmap_handle);
+        static_shadowmap_handle = nullptr;
+        invalidate_shadow_cache();
     }
 
     const auto num_cascades = static_cast<uint32_t>(cvar_num_shadow_cascades.Get());
     const auto max_shadow_distance = static_cast<float>(cvar_max_shadow_distance.Get());
     const auto cascade_split_lambda = static_cast<float>(cvar_shadow_cascade_split_lambda.Get());
+    const auto csm_resolution = static_cast<uint32_t>(cvar_shadow_cascade_resolution.Get());
+    const auto update_interval = static_cast<uint32_t>(glm::max(cvar_shadow_far_cascade_update_interval.Get(), 1));
+    const auto first_staggered_cascade = static_cast<uint32_t>(glm::max(cvar_shadow_first_staggered_cascade.Get(), 0));
 
     // Shadow frustum fitting code based on
     // https://github.com/SaschaWillems/Vulkan/blob/master/examples/shadowmappingcascade/shadowmappingcascade.cpp#L637,
@@ -200,6 +281,17 @@ void DirectionalLight::update_shadow_cascades(const SceneView& view) {
         // Shadow cascade frustum
         const auto light_dir = glm::normalize(glm::vec3{constants.direction_and_tan_size});
 
+        // Snap the cascade's center to its texel grid in light space. Texels stay put in the world as the camera moves,
+        // which stops shadow edges from shimmering and lets cached cascades stay valid until the camera moves a full
+        // texel
+        {
+            const auto light_rotation = glm::lookAt(glm::vec3{0.f}, light_dir, glm::vec3{0.f, 1.f, 0.f});
+            const auto texel_size = radius * 2.f / static_cast<float>(csm_resolution);
+            auto lightspace_center = glm::vec3{light_rotation * glm::vec4{frustum_center, 1.f}};
+            lightspace_center = glm::floor(lightspace_center / texel_size) * texel_size;
+            frustum_center = glm::vec3{glm::inverse(light_rotation) * glm::vec4{lightspace_center, 1.f}};
+        }
+
         const auto light_view_matrix = glm::lookAt(
             frustum_center - light_dir * radius,
             frustum_center,
@@ -207,16 +299,59 @@ void DirectionalLight::update_shadow_cascades(const SceneView& view) {
         );
         const auto light_projection_matrix = glm::ortho(-radius, radius, -radius, radius, 0.f, radius + radius);
 
+        // Far cascades only update every few frames, staggered so that they don't all update on the same frame. Until
+        // then they keep the matrix they were rendered with
+        auto& state = cascade_states[i];
+        state.render_this_frame = true;
+        if(state.is_valid && update_interval > 1 && i >= first_staggered_cascade) {
+            state.render_this_frame = (cascade_update_frame + i) % update_interval == 0;
+        }
+
+        state.render_static_this_frame = false;
+        if(state.render_this_frame) {
+            const auto cascade_matrix = light_projection_matrix * light_view_matrix;
+            if(cascade_matrix != state.matrix) {
+                state.matrix = cascade_matrix;
+                state.is_static_cache_valid = false;
+            }
+            state.is_valid = true;
+
+            if(cache_static_casters && !state.is_static_cache_valid) {
+                state.render_static_this_frame = true;
+                state.is_static_cache_valid = true;
+            }
+        }
+
         // Store split distance and matrix in cascade
         constants.data[i] = glm::vec4{};
         constants.data[i].x = split_distance * clip_range * -1;
-        constants.cascade_matrices[i] = light_projection_matrix * light_view_matrix;
+        constants.cascade_matrices[i] = state.matrix;
         constants.cascade_inverse_matrices[i] = glm::inverse(constants.cascade_matrices[i]);
 
         last_split_distance = cascade_splits[i];
     }
 
-    const auto csm_resolution = static_cast<uint32_t>(cvar_shadow_cascade_resolution.Get());
+    // Extract the planes of the shadowed part of the view frustum, for receiver culling
+    // See https://www.gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf
+    {
+        const auto projection_matrix = glm::perspectiveFov(
+            view.get_fov(),
+            view.get_aspect_ratio(),
+            1.f,
+            z_near,
+            clip_range
+        );
+        const auto view_projection_t = glm::transpose(projection_matrix * view.get_gpu_data().view);
+        receiver_frustum_planes[0] = normalize_plane(view_projection_t[3] + view_projection_t[0]);
+        receiver_frustum_planes[1] = normalize_plane(view_projection_t[3] - view_projection_t[0]);
+        receiver_frustum_planes[2] = normalize_plane(view_projection_t[3] + view_projection_t[1]);
+        receiver_frustum_planes[3] = normalize_plane(view_projection_t[3] - view_projection_t[1]);
+        receiver_frustum_planes[4] = normalize_plane(view_projection_t[3] + view_projection_t[2]);
+        receiver_frustum_planes[5] = normalize_plane(view_projection_t[3] - view_projection_t[2]);
+    }
+
+    cascade_update_frame++;
+
     constants.csm_resolution.x = csm_resolution;
     constants.csm_resolution.y = csm_resolution;
 
@@ -230,7 +365,12 @@ void DirectionalLight::update_shadow_cascades(const SceneView& view) {
 }
 
 void DirectionalLight::set_direction(const glm::vec3& direction) {
-    constants.direction_and_tan_size = glm::vec4{glm::normalize(direction), tan(glm::radians(angular_size))};
+    const auto new_direction_and_tan_size = glm::vec4{glm::normalize(direction), tan(glm::radians(angular_size))};
+    if(new_direction_and_tan_size != constants.direction_and_tan_size) {
+        invalidate_shadow_cache();
+    }
+
+    constants.direction_and_tan_size = new_direction_and_tan_size;
     sun_buffer_dirty = true;
 }
 
@@ -279,51 +419,291 @@ glm::vec3 DirectionalLight::get_direction() const {
     return glm::normalize(glm::vec3{constants.direction_and_tan_size});
 }
 
+glm::vec4 DirectionalLight::get_color() const {
+    return constants.color;
+}
+
+void DirectionalLight::invalidate_shadow_cache() {
+    for(auto& state : cascade_states) {
+        state.is_valid = false;
+        state.is_static_cache_valid = false;
+    }
+}
+
 SunShadowMode DirectionalLight::get_shadow_mode() {
     return cvar_sun_shadow_mode.Get();
 }
 
-void DirectionalLight::render_shadows(RenderGraph& graph, const RenderScene& scene) const {
+void DirectionalLight::render_shadows(RenderGraph& graph, const RenderScene& scene) {
+    ZoneScoped;
+
+    if(cvar_sun_shadow_mode.Get() != SunShadowMode::CascadedShadowMaps) {
+        return;
+    }
+
+    const auto num_cascades = static_cast<uint32_t>(cvar_num_shadow_cascades.Get());
+    const auto cache_static_casters = static_shadowmap_handle != nullptr;
+
+    // Cascades that need any rendering this frame, and cascades that need their static casters rendered. Without the
+    // static cache, every caster is treated as static and drawn straight into the shadowmap
+    auto render_cascade_mask = 0u;
+    auto static_cascade_mask = 0u;
+    for(auto cascade = 0u; cascade < num_cascades; cascade++) {
+        const auto& state = cascade_states[cascade];
+        if(state.render_this_frame) {
+            render_cascade_mask |= 1u << cascade;
+        }
+        if(!cache_static_casters ? state.render_this_frame : state.render_static_this_frame) {
+            static_cascade_mask |= 1u << cascade;
+        }
+    }
+    const auto dynamic_cascade_mask = cache_static_casters ? render_cascade_mask : 0u;
+
+    // Receiver culling depends on the current view, so only cull in cascades that get re-rendered every frame
+    auto receiver_cull_cascade_mask = 0u;
+    if(cvar_shadow_cull_receivers.Get() != 0) {
+        const auto update_interval = cvar_shadow_far_cascade_update_interval.Get();
+        const auto first_staggered_cascade = static_cast<uint32_t>(glm::max(
+            cvar_shadow_first_staggered_cascade.Get(),
+            0));
+        for(auto cascade = 0u; cascade < num_cascades; cascade++) {
+            if(update_interval <= 1 || cascade < first_staggered_cascade) {
+                receiver_cull_cascade_mask |= 1u << cascade;
+            }
+        }
+    }
+
+    if(render_cascade_mask == 0) {
+        return;
+    }
+
     auto& backend = RenderBackend::get();
-    if(cvar_sun_shadow_mode.Get() == SunShadowMode::CascadedShadowMaps) {
-        const auto& pipelines = scene.get_material_storage().get_pipelines();
-        const auto shadow_pso = pipelines.get_shadow_pso();
-        const auto shadow_masked_pso = pipelines.get_shadow_masked_pso();
-
-        const auto solid_set = backend.get_transient_descriptor_allocator()
-                                      .build_set(shadow_pso, 0)
-                                      .bind(scene.get_primitive_buffer())
-                                      .bind(world_to_ndc_matrices_buffer)
-                                      .build();
-
-        const auto masked_set = backend.get_transient_descriptor_allocator()
-                                       .build_set(shadow_masked_pso, 0)
-                                       .bind(scene.get_primitive_buffer())
-                                       .bind(world_to_ndc_matrices_buffer)
-                                       .build();
+    auto& allocator = backend.get_global_allocator();
+
+    const auto num_primitives = scene.get_total_num_primitives();
+    // Solid static, masked static, solid dynamic, and masked dynamic draws for each cascade
+    const auto num_lists = num_cascades * 4;
+
+    const auto draw_commands = allocator.create_buffer(
+        "Shadow draw commands",
+        sizeof(VkDrawIndexedIndirectCommand) * num_primitives * num_lists,
+        BufferUsage::IndirectBuffer);
+    const auto draw_counts = allocator.create_buffer(
+        "Shadow draw counts",
+        sizeof(uint32_t) * num_lists,
+        BufferUsage::IndirectBuffer);
+    const auto primitive_ids = allocator.create_buffer(
+        "Shadow primitive IDs",
+        sizeof(uint32_t) * num_primitives * num_lists,
+        BufferUsage::VertexBuffer);
+
+    graph.add_pass(
+        {
+            .name = "Clear shadow draw counts",
+            .buffers = {
+                {
+                    .buffer = draw_counts,
+                    .stage = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                    .access = VK_ACCESS_2_TRANSFER_WRITE_BIT
+                }
+            },
+            .execute = [&](CommandBuffer& commands) {
+                commands.fill_buffer(draw_counts, 0);
+            }
+        });
+
+    const auto culling_set = backend.get_transient_descriptor_allocator()
+                                    .build_set(shadow_culling_pipeline, 0)
+                                    .bind(scene.get_primitive_buffer())
+                                    .bind(sun_buffer)
+                                    .bind(scene.get_meshes().get_draw_args_buffer())
+                                    .bind(draw_commands)
+                                    .bind(draw_counts)
+                                    .bind(primitive_ids)
+                                    .build();
+
+    graph.add_compute_dispatch<ShadowCullingConstants>(
+        {
+            .name = "Cull shadow casters",
+            .descriptor_sets = {culling_set},
+            .push_constants = ShadowCullingConstants{
+                .receiver_frustum = receiver_frustum_planes,
+                .num_primitives = num_primitives,
+                .num_cascades = num_cascades,
+                .receiver_cull_cascade_mask = receiver_cull_cascade_mask,
+                .static_cascade_mask = static_cascade_mask,
+                .dynamic_cascade_mask = dynamic_cascade_mask,
+                .separate_dynamic_casters = cache_static_casters ? 1u : 0u
+            },
+            .num_workgroups = {(num_primitives + 95) / 96, 1, 1},
+            .compute_shader = shadow_culling_pipeline
+        });
+
+    const auto& pipelines = scene.get_material_storage().get_pipelines();
+    const auto shadow_pso = pipelines.get_shadow_pso();
+    const auto shadow_masked_pso = pipelines.get_shadow_masked_pso();
+
+    const auto solid_set = backend.get_transient_descriptor_allocator()
+                                  .build_set(shadow_pso, 0)
+                                  .bind(scene.get_primitive_buffer())
+                                  .bind(world_to_ndc_matrices_buffer)
+                                  .build();
+
+    const auto masked_set = backend.get_transient_descriptor_allocator()
+                                   .build_set(shadow_masked_pso, 0)
+                                   .bind(scene.get_primitive_buffer())
+                                   .bind(world_to_ndc_matrices_buffer)
+                                   .build();
+
+    const auto draw_list = [&](
+        CommandBuffer& commands, const GraphicsPipelineHandle pso, const VkCullModeFlags cull_mode,
+        const uint32_t list_index
+    ) {
+        scene.get_meshes().bind_to_commands(commands);
+        commands.bind_vertex_buffer(2, primitive_ids);
+
+        if(pso->descriptor_sets.size() > 1) {
+            commands.bind_descriptor_set(1, backend.get_texture_descriptor_pool().get_descriptor_set());
+        }
+
+        commands.bind_pipeline(pso);
+
+        commands.set_cull_mode(cull_mode);
+        commands.set_front_face(VK_FRONT_FACE_CLOCKWISE);
+
+        commands.draw_indexed_indirect(
+            draw_commands,
+            static_cast<uint32_t>(sizeof(VkDrawIndexedIndirectCommand) * num_primitives * list_index),
+            draw_counts,
+            static_cast<uint32_t>(sizeof(uint32_t) * list_index),
+            num_primitives);
+
+        if(pso->descriptor_sets.size() > 1) {
+            commands.clear_descriptor_set(1);
+        }
+    };
+
+    // Draws the solid and masked lists for one cascade. `dynamic_index` is 0 for the static lists, 1 for the dynamic ones
+    const auto draw_casters = [&](CommandBuffer& commands, const uint32_t cascade, const uint32_t dynamic_index) {
+        const auto first_list = (cascade * 2 + dynamic_index) * 2;
+
+        commands.bind_descriptor_set(0, solid_set);
+        draw_list(commands, shadow_pso, VK_CULL_MODE_BACK_BIT, first_list);
+
+        commands.bind_descriptor_set(0, masked_set);
+        draw_list(commands, shadow_masked_pso, VK_CULL_MODE_NONE, first_list + 1);
+
+        commands.clear_descriptor_set(0);
+    };
+
+    const auto indirect_buffer_usages = BufferUsageList{
+        {
+            .buffer = draw_commands,
+            .stage = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+            .access = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT
+        },
+        {
+            .buffer = draw_counts,
+            .stage = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+            .access = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT
+        },
+        {
+            .buffer = primitive_ids,
+            .stage = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+            .access = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT
+        }
+    };
+
+    // Render each cascade in its own pass, so that each can use its own draw list. The view mask selects the cascade's
+    // layer, and the view ID picks the cascade's matrix in the shader
+    for(auto cascade = 0u; cascade < num_cascades; cascade++) {
+        if((render_cascade_mask & (1u << cascade)) == 0) {
+            continue;
+        }
+
+        const auto num_skipped_draws = graph.get_num_skipped_draws();
+
+        if(!cache_static_casters) {
+            graph.add_render_pass(
+                {
+                    .name = fmt::format("Sun shadow cascade {}", cascade),
+                    .buffers = indirect_buffer_usages,
+                    .descriptor_sets = {solid_set, masked_set},
+                    .depth_attachment = RenderingAttachmentInfo{
+                        .image = shadowmap_handle,
+                        .load_op = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                        .clear_value = {.depthStencil = {.depth = 1.f}}
+                    },
+                    .view_mask = 1u << cascade,
+                    .execute = [&](CommandBuffer& commands) {
+                        draw_casters(commands, cascade, 0);
+                    }
+                });
+
+            // Casters whose PSO is still compiling aren't in the shadowmap. Render the cascade again next frame
+            if(graph.get_num_skipped_draws() != num_skipped_draws) {
+                cascade_states[cascade].is_valid = false;
+            }
+            continue;
+        }
+
+        if(cascade_states[cascade].render_static_this_frame) {
+            graph.add_render_pass(
+                {
+                    .name = fmt::format("Sun static shadow cache cascade {}", cascade),
+                    .buffers = indirect_buffer_usages,
+                    .descriptor_sets = {solid_set, masked_set},
+                    .depth_attachment = RenderingAttachmentInfo{
+                        .image = static_shadowmap_handle,
+                        .load_op = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                        .clear_value = {.depthStencil = {.depth = 1.f}}
+                    },
+                    .view_mask = 1u << cascade,
+                    .execute = [&](CommandBuffer& commands) {
+                        draw_casters(commands, cascade, 0);
+                    }
+                });
+
+            // Don't cache a cascade that's missing casters. Render the static casters again next frame
+            if(graph.get_num_skipped_draws() != num_skipped_draws) {
+                cascade_states[cascade].is_static_cache_valid = false;
+            }
+        }
+
+        const auto copy_set = backend.get_transient_descriptor_allocator()
+                                     .build_set(copy_static_shadows_pso, 0)
+                                     .bind(static_shadowmap_handle)
+                                     .build();
 
         graph.add_render_pass(
             {
-                .name = "Sun shadow",
-                .descriptor_sets = {masked_set},
+                .name = fmt::format("Sun shadow cascade {}", cascade),
+                .buffers = indirect_buffer_usages,
+                .descriptor_sets = {copy_set, solid_set, masked_set},
                 .depth_attachment = RenderingAttachmentInfo{
                     .image = shadowmap_handle,
-                    .load_op = VK_ATTACHMENT_LOAD_OP_CLEAR,
-                    .clear_value = {.depthStencil = {.depth = 1.f}}
+                    .load_op = VK_ATTACHMENT_LOAD_OP_DONT_CARE
                 },
-                .view_mask = 0x000F,
+                .view_mask = 1u << cascade,
                 .execute = [&](CommandBuffer& commands) {
-                    commands.bind_descriptor_set(0, solid_set);
-
-                    scene.draw_opaque(commands, shadow_pso);
-
-                    commands.bind_descriptor_set(0, masked_set);
-                    scene.draw_masked(commands, shadow_masked_pso);
-
+                    // Start with the cached static casters, then draw the dynamic casters over them
+                    commands.bind_descriptor_set(0, copy_set);
+                    commands.bind_pipeline(copy_static_shadows_pso);
+                    commands.draw_triangle();
                     commands.clear_descriptor_set(0);
+
+                    draw_casters(commands, cascade, 1);
                 }
             });
+
+        if(graph.get_num_skipped_draws() != num_skipped_draws) {
+            cascade_states[cascade].is_valid = false;
+        }
     }
+
+    allocator.destroy_buffer(draw_commands);
+    allocator.destroy_buffer(draw_counts);
+    allocator.destroy_buffer(primitive_ids);
 }
 
 void DirectionalLight::render(CommandBuffer& commands, const SceneView& view) const {
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <EASTL/array.h>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
 
 #include "render/backend/handles.hpp"
 #include "backend/graphics_pipeline.hpp"
@@ -34,6 +36,12 @@ public:
 
     explicit DirectionalLight();
 
+    /**
+     * Fits the shadow cascades to the view, and decides which cascades to re-render this frame
+     *
+     * Cascades are snapped to their texel grid. Far cascades may keep last frame's matrix and contents, see
+     * r.Shadow.CSM.FarCascadeUpdateInterval
+     */
     void update_shadow_cascades(const SceneView& view);
 
     void set_direction(const glm::vec3& direction);
@@ -48,10 +56,22 @@ public:
 
     glm::vec3 get_direction() const;
 
+    glm::vec4 get_color() const;
+
+    /**
+     * Throws away all cached shadow cascades. Call this when static shadow casters change
+     */
+    void invalidate_shadow_cache();
+
     /**
      * Rasterizes the cascaded shadow maps for this light
+     *
+     * Primitives are culled against each cascade on the GPU, then each cascade is drawn with its own indirect draw list.
+     * Static casters may come from a cache, and far cascades may be skipped on some frames. See update_shadow_cascades.
+     * Cascades that had draws skipped because their PSO was still compiling aren't cached, so they're rendered again
+     * next frame
      */
-    void render_shadows(RenderGraph& graph, const RenderScene& scene) const;
+    void render_shadows(RenderGraph& graph, const RenderScene& scene);
 
     /**
      * Renders this light's contribution to the scene, using a fullscreen triangle and additive blending
@@ -69,6 +89,36 @@ public:
     TextureHandle get_shadowmap_handle() const;
 
 private:
+    /**
+     * Caching information for one shadow cascade
+     */
+    struct CascadeCacheState {
+        /**
+         * World to shadow NDC matrix that the cascade was last rendered with
+         */
+        glm::mat4 matrix = {};
+
+        /**
+         * Whether the cascade's layer in the shadowmap has been rendered with `matrix`
+         */
+        bool is_valid = false;
+
+        /**
+         * Whether the cascade's layer in the static shadow cache has been rendered with `matrix`
+         */
+        bool is_static_cache_valid = false;
+
+        /**
+         * Whether to re-render this cascade this frame
+         */
+        bool render_this_frame = false;
+
+        /**
+         * Whether to re-render the static casters into the static shadow cache this frame
+         */
+        bool render_static_this_frame = false;
+    };
+
     bool sun_buffer_dirty = true;
 
     SunLightConstants constants = {};
@@ -85,8 +135,26 @@ private:
 
     GraphicsPipelineHandle pipeline = {};
 
+    ComputePipelineHandle shadow_culling_pipeline = nullptr;
+
+    /**
+     * Worldspace planes of the part of the view frustum that can receive shadows, with normals pointing inwards
+     */
+    eastl::array<glm::vec4, 6> receiver_frustum_planes = {};
+
     TextureHandle shadowmap_handle = nullptr;
 
+    eastl::array<CascadeCacheState, 4> cascade_states = {};
+
+    /**
+     * Depth of the static shadow casters in each cascade. Dynamic casters are rendered on top of a copy of this
+     */
+    TextureHandle static_shadowmap_handle = nullptr;
+
+    GraphicsPipelineHandle copy_static_shadows_pso = nullptr;
+
+    uint32_t cascade_update_frame = 0;
+
     RayTracingPipelineHandle rt_pipeline = nullptr;
 
     uint32_t frame_index = 0;
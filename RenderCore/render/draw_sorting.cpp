@@ -0,0 +1,43 @@
+#include "draw_sorting.hpp"
+
+#include <EASTL/sort.h>
+
+uint64_t make_draw_sort_key(
+    const uint32_t pipeline_index, const bool double_sided, const bool front_face_ccw, const uint32_t mesh_index
+) {
+    return static_cast<uint64_t>(pipeline_index & 0x3FFF) << 50 |
+        static_cast<uint64_t>(double_sided ? 1 : 0) << 49 |
+        static_cast<uint64_t>(front_face_ccw ? 1 : 0) << 48 |
+        static_cast<uint64_t>(mesh_index);
+}
+
+uint32_t get_draw_state(const uint64_t key) {
+    return static_cast<uint32_t>(key >> 48);
+}
+
+void batch_draws(eastl::vector<SortedDraw>& draws, const bool preserve_order, eastl::vector<DrawBatch>& batches) {
+    if(!preserve_order) {
+        // Stable, so that draws with the same key keep their relative order. That keeps the instance order
+        // deterministic
+        eastl::stable_sort(
+            draws.begin(),
+            draws.end(),
+            [](const SortedDraw& a, const SortedDraw& b) {
+                return a.key < b.key;
+            });
+    }
+
+    batches.clear();
+
+    auto batch_start = 0u;
+    while(batch_start < draws.size()) {
+        auto batch_end = batch_start + 1;
+        while(batch_end < draws.size() && draws[batch_end].key == draws[batch_start].key) {
+            batch_end++;
+        }
+
+        batches.emplace_back(DrawBatch{.first_draw = batch_start, .num_draws = batch_end - batch_start});
+
+        batch_start = batch_end;
+    }
+}
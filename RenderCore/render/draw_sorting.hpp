@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include <EASTL/vector.h>
+
+/**
+ * A direct draw, with a key that orders draws so that submitting them changes as little state as possible
+ */
+struct SortedDraw {
+    uint64_t key;
+
+    /**
+     * Index of the draw in the caller's list of draws
+     */
+    uint32_t draw_index;
+};
+
+/**
+ * A run of draws with the same key. Submitted as one instanced draw
+ */
+struct DrawBatch {
+    uint32_t first_draw;
+
+    uint32_t num_draws;
+};
+
+/**
+ * Sort key for direct draws. Draws are sorted by pipeline, then double-sidedness and front face so that dynamic state
+ * changes as little as possible, then by mesh so that draws of the same mesh end up next to each other and can be
+ * instanced
+ */
+uint64_t make_draw_sort_key(uint32_t pipeline_index, bool double_sided, bool front_face_ccw, uint32_t mesh_index);
+
+/**
+ * Retrieves the pipeline and dynamic state bits of a draw's key. Two draws with the same state can be submitted without
+ * any state changes between them
+ */
+uint32_t get_draw_state(uint64_t key);
+
+/**
+ * Sorts draws by key, and merges runs of draws with the same key into batches
+ *
+ * \param preserve_order Don't sort the draws, only merge neighbouring draws with the same key. Translucent draws need
+ * this, since they blend in the order they're submitted
+ */
+void batch_draws(eastl::vector<SortedDraw>& draws, bool preserve_order, eastl::vector<DrawBatch>& batches);
@@ -23,9 +23,12 @@ public:
         RenderGraph& graph, const SceneView& view, const RenderScene& scene, TextureHandle noise_tex
     ) = 0;
 
+    /**
+     * \param motion_vectors This frame's motion vectors. Only valid if the GI asked for them
+     */
     virtual void post_render(
         RenderGraph& graph, const SceneView& view, const RenderScene& scene, const GBuffer& gbuffer,
-        TextureHandle noise_tex
+        TextureHandle motion_vectors, TextureHandle noise_tex
     ) = 0;
 
     virtual void get_lighting_resource_usages(
@@ -1,6 +1,8 @@
 #include "irradiance_cache.hpp"
 
-#include <random>
+#include <array>
+
+#include <EASTL/algorithm.h>
 
 #include "console/cvars.hpp"
 #include "core/system_interface.hpp"
@@ -33,34 +35,14 @@ static AutoCVar_Int cvar_probe_debug_mode{
 
 static std::shared_ptr<spdlog::logger> logger;
 
-IrradianceCache::Probe& IrradianceCache::ProbeGrid::at(const uint3 index) {
-    const auto array_index = index.x + index.y * cascade_size_xz + index.z * cascade_size_xz * cascade_size_y;
-    return this->operator[](array_index);
-}
-
-void IrradianceCache::Cascade::move_probes() {
-    ProbeGrid new_probes;
-
-    for(auto z = 0; z < static_cast<int>(cascade_size_xz); z++) {
-        for(auto y = 0; y < static_cast<int>(cascade_size_y); y++) {
-            for(auto x = 0; x < static_cast<int>(cascade_size_xz); x++) {
-                const auto source_x = x + movement.x;
-                const auto source_y = y + movement.y;
-                const auto source_z = z + movement.z;
-
-                if(source_x >= 0 && source_x < static_cast<int>(cascade_size_xz) &&
-                    source_y >= 0 && source_y < static_cast<int>(cascade_size_y) &&
-                    source_z >= 0 && source_z < static_cast<int>(cascade_size_xz)) {
-                    new_probes.at({x, y, z}) = probes.at({source_x, source_y, source_z});
-                }
-            }
+IrradianceCache::IrradianceCache() :
+    scheduler{
+        uint3{cascade_size_xz, cascade_size_y, cascade_size_xz},
+        std::array{
+            cascades[0].update_priority, cascades[1].update_priority, cascades[2].update_priority,
+            cascades[3].update_priority
         }
-    }
-
-    probes = new_probes;
-}
-
-IrradianceCache::IrradianceCache() {
+    } {
     if(logger == nullptr) {
         logger = SystemInterface::get().get_logger("IrradianceCache");
     }
@@ -93,16 +75,8 @@ IrradianceCache::IrradianceCache() {
 
     constexpr auto resolution = glm::uvec2{cascade_size_xz, cascade_size_y * num_cascades};
     constexpr uint2 rtgi_probe_size = {7, 8};
-    rtgi_a = allocator.create_texture(
-        "probe_rtgi_a",
-        {
-            .format = VK_FORMAT_B10G11R11_UFLOAT_PACK32,
-            .resolution = resolution * rtgi_probe_size,
-            .usage = TextureUsage::StorageImage,
-            .num_layers = cascade_size_xz,
-        });
-    rtgi_b = allocator.create_texture(
-        "probe_rtgi_b",
+    rtgi = allocator.create_texture(
+        "probe_rtgi",
         {
             .format = VK_FORMAT_B10G11R11_UFLOAT_PACK32,
             .resolution = resolution * rtgi_probe_size,
@@ -111,16 +85,8 @@ IrradianceCache::IrradianceCache() {
         });
 
     constexpr uint2 light_cache_probe_size = {13, 13};
-    light_cache_a = allocator.create_texture(
-        "probe_light_cache_a",
-        {
-            .format = VK_FORMAT_B10G11R11_UFLOAT_PACK32,
-            .resolution = resolution * light_cache_probe_size,
-            .usage = TextureUsage::StorageImage,
-            .num_layers = cascade_size_xz,
-        });
-    light_cache_b = allocator.create_texture(
-        "probe_light_cache_b",
+    light_cache = allocator.create_texture(
+        "probe_light_cache",
         {
             .format = VK_FORMAT_B10G11R11_UFLOAT_PACK32,
             .resolution = resolution * light_cache_probe_size,
@@ -129,17 +95,8 @@ IrradianceCache::IrradianceCache() {
         });
 
     constexpr uint2 probe_depth_probe_size = {12, 12};
-    depth_a = allocator.create_texture(
-        "probe_depth_a",
-        {
-            .format = VK_FORMAT_R16G16_SFLOAT,
-            .resolution = resolution * probe_depth_probe_size,
-            .usage = TextureUsage::StorageImage,
-            .num_layers = cascade_size_xz,
-        }
-    );
-    depth_b = allocator.create_texture(
-        "probe_depth_b",
+    depth = allocator.create_texture(
+        "probe_depth",
         {
             .format = VK_FORMAT_R16G16_SFLOAT,
             .resolution = resolution * probe_depth_probe_size,
@@ -148,16 +105,8 @@ IrradianceCache::IrradianceCache() {
         }
     );
 
-    average_a = allocator.create_texture(
-        "probe_average_a",
-        {
-            .format = VK_FORMAT_B10G11R11_UFLOAT_PACK32,
-            .resolution = resolution,
-            .usage = TextureUsage::StorageImage,
-            .num_layers = cascade_size_xz,
-        });
-    average_b = allocator.create_texture(
-        "probe_average_b",
+    average = allocator.create_texture(
+        "probe_average",
         {
             .format = VK_FORMAT_B10G11R11_UFLOAT_PACK32,
             .resolution = resolution,
@@ -165,16 +114,8 @@ IrradianceCache::IrradianceCache() {
             .num_layers = cascade_size_xz,
         });
 
-    validity_a = allocator.create_texture(
-        "probe_validity_a",
-        {
-            .format = VK_FORMAT_R8_UNORM,
-            .resolution = resolution,
-            .usage = TextureUsage::StorageImage,
-            .num_layers = cascade_size_xz,
-        });
-    validity_b = allocator.create_texture(
-        "probe_validity_b",
+    validity = allocator.create_texture(
+        "probe_validity",
         {
             .format = VK_FORMAT_R8_UNORM,
             .resolution = resolution,
@@ -220,16 +161,11 @@ IrradianceCache::IrradianceCache() {
 IrradianceCache::~IrradianceCache() {
     auto& allocator = RenderBackend::get().get_global_allocator();
 
-    allocator.destroy_texture(rtgi_a);
-    allocator.destroy_texture(light_cache_a);
-    allocator.destroy_texture(depth_a);
-    allocator.destroy_texture(average_a);
-    allocator.destroy_texture(validity_a);
-    allocator.destroy_texture(rtgi_b);
-    allocator.destroy_texture(light_cache_b);
-    allocator.destroy_texture(depth_b);
-    allocator.destroy_texture(average_b);
-    allocator.destroy_texture(validity_b);
+    allocator.destroy_texture(rtgi);
+    allocator.destroy_texture(light_cache);
+    allocator.destroy_texture(depth);
+    allocator.destroy_texture(average);
+    allocator.destroy_texture(validity);
 
     allocator.destroy_buffer(probes_to_update_buffer);
     allocator.destroy_buffer(cache_cbuffer);
@@ -247,7 +183,7 @@ void IrradianceCache::update_cascades_and_probes(
 
     place_probes_from_view(view);
 
-    copy_probes_to_new_texture(graph);
+    clear_scrolled_in_probes(graph);
 
     find_probes_to_update(view.get_frame_count());
 
@@ -258,27 +194,27 @@ void IrradianceCache::get_resource_uses(
     TextureUsageList& textures, BufferUsageList& buffers
 ) {
     textures.emplace_back(
-        rtgi_a,
+        rtgi,
         VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
         VK_ACCESS_2_SHADER_READ_BIT,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     textures.emplace_back(
-        light_cache_a,
+        light_cache,
         VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
         VK_ACCESS_2_SHADER_READ_BIT,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     textures.emplace_back(
-        depth_a,
+        depth,
         VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
         VK_ACCESS_2_SHADER_READ_BIT,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     textures.emplace_back(
-        average_a,
+        average,
         VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
         VK_ACCESS_2_SHADER_READ_BIT,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     textures.emplace_back(
-        validity_a,
+        validity,
         VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
         VK_ACCESS_2_SHADER_READ_BIT,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -288,9 +224,9 @@ void IrradianceCache::add_to_lit_scene(CommandBuffer& commands, const BufferHand
     const auto set = RenderBackend::get().get_transient_descriptor_allocator().build_set(overlay_pso, 1)
                                          .bind(view_buffer)
                                          .bind(cache_cbuffer)
-                                         .bind(rtgi_a, linear_sampler)
-                                         .bind(depth_a, linear_sampler)
-                                         .bind(validity_a)
+                                         .bind(rtgi, linear_sampler)
+                                         .bind(depth, linear_sampler)
+                                         .bind(validity)
                                          .build();
 
     commands.bind_descriptor_set(1, set);
@@ -316,11 +252,11 @@ void IrradianceCache::draw_debug_overlays(
                             .build_set(probe_debug_pso, 0)
                             .bind(view.get_buffer())
                             .bind(cache_cbuffer)
-                            .bind(rtgi_a, point_sampler)
-                            .bind(light_cache_a, point_sampler)
-                            //.bind(depth_a, point_sampler)
-                            .bind(average_a)
-                            .bind(validity_a)
+                            .bind(rtgi, point_sampler)
+                            .bind(light_cache, point_sampler)
+                            //.bind(depth, point_sampler)
+                            .bind(average)
+                            .bind(validity)
                             .build();
 
     graph.add_render_pass(
@@ -348,17 +284,6 @@ void IrradianceCache::draw_debug_overlays(
         });
 }
 
-bool IrradianceCache::request_probe_update(const uint3 probe_index) {
-    ZoneScoped;
-    if(probes_to_update.size() == static_cast<uint32_t>(cvar_probes_per_frame.Get())) {
-        return false;
-    }
-
-    probes_to_update.emplace_back(probe_index);
-
-    return true;
-}
-
 void IrradianceCache::place_probes_from_view(const SceneView& view) {
     ZoneScoped;
 
@@ -391,34 +316,25 @@ void IrradianceCache::place_probes_from_view(const SceneView& view) {
 
             if(first_frame) {
                 cascade.movement = float3{64};
-            } else {
-                cascade.move_probes();
             }
-
-            // Find the new probes, add them to the update list
-            cascade.probes.foreach(
-                [&](const uint3 cur_probe, Probe& probe) {
-                    const auto old_probe_location = int3{cur_probe} - int3{cascade.movement};
-                    if(glm::any(glm::lessThan(old_probe_location, int3{0})) ||
-                        glm::any(greaterThan(old_probe_location, int3{probe_grid_size - 1.f}))) {
-
-                        const auto updated = request_probe_update(
-                            uint3{cur_probe.x, cur_probe.y + 8 * cur_cascade, cur_probe.z});
-                        if(updated) {
-                            probe.is_valid = true;
-                            probe.last_update_frame = view.get_frame_count();
-                            return true;
-                        } else {
-                            return false;
-                        }
-                    }
-                    return true;
-                });
-
         } else {
             cascade.movement = float3{0};
         }
 
+        cascade.camera_position = (view.get_position() - cascade.location) / cascade.probe_spacing;
+
+        // The probe textures wrap around, so each probe's texels stay put as the cascade moves. The probe at the min
+        // of the cascade is at the min's grid index, wrapped to the size of the cascade
+        const auto grid_size = int3{probe_grid_size};
+        const auto min_probe = int3{glm::round(cascade.location / cascade.probe_spacing)};
+        cascade.scroll_offset = uint3{(min_probe % grid_size + grid_size) % grid_size};
+
+        // Every probe starts out invalid, so on the first frame the scheduler already has them at the front of the
+        // queue. After that, scrolling invalidates the probes that came into view
+        if(cascade.movement != int3{0}) {
+            scheduler.scroll_cascade(cur_cascade, cascade.movement, cascade.scroll_offset, cascade.camera_position);
+        }
+
         constexpr auto bias_mat = float4x4{
             0.5f, 0.0f, 0.0f, 0.0f,
             0.0f, 0.5f, 0.0f, 0.0f,
@@ -447,137 +363,71 @@ void IrradianceCache::place_probes_from_view(const SceneView& view) {
     for(uint i = 0; i < cascades.size(); i++) {
         gpu_data.cascades[i].min = cascades[i].location;
         gpu_data.cascades[i].probe_spacing = cascades[i].probe_spacing;
+        gpu_data.cascades[i].scroll_offset = cascades[i].scroll_offset;
     }
 
     RenderBackend::get().get_upload_queue().upload_to_buffer(cache_cbuffer, gpu_data);
 }
 
-void IrradianceCache::copy_probes_to_new_texture(RenderGraph& graph) {
+void IrradianceCache::clear_scrolled_in_probes(RenderGraph& graph) {
+    const auto any_cascade_moved = eastl::any_of(
+        cascades.begin(),
+        cascades.end(),
+        [](const Cascade& cascade) { return cascade.movement != int3{0}; });
+    if(!any_cascade_moved) {
+        return;
+    }
+
     auto& backend = RenderBackend::get();
-    if(cascade_copy_shader == nullptr) {
-        cascade_copy_shader = backend.get_pipeline_cache().create_pipeline(
-            "shaders/gi/cache/copy_cascades.comp.spv");
+    if(clear_probes_shader == nullptr) {
+        clear_probes_shader = backend.get_pipeline_cache().create_pipeline(
+            "shaders/gi/cache/clear_scrolled_in_probes.comp.spv");
     }
 
     const auto set = backend.get_transient_descriptor_allocator()
-                            .build_set(cascade_copy_shader, 0)
-                            .bind(rtgi_a)
-                            .bind(light_cache_a)
-                            .bind(depth_a)
-                            .bind(average_a)
-                            .bind(validity_a)
-                            .bind(rtgi_b)
-                            .bind(light_cache_b)
-                            .bind(depth_b)
-                            .bind(average_b)
-                            .bind(validity_b)
+                            .build_set(clear_probes_shader, 0)
+                            .bind(cache_cbuffer)
+                            .bind(rtgi)
+                            .bind(light_cache)
+                            .bind(depth)
+                            .bind(average)
+                            .bind(validity)
                             .build();
 
     graph.add_compute_dispatch(
-        ComputeDispatch<float3[4]>{
-            .name = "cascade_copy",
+        ComputeDispatch<int4[4]>{
+            .name = "clear_scrolled_in_probes",
             .descriptor_sets = {set},
-            .push_constants = {cascades[0].movement, cascades[1].movement, cascades[2].movement, cascades[3].movement},
+            .push_constants = {
+                int4{cascades[0].movement, 0}, int4{cascades[1].movement, 0}, int4{cascades[2].movement, 0},
+                int4{cascades[3].movement, 0}
+            },
             .num_workgroups = {8, 8, 8},
-            .compute_shader = cascade_copy_shader
+            .compute_shader = clear_probes_shader
         });
-
-    swap_probe_textures();
-}
-
-void IrradianceCache::swap_probe_textures() {
-    std::swap(rtgi_a, rtgi_b);
-    std::swap(light_cache_a, light_cache_b);
-    std::swap(depth_a, depth_b);
-    std::swap(average_a, average_b);
-    std::swap(validity_a, validity_b);
 }
 
 void IrradianceCache::find_probes_to_update(const uint32_t frame_count) {
     ZoneScoped;
 
-    const auto update_budget = static_cast<uint32_t>(cvar_probes_per_frame.Get());
-    if(probes_to_update.size() >= update_budget) {
-        return;
-    }
-
     /*
-     * Add recently invalidated probes
+     * Recently invalidated probes go first
      *
      * A probe is invalidated if it's near a dynamic object. It's also invalidated if the time of day changes. Well,
-     * that's how Ubisoft did it. I don't yet have any dynamic objects, nor do I have dynamic time of day, so we'll
-     * skip this part
+     * that's how Ubisoft did it. I don't yet have any dynamic objects, nor do I have dynamic time of day, so the only
+     * invalid probes are the ones that scrolled into a cascade
      */
 
-    auto rng = std::default_random_engine{frame_count};
-    auto distribution = std::uniform_real_distribution{0.f, 1.f};
-
-    auto total_weight = 0.f;
-    for(const auto& cascade : cascades) {
-        total_weight += cascade.update_priority;
+    auto camera_positions = eastl::array<float3, num_cascades>{};
+    for(auto i = 0u; i < num_cascades; i++) {
+        camera_positions[i] = cascades[i].camera_position;
     }
 
-    {
-        ZoneScopedN("Update invalid probes");
-        for(auto& cascade : cascades) {
-            const auto normalized_priority = cascade.update_priority / total_weight;
-            cascade.probes.foreach(
-                [&](const uint3 index, Probe& probe) {
-                    if(!probe.is_valid) {
-                        float num;
-                        {
-                            ZoneScopedN("rng1");
-                            num = distribution(rng);
-                        }
-                        if(num < normalized_priority) {
-                            const auto updated = request_probe_update(index);
-                            if(updated) {
-                                probe.is_valid = true;
-                                probe.last_update_frame = frame_count;
-                            } else {
-                                return false;
-                            }
-                        }
-                    }
-                    return true;
-                });
-        }
-    }
-
-    if(probes_to_update.size() >= update_budget) {
-        return;
-    }
-
-    /*
-     * Add probes that haven't been updated in a while
-     */
-    {
-        ZoneScopedN("Update old probes");
-        for(auto& cascade : cascades) {
-            const auto normalized_priority = cascade.update_priority / total_weight;
-            cascade.probes.foreach(
-                [&](const uint3 index, Probe& probe) {
-                    // Inaccurate, but plausible
-                    const auto seconds_since_update = static_cast<float>(frame_count - probe.last_update_frame) / 60.f;
-                    const auto update_score = log(seconds_since_update);
-                    float num;
-                    {
-                        ZoneScopedN("rng2");
-                        num = distribution(rng);
-                    }
-                    if(num < update_score * normalized_priority) {
-                        const auto updated = request_probe_update(index);
-                        if(updated) {
-                            probe.is_valid = true;
-                            probe.last_update_frame = frame_count;
-                        } else {
-                            return false;
-                        }
-                    }
-                    return true;
-                });
-        }
-    }
+    scheduler.pull_probes_to_update(
+        frame_count,
+        static_cast<uint32_t>(cvar_probes_per_frame.Get()),
+        camera_positions,
+        probes_to_update);
 
     logger->info("Updating {} probes", probes_to_update.size());
 }
@@ -616,12 +466,12 @@ void IrradianceCache::dispatch_probe_updates(
                                        .bind(cache_cbuffer)
                                        .bind(trace_results_texture)
                                        .bind(noise_tex)
-                                       .bind(rtgi_a, linear_sampler)
-                                       .bind(depth_a, linear_sampler)
+                                       .bind(rtgi, linear_sampler)
+                                       .bind(depth, linear_sampler)
                                        .next_binding(9)
                                        .bind(sky.get_transmittance_lut(), sky.get_sampler())
                                        .bind(sky.get_sky_view_lut(), sky.get_sampler())
-                                       .bind(validity_a)
+                                       .bind(validity)
                                        .build();
 
         graph.add_pass(
@@ -649,7 +499,7 @@ void IrradianceCache::dispatch_probe_updates(
         auto set = descriptor_allocator.build_set(probe_depth_update_shader, 0)
                                        .bind(probes_to_update_buffer)
                                        .bind(trace_results_texture)
-                                       .bind(depth_a)
+                                       .bind(depth)
                                        .build();
 
         graph.add_compute_dispatch(
@@ -669,7 +519,7 @@ void IrradianceCache::dispatch_probe_updates(
                                        .bind(cache_cbuffer)
                                        .bind(probes_to_update_buffer)
                                        .bind(trace_results_texture)
-                                       .bind(light_cache_a)
+                                       .bind(light_cache)
                                        .build();
 
         graph.add_compute_dispatch(
@@ -689,7 +539,7 @@ void IrradianceCache::dispatch_probe_updates(
                                        .bind(cache_cbuffer)
                                        .bind(probes_to_update_buffer)
                                        .bind(trace_results_texture)
-                                       .bind(rtgi_a)
+                                       .bind(rtgi)
                                        .build();
 
         graph.add_compute_dispatch(
@@ -707,10 +557,10 @@ void IrradianceCache::dispatch_probe_updates(
         }
         auto set = descriptor_allocator.build_set(probe_finalize_shader, 0)
                                        .bind(probes_to_update_buffer)
-                                       .bind(rtgi_a)
-                                       .bind(depth_a)
-                                       .bind(average_a)
-                                       .bind(validity_a)
+                                       .bind(rtgi)
+                                       .bind(depth)
+                                       .bind(average)
+                                       .bind(validity)
                                        .build();
 
         graph.add_compute_dispatch(
@@ -9,6 +9,7 @@
 #include "render/backend/handles.hpp"
 #include "render/backend/texture_usage_token.hpp"
 #include "render/backend/buffer_usage_token.hpp"
+#include "render/gi/probe_update_scheduler.hpp"
 #include "shared/gi_probe.hpp"
 
 struct GBuffer;
@@ -43,28 +44,6 @@ public:
 
     static constexpr uint32_t num_cascades = 4;
 
-    /**
-     * Some CPU-side information about a probe
-     */
-    struct Probe {
-        /**
-         * Marks if the probe has been invalidated for any reason
-         */
-        bool is_valid = false;
-
-        /**
-         * The frame where this probe was most recently updated
-         */
-        uint last_update_frame = 0;
-    };
-
-    struct ProbeGrid : eastl::array<Probe, cascade_size_xz * cascade_size_y * cascade_size_xz> {
-        template <typename F>
-        void foreach(F func);
-
-        Probe& at(uint3 index);
-    };
-
     struct Cascade {
         /**
          * Distance between probes, in meters
@@ -99,10 +78,21 @@ public:
         float3 location = {};
 
         /**
-         * How far the cascade has moved, measured in probes. Used when copying old probes to the new volume
+         * How far the cascade has moved, measured in probes. Used to find the probes that scrolled into the cascade
          */
         int3 movement = {};
 
+        /**
+         * Index of the probe at the cascade's min in the probe textures. The textures wrap around, so the probes that
+         * stay in the cascade when it moves don't need to be copied
+         */
+        uint3 scroll_offset = {};
+
+        /**
+         * The camera's position in this cascade's probe grid, measured in probes
+         */
+        float3 camera_position = {};
+
         /**
          * Transforms from worldspace to pixel in the probe texture
          */
@@ -112,10 +102,6 @@ public:
          * Transforms from pixel in the probe texture to worldspace
          */
         float4x4 cascade_to_world = float4x4{1};
-
-        ProbeGrid probes;
-
-        void move_probes();
     };
 
     IrradianceCache();
@@ -142,7 +128,7 @@ public:
 
 private:
     /**
-     * We can skip copying the cascade textures if this is the first frame
+     * On the first frame, every probe is new
      */
     bool first_frame = true;
 
@@ -153,33 +139,28 @@ private:
     /**
      * Stores 8x8 R11G11B10 textures representing the incoming light at each probe
      */
-    TextureHandle rtgi_a = nullptr;
-    TextureHandle rtgi_b = nullptr;
+    TextureHandle rtgi = nullptr;
 
     /**
      * Stores 11x11 R11G11B10 textures used as a fallback when tracing rays. Essentially a less-averaged version of rtgi
      */
-    TextureHandle light_cache_a = nullptr;
-    TextureHandle light_cache_b = nullptr;
+    TextureHandle light_cache = nullptr;
 
     /**
      * 10x10 R8 textures storing the depth around each probe, and also depth squared
      */
-    TextureHandle depth_a = nullptr;
-    TextureHandle depth_b = nullptr;
+    TextureHandle depth = nullptr;
 
     /**
      * Average of the irradiance at this probe. Used for volumetrics, which I will totally code up at some point
      */
-    TextureHandle average_a = nullptr;
-    TextureHandle average_b = nullptr;
+    TextureHandle average = nullptr;
 
     /**
      * Single int saying if this probe is valid or not. Invalid probes lie entirely inside of an object. They have no
      * impact on the final scene
      */
-    TextureHandle validity_a = nullptr;
-    TextureHandle validity_b = nullptr;
+    TextureHandle validity = nullptr;
 
     eastl::array<Cascade, num_cascades> cascades = {
         Cascade{
@@ -204,6 +185,8 @@ private:
         },
     };
 
+    ProbeUpdateScheduler scheduler;
+
     BufferHandle cache_cbuffer = nullptr;
 
     eastl::vector<glm::uvec3> probes_to_update = {};
@@ -220,7 +203,7 @@ private:
 
     VkSampler point_sampler;
 
-    static inline ComputePipelineHandle cascade_copy_shader = nullptr;
+    static inline ComputePipelineHandle clear_probes_shader = nullptr;
 
     static inline RayTracingPipelineHandle probe_tracing_pipeline = nullptr;
 
@@ -234,46 +217,21 @@ private:
 
     static inline ComputePipelineHandle probe_finalize_shader = nullptr;
 
-    /**
-     * Requests an update of a given probe. Returns true if the probe can be updated this frame, false otherwise
-     *
-     * The probe index Y MUST contain an offset for the cascade it's in. Otherwise we don't know which cascade we're in :(
-     */
-    bool request_probe_update(uint3 probe_index);
-
     /**
      * Updates cascade locations based on the provided view
      */
     void place_probes_from_view(const SceneView& view);
 
     /**
-     * Copies probes from the A texture to the B texture, so that they're in the right location. Out-of-bounds probes
-     * are lost
+     * Clears the probes that scrolled into each cascade. Probes that stayed in the cascade keep their texels
      */
-    void copy_probes_to_new_texture(RenderGraph& graph);
-
-    void swap_probe_textures();
+    void clear_scrolled_in_probes(RenderGraph& graph);
 
     /**
-     * Determines which probes should be updated, using a heuristic based on time since update and distance from the
-     * center of the screen
+     * Pulls this frame's probe updates from the scheduler. Probes that scrolled into view go first, then probes by how
+     * overdue they are. Nearby probes in important cascades are due more often
      */
     void find_probes_to_update(uint32_t frame_count);
 
     void dispatch_probe_updates(RenderGraph& graph, const RenderScene& scene, TextureHandle noise_tex);
 };
-
-template <typename F>
-void IrradianceCache::ProbeGrid::foreach(F func) {
-    ZoneScoped;
-    for(auto x = 0u; x < cascade_size_xz; x++) {
-        for(auto y = 0u; y < cascade_size_y; y++) {
-            for(auto z = 0u; z < cascade_size_xz; z++) {
-                const auto keep_looping = func(uint3{x, y, z}, at({x, y, z}));
-                if(!keep_looping) {
-                    return;
-                }
-            }
-        }
-    }
-}
@@ -1,6 +1,8 @@
 #include "light_propagation_volume.hpp"
 
 #include <magic_enum.hpp>
+#include <EASTL/fixed_vector.h>
+#include <EASTL/sort.h>
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
 
@@ -17,6 +19,7 @@
 #include "render/scene_view.hpp"
 #include "render/render_scene.hpp"
 #include "shared/vpl.hpp"
+#include "shared/emissive_points.hpp"
 #include "shared/lpv.hpp"
 #include "shared/view_info.hpp"
 
@@ -40,6 +43,26 @@ static auto cvar_lpv_num_propagation_steps = AutoCVar_Int{
     "Number of times to propagate lighting through the LPV", 32
 };
 
+static auto cvar_lpv_propagation_budget = AutoCVar_Int{
+    "r.GI.LPV.PropagationBudget",
+    "Number of propagation dispatches per frame. Each dispatch is one propagation step of one cascade", 32
+};
+
+static auto cvar_lpv_far_cascade_update_interval = AutoCVar_Int{
+    "r.GI.LPV.FarCascadeUpdateInterval",
+    "Number of frames between injections of the far LPV cascades. 1 injects them as often as they change", 4
+};
+
+static auto cvar_lpv_first_staggered_cascade = AutoCVar_Int{
+    "r.GI.LPV.FirstStaggeredCascade",
+    "Index of the first cascade that's only injected every r.GI.LPV.FarCascadeUpdateInterval frames", 2
+};
+
+static auto cvar_lpv_history_blend = AutoCVar_Float{
+    "r.GI.LPV.HistoryBlend",
+    "Weight of newly propagated lighting when it's blended into the LPV history. 1 disables blending", 0.5
+};
+
 static auto cvar_lpv_behind_camera_percent = AutoCVar_Float{
     "r.GI.LPV.PercentBehindCamera",
     "The percentage of the LPV that should be behind the camera. Not exact",
@@ -96,6 +119,8 @@ LightPropagationVolume::LightPropagationVolume() {
 
     propagation_shader = pipeline_cache.create_pipeline("shaders/gi/lpv/lpv_propagate.comp.spv");
 
+    blend_history_shader = pipeline_cache.create_pipeline("shaders/gi/lpv/blend_lpv_history.comp.spv");
+
     linear_sampler = backend.get_global_allocator().get_sampler(
         {
             .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
@@ -114,6 +139,8 @@ LightPropagationVolume::LightPropagationVolume() {
 
     rsm_generate_vpls_pipeline = pipeline_cache.create_pipeline("shaders/gi/lpv/rsm_generate_vpls.comp.spv");
 
+    cull_emissive_points_pipeline = pipeline_cache.create_pipeline("shaders/gi/lpv/cull_emissive_points.comp.spv");
+
     if(cvar_lpv_use_compute_vpl_injection.Get() == 0) {
         vpl_injection_pipeline = backend.begin_building_pipeline("VPL Injection")
                                         .set_topology(VK_PRIMITIVE_TOPOLOGY_POINT_LIST)
@@ -214,19 +241,29 @@ LightPropagationVolume::~LightPropagationVolume() {
     allocator.destroy_texture(lpv_b_red);
     allocator.destroy_texture(lpv_b_green);
     allocator.destroy_texture(lpv_b_blue);
+    allocator.destroy_texture(lpv_history_red);
+    allocator.destroy_texture(lpv_history_green);
+    allocator.destroy_texture(lpv_history_blue);
     allocator.destroy_texture(geometry_volume_handle);
 
     allocator.destroy_buffer(cascade_data_buffer);
+    allocator.destroy_buffer(history_cascade_data_buffer);
     allocator.destroy_buffer(vp_matrix_buffer);
 }
 
 void LightPropagationVolume::pre_render(
     RenderGraph& graph, const SceneView& view, const RenderScene& scene, TextureHandle noise_tex
 ) {
-    clear_volume(graph);
+    frame_index++;
 
     update_cascade_transforms(view, scene.get_sun_light());
 
+    select_cascades_to_inject(scene);
+
+    const auto num_skipped_draws = graph.get_num_skipped_draws();
+
+    clear_volume(graph);
+
     // VPL cloud generation
 
     inject_indirect_sun_light(graph, scene);
@@ -234,10 +271,21 @@ void LightPropagationVolume::pre_render(
     if(cvar_enable_mesh_lights.Get()) {
         inject_emissive_point_clouds(graph, scene);
     }
+
+    // Some of the RSM or injection draws were skipped because their PSO is still compiling, so this frame's injection
+    // is missing light. Forget its inputs, so that the cascades are injected again even if the scene doesn't change
+    if(graph.get_num_skipped_draws() != num_skipped_draws) {
+        for(auto& cascade : cascades) {
+            if(cascade.inject_this_frame) {
+                cascade.input_hash = 0;
+            }
+        }
+    }
 }
 
 void LightPropagationVolume::post_render(
-    RenderGraph& graph, const SceneView& view, const RenderScene& scene, const GBuffer& gbuffer, TextureHandle noise_tex
+    RenderGraph& graph, const SceneView& view, const RenderScene& scene, const GBuffer& gbuffer,
+    TextureHandle motion_vectors, TextureHandle noise_tex
 ) {
     if(cvar_lpv_build_gv_mode.Get() == GvBuildMode::DepthBuffers) {
         build_geometry_volume_from_scene_view(
@@ -255,17 +303,17 @@ void LightPropagationVolume::get_lighting_resource_usages(
     TextureUsageList& textures, BufferUsageList& buffers
 ) const {
     textures.emplace_back(
-        lpv_a_red,
+        lpv_history_red,
         VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
         VK_ACCESS_2_SHADER_READ_BIT,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     textures.emplace_back(
-        lpv_a_green,
+        lpv_history_green,
         VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
         VK_ACCESS_2_SHADER_READ_BIT,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     textures.emplace_back(
-        lpv_a_blue,
+        lpv_history_blue,
         VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
         VK_ACCESS_2_SHADER_READ_BIT,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -283,10 +331,10 @@ void LightPropagationVolume::render_to_lit_scene(
 
     auto& backend = RenderBackend::get();
     const auto lpv_descriptor = backend.get_transient_descriptor_allocator().build_set(lpv_render_shader, 1)
-                                       .bind(lpv_a_red, linear_sampler)
-                                       .bind(lpv_a_green, linear_sampler)
-                                       .bind(lpv_a_blue, linear_sampler)
-                                       .bind(cascade_data_buffer)
+                                       .bind(lpv_history_red, linear_sampler)
+                                       .bind(lpv_history_green, linear_sampler)
+                                       .bind(lpv_history_blue, linear_sampler)
+                                       .bind(history_cascade_data_buffer)
                                        .bind(view_buffer)
                                        .bind(ao_tex, linear_sampler)
                                        .build();
@@ -369,6 +417,28 @@ void LightPropagationVolume::init_resources(ResourceAllocator& allocator) {
         TextureUsage::StorageImage
     );
 
+    lpv_history_red = allocator.create_volume_texture(
+        "LPV Red History",
+        VK_FORMAT_R16G16B16A16_SFLOAT,
+        texture_resolution,
+        1,
+        TextureUsage::StorageImage
+    );
+    lpv_history_green = allocator.create_volume_texture(
+        "LPV Green History",
+        VK_FORMAT_R16G16B16A16_SFLOAT,
+        texture_resolution,
+        1,
+        TextureUsage::StorageImage
+    );
+    lpv_history_blue = allocator.create_volume_texture(
+        "LPV Blue History",
+        VK_FORMAT_R16G16B16A16_SFLOAT,
+        texture_resolution,
+        1,
+        TextureUsage::StorageImage
+    );
+
     geometry_volume_handle = allocator.create_volume_texture(
         "Geometry Volume",
         VK_FORMAT_R16G16B16A16_SFLOAT,
@@ -383,6 +453,12 @@ void LightPropagationVolume::init_resources(ResourceAllocator& allocator) {
         BufferUsage::UniformBuffer
     );
 
+    history_cascade_data_buffer = allocator.create_buffer(
+        "LPV History Cascade Data",
+        sizeof(LPVCascadeMatrices) * num_cascades,
+        BufferUsage::UniformBuffer
+    );
+
     vp_matrix_buffer = allocator.create_buffer(
         "rsm_vp_matrices",
         sizeof(glm::mat4) * num_cascades,
@@ -518,20 +594,103 @@ void LightPropagationVolume::update_cascade_transforms(const SceneView& view, co
     update_buffers();
 }
 
+/**
+ * Number of propagation steps per injection. Steps ping-pong between the A and B volumes, so we round up to an even
+ * number to end in A
+ */
+static uint32_t get_num_propagation_steps() {
+    const auto num_steps = static_cast<uint32_t>(glm::max(cvar_lpv_num_propagation_steps.Get(), 1));
+    return (num_steps + 1) & ~1u;
+}
+
+static LPVCascadeMatrices make_cascade_matrices(const CascadeData& cascade) {
+    return LPVCascadeMatrices{
+        .rsm_vp = cascade.rsm_vp,
+        .inverse_rsm_vp = glm::inverse(cascade.rsm_vp),
+        .world_to_cascade = cascade.world_to_cascade,
+        .cascade_to_world = glm::inverse(cascade.world_to_cascade)
+    };
+}
+
+/**
+ * FNV-1a. Good enough to tell when the LPV's inputs change
+ */
+static uint64_t hash_bytes(const void* data, const size_t size, uint64_t hash = 14695981039346656037ull) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for(auto i = 0u; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void LightPropagationVolume::select_cascades_to_inject(const RenderScene& scene) {
+    ZoneScoped;
+
+    const auto& sun = scene.get_sun_light();
+    const auto sun_direction = sun.get_direction();
+    const auto sun_color = sun.get_color();
+    const auto primitive_generation = scene.get_primitive_generation();
+    const auto num_emissive_ranges = cvar_enable_mesh_lights.Get() != 0 ? scene.get_num_emissive_ranges() : 0u;
+
+    auto scene_hash = hash_bytes(&sun_direction, sizeof(sun_direction));
+    scene_hash = hash_bytes(&sun_color, sizeof(sun_color), scene_hash);
+    scene_hash = hash_bytes(&primitive_generation, sizeof(primitive_generation), scene_hash);
+    scene_hash = hash_bytes(&num_emissive_ranges, sizeof(num_emissive_ranges), scene_hash);
+
+    const auto update_interval = static_cast<uint32_t>(glm::max(cvar_lpv_far_cascade_update_interval.Get(), 1));
+    const auto first_staggered_cascade = static_cast<uint32_t>(glm::max(cvar_lpv_first_staggered_cascade.Get(), 0));
+
+    for(auto cascade_index = 0u; cascade_index < cascades.size(); cascade_index++) {
+        auto& cascade = cascades[cascade_index];
+        cascade.inject_this_frame = false;
+
+        if(cascade.propagation_steps_left > 0) {
+            // Still propagating the last injection. Injecting now would stomp on it
+            continue;
+        }
+
+        const auto hash = hash_bytes(&cascade.world_to_cascade, sizeof(cascade.world_to_cascade), scene_hash);
+        if(cascade.has_history && hash == cascade.input_hash) {
+            continue;
+        }
+
+        if(cascade.has_history && cascade_index >= first_staggered_cascade &&
+            frame_index - cascade.injection_frame < update_interval) {
+            continue;
+        }
+
+        cascade.inject_this_frame = true;
+        cascade.input_hash = hash;
+        cascade.injection_frame = frame_index;
+        cascade.propagation_steps_left = get_num_propagation_steps();
+        cascade.propagating_matrices = make_cascade_matrices(cascade);
+
+        if(!cascade.has_history) {
+            // The history is cleared to black, so it may as well be where the cascade is
+            cascade.history_matrices = cascade.propagating_matrices;
+        }
+    }
+}
+
+uint32_t LightPropagationVolume::get_injection_mask() const {
+    auto mask = 0u;
+    for(auto cascade_index = 0u; cascade_index < cascades.size(); cascade_index++) {
+        if(cascades[cascade_index].inject_this_frame) {
+            mask |= 1 << cascade_index;
+        }
+    }
+
+    return mask;
+}
+
 void LightPropagationVolume::update_buffers() const {
     ZoneScoped;
 
     auto cascade_matrices = eastl::vector<LPVCascadeMatrices>{};
     cascade_matrices.reserve(cascades.size());
     for(const auto& cascade : cascades) {
-        cascade_matrices.emplace_back(
-            LPVCascadeMatrices{
-                .rsm_vp = cascade.rsm_vp,
-                .inverse_rsm_vp = glm::inverse(cascade.rsm_vp),
-                .world_to_cascade = cascade.world_to_cascade,
-                .cascade_to_world = glm::inverse(cascade.world_to_cascade)
-            }
-        );
+        cascade_matrices.emplace_back(make_cascade_matrices(cascade));
     }
 
     auto& queue = RenderBackend::get().get_upload_queue();
@@ -561,13 +720,14 @@ void LightPropagationVolume::inject_indirect_sun_light(
     // Unfortunately there's a sync point between the VPL generation FS and the VPL injection pass. Not sure if I can get
     // rid of that
 
-    graph.begin_label("LPV indirect sun light injection");
-
-    auto view_mask = 0u;
-    for(auto cascade_index = 0u; cascade_index < cascades.size(); cascade_index++) {
-        view_mask |= 1 << cascade_index;
+    // Only render the RSM for the cascades that we're injecting
+    const auto view_mask = get_injection_mask();
+    if(view_mask == 0) {
+        return;
     }
 
+    graph.begin_label("LPV indirect sun light injection");
+
     const auto& pipelines = scene.get_material_storage().get_pipelines();
     const auto rsm_pso = pipelines.get_rsm_pso();
     const auto rsm_masked_pso = pipelines.get_rsm_masked_pso();
@@ -618,6 +778,10 @@ void LightPropagationVolume::inject_indirect_sun_light(
 
     for(auto cascade_index = 0u; cascade_index < cascades.size(); cascade_index++) {
         const auto& cascade = cascades[cascade_index];
+        if(!cascade.inject_this_frame) {
+            continue;
+        }
+
         graph.add_pass(
             ComputePass{
                 .name = "Clear VPL Count",
@@ -686,6 +850,10 @@ void LightPropagationVolume::inject_indirect_sun_light(
 
     for(auto cascade_index = 0u; cascade_index < cascades.size(); cascade_index++) {
         const auto& cascade = cascades[cascade_index];
+        if(!cascade.inject_this_frame) {
+            continue;
+        }
+
         dispatch_vpl_injection_pass(graph, cascade_index, cascade);
 
         if(cvar_lpv_build_gv_mode.Get() == GvBuildMode::DepthBuffers) {
@@ -787,60 +955,165 @@ void LightPropagationVolume::dispatch_vpl_injection_pass(
 void LightPropagationVolume::inject_emissive_point_clouds(RenderGraph& graph, const RenderScene& scene) const {
     ZoneScoped;
 
+    const auto num_ranges = scene.get_num_emissive_ranges();
+    if(num_ranges == 0 || vpl_injection_pipeline == nullptr || get_injection_mask() == 0) {
+        return;
+    }
+
     graph.begin_label("Emissive mesh injection");
     auto& backend = RenderBackend::get();
+    auto& allocator = backend.get_global_allocator();
 
-    for(auto cascade_index = 0u; cascade_index < cvar_lpv_num_cascades.Get(); cascade_index++) {
-        const auto& cascade = cascades[cascade_index];
+    const auto num_cascades = static_cast<uint32_t>(cvar_lpv_num_cascades.Get());
+
+    // Each cascade gets a region of num_ranges draws, and its draw count is at index cascade_index
+    const auto draw_commands = allocator.create_buffer(
+        "Emissive point draws",
+        sizeof(VkDrawIndirectCommand) * num_ranges * num_cascades,
+        BufferUsage::IndirectBuffer);
+    const auto draw_counts = allocator.create_buffer(
+        "Emissive point draw counts",
+        sizeof(uint32_t) * num_cascades,
+        BufferUsage::IndirectBuffer);
+
+    graph.add_pass(
+        {
+            .name = "Clear emissive point draw counts",
+            .buffers = {
+                {
+                    .buffer = draw_counts,
+                    .stage = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                    .access = VK_ACCESS_2_TRANSFER_WRITE_BIT
+                }
+            },
+            .execute = [=](CommandBuffer& commands) {
+                commands.fill_buffer(draw_counts, 0);
+            }
+        });
+
+    struct CullEmissivePointsConstants {
+        glm::vec3 cascade_min;
+        uint32_t num_ranges;
+        glm::vec3 cascade_max;
+        uint32_t cascade_index;
+    };
+
+    auto& descriptor_allocator = backend.get_transient_descriptor_allocator();
+    const auto cull_set = descriptor_allocator.build_set(cull_emissive_points_pipeline, 0)
+                                              .bind(scene.get_emissive_ranges_buffer())
+                                              .bind(draw_commands)
+                                              .bind(draw_counts)
+                                              .build();
 
-        const auto& primitives = scene.get_primitives_in_bounds(cascade.min_bounds, cascade.max_bounds);
-        if(primitives.empty()) {
+    for(auto cascade_index = 0u; cascade_index < num_cascades; cascade_index++) {
+        const auto& cascade = cascades[cascade_index];
+        if(!cascade.inject_this_frame) {
             continue;
         }
 
-        const auto set = backend.get_transient_descriptor_allocator().build_set(vpl_injection_pipeline, 0)
-                                .bind(cascade_data_buffer)
-                                .build();
+        graph.add_compute_dispatch<CullEmissivePointsConstants>(
+            {
+                .name = "Cull emissive points",
+                .descriptor_sets = {cull_set},
+                .push_constants = {
+                    .cascade_min = cascade.min_bounds,
+                    .num_ranges = num_ranges,
+                    .cascade_max = cascade.max_bounds,
+                    .cascade_index = cascade_index
+                },
+                .num_workgroups = {(num_ranges + 63) / 64, 1, 1},
+                .compute_shader = cull_emissive_points_pipeline
+            });
+    }
+
+    const auto set = descriptor_allocator.build_set(vpl_injection_pipeline, 0)
+                                         .bind(cascade_data_buffer)
+                                         .build();
+
+    const auto emissive_points = scene.get_emissive_points_buffer();
+
+    for(auto cascade_index = 0u; cascade_index < num_cascades; cascade_index++) {
+        if(!cascades[cascade_index].inject_this_frame) {
+            continue;
+        }
 
         graph.add_render_pass(
             {
                 .name = "emissive_mesh_injection",
+                .buffers = {
+                    {emissive_points, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT},
+                    {
+                        .buffer = draw_commands,
+                        .stage = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+                        .access = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT
+                    },
+                    {
+                        .buffer = draw_counts,
+                        .stage = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+                        .access = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT
+                    }
+                },
                 .descriptor_sets = {set},
                 .color_attachments = {
                     {.image = lpv_a_red,},
                     {.image = lpv_a_green},
                     {.image = lpv_a_blue}
                 },
-                .execute = [&](CommandBuffer& commands) {
+                .execute = [=, this](CommandBuffer& commands) {
                     commands.bind_descriptor_set(0, set);
 
+                    commands.bind_buffer_reference(0, emissive_points);
                     commands.set_push_constant(2, cascade_index);
-                    commands.set_push_constant(3, static_cast<uint32_t>(cvar_lpv_num_cascades.Get()));
+                    commands.set_push_constant(3, num_cascades);
 
                     commands.bind_pipeline(vpl_injection_pipeline);
 
-                    for(const auto& primitive : primitives) {
-                        if(!primitive->material->first.emissive) {
-                            continue;
-                        }
-
-                        commands.bind_buffer_reference(0, primitive->emissive_points_buffer);
-                        commands.draw(primitive->mesh->num_points);
-                    }
+                    commands.draw_indirect(
+                        draw_commands,
+                        cascade_index * num_ranges * sizeof(VkDrawIndirectCommand),
+                        draw_counts,
+                        cascade_index * sizeof(uint32_t),
+                        num_ranges);
 
                     commands.clear_descriptor_set(0);
                 }
             });
     }
 
+    // Scratch buffers. Destruction waits until the GPU is done with this frame
+    allocator.destroy_buffer(draw_commands);
+    allocator.destroy_buffer(draw_counts);
+
     graph.end_label();
 }
 
-void LightPropagationVolume::clear_volume(RenderGraph& render_graph) const {
+void LightPropagationVolume::clear_volume(RenderGraph& render_graph) {
     ZoneScoped;
 
     auto& backend = RenderBackend::get();
 
+    if(!is_history_cleared) {
+        // The lighting pass reads every cascade of the history, even before the cascade's first propagation finishes
+        const auto set = backend.get_transient_descriptor_allocator().build_set(clear_lpv_shader, 0)
+                                .bind(lpv_history_red)
+                                .bind(lpv_history_green)
+                                .bind(lpv_history_blue)
+                                .bind(geometry_volume_handle)
+                                .build();
+        render_graph.add_compute_dispatch<uint32_t>(
+            {
+                .name = "Clear LPV history",
+                .descriptor_sets = {set},
+                .push_constants = 0xFFFFFFFF,
+                .num_workgroups = {static_cast<uint32_t>(cvar_lpv_num_cascades.Get()), 32, 32},
+                .compute_shader = clear_lpv_shader
+            });
+
+        is_history_cleared = true;
+    }
+
+    const auto injection_mask = get_injection_mask();
+
     render_graph.add_pass(
         {
             .name = "LightPropagationVolume::clear_volume",
@@ -870,8 +1143,8 @@ void LightPropagationVolume::clear_volume(RenderGraph& render_graph) const {
                     .layout = VK_IMAGE_LAYOUT_GENERAL,
                 }
             },
-            .execute = [&](CommandBuffer& commands) {
-                auto descriptor_set = *vkutil::DescriptorBuilder::begin(
+            .execute = [&backend, injection_mask, this](CommandBuffer& commands) {
+                auto descriptor_set = vkutil::DescriptorBuilder::begin(
                                            backend,
                                            backend.get_transient_descriptor_allocator()
                                        )
@@ -911,10 +1184,12 @@ void LightPropagationVolume::clear_volume(RenderGraph& render_graph) const {
                                            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
                                            VK_SHADER_STAGE_COMPUTE_BIT
                                        )
-                                       .build();
+                                       .build().value_or(VK_NULL_HANDLE);
 
                 commands.bind_descriptor_set(0, descriptor_set);
 
+                commands.set_push_constant(0, injection_mask);
+
                 commands.bind_pipeline(clear_lpv_shader);
 
                 commands.dispatch(cvar_lpv_num_cascades.Get(), 32, 32);
@@ -967,7 +1242,7 @@ void LightPropagationVolume::build_geometry_volume_from_scene_view(
         });
 }
 
-void LightPropagationVolume::propagate_lighting(RenderGraph& render_graph) const {
+void LightPropagationVolume::propagate_lighting(RenderGraph& render_graph) {
     ZoneScoped;
 
     render_graph.begin_label("LPV Propagation");
@@ -999,57 +1274,110 @@ void LightPropagationVolume::propagate_lighting(RenderGraph& render_graph) const
 
     const auto num_cells = static_cast<uint32_t>(cvar_lpv_resolution.Get());
     const auto num_cascades = static_cast<uint32_t>(cvar_lpv_num_cascades.Get());
-    const auto dispatch_size = glm::uvec3{num_cells * num_cascades, num_cells, num_cells} / glm::uvec3{4, 4, 4};
+    const auto dispatch_size = glm::uvec3{num_cells} / glm::uvec3{4, 4, 4};
+    const auto num_steps = get_num_propagation_steps();
 
     struct PropagationConstants {
         uint32_t use_gv;
         uint32_t num_cascades;
         uint32_t num_cells;
+        uint32_t cascade_index;
     };
 
-    const auto constants = PropagationConstants{
-        .use_gv = use_gv ? 1u : 0u,
-        .num_cascades = num_cascades,
-        .num_cells = num_cells
-    };
+    // Spend the budget on the oldest injections first, so that a cascade that changes every frame can't starve the
+    // others
+    auto propagating_cascades = eastl::fixed_vector<uint32_t, 4>{};
+    for(auto cascade_index = 0u; cascade_index < cascades.size(); cascade_index++) {
+        if(cascades[cascade_index].propagation_steps_left > 0) {
+            propagating_cascades.push_back(cascade_index);
+        }
+    }
+    eastl::sort(
+        propagating_cascades.begin(),
+        propagating_cascades.end(),
+        [&](const uint32_t a, const uint32_t b) {
+            if(cascades[a].injection_frame != cascades[b].injection_frame) {
+                return cascades[a].injection_frame < cascades[b].injection_frame;
+            }
+            return a < b;
+        });
 
-    for(auto step_index = 0; step_index < cvar_lpv_num_propagation_steps.Get(); step_index += 2) {
-        render_graph.add_compute_dispatch(
-            ComputeDispatch{
-                .name = "Propagate lighting cascade",
-                .descriptor_sets = {a_to_b_set},
-                .push_constants = constants,
-                .num_workgroups = dispatch_size,
-                .compute_shader = propagation_shader
-            });
+    auto budget = static_cast<uint32_t>(glm::max(cvar_lpv_propagation_budget.Get(), 1));
+    auto num_dispatches = 0u;
 
-        render_graph.add_compute_dispatch(
-            ComputeDispatch{
-                .name = "Propagate lighting cascade",
-                .descriptor_sets = {b_to_a_set},
-                .push_constants = constants,
-                .num_workgroups = dispatch_size,
-                .compute_shader = propagation_shader
-            });
+    for(const auto cascade_index : propagating_cascades) {
+        if(budget == 0) {
+            break;
+        }
+
+        auto& cascade = cascades[cascade_index];
+        const auto num_steps_this_frame = glm::min(budget, cascade.propagation_steps_left);
+
+        const auto constants = PropagationConstants{
+            .use_gv = use_gv ? 1u : 0u,
+            .num_cascades = num_cascades,
+            .num_cells = num_cells,
+            .cascade_index = cascade_index
+        };
+
+        for(auto step = 0u; step < num_steps_this_frame; step++) {
+            // Even steps read from A, odd steps read from B
+            const auto step_index = num_steps - cascade.propagation_steps_left;
+            render_graph.add_compute_dispatch(
+                ComputeDispatch{
+                    .name = "Propagate lighting cascade",
+                    .descriptor_sets = {step_index % 2 == 0 ? a_to_b_set : b_to_a_set},
+                    .push_constants = constants,
+                    .num_workgroups = dispatch_size,
+                    .compute_shader = propagation_shader
+                });
+
+            cascade.propagation_steps_left--;
+        }
+
+        budget -= num_steps_this_frame;
+        num_dispatches += num_steps_this_frame;
+
+        if(cascade.propagation_steps_left == 0) {
+            // If the cascade moved, the history is in the wrong place. Replace it rather than blending
+            const auto& old_transform = cascade.history_matrices.world_to_cascade;
+            const auto& new_transform = cascade.propagating_matrices.world_to_cascade;
+            const auto blend_weight = cascade.has_history && old_transform == new_transform
+                                          ? glm::clamp(cvar_lpv_history_blend.GetFloat(), 0.f, 1.f)
+                                          : 1.f;
+            blend_into_history(render_graph, cascade_index, blend_weight);
+
+            cascade.history_matrices = cascade.propagating_matrices;
+            cascade.has_history = true;
+        }
     }
 
+    TracyPlot("LPV propagation dispatches", static_cast<int64_t>(num_dispatches));
+
+    auto history_matrices = eastl::vector<LPVCascadeMatrices>{};
+    history_matrices.reserve(cascades.size());
+    for(const auto& cascade : cascades) {
+        history_matrices.emplace_back(cascade.history_matrices);
+    }
+    RenderBackend::get().get_upload_queue().upload_to_buffer(history_cascade_data_buffer, std::span{history_matrices});
+
     render_graph.add_transition_pass(
         {
             .textures = {
                 {
-                    lpv_a_red,
+                    lpv_history_red,
                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
                     VK_ACCESS_SHADER_READ_BIT,
                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
                 },
                 {
-                    lpv_a_green,
+                    lpv_history_green,
                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
                     VK_ACCESS_SHADER_READ_BIT,
                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
                 },
                 {
-                    lpv_a_blue,
+                    lpv_history_blue,
                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
                     VK_ACCESS_SHADER_READ_BIT,
                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
@@ -1062,6 +1390,42 @@ void LightPropagationVolume::propagate_lighting(RenderGraph& render_graph) const
 
 }
 
+void LightPropagationVolume::blend_into_history(
+    RenderGraph& graph, const uint32_t cascade_index, const float blend_weight
+) const {
+    struct BlendHistoryConstants {
+        uint32_t cascade_index;
+        uint32_t num_cells;
+        float blend_weight;
+    };
+
+    const auto num_cells = static_cast<uint32_t>(cvar_lpv_resolution.Get());
+
+    // Propagation always ends in the A volume
+    const auto set = RenderBackend::get().get_transient_descriptor_allocator()
+                                         .build_set(blend_history_shader, 0)
+                                         .bind(lpv_a_red)
+                                         .bind(lpv_a_green)
+                                         .bind(lpv_a_blue)
+                                         .bind(lpv_history_red)
+                                         .bind(lpv_history_green)
+                                         .bind(lpv_history_blue)
+                                         .build();
+
+    graph.add_compute_dispatch<BlendHistoryConstants>(
+        {
+            .name = "Blend LPV history",
+            .descriptor_sets = {set},
+            .push_constants = {
+                .cascade_index = cascade_index,
+                .num_cells = num_cells,
+                .blend_weight = blend_weight
+            },
+            .num_workgroups = (glm::uvec3{num_cells} + glm::uvec3{3}) / glm::uvec3{4},
+            .compute_shader = blend_history_shader
+        });
+}
+
 void LightPropagationVolume::inject_rsm_depth_into_cascade_gv(
     RenderGraph& graph,
     const CascadeData& cascade,
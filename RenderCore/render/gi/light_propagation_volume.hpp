@@ -7,6 +7,7 @@
 
 #include "global_illuminator.hpp"
 #include "render/backend/handles.hpp"
+#include "shared/lpv.hpp"
 
 class ResourceUploadQueue;
 struct DescriptorSet;
@@ -44,6 +45,41 @@ struct CascadeData {
 
     glm::vec3 min_bounds;
     glm::vec3 max_bounds;
+
+    /**
+     * Hash of the inputs to the cascade's lighting - its transform, the sun, and the scene - when we last injected it.
+     * If the inputs haven't changed, the propagated lighting is still good and we skip the cascade
+     */
+    uint64_t input_hash = 0;
+
+    /**
+     * Frame when we last injected lighting into this cascade
+     */
+    uint32_t injection_frame = 0;
+
+    /**
+     * Whether we clear and inject this cascade this frame
+     */
+    bool inject_this_frame = false;
+
+    /**
+     * Number of propagation steps that the injected lighting still needs. Propagation may span several frames. 0 means
+     * that the cascade isn't propagating
+     */
+    uint32_t propagation_steps_left = 0;
+
+    /**
+     * Matrices that the propagating lighting was injected with
+     */
+    LPVCascadeMatrices propagating_matrices = {};
+
+    /**
+     * Matrices of the lighting in the history textures. The lighting pass uses these, since the history may be from
+     * an older transform than the cascade's current one
+     */
+    LPVCascadeMatrices history_matrices = {};
+
+    bool has_history = false;
 };
 
 enum class GvBuildMode {
@@ -72,7 +108,7 @@ public:
 
     void post_render(
         RenderGraph& graph, const SceneView& view, const RenderScene& scene, const GBuffer& gbuffer,
-        TextureHandle noise_tex
+        TextureHandle motion_vectors, TextureHandle noise_tex
     ) override;
 
     void get_lighting_resource_usages(
@@ -109,6 +145,15 @@ private:
 
     TextureHandle geometry_volume_handle = nullptr;
 
+    // Last finished propagation result of each cascade, blended over time. This is what we light the scene with
+    TextureHandle lpv_history_red = nullptr;
+    TextureHandle lpv_history_green = nullptr;
+    TextureHandle lpv_history_blue = nullptr;
+
+    bool is_history_cleared = false;
+
+    uint32_t frame_index = 0;
+
     VkSampler linear_sampler = VK_NULL_HANDLE;
 
     ComputePipelineHandle rsm_generate_vpls_pipeline;
@@ -119,11 +164,20 @@ private:
 
     ComputePipelineHandle vpl_injection_compute_pipeline;
 
+    ComputePipelineHandle cull_emissive_points_pipeline;
+
     ComputePipelineHandle propagation_shader;
 
+    ComputePipelineHandle blend_history_shader;
+
     eastl::vector<CascadeData> cascades;
     BufferHandle cascade_data_buffer = {};
 
+    /**
+     * Matrices of each cascade's history. See CascadeData::history_matrices
+     */
+    BufferHandle history_cascade_data_buffer = {};
+
     /**
      * Buffer of the cascade matrices in an array
      */
@@ -156,7 +210,20 @@ private:
      */
     void update_cascade_transforms(const SceneView& view, const DirectionalLight& light);
 
-    void clear_volume(RenderGraph& render_graph) const;
+    /**
+     * Decides which cascades to inject this frame
+     *
+     * A cascade is injected when its inputs changed since its last injection, and it isn't still propagating the
+     * last injection. Far cascades are injected at most every r.GI.LPV.FarCascadeUpdateInterval frames
+     */
+    void select_cascades_to_inject(const RenderScene& scene);
+
+    /**
+     * Bitmask of the cascades that we inject this frame
+     */
+    uint32_t get_injection_mask() const;
+
+    void clear_volume(RenderGraph& render_graph);
 
     static GvBuildMode get_build_mode();
 
@@ -181,10 +248,19 @@ private:
 
     /**
      * \brief Injects emissive mesh VPL clouds into the LPV
+     *
+     * A compute pass culls each emissive primitive's VPL range against each cascade and writes one draw per visible
+     * range. Each cascade then injects all its emissive VPLs with one indirect draw
      */
     void inject_emissive_point_clouds(RenderGraph& graph, const RenderScene& scene) const;
 
-    void propagate_lighting(RenderGraph& render_graph) const;
+    /**
+     * Spends this frame's propagation budget on the cascades that are propagating, oldest injection first. Cascades
+     * that finish are blended into the history
+     */
+    void propagate_lighting(RenderGraph& render_graph);
+
+    void blend_into_history(RenderGraph& graph, uint32_t cascade_index, float blend_weight) const;
 
     /**
      * Additively renders the LPV onto the bound framebuffer
@@ -0,0 +1,309 @@
+#include "probe_update_scheduler.hpp"
+
+#include <EASTL/algorithm.h>
+#include <EASTL/heap.h>
+#include <tracy/Tracy.hpp>
+
+#include "console/cvars.hpp"
+
+static AutoCVar_Int cvar_max_probe_age{
+    "r.GI.Cache.MaxProbeAge",
+    "Longest time that we schedule between updates of a probe, in frames. Bounds how stale the least important probes get",
+    600
+};
+
+static AutoCVar_Float cvar_distance_falloff{
+    "r.GI.Cache.DistanceFalloff",
+    "How quickly probe update priority falls off with distance from the camera, per probe of distance",
+    0.1f
+};
+
+ProbeUpdateScheduler::ProbeUpdateScheduler(const uint3 grid_size_in, const std::span<const float> cascade_priorities_in) :
+    grid_size{grid_size_in},
+    probes_per_cascade{grid_size_in.x * grid_size_in.y * grid_size_in.z},
+    cascade_priorities(cascade_priorities_in.begin(), cascade_priorities_in.end()) {
+    const auto num_cascades = static_cast<uint32_t>(cascade_priorities.size());
+
+    camera_positions.resize(num_cascades, float3{grid_size} * 0.5f);
+    scroll_offsets.resize(num_cascades, uint3{0});
+    probes.resize(num_cascades * probes_per_cascade);
+    queues.resize(num_cascades);
+
+    reference_weights.reserve(probes.size());
+    for(auto cascade = 0u; cascade < num_cascades; cascade++) {
+        for(auto probe = 0u; probe < probes_per_cascade; probe++) {
+            reference_weights.push_back(get_weight(cascade, get_texture_index(probe)));
+        }
+    }
+
+    current_max_probe_age = static_cast<uint32_t>(glm::max(cvar_max_probe_age.Get(), 1));
+    update_interval_scale();
+
+    for(auto cascade = 0u; cascade < num_cascades; cascade++) {
+        // Every probe starts out invalid, so this just puts them all at the front of the queue
+        rebuild_queue(cascade);
+    }
+}
+
+void ProbeUpdateScheduler::scroll_cascade(
+    const uint32_t cascade, const int3 movement, const uint3 scroll_offset, const float3 camera_position
+) {
+    ZoneScoped;
+
+    camera_positions[cascade] = camera_position;
+    scroll_offsets[cascade] = scroll_offset;
+
+    if(glm::any(glm::greaterThanEqual(glm::abs(movement), int3{grid_size}))) {
+        // None of the old probes are still in the cascade
+        const auto first_probe = probes.begin() + cascade * probes_per_cascade;
+        eastl::fill(first_probe, first_probe + probes_per_cascade, ProbeState{});
+        rebuild_queue(cascade);
+        return;
+    }
+
+    // Along each axis, the probes that scrolled in are a slab at one end of the grid, and the probes that stayed are
+    // the rest of the axis
+    auto scrolled_in_min = uint3{0};
+    auto scrolled_in_max = uint3{0};
+    auto kept_min = uint3{0};
+    auto kept_max = grid_size;
+    for(auto axis = 0; axis < 3; axis++) {
+        const auto size = static_cast<int32_t>(grid_size[axis]);
+        if(movement[axis] > 0) {
+            // The probe at index i used to be at i - movement, so the probes below movement are new
+            scrolled_in_max[axis] = movement[axis];
+            kept_min[axis] = movement[axis];
+        } else if(movement[axis] < 0) {
+            scrolled_in_min[axis] = size + movement[axis];
+            scrolled_in_max[axis] = size;
+            kept_max[axis] = size + movement[axis];
+        }
+    }
+
+    // Every probe that scrolled in is in at least one slab. Clip the slabs against each other so that we invalidate
+    // each probe once
+    invalidate_probes(cascade, {scrolled_in_min.x, 0, 0}, {scrolled_in_max.x, grid_size.y, grid_size.z});
+    invalidate_probes(cascade, {kept_min.x, scrolled_in_min.y, 0}, {kept_max.x, scrolled_in_max.y, grid_size.z});
+    invalidate_probes(
+        cascade,
+        {kept_min.x, kept_min.y, scrolled_in_min.z},
+        {kept_max.x, kept_max.y, scrolled_in_max.z});
+}
+
+void ProbeUpdateScheduler::invalidate_probe(const uint32_t cascade, const uint3 probe) {
+    const auto texture_index = (probe + scroll_offsets[cascade]) % grid_size;
+    const auto probe_index = get_probe_index(cascade, texture_index);
+    auto& state = probes[probe_index];
+    state.is_valid = false;
+    state.generation++;
+
+    auto& queue = queues[cascade];
+    queue.emplace_back(
+        QueueEntry{
+            .due_frame = 0,
+            .weight = get_weight(cascade, texture_index),
+            .probe = probe_index,
+            .generation = state.generation
+        });
+    eastl::push_heap(queue.begin(), queue.end(), is_less_urgent);
+
+    // The probe's old entry is still in the queue. If enough of those pile up, clean them out
+    if(queue.size() > probes_per_cascade * 2) {
+        rebuild_queue(cascade);
+    }
+}
+
+void ProbeUpdateScheduler::pull_probes_to_update(
+    const uint32_t frame, const uint32_t budget, const std::span<const float3> camera_positions_in,
+    eastl::vector<uint3>& probes_out
+) {
+    ZoneScoped;
+
+    camera_positions.assign(camera_positions_in.begin(), camera_positions_in.end());
+
+    const auto max_probe_age = static_cast<uint32_t>(glm::max(cvar_max_probe_age.Get(), 1));
+    if(eastl::max(budget, 1u) != current_budget || max_probe_age != current_max_probe_age) {
+        current_budget = eastl::max(budget, 1u);
+        current_max_probe_age = max_probe_age;
+        update_interval_scale();
+    }
+
+    const auto num_to_pull = static_cast<uint32_t>(probes_out.size()) + eastl::min(
+        budget, static_cast<uint32_t>(probes.size()));
+
+    auto max_age = 0u;
+    auto num_invalid_probes = 0u;
+
+    rescheduled_probes.clear();
+
+    while(probes_out.size() < num_to_pull) {
+        // Find the cascade with the most urgent probe
+        auto cascade = 0u;
+        for(auto i = 1u; i < queues.size(); i++) {
+            if(queues[i].empty()) {
+                continue;
+            }
+            if(queues[cascade].empty() || is_less_urgent(queues[cascade].front(), queues[i].front())) {
+                cascade = i;
+            }
+        }
+
+        auto& queue = queues[cascade];
+        if(queue.empty()) {
+            // Every probe was updated this frame
+            break;
+        }
+
+        eastl::pop_heap(queue.begin(), queue.end(), is_less_urgent);
+        const auto entry = queue.back();
+        queue.pop_back();
+
+        auto& state = probes[entry.probe];
+        if(entry.generation != state.generation) {
+            continue;
+        }
+
+        const auto coords = get_texture_index(entry.probe);
+        probes_out.emplace_back(coords.x, coords.y + cascade * grid_size.y, coords.z);
+
+        if(state.is_valid) {
+            max_age = eastl::max(max_age, frame - state.last_update_frame);
+        } else {
+            num_invalid_probes++;
+        }
+
+        state.is_valid = true;
+        state.last_update_frame = frame;
+        state.generation++;
+
+        const auto weight = get_weight(cascade, coords);
+        rescheduled_probes.emplace_back(
+            QueueEntry{
+                .due_frame = frame + get_update_interval(weight),
+                .weight = weight,
+                .probe = entry.probe,
+                .generation = state.generation
+            });
+    }
+
+    for(const auto& entry : rescheduled_probes) {
+        auto& queue = queues[entry.probe / probes_per_cascade];
+        queue.emplace_back(entry);
+        eastl::push_heap(queue.begin(), queue.end(), is_less_urgent);
+    }
+
+    TracyPlot("GI probe max age", static_cast<int64_t>(max_age));
+    TracyPlot("GI invalid probes updated", static_cast<int64_t>(num_invalid_probes));
+}
+
+bool ProbeUpdateScheduler::is_less_urgent(const QueueEntry& a, const QueueEntry& b) {
+    if(a.due_frame != b.due_frame) {
+        return a.due_frame > b.due_frame;
+    }
+    if(a.weight != b.weight) {
+        // Invalid probes are all due at frame 0, and the important ones go first. Among valid probes, the one with the
+        // lowest weight has the longest interval, so it's the closest to r.GI.Cache.MaxProbeAge
+        return a.due_frame == 0 ? a.weight < b.weight : a.weight > b.weight;
+    }
+    return a.probe > b.probe;
+}
+
+uint32_t ProbeUpdateScheduler::get_probe_index(const uint32_t cascade, const uint3 texture_index) const {
+    return cascade * probes_per_cascade + texture_index.x + texture_index.y * grid_size.x +
+        texture_index.z * grid_size.x * grid_size.y;
+}
+
+uint3 ProbeUpdateScheduler::get_texture_index(const uint32_t probe_index) const {
+    const auto index_in_cascade = probe_index % probes_per_cascade;
+    return uint3{
+        index_in_cascade % grid_size.x,
+        (index_in_cascade / grid_size.x) % grid_size.y,
+        index_in_cascade / (grid_size.x * grid_size.y)
+    };
+}
+
+uint3 ProbeUpdateScheduler::get_cascade_index(const uint32_t cascade, const uint3 texture_index) const {
+    return (texture_index + grid_size - scroll_offsets[cascade]) % grid_size;
+}
+
+float ProbeUpdateScheduler::get_weight(const uint32_t cascade, const uint3 texture_index) const {
+    const auto probe = get_cascade_index(cascade, texture_index);
+    const auto distance = glm::length(float3{probe} - camera_positions[cascade]);
+    return cascade_priorities[cascade] / (1.f + distance * cvar_distance_falloff.GetFloat());
+}
+
+void ProbeUpdateScheduler::invalidate_probes(const uint32_t cascade, const uint3 box_min, const uint3 box_max) {
+    for(auto z = box_min.z; z < box_max.z; z++) {
+        for(auto y = box_min.y; y < box_max.y; y++) {
+            for(auto x = box_min.x; x < box_max.x; x++) {
+                invalidate_probe(cascade, {x, y, z});
+            }
+        }
+    }
+}
+
+uint32_t ProbeUpdateScheduler::get_update_interval(const float weight) const {
+    const auto interval = static_cast<uint32_t>(glm::ceil(interval_scale / glm::max(weight, 1e-6f)));
+    return glm::clamp(interval, 1u, current_max_probe_age);
+}
+
+void ProbeUpdateScheduler::update_interval_scale() {
+    ZoneScoped;
+
+    // If every probe is updated once per interval, the whole cache asks for the sum of 1 / interval updates per frame.
+    // Without clamping that's total_weight / interval_scale, but the probes clamped to the max age ask for more than
+    // their weight says, and the probes clamped to one frame ask for less. Binary search for the smallest scale that
+    // fits in the budget
+    const auto max_age = static_cast<float>(current_max_probe_age);
+    const auto get_updates_per_frame = [&](const float scale) {
+        auto updates_per_frame = 0.f;
+        for(const auto weight : reference_weights) {
+            updates_per_frame += 1.f / glm::clamp(scale / glm::max(weight, 1e-6f), 1.f, max_age);
+        }
+        return updates_per_frame;
+    };
+
+    const auto budget = static_cast<float>(current_budget);
+    const auto max_weight = *eastl::max_element(reference_weights.begin(), reference_weights.end());
+
+    // Past this scale, every interval is the max age. If that's still too many updates, the budget can't keep up
+    // anyway, and we settle for every probe asking for the max age
+    auto max_scale = max_weight * max_age;
+    auto min_scale = 0.f;
+    if(get_updates_per_frame(max_scale) > budget) {
+        interval_scale = max_scale;
+        return;
+    }
+
+    for(auto i = 0; i < 32; i++) {
+        const auto scale = (min_scale + max_scale) * 0.5f;
+        if(get_updates_per_frame(scale) > budget) {
+            min_scale = scale;
+        } else {
+            max_scale = scale;
+        }
+    }
+
+    interval_scale = max_scale;
+}
+
+void ProbeUpdateScheduler::rebuild_queue(const uint32_t cascade) {
+    auto& queue = queues[cascade];
+    queue.clear();
+    queue.reserve(probes_per_cascade);
+
+    for(auto probe = 0u; probe < probes_per_cascade; probe++) {
+        const auto probe_index = cascade * probes_per_cascade + probe;
+        const auto& state = probes[probe_index];
+        const auto weight = get_weight(cascade, get_texture_index(probe));
+        queue.emplace_back(
+            QueueEntry{
+                .due_frame = state.is_valid ? state.last_update_frame + get_update_interval(weight) : 0,
+                .weight = weight,
+                .probe = probe_index,
+                .generation = state.generation
+            });
+    }
+
+    eastl::make_heap(queue.begin(), queue.end(), is_less_urgent);
+}
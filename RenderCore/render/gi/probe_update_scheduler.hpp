@@ -0,0 +1,169 @@
+#pragma once
+
+#include <span>
+
+#include <EASTL/vector.h>
+
+#include "shared/prelude.h"
+
+/**
+ * Decides which irradiance cache probes to update each frame
+ *
+ * Every probe has a due frame. When we update a probe, we schedule its next update based on its weight - the cascade's
+ * update priority, scaled by how close the probe is to the camera. Important probes come due sooner. The intervals are
+ * sized so that the whole cache asks for about as many updates per frame as the budget allows, including the probes
+ * whose intervals are clamped
+ *
+ * Each cascade keeps its probes in a min-heap ordered by due frame, and each frame we pull exactly the budget from the
+ * front of the heaps. That's O(budget * log(probes)), rather than a walk over every probe. Probes that are new or
+ * invalidated are due at frame 0, so they go to the front of the line. Ties are broken by weight - highest first for
+ * invalid probes, lowest first for valid ones - then by index, so the schedule is fully deterministic
+ *
+ * No interval is longer than r.GI.Cache.MaxProbeAge. When the budget has room for every probe at that age, no probe
+ * waits longer. When it doesn't, a probe may wait past its due frame while the probes ahead of it take up the whole
+ * budget, but every probe still gets its turn - Tracy's "GI probe max age" plot shows how far behind we are
+ */
+class ProbeUpdateScheduler {
+public:
+    /**
+     * \param grid_size_in Number of probes in each cascade, along each axis
+     * \param cascade_priorities_in How important each cascade's probes are. One entry per cascade
+     */
+    ProbeUpdateScheduler(uint3 grid_size_in, std::span<const float> cascade_priorities_in);
+
+    /**
+     * Tells the scheduler that a cascade moved
+     *
+     * The probe textures wrap around, so the probes that stayed in the cascade keep their texels and their schedule.
+     * Only the slabs of probes that scrolled in are invalidated
+     *
+     * \param movement How far the cascade moved, in probes. The probe at index i is now at index i + movement
+     * \param scroll_offset Texture index of the probe at the cascade's min
+     * \param camera_position The camera's position in the cascade's grid, in probes
+     */
+    void scroll_cascade(uint32_t cascade, int3 movement, uint3 scroll_offset, float3 camera_position);
+
+    /**
+     * Forces a probe to be updated as soon as possible
+     *
+     * \param probe Index of the probe, relative to the cascade's min
+     */
+    void invalidate_probe(uint32_t cascade, uint3 probe);
+
+    /**
+     * Pulls the probes to update this frame
+     *
+     * Returns min(budget, number of probes) probes. Each probe is returned as its index in the probe textures, with
+     * an offset for its cascade in the Y index, which is how the probe update shaders expect them
+     *
+     * \param camera_positions The camera's position in each cascade's grid, in probes
+     */
+    void pull_probes_to_update(
+        uint32_t frame, uint32_t budget, std::span<const float3> camera_positions, eastl::vector<uint3>& probes
+    );
+
+private:
+    struct ProbeState {
+        bool is_valid = false;
+
+        uint32_t last_update_frame = 0;
+
+        /**
+         * Incremented whenever the probe is re-queued. Queue entries with an older generation are stale and skipped
+         */
+        uint32_t generation = 0;
+    };
+
+    struct QueueEntry {
+        uint32_t due_frame = 0;
+
+        float weight = 0;
+
+        uint32_t probe = 0;
+
+        uint32_t generation = 0;
+    };
+
+    /**
+     * Whether a should be updated after b. Used as the heap comparator, so the top of the heap is the most urgent probe
+     */
+    static bool is_less_urgent(const QueueEntry& a, const QueueEntry& b);
+
+    uint3 grid_size;
+
+    uint32_t probes_per_cascade;
+
+    eastl::vector<float> cascade_priorities;
+
+    /**
+     * Camera position in each cascade's grid, as of the most recent scroll or pull
+     */
+    eastl::vector<float3> camera_positions;
+
+    /**
+     * Texture index of the probe at each cascade's min
+     */
+    eastl::vector<uint3> scroll_offsets;
+
+    /**
+     * Budget of the most recent pull. Used to size the intervals of probes that we re-queue between pulls
+     */
+    uint32_t current_budget = 1;
+
+    /**
+     * r.GI.Cache.MaxProbeAge as of the most recent pull
+     */
+    uint32_t current_max_probe_age = 1;
+
+    /**
+     * Weight of every probe, assuming the camera is in the middle of each cascade. Used to size the update intervals
+     */
+    eastl::vector<float> reference_weights;
+
+    /**
+     * A probe's update interval is this divided by its weight, before clamping. Sized so that the reference weights ask
+     * for current_budget updates per frame
+     */
+    float interval_scale = 1;
+
+    /**
+     * State of each probe, by cascade and then by texture index. Probes keep their state when the cascade scrolls
+     */
+    eastl::vector<ProbeState> probes;
+
+    eastl::vector<eastl::vector<QueueEntry>> queues;
+
+    /**
+     * Probes that were updated this frame. They go back in the queue after we've pulled the whole budget, so that one
+     * probe can't be pulled twice in one frame
+     */
+    eastl::vector<QueueEntry> rescheduled_probes;
+
+    uint32_t get_probe_index(uint32_t cascade, uint3 texture_index) const;
+
+    /**
+     * Converts a probe index to the probe's texture index in its cascade
+     */
+    uint3 get_texture_index(uint32_t probe_index) const;
+
+    /**
+     * Converts a probe's texture index to its index relative to the cascade's min
+     */
+    uint3 get_cascade_index(uint32_t cascade, uint3 texture_index) const;
+
+    float get_weight(uint32_t cascade, uint3 texture_index) const;
+
+    /**
+     * Invalidates every probe in a box of the cascade. The box is given in indices relative to the cascade's min
+     */
+    void invalidate_probes(uint32_t cascade, uint3 box_min, uint3 box_max);
+
+    uint32_t get_update_interval(float weight) const;
+
+    /**
+     * Finds the interval scale for the current budget
+     */
+    void update_interval_scale();
+
+    void rebuild_queue(uint32_t cascade);
+};
@@ -22,10 +22,52 @@ static AutoCVar_Int cvar_gi_cache{"r.GI.Cache.Enabled", "Whether to enable the G
 
 static AutoCVar_Int cvar_gi_cache_debug{"r.GI.Cache.Debug", "Enable a debug draw of the irradiance cache", true};
 
+static AutoCVar_Int cvar_trace_downscale{
+    "r.GI.TraceDownscale",
+    "How much to reduce the resolution that we trace GI at. 1 = full resolution, 2 = half, 4 = quarter. Reduced resolutions trace a different pixel in each block every frame, and reconstruct the rest",
+    1
+};
+
+static AutoCVar_Float cvar_max_history_length{
+    "r.GI.MaxHistoryLength", "Maximum number of frames to accumulate reduced resolution GI over", 16.f
+};
+
+static AutoCVar_Float cvar_disocclusion_threshold{
+    "r.GI.DisocclusionThreshold",
+    "Largest relative difference in depth between the current and reprojected pixel where we keep the GI history",
+    0.1f
+};
+
+/**
+ * Order that we trace the pixels of a 4x4 block in. It's a Bayer matrix, so each frame's pixels are spread out over
+ * the block. The first four entries are a 2x2 Bayer matrix, scaled up
+ */
+static constexpr glm::uvec2 bayer_offsets[] = {
+    {0, 0}, {2, 2}, {2, 0}, {0, 2},
+    {1, 1}, {3, 3}, {3, 1}, {1, 3},
+    {1, 0}, {3, 2}, {3, 0}, {1, 2},
+    {0, 1}, {2, 3}, {2, 1}, {0, 3},
+};
+
+static uint32_t get_trace_downscale() {
+    const auto downscale = cvar_trace_downscale.Get();
+    if(downscale >= 4) {
+        return 4;
+    } else if(downscale >= 2) {
+        return 2;
+    } else {
+        return 1;
+    }
+}
+
 bool RayTracedGlobalIllumination::should_render() {
     return cvar_num_bounces.Get() > 0;
 }
 
+bool RayTracedGlobalIllumination::needs_motion_vectors() {
+    return get_trace_downscale() > 1;
+}
+
 RayTracedGlobalIllumination::RayTracedGlobalIllumination() {
     auto& backend = RenderBackend::get();
     if(overlay_pso == nullptr) {
@@ -48,6 +90,11 @@ RayTracedGlobalIllumination::~RayTracedGlobalIllumination() {
 
     allocator.destroy_texture(ray_texture);
     allocator.destroy_texture(ray_irradiance);
+    allocator.destroy_texture(resolved_rays);
+    for(const auto irradiance : resolved_irradiance) {
+        allocator.destroy_texture(irradiance);
+    }
+    allocator.destroy_texture(depth_history);
 }
 
 void RayTracedGlobalIllumination::pre_render(
@@ -68,30 +115,38 @@ void RayTracedGlobalIllumination::pre_render(
 
 void RayTracedGlobalIllumination::post_render(
     RenderGraph& graph, const SceneView& view, const RenderScene& scene, const GBuffer& gbuffer,
-    const TextureHandle noise_tex
+    const TextureHandle motion_vectors, const TextureHandle noise_tex
 ) {
     auto& backend = RenderBackend::get();
     auto& allocator = backend.get_global_allocator();
 
-    const auto render_resolution = gbuffer.depth->get_resolution();
+    frame_index++;
 
-    if(ray_texture == nullptr || ray_texture->get_resolution() != render_resolution) {
+    // The ray textures cover the whole gbuffer. Dynamic resolution only renders to part of it, so we only trace that
+    // part
+    const auto downscale = get_trace_downscale();
+    const auto trace_texture_resolution = (gbuffer.depth->get_resolution() + glm::uvec2{downscale - 1}) /
+        glm::uvec2{downscale};
+    const auto trace_resolution = (view.get_render_resolution() + glm::uvec2{downscale - 1}) / glm::uvec2{downscale};
+    const auto sample_offset = bayer_offsets[frame_index % (downscale * downscale)] * downscale / 4u;
+
+    if(ray_texture == nullptr || ray_texture->get_resolution() != trace_texture_resolution) {
         allocator.destroy_texture(ray_texture);
         ray_texture = allocator.create_texture(
             "rtgi_params",
             {
                 .format = VK_FORMAT_R16G16B16A16_SFLOAT,
-                .resolution = render_resolution,
+                .resolution = trace_texture_resolution,
                 .usage = TextureUsage::StorageImage
             });
     }
-    if(ray_irradiance == nullptr || ray_irradiance->get_resolution() != render_resolution) {
+    if(ray_irradiance == nullptr || ray_irradiance->get_resolution() != trace_texture_resolution) {
         allocator.destroy_texture(ray_irradiance);
         ray_irradiance = allocator.create_texture(
             "rtgi_irradiance",
             {
                 .format = VK_FORMAT_R16G16B16A16_SFLOAT,
-                .resolution = render_resolution,
+                .resolution = trace_texture_resolution,
                 .usage = TextureUsage::StorageImage
             });
     }
@@ -129,25 +184,157 @@ void RayTracedGlobalIllumination::post_render(
                 commands.bind_descriptor_set(1, backend.get_texture_descriptor_pool().get_descriptor_set());
 
                 commands.set_push_constant(0, static_cast<uint32_t>(cvar_num_bounces.Get()));
+                commands.set_push_constant(1, downscale);
+                commands.set_push_constant(2, sample_offset.x);
+                commands.set_push_constant(3, sample_offset.y);
 
-                commands.dispatch_rays(render_resolution);
+                commands.dispatch_rays(trace_resolution);
 
                 commands.clear_descriptor_set(0);
                 commands.clear_descriptor_set(1);
             }
         });
+
+    if(downscale == 1) {
+        overlay_rays = ray_texture;
+        overlay_irradiance = ray_irradiance;
+        has_history = false;
+        return;
+    }
+
+    upsample_rays(graph, view, gbuffer, motion_vectors, downscale, sample_offset);
+}
+
+void RayTracedGlobalIllumination::create_resolved_textures(const glm::uvec2 render_resolution) {
+    if(resolved_rays != nullptr && resolved_rays->get_resolution() == render_resolution) {
+        return;
+    }
+
+    auto& allocator = RenderBackend::get().get_global_allocator();
+
+    allocator.destroy_texture(resolved_rays);
+    resolved_rays = allocator.create_texture(
+        "rtgi_resolved_params",
+        {
+            .format = VK_FORMAT_R16G16B16A16_SFLOAT,
+            .resolution = render_resolution,
+            .usage = TextureUsage::StorageImage
+        });
+
+    for(auto i = 0u; i < resolved_irradiance.size(); i++) {
+        allocator.destroy_texture(resolved_irradiance[i]);
+        resolved_irradiance[i] = allocator.create_texture(
+            fmt::format("rtgi_resolved_irradiance_{}", i),
+            {
+                .format = VK_FORMAT_R16G16B16A16_SFLOAT,
+                .resolution = render_resolution,
+                .usage = TextureUsage::StorageImage
+            });
+    }
+
+    allocator.destroy_texture(depth_history);
+    depth_history = allocator.create_texture(
+        "rtgi_depth_history",
+        {
+            .format = VK_FORMAT_R32_SFLOAT,
+            .resolution = render_resolution,
+            .usage = TextureUsage::StorageImage
+        });
+
+    has_history = false;
+}
+
+void RayTracedGlobalIllumination::upsample_rays(
+    RenderGraph& graph, const SceneView& view, const GBuffer& gbuffer, const TextureHandle motion_vectors,
+    const uint32_t downscale, const glm::uvec2 sample_offset
+) {
+    ZoneScoped;
+
+    auto& backend = RenderBackend::get();
+
+    if(upsample_pipeline == nullptr) {
+        upsample_pipeline = backend.get_pipeline_cache().create_pipeline("shaders/gi/rtgi/rtgi_upsample.comp.spv");
+    }
+
+    create_resolved_textures(gbuffer.depth->get_resolution());
+
+    // Only upsample the part of the gbuffer that we rendered to. The motion vectors may be at a different resolution,
+    // so we scale their size by the same amount
+    const auto render_resolution = view.get_render_resolution();
+    const auto trace_resolution = (render_resolution + glm::uvec2{downscale - 1}) / glm::uvec2{downscale};
+    const auto motion_vectors_resolution = motion_vectors->get_resolution() * render_resolution /
+        gbuffer.depth->get_resolution();
+
+    const auto previous_irradiance = resolved_irradiance[(frame_index + 1) % 2];
+    const auto current_irradiance = resolved_irradiance[frame_index % 2];
+
+    const auto set = backend.get_transient_descriptor_allocator()
+                            .build_set(upsample_pipeline, 0)
+                            .bind(view.get_buffer())
+                            .bind(gbuffer.depth)
+                            .bind(gbuffer.normals)
+                            .bind(depth_history)
+                            .bind(motion_vectors)
+                            .bind(ray_texture)
+                            .bind(ray_irradiance)
+                            .bind(previous_irradiance)
+                            .bind(resolved_rays)
+                            .bind(current_irradiance)
+                            .build();
+
+    struct Constants {
+        glm::u16vec2 resolution;
+        glm::u16vec2 trace_resolution;
+        glm::u16vec2 motion_vectors_resolution;
+        glm::u16vec2 sample_offset;
+        uint32_t downscale;
+        float max_history_length;
+        float disocclusion_threshold;
+        uint32_t has_history;
+    };
+
+    graph.add_compute_dispatch(
+        ComputeDispatch<Constants>{
+            .name = "rtgi_upsample",
+            .descriptor_sets = {set},
+            .push_constants = Constants{
+                .resolution = {render_resolution},
+                .trace_resolution = {trace_resolution},
+                .motion_vectors_resolution = {motion_vectors_resolution},
+                .sample_offset = {sample_offset},
+                .downscale = downscale,
+                .max_history_length = glm::max(cvar_max_history_length.GetFloat(), 1.f),
+                .disocclusion_threshold = cvar_disocclusion_threshold.GetFloat(),
+                .has_history = has_history ? 1u : 0u
+            },
+            .num_workgroups = glm::uvec3{(render_resolution + glm::uvec2{7}) / glm::uvec2{8}, 1},
+            .compute_shader = upsample_pipeline
+        });
+
+    // Save this frame's depth for next frame's reprojection
+    graph.add_copy_pass(
+        ImageCopyPass{
+            .name = "rtgi_copy_depth_history",
+            .dst = depth_history,
+            .src = gbuffer.depth
+        });
+
+    has_history = true;
+
+    overlay_rays = resolved_rays;
+    overlay_irradiance = current_irradiance;
 }
 
 void RayTracedGlobalIllumination::get_lighting_resource_usages(
     TextureUsageList& textures, BufferUsageList& buffers
 ) const {
     textures.emplace_back(
-        ray_texture,
+        overlay_rays,
         VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
         VK_ACCESS_2_SHADER_READ_BIT,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     textures.emplace_back(
-        ray_irradiance,
+        overlay_irradiance,
         VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
         VK_ACCESS_2_SHADER_READ_BIT,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -168,8 +355,8 @@ void RayTracedGlobalIllumination::render_to_lit_scene(
                                        .build_set(overlay_pso, 1)
                                        .bind(view_buffer)
                                        .bind(noise_texture)
-                                       .bind(ray_texture)
-                                       .bind(ray_irradiance)
+                                       .bind(overlay_rays)
+                                       .bind(overlay_irradiance)
                                        .build();
 
         commands.set_cull_mode(VK_CULL_MODE_NONE);
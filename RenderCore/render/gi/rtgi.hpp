@@ -1,6 +1,8 @@
 #pragma once
 
+#include <EASTL/array.h>
 #include <EASTL/vector.h>
+#include <glm/vec2.hpp>
 
 #include "render/gi/global_illuminator.hpp"
 #include "render/gi/irradiance_cache.hpp"
@@ -23,6 +25,11 @@ class RayTracedGlobalIllumination : public IGlobalIlluminator {
 public:
     static bool should_render();
 
+    /**
+     * Whether RTGI needs this frame's motion vectors, which it does when it traces at a reduced resolution
+     */
+    static bool needs_motion_vectors();
+
     RayTracedGlobalIllumination();
 
     ~RayTracedGlobalIllumination() override;
@@ -33,7 +40,7 @@ public:
 
     void post_render(
         RenderGraph& graph, const SceneView& view, const RenderScene& scene, const GBuffer& gbuffer,
-        TextureHandle noise_tex
+        TextureHandle motion_vectors, TextureHandle noise_tex
     ) override;
 
     /**
@@ -67,9 +74,43 @@ private:
      */
     TextureHandle ray_irradiance = nullptr;
 
+    /**
+     * Full resolution rays and irradiance, reconstructed from the rays when we trace at a reduced resolution. The
+     * irradiance is accumulated over time, and we ping-pong between the two textures
+     */
+    TextureHandle resolved_rays = nullptr;
+    eastl::array<TextureHandle, 2> resolved_irradiance = {};
+
+    /**
+     * R32F copy of last frame's depth buffer, to reject disoccluded history
+     */
+    TextureHandle depth_history = nullptr;
+
+    bool has_history = false;
+
+    /**
+     * Rays and irradiance that the overlay applies to the lit scene. Either the traced textures, or the resolved ones
+     */
+    TextureHandle overlay_rays = nullptr;
+    TextureHandle overlay_irradiance = nullptr;
+
+    uint32_t frame_index = 0;
+
     std::unique_ptr<IrradianceCache> irradiance_cache = nullptr;
 
     static inline RayTracingPipelineHandle rtgi_pipeline = nullptr;
 
+    static inline ComputePipelineHandle upsample_pipeline = nullptr;
+
     static inline GraphicsPipelineHandle overlay_pso = nullptr;
+
+    void create_resolved_textures(glm::uvec2 render_resolution);
+
+    /**
+     * Reconstructs full resolution GI from the rays, and accumulates it with last frame's
+     */
+    void upsample_rays(
+        RenderGraph& graph, const SceneView& view, const GBuffer& gbuffer, TextureHandle motion_vectors,
+        uint32_t downscale, glm::uvec2 sample_offset
+    );
 };
@@ -10,6 +10,43 @@ static ComputePipelineHandle init_count_buffer_pipeline = nullptr;
 
 static ComputePipelineHandle visibility_list_to_draw_commands = nullptr;
 
+static ComputePipelineHandle bin_visible_primitives_pipeline = nullptr;
+
+static ComputePipelineHandle scan_draw_bins_pipeline = nullptr;
+
+static ComputePipelineHandle write_binned_draw_commands_pipeline = nullptr;
+
+struct DrawBinningConstants {
+    uint32_t num_primitives;
+    uint32_t num_pipeline_bins;
+    uint32_t num_materials;
+};
+
+/**
+ * Finds the bin of a primitive, or UINT32_MAX if it isn't drawn with any of the binned pipelines. Must match
+ * get_draw_bin in draw_bins.slangi
+ */
+static uint32_t get_draw_bin(
+    const PrimitiveDataGPU& primitive, const uint32_t num_pipeline_bins, const uint32_t num_materials
+) {
+    if(primitive.type >= num_pipeline_bins || primitive.material_id >= num_materials) {
+        return UINT32_MAX;
+    }
+
+    return primitive.type * num_materials + primitive.material_id;
+}
+
+IndirectDrawingBuffers BinnedIndirectDrawingBuffers::get_pipeline_bin(const uint32_t pipeline_bin) const {
+    return IndirectDrawingBuffers{
+        .commands = commands,
+        .count = counts,
+        .primitive_ids = primitive_ids,
+        .commands_offset = static_cast<uint32_t>(
+            sizeof(VkDrawIndexedIndirectCommand) * max_draws_per_bin * pipeline_bin),
+        .count_offset = static_cast<uint32_t>(sizeof(uint32_t) * pipeline_bin)
+    };
+}
+
 IndirectDrawingBuffers translate_visibility_list_to_draw_commands(
     RenderGraph& graph, const BufferHandle visibility_list, const BufferHandle primitive_buffer,
     const uint32_t num_primitives, const BufferHandle mesh_draw_args_buffer, const uint32_t primitive_type
@@ -80,3 +117,198 @@ IndirectDrawingBuffers translate_visibility_list_to_draw_commands(
 
     return buffers;
 }
+
+BinnedIndirectDrawingBuffers bin_visibility_list_to_draw_commands(
+    RenderGraph& graph, const BufferHandle visibility_list, const BufferHandle primitive_buffer,
+    const uint32_t num_primitives, const BufferHandle mesh_draw_args_buffer, const uint32_t num_pipeline_bins,
+    const uint32_t num_materials
+) {
+    ZoneScoped;
+
+    auto& backend = RenderBackend::get();
+
+    auto& pipeline_cache = backend.get_pipeline_cache();
+
+    if(!bin_visible_primitives_pipeline) {
+        bin_visible_primitives_pipeline = pipeline_cache.create_pipeline(
+            "shaders/util/bin_visible_primitives.comp.spv");
+    }
+    if(!scan_draw_bins_pipeline) {
+        scan_draw_bins_pipeline = pipeline_cache.create_pipeline("shaders/util/scan_draw_bins.comp.spv");
+    }
+    if(!write_binned_draw_commands_pipeline) {
+        write_binned_draw_commands_pipeline = pipeline_cache.create_pipeline(
+            "shaders/util/write_binned_draw_commands.comp.spv");
+    }
+
+    // Vulkan doesn't like empty buffers
+    const auto num_bins = std::max(num_pipeline_bins * num_materials, 1u);
+
+    auto& allocator = backend.get_global_allocator();
+    const auto buffers = BinnedIndirectDrawingBuffers{
+        .commands = allocator.create_buffer(
+            "Binned draw commands",
+            sizeof(VkDrawIndexedIndirectCommand) * num_primitives * num_pipeline_bins,
+            BufferUsage::IndirectBuffer),
+        .counts = allocator.create_buffer(
+            "Binned draw counts",
+            sizeof(uint32_t) * num_pipeline_bins,
+            BufferUsage::IndirectBuffer),
+        .primitive_ids = allocator.create_buffer(
+            "Binned primitive IDs",
+            sizeof(uint32_t) * num_primitives * num_pipeline_bins,
+            BufferUsage::VertexBuffer),
+        .max_draws_per_bin = num_primitives
+    };
+
+    const auto bin_counts = allocator.create_buffer(
+        "Draw bin counts",
+        sizeof(uint32_t) * num_bins,
+        BufferUsage::StorageBuffer);
+    const auto bin_offsets = allocator.create_buffer(
+        "Draw bin offsets",
+        sizeof(uint32_t) * num_bins,
+        BufferUsage::StorageBuffer);
+    const auto primitive_bin_slots = allocator.create_buffer(
+        "Primitive draw bin slots",
+        sizeof(uint32_t) * num_primitives,
+        BufferUsage::StorageBuffer);
+
+    const auto constants = DrawBinningConstants{
+        .num_primitives = num_primitives,
+        .num_pipeline_bins = num_pipeline_bins,
+        .num_materials = num_materials
+    };
+
+    graph.add_pass(
+        {
+            .name = "Clear draw bin counts",
+            .buffers = {
+                {
+                    .buffer = bin_counts,
+                    .stage = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                    .access = VK_ACCESS_2_TRANSFER_WRITE_BIT
+                }
+            },
+            .execute = [=](CommandBuffer& commands) {
+                commands.fill_buffer(bin_counts, 0);
+            }
+        });
+
+    auto& descriptor_allocator = backend.get_transient_descriptor_allocator();
+
+    const auto count_set = descriptor_allocator.build_set(bin_visible_primitives_pipeline, 0)
+                                               .bind(primitive_buffer)
+                                               .bind(visibility_list)
+                                               .bind(bin_counts)
+                                               .bind(primitive_bin_slots)
+                                               .build();
+    graph.add_compute_dispatch<DrawBinningConstants>(
+        {
+            .name = "Count draws per bin",
+            .descriptor_sets = {count_set},
+            .push_constants = constants,
+            .num_workgroups = {(num_primitives + 95) / 96, 1, 1},
+            .compute_shader = bin_visible_primitives_pipeline
+        });
+
+    const auto scan_set = descriptor_allocator.build_set(scan_draw_bins_pipeline, 0)
+                                              .bind(bin_counts)
+                                              .bind(bin_offsets)
+                                              .bind(buffers.counts)
+                                              .build();
+    graph.add_compute_dispatch<DrawBinningConstants>(
+        {
+            .name = "Scan draw bins",
+            .descriptor_sets = {scan_set},
+            .push_constants = constants,
+            .num_workgroups = {1, 1, 1},
+            .compute_shader = scan_draw_bins_pipeline
+        });
+
+    const auto write_set = descriptor_allocator.build_set(write_binned_draw_commands_pipeline, 0)
+                                               .bind(primitive_buffer)
+                                               .bind(visibility_list)
+                                               .bind(mesh_draw_args_buffer)
+                                               .bind(bin_offsets)
+                                               .bind(primitive_bin_slots)
+                                               .bind(buffers.commands)
+                                               .bind(buffers.primitive_ids)
+                                               .build();
+    graph.add_compute_dispatch<DrawBinningConstants>(
+        {
+            .name = "Write binned draw commands",
+            .descriptor_sets = {write_set},
+            .push_constants = constants,
+            .num_workgroups = {(num_primitives + 95) / 96, 1, 1},
+            .compute_shader = write_binned_draw_commands_pipeline
+        });
+
+    // Scratch buffers. Destruction waits until the GPU is done with this frame
+    allocator.destroy_buffer(bin_counts);
+    allocator.destroy_buffer(bin_offsets);
+    allocator.destroy_buffer(primitive_bin_slots);
+
+    return buffers;
+}
+
+BinnedDrawCommands bin_draw_commands_on_cpu(
+    const std::span<const PrimitiveDataGPU> primitives, const std::span<const uint32_t> visibility_list,
+    const std::span<const VkDrawIndexedIndirectCommand> mesh_draw_args, const uint32_t num_pipeline_bins,
+    const uint32_t num_materials
+) {
+    const auto num_primitives = static_cast<uint32_t>(primitives.size());
+
+    auto result = BinnedDrawCommands{};
+    result.commands.resize(num_primitives * num_pipeline_bins, VkDrawIndexedIndirectCommand{});
+    result.counts.resize(num_pipeline_bins, 0);
+    result.primitive_ids.resize(num_primitives * num_pipeline_bins, 0);
+    result.bin_offsets.resize(num_pipeline_bins * num_materials, 0);
+
+    // Count the draws in each bin
+    auto bin_counts = eastl::vector<uint32_t>(num_pipeline_bins * num_materials, 0);
+    for(auto primitive_id = 0u; primitive_id < num_primitives; primitive_id++) {
+        if(visibility_list[primitive_id] == 0) {
+            continue;
+        }
+
+        const auto bin = get_draw_bin(primitives[primitive_id], num_pipeline_bins, num_materials);
+        if(bin != UINT32_MAX) {
+            bin_counts[bin]++;
+        }
+    }
+
+    // Exclusive prefix sum within each pipeline bin
+    for(auto pipeline_bin = 0u; pipeline_bin < num_pipeline_bins; pipeline_bin++) {
+        auto running_total = 0u;
+        for(auto material_id = 0u; material_id < num_materials; material_id++) {
+            const auto bin = pipeline_bin * num_materials + material_id;
+            result.bin_offsets[bin] = pipeline_bin * num_primitives + running_total;
+            running_total += bin_counts[bin];
+        }
+        result.counts[pipeline_bin] = running_total;
+    }
+
+    // Write the draws
+    auto bin_next_slot = eastl::vector<uint32_t>(num_pipeline_bins * num_materials, 0);
+    for(auto primitive_id = 0u; primitive_id < num_primitives; primitive_id++) {
+        if(visibility_list[primitive_id] == 0) {
+            continue;
+        }
+
+        const auto& primitive = primitives[primitive_id];
+        const auto bin = get_draw_bin(primitive, num_pipeline_bins, num_materials);
+        if(bin == UINT32_MAX) {
+            continue;
+        }
+
+        const auto draw_id = result.bin_offsets[bin] + bin_next_slot[bin]++;
+
+        result.primitive_ids[draw_id] = primitive_id;
+
+        result.commands[draw_id] = mesh_draw_args[primitive.mesh_id];
+        result.commands[draw_id].firstInstance = draw_id;
+    }
+
+    return result;
+}
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <cstdint>
+#include <span>
+
+#include <EASTL/vector.h>
+#include <volk.h>
 
 #include "backend/handles.hpp"
+#include "shared/primitive_data.hpp"
 
 class RenderGraph;
 
@@ -10,6 +15,35 @@ struct IndirectDrawingBuffers {
     BufferHandle commands;
     BufferHandle count;
     BufferHandle primitive_ids;
+
+    /**
+     * Byte offset of the first draw command in `commands`
+     */
+    uint32_t commands_offset = 0;
+
+    /**
+     * Byte offset of the draw count in `count`
+     */
+    uint32_t count_offset = 0;
+};
+
+/**
+ * Indirect draw commands for the visible primitives, binned by pipeline and then by material
+ *
+ * Each pipeline bin has room for max_draws_per_bin draws, and its draw count lives at its index in `counts`. Within a
+ * pipeline bin, draws with the same material are next to each other
+ */
+struct BinnedIndirectDrawingBuffers {
+    BufferHandle commands;
+    BufferHandle counts;
+    BufferHandle primitive_ids;
+
+    uint32_t max_draws_per_bin = 0;
+
+    /**
+     * Retrieves the draws of one pipeline bin, for one DrawIndexedIndirectCount
+     */
+    IndirectDrawingBuffers get_pipeline_bin(uint32_t pipeline_bin) const;
 };
 
 /**
@@ -31,3 +65,55 @@ IndirectDrawingBuffers translate_visibility_list_to_draw_commands(
     RenderGraph& graph, BufferHandle visibility_list, BufferHandle primitive_buffer, uint32_t num_primitives,
     BufferHandle mesh_draw_args_buffer, uint32_t primitive_type
 );
+
+/**
+ * \brief Translates a visibility list to indirect draw commands, binned by pipeline and material
+ *
+ * The pipeline bin of a primitive is its PRIMITIVE_TYPE_, so pipeline bins 0 and 1 hold the solid and cutout draws.
+ * Primitives with a type of num_pipeline_bins or greater aren't drawn
+ *
+ * We count the visible primitives in each bin, take a prefix sum of the counts to find where each bin starts, then
+ * write the draws. Unlike translate_visibility_list_to_draw_commands, draws that use the same material are next to
+ * each other
+ *
+ * The returned buffers are destroyed at the beginning of the next frame. Do not cache them
+ *
+ * \param graph Render graph to use to execute operations
+ * \param visibility_list List of primitive visibility. Contains one uint per primitive: 1 if it's visible, 0 if not
+ * \param primitive_buffer List of PrimitiveDataGPUs
+ * \param num_primitives Total number of primitives
+ * \param mesh_draw_args_buffer Buffer containing the draw arguments for each mesh
+ * \param num_pipeline_bins Number of pipeline bins to generate draws for
+ * \param num_materials Number of material slots. Every primitive's material ID must be less than this
+ */
+BinnedIndirectDrawingBuffers bin_visibility_list_to_draw_commands(
+    RenderGraph& graph, BufferHandle visibility_list, BufferHandle primitive_buffer, uint32_t num_primitives,
+    BufferHandle mesh_draw_args_buffer, uint32_t num_pipeline_bins, uint32_t num_materials
+);
+
+/**
+ * CPU copy of the buffers that bin_visibility_list_to_draw_commands generates
+ */
+struct BinnedDrawCommands {
+    eastl::vector<VkDrawIndexedIndirectCommand> commands;
+
+    eastl::vector<uint32_t> counts;
+
+    eastl::vector<uint32_t> primitive_ids;
+
+    /**
+     * Index of the first draw of each material bin
+     */
+    eastl::vector<uint32_t> bin_offsets;
+};
+
+/**
+ * Reference implementation of bin_visibility_list_to_draw_commands, for validating the GPU binning
+ *
+ * The GPU writes the draws within a material bin in whatever order its atomics give it, while this writes them in
+ * primitive order. Compare bins as sets of draws. The draw binning tests compare it with a CPU port of the shaders
+ */
+BinnedDrawCommands bin_draw_commands_on_cpu(
+    std::span<const PrimitiveDataGPU> primitives, std::span<const uint32_t> visibility_list,
+    std::span<const VkDrawIndexedIndirectCommand> mesh_draw_args, uint32_t num_pipeline_bins, uint32_t num_materials
+);
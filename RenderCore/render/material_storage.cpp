@@ -43,6 +43,13 @@ PooledObject<BasicPbrMaterialProxy> MaterialStorage::add_material_instance(Basic
 }
 
 void MaterialStorage::destroy_material_instance(PooledObject<BasicPbrMaterialProxy>&& proxy) {
+    auto& texture_descriptor_pool = RenderBackend::get().get_texture_descriptor_pool();
+    const auto& gpu_data = proxy->first.gpu_data;
+    texture_descriptor_pool.free_descriptor(gpu_data.base_color_texture_index);
+    texture_descriptor_pool.free_descriptor(gpu_data.normal_texture_index);
+    texture_descriptor_pool.free_descriptor(gpu_data.data_texture_index);
+    texture_descriptor_pool.free_descriptor(gpu_data.emission_texture_index);
+
     material_instance_pool.free_object(proxy);
 }
 
@@ -64,9 +71,8 @@ GraphicsPipelineHandle MaterialStorage::get_pipeline_group() {
 
     auto pipelines_in_group = eastl::vector<GraphicsPipelineHandle>{};
     pipelines_in_group.reserve(1024);
-    const auto& material_proxies = material_instance_pool.get_data();
-    for(auto i = 0; i < material_proxies.size(); i++) {
-        const auto& proxy = material_instance_pool.make_handle(i);
+    for(const auto index : material_instance_pool.get_live_indices()) {
+        const auto& proxy = material_instance_pool.make_handle(index);
         for(auto handle : proxy->second.pipelines) {
             pipelines_in_group.emplace_back(handle);
         }
@@ -80,3 +86,7 @@ GraphicsPipelineHandle MaterialStorage::get_pipeline_group() {
 }
 
 const MaterialPipelines& MaterialStorage::get_pipelines() const { return basic_bpr_material_pipelines; }
+
+uint32_t MaterialStorage::get_num_material_slots() const {
+    return static_cast<uint32_t>(material_instance_pool.get_data().size());
+}
@@ -25,6 +25,11 @@ public:
 
     const MaterialPipelines& get_pipelines() const;
 
+    /**
+     * Retrieves the number of material slots, including free ones. Every material index is less than this
+     */
+    uint32_t get_num_material_slots() const;
+
 private:
     MaterialPipelines basic_bpr_material_pipelines;
 
@@ -88,7 +88,12 @@ void SceneDrawer::draw_indirect(
     }
 
     commands.bind_pipeline(pso);
-    commands.draw_indexed_indirect(drawbuffers.commands, drawbuffers.count, static_cast<uint32_t>(solids.size()));
+    commands.draw_indexed_indirect(
+        drawbuffers.commands,
+        drawbuffers.commands_offset,
+        drawbuffers.count,
+        drawbuffers.count_offset,
+        static_cast<uint32_t>(solids.size()));
 
     if (is_color_pass(type)) {
         commands.clear_descriptor_set(1);
@@ -123,7 +123,7 @@ void MipChainGenerator::fill_mip_chain(
                     );
                 }
 
-                auto set = *vkutil::DescriptorBuilder::begin(
+                auto set = vkutil::DescriptorBuilder::begin(
                                 backend,
                                 backend.get_transient_descriptor_allocator()
                             )
@@ -144,7 +144,7 @@ void MipChainGenerator::fill_mip_chain(
                                 VK_SHADER_STAGE_COMPUTE_BIT,
                                 static_cast<int32_t>(uavs.size())
                             )
-                            .build();
+                            .build().value_or(VK_NULL_HANDLE);
 
                 commands.bind_descriptor_set(0, set);
 
@@ -25,6 +25,30 @@ static AutoCVar_Float cvar_ao_radius{
     "r.AO.MaxRayDistance", "Maximum ray distance for RTAO", 8.f
 };
 
+static AutoCVar_Int cvar_rtao_denoise{
+    "r.AO.RTAO.Denoise", "Whether to accumulate RTAO over time and filter it", 1
+};
+
+static AutoCVar_Float cvar_rtao_max_history_length{
+    "r.AO.RTAO.MaxHistoryLength", "Maximum number of frames to accumulate RTAO over", 32.f
+};
+
+static AutoCVar_Float cvar_rtao_variance_clip_gamma{
+    "r.AO.RTAO.VarianceClipGamma",
+    "How many standard deviations from the current frame's AO that the history may be. Lower values lag less but are noisier",
+    2.f
+};
+
+static AutoCVar_Float cvar_rtao_disocclusion_threshold{
+    "r.AO.RTAO.DisocclusionThreshold",
+    "Largest relative difference in depth between the current and reprojected pixel where we keep the history",
+    0.1f
+};
+
+static AutoCVar_Int cvar_rtao_filter_iterations{
+    "r.AO.RTAO.FilterIterations", "Number of iterations of the à-trous filter", 2
+};
+
 #if SAH_USE_FFX
 static AutoCVar_Enum<FfxCacaoQuality> cvar_cacao_quality{
     "r.CACAO.Quality", "Quality of CACAO", FFX_CACAO_QUALITY_HIGHEST
@@ -108,6 +132,10 @@ static std::string to_string(const ffxReturnCode_t code) {
 }
 #endif
 
+bool AmbientOcclusionPhase::needs_motion_vectors() {
+    return cvar_ao_technique.Get() == AoTechnique::RTAO && cvar_rtao_denoise.Get() != 0;
+}
+
 AmbientOcclusionPhase::AmbientOcclusionPhase() {
 #if SAH_USE_FFX
     const auto& backend = RenderBackend::get();
@@ -152,16 +180,29 @@ AmbientOcclusionPhase::~AmbientOcclusionPhase() {
 
     // ffxDestroyContext(&ffx, nullptr);
 #endif
+
+    auto& allocator = RenderBackend::get().get_global_allocator();
+    allocator.destroy_texture(stinky_depth);
+    allocator.destroy_texture(noisy_ao);
+    for(const auto history : ao_history) {
+        allocator.destroy_texture(history);
+    }
 }
 
 void AmbientOcclusionPhase::generate_ao(
     RenderGraph& graph, const SceneView& view, const RenderScene& scene, const NoiseTexture& noise,
-    const TextureHandle gbuffer_normals, const TextureHandle gbuffer_depth, const TextureHandle ao_out
+    const TextureHandle gbuffer_normals, const TextureHandle gbuffer_depth, const TextureHandle motion_vectors,
+    const TextureHandle ao_out
 ) {
     ZoneScoped;
 
     frame_index++;
 
+    if(!needs_motion_vectors()) {
+        // Anything else may write to stinky_depth, and the history is stale when we get back to it anyways
+        has_rtao_history = false;
+    }
+
     switch(cvar_ao_technique.Get()) {
     case AoTechnique::Off:
         graph.add_render_pass(
@@ -183,7 +224,7 @@ void AmbientOcclusionPhase::generate_ao(
         break;
 
     case AoTechnique::RTAO:
-        evaluate_rtao(graph, view, scene, noise, gbuffer_depth, gbuffer_normals, ao_out);
+        evaluate_rtao(graph, view, scene, noise, gbuffer_depth, gbuffer_normals, motion_vectors, ao_out);
         break;
     }
 }
@@ -211,26 +252,7 @@ void AmbientOcclusionPhase::evaluate_cacao(
         has_context = true;
     }
 
-    if(stinky_depth == nullptr || stinky_depth->create_info.extent.width != gbuffer_depth->create_info.extent.
-        width) {
-        auto& allocator = RenderBackend::get().get_global_allocator();
-        allocator.destroy_texture(stinky_depth);
-        stinky_depth = allocator.create_texture(
-            "R32F Depth Meme",
-            {
-                .format = VK_FORMAT_R32_SFLOAT,
-                .resolution = {gbuffer_depth->create_info.extent.width, gbuffer_depth->create_info.extent.height},
-                .num_mips = gbuffer_depth->create_info.mipLevels,
-                .usage = TextureUsage::StorageImage
-            });
-    }
-
-    graph.add_copy_pass(
-        ImageCopyPass{
-            .name = "Copy D32 to R32 lmao",
-            .dst = stinky_depth,
-            .src = gbuffer_depth
-        });
+    copy_depth(graph, gbuffer_depth);
 
     const auto stinky_depth_name = to_wstring(stinky_depth->name);
     auto ffx_depth = ffxGetResourceVK(
@@ -354,22 +376,55 @@ void AmbientOcclusionPhase::evaluate_cacao(
 #endif
 }
 
+void AmbientOcclusionPhase::copy_depth(RenderGraph& graph, const TextureHandle gbuffer_depth) {
+    if(stinky_depth == nullptr || stinky_depth->get_resolution() != gbuffer_depth->get_resolution()) {
+        auto& allocator = RenderBackend::get().get_global_allocator();
+        allocator.destroy_texture(stinky_depth);
+        stinky_depth = allocator.create_texture(
+            "R32F Depth Meme",
+            {
+                .format = VK_FORMAT_R32_SFLOAT,
+                .resolution = {gbuffer_depth->create_info.extent.width, gbuffer_depth->create_info.extent.height},
+                .num_mips = gbuffer_depth->create_info.mipLevels,
+                .usage = TextureUsage::StorageImage
+            });
+    }
+
+    graph.add_copy_pass(
+        ImageCopyPass{
+            .name = "Copy D32 to R32 lmao",
+            .dst = stinky_depth,
+            .src = gbuffer_depth
+        });
+}
+
 void AmbientOcclusionPhase::evaluate_rtao(
     RenderGraph& graph, const SceneView& view, const RenderScene& scene, const NoiseTexture& noise,
-    const TextureHandle gbuffer_depth, const TextureHandle gbuffer_normals, const TextureHandle ao_out
+    const TextureHandle gbuffer_depth, const TextureHandle gbuffer_normals, const TextureHandle motion_vectors,
+    const TextureHandle ao_out
 ) {
     auto& backend = RenderBackend::get();
     if(rtao_pipeline == nullptr) {
         rtao_pipeline = backend.get_pipeline_cache().create_pipeline("shaders/ao/rtao.comp.spv");
     }
 
+    const auto denoise = cvar_rtao_denoise.Get() != 0;
+    if(denoise) {
+        create_rtao_textures(ao_out->get_resolution());
+    }
+
+    // Dynamic resolution only renders to part of the gbuffer, so we only trace that part
+    const auto resolution = glm::min(view.get_render_resolution(), ao_out->get_resolution());
+
+    const auto trace_target = denoise ? noisy_ao : ao_out;
+
     const auto set = backend.get_transient_descriptor_allocator().build_set(rtao_pipeline, 0)
                             .bind(view.get_buffer())
                             .bind(scene.get_raytracing_scene().get_acceleration_structure())
                             .bind(gbuffer_depth)
                             .bind(gbuffer_normals)
                             .bind(noise.layers[frame_index % noise.num_layers])
-                            .bind(ao_out)
+                            .bind(trace_target)
                             .build();
 
     struct Constants {
@@ -379,8 +434,6 @@ void AmbientOcclusionPhase::evaluate_rtao(
         glm::u16vec2 noise_tex_resolution;
     };
 
-    const auto resolution = glm::uvec2{ao_out->create_info.extent.width, ao_out->create_info.extent.height};
-
     graph.add_compute_dispatch(
         ComputeDispatch<Constants>{
             .name = "Ray traced ambient occlusion",
@@ -394,4 +447,144 @@ void AmbientOcclusionPhase::evaluate_rtao(
             .num_workgroups = glm::uvec3{(resolution + glm::uvec2{7}) / glm::uvec2{8}, 1},
             .compute_shader = rtao_pipeline
         });
+
+    if(denoise) {
+        denoise_rtao(graph, view, gbuffer_depth, gbuffer_normals, motion_vectors, ao_out);
+    }
+}
+
+void AmbientOcclusionPhase::create_rtao_textures(const glm::uvec2 resolution) {
+    if(noisy_ao != nullptr && noisy_ao->get_resolution() == resolution) {
+        return;
+    }
+
+    auto& allocator = RenderBackend::get().get_global_allocator();
+
+    allocator.destroy_texture(noisy_ao);
+    noisy_ao = allocator.create_texture(
+        "RTAO Noisy",
+        {
+            .format = VK_FORMAT_R32_SFLOAT,
+            .resolution = resolution,
+            .usage = TextureUsage::StorageImage
+        });
+
+    for(auto i = 0u; i < ao_history.size(); i++) {
+        allocator.destroy_texture(ao_history[i]);
+        ao_history[i] = allocator.create_texture(
+            fmt::format("RTAO History {}", i),
+            {
+                .format = VK_FORMAT_R16G16_SFLOAT,
+                .resolution = resolution,
+                .usage = TextureUsage::StorageImage
+            });
+    }
+
+    has_rtao_history = false;
+}
+
+void AmbientOcclusionPhase::denoise_rtao(
+    RenderGraph& graph, const SceneView& view, const TextureHandle gbuffer_depth, const TextureHandle gbuffer_normals,
+    const TextureHandle motion_vectors, const TextureHandle ao_out
+) {
+    ZoneScoped;
+
+    auto& backend = RenderBackend::get();
+    auto& pipeline_cache = backend.get_pipeline_cache();
+    auto& descriptor_allocator = backend.get_transient_descriptor_allocator();
+
+    if(temporal_pipeline == nullptr) {
+        temporal_pipeline = pipeline_cache.create_pipeline("shaders/ao/rtao_temporal.comp.spv");
+    }
+    if(filter_pipeline == nullptr) {
+        filter_pipeline = pipeline_cache.create_pipeline("shaders/ao/rtao_filter.comp.spv");
+    }
+
+    // The motion vectors may be at a different resolution, so we scale their size by the same amount
+    const auto resolution = glm::min(view.get_render_resolution(), noisy_ao->get_resolution());
+    const auto motion_vectors_resolution = motion_vectors->get_resolution() * resolution / noisy_ao->get_resolution();
+    const auto num_workgroups = glm::uvec3{(resolution + glm::uvec2{7}) / glm::uvec2{8}, 1};
+
+    if(stinky_depth == nullptr || stinky_depth->get_resolution() != gbuffer_depth->get_resolution()) {
+        has_rtao_history = false;
+    }
+
+    const auto previous_history = ao_history[(frame_index + 1) % 2];
+    const auto current_history = ao_history[frame_index % 2];
+
+    // Without a history, the shader doesn't read last frame's depth, and stinky_depth may not exist yet. Bind this
+    // frame's depth so the set is valid
+    const auto temporal_set = descriptor_allocator.build_set(temporal_pipeline, 0)
+                                                  .bind(view.get_buffer())
+                                                  .bind(gbuffer_depth)
+                                                  .bind(has_rtao_history ? stinky_depth : gbuffer_depth)
+                                                  .bind(motion_vectors)
+                                                  .bind(noisy_ao)
+                                                  .bind(previous_history)
+                                                  .bind(current_history)
+                                                  .build();
+
+    struct TemporalConstants {
+        glm::u16vec2 resolution;
+        glm::u16vec2 motion_vectors_resolution;
+        float max_history_length;
+        float variance_clip_gamma;
+        float disocclusion_threshold;
+        uint32_t has_history;
+    };
+
+    graph.add_compute_dispatch(
+        ComputeDispatch<TemporalConstants>{
+            .name = "RTAO temporal accumulation",
+            .descriptor_sets = {temporal_set},
+            .push_constants = TemporalConstants{
+                .resolution = {resolution},
+                .motion_vectors_resolution = {motion_vectors_resolution},
+                .max_history_length = glm::max(cvar_rtao_max_history_length.GetFloat(), 1.f),
+                .variance_clip_gamma = cvar_rtao_variance_clip_gamma.GetFloat(),
+                .disocclusion_threshold = cvar_rtao_disocclusion_threshold.GetFloat(),
+                .has_history = has_rtao_history ? 1u : 0u
+            },
+            .num_workgroups = num_workgroups,
+            .compute_shader = temporal_pipeline
+        });
+
+    // Save this frame's depth for next frame's reprojection
+    copy_depth(graph, gbuffer_depth);
+    has_rtao_history = true;
+
+    struct FilterConstants {
+        glm::u16vec2 resolution;
+        uint32_t step_size;
+    };
+
+    // Ping-pong between ao_out and noisy_ao, such that the last iteration writes to ao_out. The history must stay
+    // unfiltered, so it's only ever an input
+    const auto num_iterations = static_cast<uint32_t>(glm::max(cvar_rtao_filter_iterations.Get(), 1));
+    auto filter_input = current_history;
+    for(auto iteration = 0u; iteration < num_iterations; iteration++) {
+        const auto filter_output = (num_iterations - 1 - iteration) % 2 == 0 ? ao_out : noisy_ao;
+
+        const auto filter_set = descriptor_allocator.build_set(filter_pipeline, 0)
+                                                    .bind(view.get_buffer())
+                                                    .bind(gbuffer_depth)
+                                                    .bind(gbuffer_normals)
+                                                    .bind(filter_input)
+                                                    .bind(filter_output)
+                                                    .build();
+
+        graph.add_compute_dispatch(
+            ComputeDispatch<FilterConstants>{
+                .name = "RTAO à-trous filter",
+                .descriptor_sets = {filter_set},
+                .push_constants = FilterConstants{
+                    .resolution = {resolution},
+                    .step_size = 1u << iteration
+                },
+                .num_workgroups = num_workgroups,
+                .compute_shader = filter_pipeline
+            });
+
+        filter_input = filter_output;
+    }
 }
@@ -4,6 +4,9 @@
 #include <FidelityFX/host/ffx_cacao.h>
 #endif
 
+#include <EASTL/array.h>
+#include <glm/vec2.hpp>
+
 #include "render/backend/handles.hpp"
 
 struct NoiseTexture;
@@ -26,16 +29,23 @@ enum class AoTechnique {
  * https://github.com/nvpro-samples/gl_ssao
  *
  * Also consider https://www.activision.com/cdn/research/Practical_Real_Time_Strategies_for_Accurate_Indirect_Occlusion_NEW%20VERSION_COLOR.pdf 
+ *
+ * RTAO traces few rays per pixel, and relies on temporal accumulation and an à-trous filter to clean up the noise
  */
 class AmbientOcclusionPhase {
 public:
+    /**
+     * Whether the AO needs this frame's motion vectors
+     */
+    static bool needs_motion_vectors();
+
     AmbientOcclusionPhase();
 
     ~AmbientOcclusionPhase();
 
     void generate_ao(
         RenderGraph& graph, const SceneView& view, const RenderScene& scene, const NoiseTexture& noise,
-        TextureHandle gbuffer_normals, TextureHandle gbuffer_depth, TextureHandle ao_out
+        TextureHandle gbuffer_normals, TextureHandle gbuffer_depth, TextureHandle motion_vectors, TextureHandle ao_out
     );
 
 private:
@@ -45,9 +55,14 @@ private:
     FfxDevice ffx_device;
     bool has_context = false;
     FfxCacaoContext context = {};
+#endif
 
+    /**
+     * R32F copy of the depth buffer. CACAO reads it as this frame's depth, RTAO reads it as last frame's depth
+     */
     TextureHandle stinky_depth = nullptr;
-#endif
+
+    void copy_depth(RenderGraph& graph, TextureHandle gbuffer_depth);
 
     void evaluate_cacao(
         RenderGraph& graph, const SceneView& view, TextureHandle gbuffer_depth, TextureHandle gbuffer_normals,
@@ -56,10 +71,36 @@ private:
 
     ComputePipelineHandle rtao_pipeline = nullptr;
 
+    ComputePipelineHandle temporal_pipeline = nullptr;
+
+    ComputePipelineHandle filter_pipeline = nullptr;
+
+    /**
+     * This frame's RTAO, before denoising. Reused as scratch space by the à-trous filter
+     */
+    TextureHandle noisy_ao = nullptr;
+
+    /**
+     * Accumulated RTAO in R, and the number of frames accumulated in G. We ping-pong between the two
+     */
+    eastl::array<TextureHandle, 2> ao_history = {};
+
+    /**
+     * Whether last frame's history and depth are valid for this frame
+     */
+    bool has_rtao_history = false;
+
     uint32_t frame_index = 0;
 
     void evaluate_rtao(
         RenderGraph& graph, const SceneView& view, const RenderScene& scene, const NoiseTexture& noise,
-        TextureHandle gbuffer_depth, TextureHandle gbuffer_normals, TextureHandle ao_out
+        TextureHandle gbuffer_depth, TextureHandle gbuffer_normals, TextureHandle motion_vectors, TextureHandle ao_out
+    );
+
+    void create_rtao_textures(glm::uvec2 resolution);
+
+    void denoise_rtao(
+        RenderGraph& graph, const SceneView& view, TextureHandle gbuffer_depth, TextureHandle gbuffer_normals,
+        TextureHandle motion_vectors, TextureHandle ao_out
     );
 };
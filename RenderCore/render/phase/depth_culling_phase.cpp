@@ -10,6 +10,7 @@
 #include "render/mesh_drawer.hpp"
 #include "render/mesh_storage.hpp"
 #include "render/render_scene.hpp"
+#include "render/scene_view.hpp"
 #include "render/backend/pipeline_cache.hpp"
 #include "render/backend/render_backend.hpp"
 #include "render/backend/resource_allocator.hpp"
@@ -107,16 +108,37 @@ void DepthCullingPhase::set_render_resolution(const glm::uvec2& resolution) {
     );
 
     hi_z_index = texture_descriptor_pool.create_texture_srv(hi_z_buffer, max_reduction_sampler);
+
+    // The new depth buffer needs a full clear
+    render_area = {};
 }
 
 void DepthCullingPhase::render(
-    RenderGraph& graph, const RenderScene& scene,
-    MaterialStorage& materials, const BufferHandle view_data_buffer
+    RenderGraph& graph, const RenderScene& scene, MaterialStorage& materials, const SceneView& view
 ) {
     ZoneScoped;
 
     graph.begin_label("Depth/culling pass");
 
+    // The depth passes only clear their render area. When that area changes, clear the whole depth buffer to the far
+    // plane, so that the Hi-Z pyramid doesn't pick up stale depth from outside of it
+    if(view.get_render_resolution() != render_area) {
+        render_area = view.get_render_resolution();
+
+        graph.add_render_pass(
+            {
+                .name = "Clear depth buffer",
+                .depth_attachment = RenderingAttachmentInfo{
+                    .image = depth_buffer,
+                    .load_op = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                    .clear_value = {.depthStencil = {.depth = 0.0}}
+                },
+                .execute = [](CommandBuffer&) {}
+            });
+    }
+
+    const auto view_data_buffer = view.get_buffer();
+
     auto& backend = RenderBackend::get();
 
     const auto primitive_buffer = scene.get_primitive_buffer();
@@ -309,6 +331,7 @@ void DepthCullingPhase::draw_visible_objects_dgc(
             },
             .descriptor_sets = {},
             .depth_attachment = RenderingAttachmentInfo{depth_buffer},
+            .render_area = render_area,
             .execute = [=](CommandBuffer& commands) {
                 commands.execute_commands();
             }
@@ -467,6 +490,7 @@ void DepthCullingPhase::draw_visible_objects(
                 .load_op = VK_ATTACHMENT_LOAD_OP_CLEAR,
                 .clear_value = {.depthStencil = {.depth = 0.0}}
             },
+            .render_area = render_area,
             .execute = [&](CommandBuffer& commands) {
                 commands.bind_descriptor_set(0, view_descriptor);
 
@@ -11,6 +11,7 @@
 #include "render/backend/handles.hpp"
 
 class RenderScene;
+class SceneView;
 class MaterialStorage;
 class TextureDescriptorPool;
 class RenderGraph;
@@ -32,9 +33,10 @@ public:
 
     void set_render_resolution(const glm::uvec2& resolution);
 
-    void render(
-        RenderGraph& graph, const RenderScene& scene, MaterialStorage& materials, BufferHandle view_data_buffer
-    );
+    /**
+     * Culls and draws the scene into the view's render area of the depth buffer
+     */
+    void render(RenderGraph& graph, const RenderScene& scene, MaterialStorage& materials, const SceneView& view);
 
     TextureHandle get_depth_buffer() const;
 
@@ -44,6 +46,12 @@ private:
     TextureHandle depth_buffer = nullptr;
 
     TextureHandle hi_z_buffer = nullptr;
+
+    /**
+     * Area of the depth buffer that we render to. Dynamic resolution makes this smaller than the depth buffer
+     */
+    glm::uvec2 render_area = {};
+
     VkSampler max_reduction_sampler;
 
     // Index of the hi-z descriptor in the texture descriptor array
@@ -85,6 +85,7 @@ void GbufferPhase::render(
             },
             .depth_attachment = RenderingAttachmentInfo{.image = gbuffer.depth},
             .shading_rate_image = shading_rate,
+            .render_area = player_view.get_render_resolution(),
             .execute = [&](CommandBuffer& commands) {
                 commands.bind_descriptor_set(0, gbuffer_set);
 
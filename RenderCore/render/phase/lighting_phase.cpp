@@ -90,7 +90,10 @@ void LightingPhase::render(
             });
     }
 
+    light_culler.cull_lights(render_graph, view, *scene);
+
     auto buffer_usages = BufferUsageList{};
+    light_culler.get_lighting_resource_usages(buffer_usages);
 
     if(gi) {
         gi->get_lighting_resource_usages(texture_usages, buffer_usages);
@@ -105,6 +108,7 @@ void LightingPhase::render(
             .color_attachments = {
                 RenderingAttachmentInfo{.image = lit_scene_texture, .load_op = VK_ATTACHMENT_LOAD_OP_CLEAR}
             },
+            .render_area = view.get_render_resolution(),
             .execute = [&](CommandBuffer& commands) {
                 commands.bind_descriptor_set(0, gbuffers_descriptor_set);
 
@@ -122,6 +126,8 @@ void LightingPhase::render(
 
                 add_emissive_lighting(commands);
 
+                light_culler.add_to_lit_scene(commands, view.get_buffer());
+
                 scene->get_sky().render_sky(commands, view.get_buffer(), sun.get_constant_buffer(), gbuffer.depth);
 
                 // The sky uses different descriptor sets, so if we add anything after this we'll have to re-bind the gbuffer descriptor set
@@ -2,6 +2,7 @@
 
 #include <optional>
 
+#include "render/clustered_light_culler.hpp"
 #include "render/gbuffer.hpp"
 #include "render/backend/graphics_pipeline.hpp"
 #include "render/backend/handles.hpp"
@@ -21,8 +22,8 @@ class LightPropagationVolume;
 /**
  * Computes the lighting form the gbuffers
  *
- * This pass adds in lighting from a variety of sources: the sun, the sky, indirect lighting, area
- * lights, etc
+ * This pass adds in lighting from a variety of sources: the sun, the sky, indirect lighting, point and spot lights,
+ * area lights, etc
  */
 class LightingPhase {
 public:
@@ -47,6 +48,8 @@ private:
 
     GraphicsPipelineHandle emission_pipeline;
 
+    ClusteredLightCuller light_culler;
+
     TextureHandle sky_occlusion_map = nullptr;
 
     void rasterize_sky_shadow(RenderGraph& render_graph, const SceneView& view);
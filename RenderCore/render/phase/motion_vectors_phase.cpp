@@ -3,6 +3,7 @@
 #include "console/cvars.hpp"
 #include "render/indirect_drawing_utils.hpp"
 #include "render/render_scene.hpp"
+#include "render/scene_view.hpp"
 #include "render/backend/render_backend.hpp"
 
 static auto cvar_full_res_motion_vectors = AutoCVar_Int{
@@ -53,13 +54,13 @@ void MotionVectorsPhase::set_render_resolution(const glm::uvec2& resolution, con
 }
 
 void MotionVectorsPhase::render(
-    RenderGraph& graph, const RenderScene& scene, const BufferHandle view_data_buffer,
-    const TextureHandle depth_buffer, const IndirectDrawingBuffers& buffers,
+    RenderGraph& graph, const RenderScene& scene, const SceneView& view, const TextureHandle depth_buffer,
+    const IndirectDrawingBuffers& buffers,
     const IndirectDrawingBuffers& masked_buffers
 ) {
     auto& allocator = RenderBackend::get().get_transient_descriptor_allocator();
     const auto set = allocator.build_set(motion_vectors_pso, 0)
-                              .bind(view_data_buffer)
+                              .bind(view.get_buffer())
                               .bind(scene.get_primitive_buffer())
                               .build();
 
@@ -92,6 +93,7 @@ void MotionVectorsPhase::render(
                 }
             },
             .depth_attachment = RenderingAttachmentInfo{.image = depth_buffer},
+            .render_area = view.get_render_resolution(),
             .execute = [&](CommandBuffer& commands) {
                 commands.bind_descriptor_set(0, set);
 
@@ -8,6 +8,7 @@
 struct IndirectDrawingBuffers;
 class RenderGraph;
 class RenderScene;
+class SceneView;
 
 class MotionVectorsPhase {
 public:
@@ -18,7 +19,7 @@ public:
     void set_render_resolution(const glm::uvec2& resolution, const glm::uvec2& output_resolution);
 
     void render(
-        RenderGraph& graph, const RenderScene& scene, BufferHandle view_data_buffer, TextureHandle depth_buffer,
+        RenderGraph& graph, const RenderScene& scene, const SceneView& view, TextureHandle depth_buffer,
         const IndirectDrawingBuffers& buffers, const IndirectDrawingBuffers& masked_buffers
     );
 
@@ -0,0 +1,169 @@
+#include "primitive_store.hpp"
+
+#include <tracy/Tracy.hpp>
+
+#include <glm/common.hpp>
+#include <glm/matrix.hpp>
+#include <glm/vec4.hpp>
+
+void PrimitiveStore::add_primitive(const uint32_t index, const PrimitiveCreateInfo& create_info) {
+    ensure_slot(index);
+
+    transforms[index] = create_info.transform;
+    inverse_transforms[index] = glm::inverse(create_info.transform);
+    local_bounds[index] = create_info.local_bounds;
+    types[index] = create_info.type;
+    flags[index] = create_info.flags;
+    mesh_ids[index] = create_info.mesh_id;
+    material_ids[index] = create_info.material_id;
+    buffer_addresses[index] = create_info.addresses;
+
+    update_world_bounds(index);
+    mark_dirty(index);
+}
+
+void PrimitiveStore::set_transform(const uint32_t index, const glm::mat4& transform) {
+    transforms[index] = transform;
+    inverse_transforms[index] = glm::inverse(transform);
+
+    update_world_bounds(index);
+    mark_dirty(index);
+}
+
+const glm::mat4& PrimitiveStore::get_transform(const uint32_t index) const {
+    return transforms[index];
+}
+
+Box PrimitiveStore::get_world_bounds(const uint32_t index) const {
+    return Box{
+        .min = {world_min_x[index], world_min_y[index], world_min_z[index]},
+        .max = {world_max_x[index], world_max_y[index], world_max_z[index]}
+    };
+}
+
+uint32_t PrimitiveStore::get_flags(const uint32_t index) const {
+    return flags[index];
+}
+
+void PrimitiveStore::set_flags(const uint32_t index, const uint32_t new_flags) {
+    if(flags[index] != new_flags) {
+        flags[index] = new_flags;
+        mark_dirty(index);
+    }
+}
+
+uint32_t PrimitiveStore::get_mesh_id(const uint32_t index) const {
+    return mesh_ids[index];
+}
+
+PrimitiveDataGPU PrimitiveStore::get_gpu_data(const uint32_t index) const {
+    const auto& bounds = local_bounds[index];
+    const auto size = bounds.max - bounds.min;
+    const auto& addresses = buffer_addresses[index];
+
+    // The longest side of the bounds is a conservative radius
+    return PrimitiveDataGPU{
+        .model = transforms[index],
+        .inverse_model = inverse_transforms[index],
+        .bounds_min_and_radius = {bounds.min, glm::max(glm::max(size.x, size.y), size.z)},
+        .bounds_max = {bounds.max, 0.f},
+        .material = addresses.material,
+        .mesh_id = mesh_ids[index],
+        .type = types[index],
+        .flags = flags[index],
+        .material_id = material_ids[index],
+        .indices = addresses.indices,
+        .vertex_positions = addresses.vertex_positions,
+        .vertex_data = addresses.vertex_data,
+    };
+}
+
+void PrimitiveStore::find_in_bounds(
+    const Box& bounds, const uint8_t type, eastl::vector<uint32_t>& out_indices
+) const {
+    ZoneScoped;
+
+    const auto num_slots = get_num_slots();
+
+    // Branchless test over the component arrays, so that the compiler can vectorize it. The overlap test matches
+    // Box::overlaps
+    auto overlaps = eastl::vector<uint8_t>(num_slots);
+    for(auto i = 0u; i < num_slots; i++) {
+        overlaps[i] = static_cast<uint8_t>(
+            (world_min_x[i] < bounds.max.x) & (world_max_x[i] > bounds.min.x) &
+            (world_min_y[i] < bounds.max.y) & (world_max_y[i] > bounds.min.y) &
+            (world_min_z[i] < bounds.max.z) & (world_max_z[i] > bounds.min.z) &
+            (types[i] == type));
+    }
+
+    for(auto i = 0u; i < num_slots; i++) {
+        if(overlaps[i] != 0) {
+            out_indices.push_back(i);
+        }
+    }
+}
+
+const eastl::vector<uint32_t>& PrimitiveStore::get_dirty_indices() const {
+    return dirty_indices;
+}
+
+void PrimitiveStore::clear_dirty() {
+    for(const auto index : dirty_indices) {
+        is_dirty[index] = 0;
+    }
+    dirty_indices.clear();
+}
+
+uint32_t PrimitiveStore::get_num_slots() const {
+    return static_cast<uint32_t>(types.size());
+}
+
+void PrimitiveStore::ensure_slot(const uint32_t index) {
+    if(index < types.size()) {
+        return;
+    }
+
+    const auto new_size = index + 1;
+    transforms.resize(new_size, glm::mat4{1.f});
+    inverse_transforms.resize(new_size, glm::mat4{1.f});
+    local_bounds.resize(new_size);
+    world_min_x.resize(new_size, 0.f);
+    world_min_y.resize(new_size, 0.f);
+    world_min_z.resize(new_size, 0.f);
+    world_max_x.resize(new_size, 0.f);
+    world_max_y.resize(new_size, 0.f);
+    world_max_z.resize(new_size, 0.f);
+    types.resize(new_size, EMPTY_SLOT);
+    flags.resize(new_size, 0);
+    mesh_ids.resize(new_size, 0);
+    material_ids.resize(new_size, 0);
+    buffer_addresses.resize(new_size);
+    is_dirty.resize(new_size, 0);
+}
+
+void PrimitiveStore::update_world_bounds(const uint32_t index) {
+    // Transform the box's center and extents, rather than its corners, so that rotated primitives get correct bounds
+    const auto& bounds = local_bounds[index];
+    const auto& transform = transforms[index];
+
+    const auto center = glm::vec3{transform * glm::vec4{(bounds.min + bounds.max) * 0.5f, 1.f}};
+    const auto extents = (bounds.max - bounds.min) * 0.5f;
+
+    const auto world_extents = glm::abs(glm::vec3{transform[0]}) * extents.x +
+        glm::abs(glm::vec3{transform[1]}) * extents.y +
+        glm::abs(glm::vec3{transform[2]}) * extents.z;
+
+    world_min_x[index] = center.x - world_extents.x;
+    world_min_y[index] = center.y - world_extents.y;
+    world_min_z[index] = center.z - world_extents.z;
+    world_max_x[index] = center.x + world_extents.x;
+    world_max_y[index] = center.y + world_extents.y;
+    world_max_z[index] = center.z + world_extents.z;
+}
+
+void PrimitiveStore::mark_dirty(const uint32_t index) {
+    if(is_dirty[index] == 0) {
+        is_dirty[index] = 1;
+        dirty_indices.push_back(index);
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+
+#include <EASTL/vector.h>
+#include <glm/mat4x4.hpp>
+
+#include "core/box.hpp"
+#include "shared/primitive_data.hpp"
+
+/**
+ * GPU addresses of a primitive's material and geometry. Only read when the primitive is uploaded
+ */
+struct PrimitiveBufferAddresses {
+    MaterialPointer material = 0;
+
+    IndexPointer indices = 0;
+
+    VertexPositionPointer vertex_positions = 0;
+
+    VertexDataPointer vertex_data = 0;
+};
+
+/**
+ * Everything that the store keeps about a new primitive
+ */
+struct PrimitiveCreateInfo {
+    glm::mat4 transform = glm::mat4{1.f};
+
+    Box local_bounds = {};
+
+    /**
+     * One of the PRIMITIVE_TYPE_ defines from primitive_data.hpp
+     */
+    uint8_t type = PRIMITIVE_TYPE_SOLID;
+
+    /**
+     * PRIMITIVE_FLAG_ bits from primitive_data.hpp
+     */
+    uint32_t flags = 0;
+
+    uint32_t mesh_id = 0;
+
+    uint32_t material_id = 0;
+
+    PrimitiveBufferAddresses addresses = {};
+};
+
+/**
+ * Structure-of-arrays storage for the per-primitive data of the scene
+ *
+ * The store is the only owner of each primitive's transform, bounds, type, flags, and mesh and material IDs. Every
+ * array is indexed by the primitive's slot in the scene's primitive pool, which is also its index in the GPU primitive
+ * data buffer. Each primitive's PrimitiveDataGPU is gathered from the arrays when it's uploaded. World bounds are
+ * stored as one array per component, so that bounds tests over all primitives are simple loops over contiguous floats
+ * that the compiler can vectorize
+ *
+ * The store tracks which primitives changed since the last call to `clear_dirty`. The scene uses that to only upload
+ * changed primitives to the GPU
+ */
+class PrimitiveStore {
+public:
+    /**
+     * Type of an empty slot. Other slots use the PRIMITIVE_TYPE_ defines from primitive_data.hpp
+     */
+    static constexpr uint8_t EMPTY_SLOT = 0xFF;
+
+    void add_primitive(uint32_t index, const PrimitiveCreateInfo& create_info);
+
+    /**
+     * Moves a primitive. Recalculates its inverse transform and world bounds, and marks it dirty
+     */
+    void set_transform(uint32_t index, const glm::mat4& transform);
+
+    const glm::mat4& get_transform(uint32_t index) const;
+
+    Box get_world_bounds(uint32_t index) const;
+
+    uint32_t get_flags(uint32_t index) const;
+
+    /**
+     * Changes a primitive's PRIMITIVE_FLAG_ bits, and marks it dirty if they changed
+     */
+    void set_flags(uint32_t index, uint32_t new_flags);
+
+    uint32_t get_mesh_id(uint32_t index) const;
+
+    /**
+     * Gathers a primitive's data from the arrays, in the layout of the GPU primitive data buffer
+     */
+    PrimitiveDataGPU get_gpu_data(uint32_t index) const;
+
+    /**
+     * Finds all primitives of the given type whose world bounds overlap the box, and appends their indices to
+     * `out_indices`
+     */
+    void find_in_bounds(const Box& bounds, uint8_t type, eastl::vector<uint32_t>& out_indices) const;
+
+    /**
+     * Retrieves the indices of the primitives that changed since the last call to `clear_dirty`
+     */
+    const eastl::vector<uint32_t>& get_dirty_indices() const;
+
+    void clear_dirty();
+
+    /**
+     * Marks a primitive as changed, so that the scene uploads it in the next begin_frame
+     */
+    void mark_dirty(uint32_t index);
+
+    uint32_t get_num_slots() const;
+
+private:
+    eastl::vector<glm::mat4> transforms;
+
+    eastl::vector<glm::mat4> inverse_transforms;
+
+    eastl::vector<Box> local_bounds;
+
+    eastl::vector<float> world_min_x;
+    eastl::vector<float> world_min_y;
+    eastl::vector<float> world_min_z;
+    eastl::vector<float> world_max_x;
+    eastl::vector<float> world_max_y;
+    eastl::vector<float> world_max_z;
+
+    eastl::vector<uint8_t> types;
+
+    eastl::vector<uint32_t> flags;
+
+    eastl::vector<uint32_t> mesh_ids;
+
+    eastl::vector<uint32_t> material_ids;
+
+    eastl::vector<PrimitiveBufferAddresses> buffer_addresses;
+
+    eastl::vector<uint8_t> is_dirty;
+
+    eastl::vector<uint32_t> dirty_indices;
+
+    void ensure_slot(uint32_t index);
+
+    void update_world_bounds(uint32_t index);
+};
@@ -1,12 +1,41 @@
 #include "procedural_sky.hpp"
 
+#include <glm/gtc/constants.hpp>
 #include <tracy/Tracy.hpp>
 
 #include "backend/pipeline_cache.hpp"
 #include "backend/render_backend.hpp"
+#include "console/cvars.hpp"
 #include "core/system_interface.hpp"
 #include "render/backend/render_graph.hpp"
 
+static auto cvar_sun_altitude_threshold = AutoCVar_Float{
+    "r.Sky.SunAltitudeThreshold",
+    "How far the sun's altitude must change before we update the sky view LUT, in degrees",
+    0.05
+};
+
+static auto cvar_sky_view_update_frames = AutoCVar_Int{
+    "r.Sky.SkyViewUpdateFrames",
+    "How many frames to spread a sky view LUT update over when the sun moves",
+    4
+};
+
+constexpr uint32_t sky_view_lut_resolution = 200;
+
+struct SkyViewConstants {
+    glm::vec3 light_vector;
+    uint32_t first_row;
+};
+
+/**
+ * The sky view LUT is computed from the camera's viewpoint, with the sun's azimuth rotated away. The camera is always
+ * at the same height, so the sun's altitude is the only thing that changes the LUT
+ */
+static float get_sun_altitude(const glm::vec3& light_vector) {
+    return glm::half_pi<float>() - glm::acos(glm::clamp(-light_vector.y, -1.f, 1.f));
+}
+
 ProceduralSky::ProceduralSky() {
     auto& backend = RenderBackend::get();
     auto& allocator = backend.get_global_allocator();
@@ -31,11 +60,21 @@ ProceduralSky::ProceduralSky() {
         }
     );
 
-    sky_view_lut = allocator.create_texture(
-        "Sky view LUT",
+    sky_view_luts[0] = allocator.create_texture(
+        "Sky view LUT 0",
+        {
+            VK_FORMAT_R16G16B16A16_SFLOAT,
+            glm::uvec2{sky_view_lut_resolution},
+            1,
+            TextureUsage::StorageImage
+        }
+    );
+
+    sky_view_luts[1] = allocator.create_texture(
+        "Sky view LUT 1",
         {
             VK_FORMAT_R16G16B16A16_SFLOAT,
-            glm::uvec2{200, 200},
+            glm::uvec2{sky_view_lut_resolution},
             1,
             TextureUsage::StorageImage
         }
@@ -72,13 +111,49 @@ ProceduralSky::ProceduralSky() {
     backend.get_pipeline_cache().add_miss_shaders(occlusion_miss_shader, gi_miss_shader);
 }
 
-void ProceduralSky::update_sky_luts(RenderGraph& graph, const glm::vec3& light_vector) const {
+void ProceduralSky::update_sky_luts(RenderGraph& graph, const glm::vec3& light_vector) {
+    ZoneScoped;
+
+    const auto update_transmittance = transmittance_lut_pso->pipeline != transmittance_lut_source;
+    const auto update_multiscattering = update_transmittance ||
+        multiscattering_lut_pso->pipeline != multiscattering_lut_source;
+
+    const auto sun_altitude = get_sun_altitude(light_vector);
+    if(update_multiscattering || sky_view_lut_pso->pipeline != sky_view_lut_source) {
+        // The LUTs that the sky view reads from changed. The old sky view is wrong, so replace it all this frame
+        sky_view_update = SkyViewUpdate{
+            .light_vector = light_vector,
+            .sun_altitude = sun_altitude,
+            .next_row = 0,
+            .rows_per_frame = sky_view_lut_resolution
+        };
+    } else if(!sky_view_update) {
+        const auto threshold = glm::radians(cvar_sun_altitude_threshold.GetFloat());
+        if(glm::abs(sun_altitude - sky_view_sun_altitude) > threshold) {
+            // Round to the workgroup size, so each frame computes whole workgroups
+            const auto num_frames = static_cast<uint32_t>(glm::max(cvar_sky_view_update_frames.Get(), 1));
+            const auto rows_per_frame = ((sky_view_lut_resolution / num_frames + 7) / 8) * 8;
+            sky_view_update = SkyViewUpdate{
+                .light_vector = light_vector,
+                .sun_altitude = sun_altitude,
+                .next_row = 0,
+                .rows_per_frame = glm::max(rows_per_frame, 8u)
+            };
+        }
+    }
+
+    if(!update_transmittance && !update_multiscattering && !sky_view_update) {
+        return;
+    }
+
     auto& backend = RenderBackend::get();
     auto& descriptors = backend.get_transient_descriptor_allocator();
 
     graph.begin_label("Update sky LUTs");
 
-    {
+    auto transitions = TransitionPass{};
+
+    if(update_transmittance) {
         const auto set = descriptors.build_set(transmittance_lut_pso, 0)
                                     .bind(transmittance_lut)
                                     .build();
@@ -90,9 +165,18 @@ void ProceduralSky::update_sky_luts(RenderGraph& graph, const glm::vec3& light_v
                 .num_workgroups = glm::uvec3{256 / 8, 64 / 8, 1},
                 .compute_shader = transmittance_lut_pso
             });
+
+        transmittance_lut_source = transmittance_lut_pso->pipeline;
+
+        transitions.textures.emplace_back(
+            TextureUsageToken{
+                .texture = transmittance_lut,
+                .stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, .access = VK_ACCESS_2_SHADER_READ_BIT,
+                .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+            });
     }
 
-    {
+    if(update_multiscattering) {
         const auto set = descriptors.build_set(multiscattering_lut_pso, 0)
                                     .bind(transmittance_lut, linear_sampler)
                                     .bind(multiscattering_lut)
@@ -105,49 +189,70 @@ void ProceduralSky::update_sky_luts(RenderGraph& graph, const glm::vec3& light_v
                 .num_workgroups = glm::uvec3{32 / 8, 32 / 8, 1},
                 .compute_shader = multiscattering_lut_pso
             });
-    }
 
-    {
-        const auto set = descriptors.build_set(sky_view_lut_pso, 0)
-                                    .bind(transmittance_lut, linear_sampler)
-                                    .bind(multiscattering_lut, linear_sampler)
-                                    .bind(sky_view_lut)
-                                    .build();
+        multiscattering_lut_source = multiscattering_lut_pso->pipeline;
 
-        graph.add_compute_dispatch(
-            ComputeDispatch<glm::vec3>{
-                .name = "Compute sky view LUT",
-                .descriptor_sets = {set},
-                .push_constants = light_vector,
-                .num_workgroups = glm::uvec3{(200 / 8) + 1, (200 / 8) + 1, 1},
-                .compute_shader = sky_view_lut_pso
+        transitions.textures.emplace_back(
+            TextureUsageToken{
+                .texture = multiscattering_lut,
+                .stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, .access = VK_ACCESS_2_SHADER_READ_BIT,
+                .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
             });
     }
 
-    graph.add_transition_pass(
-        {
-            .textures = {
-                {
-                    .texture = transmittance_lut,
-                    .stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, .access = VK_ACCESS_2_SHADER_READ_BIT,
-                    .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-                {
-                    .texture = multiscattering_lut,
-                    .stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, .access = VK_ACCESS_2_SHADER_READ_BIT,
-                    .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-                {
-                    .texture = sky_view_lut,
-                    .stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, .access = VK_ACCESS_2_SHADER_READ_BIT,
-                    .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-            }
-        });
+    if(sky_view_update && update_sky_view_lut(graph)) {
+        transitions.textures.emplace_back(
+            TextureUsageToken{
+                .texture = get_sky_view_lut(),
+                .stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, .access = VK_ACCESS_2_SHADER_READ_BIT,
+                .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+            });
+    }
+
+    if(!transitions.textures.empty()) {
+        graph.add_transition_pass(transitions);
+    }
 
     graph.end_label();
 }
 
+bool ProceduralSky::update_sky_view_lut(RenderGraph& graph) {
+    auto& descriptors = RenderBackend::get().get_transient_descriptor_allocator();
+
+    const auto back_lut = sky_view_luts[1 - front_sky_view_lut];
+    const auto set = descriptors.build_set(sky_view_lut_pso, 0)
+                                .bind(transmittance_lut, linear_sampler)
+                                .bind(multiscattering_lut, linear_sampler)
+                                .bind(back_lut)
+                                .build();
+
+    const auto num_rows = glm::min(sky_view_update->rows_per_frame, sky_view_lut_resolution - sky_view_update->next_row);
+
+    graph.add_compute_dispatch(
+        ComputeDispatch<SkyViewConstants>{
+            .name = "Compute sky view LUT",
+            .descriptor_sets = {set},
+            .push_constants = {
+                .light_vector = sky_view_update->light_vector,
+                .first_row = sky_view_update->next_row
+            },
+            .num_workgroups = glm::uvec3{(sky_view_lut_resolution / 8) + 1, (num_rows + 7) / 8, 1},
+            .compute_shader = sky_view_lut_pso
+        });
+
+    sky_view_update->next_row += num_rows;
+    if(sky_view_update->next_row < sky_view_lut_resolution) {
+        return false;
+    }
+
+    front_sky_view_lut = 1 - front_sky_view_lut;
+    sky_view_sun_altitude = sky_view_update->sun_altitude;
+    sky_view_lut_source = sky_view_lut_pso->pipeline;
+    sky_view_update = tl::nullopt;
+
+    return true;
+}
+
 void ProceduralSky::render_sky(
     CommandBuffer& commands, const BufferHandle view_buffer, const BufferHandle sun_buffer,
     const TextureHandle gbuffer_depth
@@ -156,7 +261,7 @@ void ProceduralSky::render_sky(
 
     const auto set = backend.get_transient_descriptor_allocator().build_set(sky_application_pso, 0)
                             .bind(transmittance_lut, linear_sampler)
-                            .bind(sky_view_lut, linear_sampler)
+                            .bind(get_sky_view_lut(), linear_sampler)
                             .bind(view_buffer)
                             .bind(sun_buffer)
                             .bind(gbuffer_depth)
@@ -172,7 +277,7 @@ void ProceduralSky::render_sky(
 }
 
 TextureHandle ProceduralSky::get_sky_view_lut() const {
-    return sky_view_lut;
+    return sky_view_luts[front_sky_view_lut];
 }
 
 TextureHandle ProceduralSky::get_transmittance_lut() const {
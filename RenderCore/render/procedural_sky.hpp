@@ -1,5 +1,8 @@
 #pragma once
 
+#include <EASTL/array.h>
+#include <tl/optional.hpp>
+
 #include "glm/vec3.hpp"
 #include "render/backend/compute_shader.hpp"
 #include "render/backend/graphics_pipeline.hpp"
@@ -17,12 +20,17 @@ class SceneRenderer;
  * There's two important methods - `generate_luts` and `add_passes`. `generate_luts` will prepare any LUTs needed for
  * the sky. `add_passes` adds a pass to render the sky. The sky is added to the lit world render target, and is
  * based on the depth buffer, so it must be called at the end of the lighting stage
+ *
+ * The LUTs are only recomputed when their inputs change. The atmosphere parameters are constants in the LUT shaders, so
+ * the transmittance and multiscattering LUTs only change when those shaders are reloaded. The sky view LUT also
+ * depends on the sun's altitude. When only the sun moves, we spread the sky view update over a few frames, writing to
+ * a second LUT and swapping when it's done
  */
 class ProceduralSky {
 public:
     explicit ProceduralSky();
 
-    void update_sky_luts(RenderGraph& graph, const glm::vec3& light_vector) const;
+    void update_sky_luts(RenderGraph& graph, const glm::vec3& light_vector);
 
     void render_sky(
         CommandBuffer& commands, BufferHandle view_buffer, BufferHandle sun_buffer, TextureHandle gbuffer_depth
@@ -43,7 +51,44 @@ private:
 
     TextureHandle transmittance_lut;
     TextureHandle multiscattering_lut;
-    TextureHandle sky_view_lut;
+
+    /**
+     * The sky view LUT that we sample, and the one we're writing an update to
+     */
+    eastl::array<TextureHandle, 2> sky_view_luts;
+    uint32_t front_sky_view_lut = 0;
+
+    /**
+     * PSOs that last wrote each LUT. When the PSO is reloaded, the LUT needs to be recomputed
+     */
+    VkPipeline transmittance_lut_source = VK_NULL_HANDLE;
+    VkPipeline multiscattering_lut_source = VK_NULL_HANDLE;
+    VkPipeline sky_view_lut_source = VK_NULL_HANDLE;
+
+    /**
+     * Sun altitude that the front sky view LUT was computed with, in radians
+     */
+    float sky_view_sun_altitude = 0;
+
+    struct SkyViewUpdate {
+        glm::vec3 light_vector;
+
+        float sun_altitude;
+
+        uint32_t next_row;
+
+        uint32_t rows_per_frame;
+    };
+
+    /**
+     * Update to the back sky view LUT that's in progress, if any
+     */
+    tl::optional<SkyViewUpdate> sky_view_update;
 
     VkSampler linear_sampler;
+
+    /**
+     * Computes some rows of the back sky view LUT. Swaps the LUTs when the update is done. Returns true if it swapped
+     */
+    bool update_sky_view_lut(RenderGraph& graph);
 };
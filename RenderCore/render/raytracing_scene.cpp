@@ -12,23 +12,32 @@
 RaytracingScene::RaytracingScene(RenderScene& scene_in)
     : scene{scene_in} {}
 
-void RaytracingScene::add_primitive(const MeshPrimitiveHandle primitive) {
-    const auto& model_matrix = primitive->data.model;
+static VkTransformMatrixKHR to_vk_transform(const glm::mat4& model_matrix) {
+    return VkTransformMatrixKHR{
+        .matrix = {
+            {model_matrix[0][0], model_matrix[1][0], model_matrix[2][0], model_matrix[3][0]},
+            {model_matrix[0][1], model_matrix[1][1], model_matrix[2][1], model_matrix[3][1]},
+            {model_matrix[0][2], model_matrix[1][2], model_matrix[2][2], model_matrix[3][2]}
+        }
+    };
+}
+
+void RaytracingScene::add_primitive(const MeshPrimitiveHandle primitive, const glm::mat4& transform) {
     const auto blas_flags = primitive->material->first.transparency_mode == TransparencyMode::Solid
         ? VK_GEOMETRY_INSTANCE_FORCE_OPAQUE_BIT_KHR
         : VK_GEOMETRY_INSTANCE_FORCE_NO_OPAQUE_BIT_KHR;
 
     // Multiply by two because each shader group has a GI and occlusion variant
     const auto sbt_offset = static_cast<uint32_t>(primitive->material->first.transparency_mode) * 2;
+
+    if(instance_indices.size() <= primitive.index) {
+        instance_indices.resize(primitive.index + 1, 0xFFFFFFFF);
+    }
+    instance_indices[primitive.index] = static_cast<uint32_t>(placed_blases.size());
+
     placed_blases.emplace_back(
         VkAccelerationStructureInstanceKHR{
-            .transform = {
-                .matrix = {
-                    {model_matrix[0][0], model_matrix[1][0], model_matrix[2][0], model_matrix[3][0]},
-                    {model_matrix[0][1], model_matrix[1][1], model_matrix[2][1], model_matrix[3][1]},
-                    {model_matrix[0][2], model_matrix[1][2], model_matrix[2][2], model_matrix[3][2]}
-                }
-            },
+            .transform = to_vk_transform(transform),
             .instanceCustomIndex = primitive.index,
             .mask = 0xFF,
             .instanceShaderBindingTableRecordOffset = sbt_offset,
@@ -39,6 +48,16 @@ void RaytracingScene::add_primitive(const MeshPrimitiveHandle primitive) {
     is_dirty = true;
 }
 
+void RaytracingScene::update_primitive_transform(const MeshPrimitiveHandle primitive, const glm::mat4& transform) {
+    if(primitive.index >= instance_indices.size() || instance_indices[primitive.index] == 0xFFFFFFFF) {
+        return;
+    }
+
+    placed_blases[instance_indices[primitive.index]].transform = to_vk_transform(transform);
+
+    is_dirty = true;
+}
+
 void RaytracingScene::finalize(RenderGraph& graph) {
     commit_tlas_builds(graph);
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <glm/mat4x4.hpp>
+
 #include "render/scene_primitive.hpp"
 
 class RenderGraph;
@@ -9,7 +11,12 @@ class RaytracingScene {
 public:
     explicit RaytracingScene(RenderScene& scene_in);
 
-    void add_primitive(MeshPrimitiveHandle primitive);
+    void add_primitive(MeshPrimitiveHandle primitive, const glm::mat4& transform);
+
+    /**
+     * Copies the primitive's new model matrix into its TLAS instance. The TLAS is rebuilt in the next finalize()
+     */
+    void update_primitive_transform(MeshPrimitiveHandle primitive, const glm::mat4& transform);
 
     /**
      * \brief Make the raytracing scene ready for raytracing by making sure that all raytraing acceleration structure
@@ -26,6 +33,12 @@ private:
     RenderScene& scene;
 
     eastl::vector<VkAccelerationStructureInstanceKHR> placed_blases;
+
+    /**
+     * Index in placed_blases of each primitive, indexed by the primitive's index
+     */
+    eastl::vector<uint32_t> instance_indices;
+
     bool is_dirty = false;
     AccelerationStructureHandle acceleration_structure = {};
 
@@ -1,5 +1,11 @@
 #include "render_scene.hpp"
 
+#include <EASTL/algorithm.h>
+#include <EASTL/sort.h>
+#include <glm/matrix.hpp>
+#include <tracy/Tracy.hpp>
+
+#include "draw_sorting.hpp"
 #include "indirect_drawing_utils.hpp"
 #include "mesh_storage.hpp"
 #include "raytracing_scene.hpp"
@@ -7,12 +13,23 @@
 #include "render/backend/resource_allocator.hpp"
 #include "render/backend/render_backend.hpp"
 #include "core/box.hpp"
+#include "core/system_interface.hpp"
 #include "model_import/gltf_model.hpp"
+#include "shared/emissive_points.hpp"
+#include "shared/vpl.hpp"
 
 constexpr uint32_t MAX_NUM_PRIMITIVES = 65536;
 
+constexpr uint32_t MAX_NUM_PUNCTUAL_LIGHTS = 8192;
+
+static std::shared_ptr<spdlog::logger> logger;
+
 RenderScene::RenderScene(MeshStorage& meshes_in, MaterialStorage& materials_in)
     : meshes{meshes_in}, materials{materials_in} {
+    if(logger == nullptr) {
+        logger = SystemInterface::get().get_logger("RenderScene");
+    }
+
     auto& backend = RenderBackend::get();
     auto& allocator = backend.get_global_allocator();
     primitive_data_buffer = allocator.create_buffer(
@@ -20,6 +37,11 @@ RenderScene::RenderScene(MeshStorage& meshes_in, MaterialStorage& materials_in)
         MAX_NUM_PRIMITIVES * sizeof(PrimitiveDataGPU),
         BufferUsage::StorageBuffer
     );
+    punctual_lights_buffer = allocator.create_buffer(
+        "Punctual lights",
+        MAX_NUM_PUNCTUAL_LIGHTS * sizeof(PunctualLightGPU),
+        BufferUsage::StorageBuffer
+    );
 
     // Defaults
     sun.set_direction({0.1f, -1.f, -1.f});
@@ -34,27 +56,16 @@ RenderScene::RenderScene(MeshStorage& meshes_in, MaterialStorage& materials_in)
     emissive_point_cloud_shader = pipeline_cache.create_pipeline("shaders/util/emissive_point_cloud.comp.spv");
 }
 
-MeshPrimitiveHandle
-RenderScene::add_primitive(RenderGraph& graph, MeshPrimitive primitive) {
-    const auto material_buffer_address = materials.get_material_instance_buffer()->address;
-    primitive.data.material = material_buffer_address + primitive.material.index * sizeof(BasicPbrMaterialGpu);
-    primitive.data.mesh_id = primitive.mesh.index;
-    primitive.data.type = static_cast<uint32_t>(primitive.material->first.transparency_mode);
-
-    const auto index_buffer_address = meshes.get_index_buffer()->address;
-    primitive.data.indices = index_buffer_address + primitive.mesh->first_index * sizeof(uint32_t);
-
-    const auto positions_buffer_address = meshes.get_vertex_position_buffer()->address;
-    primitive.data.vertex_positions = positions_buffer_address + primitive.mesh->first_vertex * sizeof(StandardVertexPosition);
-
-    const auto data_buffer_address = meshes.get_vertex_data_buffer()->address;
-    primitive.data.vertex_data = data_buffer_address + primitive.mesh->first_vertex * sizeof(StandardVertexData);
-
+MeshPrimitiveHandle RenderScene::add_primitive(
+    RenderGraph& graph, MeshPrimitive primitive, const glm::mat4& transform, const uint32_t flags
+) {
     auto handle = mesh_primitives.add_object(std::move(primitive));
 
     total_num_primitives++;
+    primitive_generation++;
 
-    switch(handle->material->first.transparency_mode) {
+    const auto transparency_mode = handle->material->first.transparency_mode;
+    switch(transparency_mode) {
     case TransparencyMode::Solid:
         solid_primitives.push_back(handle);
         break;
@@ -74,23 +85,73 @@ RenderScene::add_primitive(RenderGraph& graph, MeshPrimitive primitive) {
 
     raytracing_scene.map(
         [&](RaytracingScene& rt_scene) {
-            rt_scene.add_primitive(handle);
+            rt_scene.add_primitive(handle, transform);
         });
 
-    if(primitive_upload_buffer.is_full()) {
-        primitive_upload_buffer.flush_to_buffer(graph, primitive_data_buffer);
-    }
-    primitive_upload_buffer.add_data(handle.index, handle->data);
+    // The primitive's GPU data is uploaded in the next begin_frame
+    const auto& mesh = *handle->mesh;
+    const auto material_buffer_address = materials.get_material_instance_buffer()->address;
+    const auto index_buffer_address = meshes.get_index_buffer()->address;
+    const auto positions_buffer_address = meshes.get_vertex_position_buffer()->address;
+    const auto data_buffer_address = meshes.get_vertex_data_buffer()->address;
+    primitive_store.add_primitive(
+        handle.index,
+        PrimitiveCreateInfo{
+            .transform = transform,
+            .local_bounds = mesh.bounds,
+            .type = static_cast<uint8_t>(transparency_mode),
+            .flags = flags,
+            .mesh_id = handle->mesh.index,
+            .material_id = handle->material.index,
+            .addresses = {
+                .material = material_buffer_address + handle->material.index * sizeof(BasicPbrMaterialGpu),
+                .indices = index_buffer_address + mesh.first_index * sizeof(uint32_t),
+                .vertex_positions = positions_buffer_address + mesh.first_vertex * sizeof(StandardVertexPosition),
+                .vertex_data = data_buffer_address + mesh.first_vertex * sizeof(StandardVertexData),
+            },
+        });
 
     new_primitives.push_back(handle);
 
+    // New static casters aren't in the cached shadows yet
+    if((flags & PRIMITIVE_FLAG_DYNAMIC) == 0) {
+        sun.invalidate_shadow_cache();
+    }
+
     return handle;
 }
 
+void RenderScene::set_primitive_transform(const MeshPrimitiveHandle& primitive, const glm::mat4& transform) {
+    primitive_store.set_transform(primitive.index, transform);
+
+    raytracing_scene.map(
+        [&](RaytracingScene& rt_scene) {
+            rt_scene.update_primitive_transform(primitive, transform);
+        });
+    primitive_generation++;
+
+    set_primitive_dynamic(primitive);
+}
+
+void RenderScene::set_primitive_dynamic(const MeshPrimitiveHandle& primitive) {
+    const auto flags = primitive_store.get_flags(primitive.index);
+    if((flags & PRIMITIVE_FLAG_DYNAMIC) != 0) {
+        return;
+    }
+
+    // The shadow culling shader moves the primitive to the dynamic casters once its new flags are uploaded. It's still
+    // baked into the cached shadows, so they have to be re-rendered without it
+    primitive_store.set_flags(primitive.index, flags | PRIMITIVE_FLAG_DYNAMIC);
+    sun.invalidate_shadow_cache();
+}
+
 void RenderScene::begin_frame(RenderGraph& graph) {
     graph.begin_label("RenderScene::begin_frame");
 
-    primitive_upload_buffer.flush_to_buffer(graph, primitive_data_buffer);
+    // The GPU is done with this frame's primitive IDs
+    num_draw_primitive_ids = 0;
+
+    upload_dirty_primitives(graph);
 
     if(raytracing_scene) {
         raytracing_scene->finalize(graph);
@@ -100,11 +161,34 @@ void RenderScene::begin_frame(RenderGraph& graph) {
 
     generate_emissive_point_clouds(graph);
 
+    if(punctual_lights_dirty) {
+        auto& backend = RenderBackend::get();
+        const auto lights = std::span{punctual_lights}.first(get_num_punctual_lights());
+        backend.get_upload_queue().upload_to_buffer(punctual_lights_buffer, lights);
+        punctual_lights_dirty = false;
+    }
+
     graph.end_label();
 
     sky.update_sky_luts(graph, sun.get_direction());
 }
 
+void RenderScene::upload_dirty_primitives(RenderGraph& graph) {
+    ZoneScoped;
+
+    // Only send the primitives that changed to the GPU. Everything else in the primitive data buffer is still valid
+    for(const auto index : primitive_store.get_dirty_indices()) {
+        if(primitive_upload_buffer.is_full()) {
+            primitive_upload_buffer.flush_to_buffer(graph, primitive_data_buffer);
+        }
+        primitive_upload_buffer.add_data(index, primitive_store.get_gpu_data(index));
+    }
+
+    primitive_store.clear_dirty();
+
+    primitive_upload_buffer.flush_to_buffer(graph, primitive_data_buffer);
+}
+
 const eastl::vector<PooledObject<MeshPrimitive>>& RenderScene::get_solid_primitives() const {
     return solid_primitives;
 }
@@ -125,6 +209,10 @@ uint32_t RenderScene::get_total_num_primitives() const {
     return total_num_primitives;
 }
 
+uint32_t RenderScene::get_primitive_generation() const {
+    return primitive_generation;
+}
+
 DirectionalLight& RenderScene::get_sun_light() {
     return sun;
 }
@@ -133,27 +221,70 @@ const DirectionalLight& RenderScene::get_sun_light() const { return sun; }
 
 const ProceduralSky& RenderScene::get_sky() const { return sky; }
 
-eastl::vector<PooledObject<MeshPrimitive>> RenderScene::get_primitives_in_bounds(
-    const glm::vec3& min_bounds, const glm::vec3& max_bounds
-) const {
-    auto output = eastl::vector<PooledObject<MeshPrimitive>>{};
-    output.reserve(solid_primitives.size());
+uint32_t RenderScene::add_point_light(const float3& position, const float3& color, const float range) {
+    return add_punctual_light(
+        PunctualLightGPU{
+            .position = position,
+            .range = range,
+            .color = color,
+            .type = PUNCTUAL_LIGHT_TYPE_POINT,
+        });
+}
+
+uint32_t RenderScene::add_spot_light(
+    const float3& position, const float3& direction, const float3& color, const float range, const float inner_angle,
+    const float outer_angle
+) {
+    return add_punctual_light(
+        PunctualLightGPU{
+            .position = position,
+            .range = range,
+            .color = color,
+            .type = PUNCTUAL_LIGHT_TYPE_SPOT,
+            .direction = glm::normalize(direction),
+            .cos_outer_angle = glm::cos(outer_angle),
+            .cos_inner_angle = glm::cos(glm::min(inner_angle, outer_angle)),
+        });
+}
 
-    const auto test_box = Box{.min = min_bounds, .max = max_bounds};
-    for(const auto& primitive : solid_primitives) {
-        const auto matrix = primitive->data.model;
-        const auto mesh_bounds = primitive->mesh->bounds;
+void RenderScene::set_punctual_light_position(const uint32_t light, const float3& position) {
+    punctual_lights[light].position = position;
+    punctual_lights_dirty = true;
+}
 
-        const auto max_mesh_bounds = mesh_bounds.max;
-        const auto min_mesh_bounds = mesh_bounds.min;
-        const auto min_primitive_bounds = matrix * glm::vec4{min_mesh_bounds, 1.f};
-        const auto max_primitive_bounds = matrix * glm::vec4{max_mesh_bounds, 1.f};
+std::span<const PunctualLightGPU> RenderScene::get_punctual_lights() const {
+    return std::span{punctual_lights}.first(get_num_punctual_lights());
+}
 
-        const auto primitive_box = Box{.min = min_primitive_bounds, .max = max_primitive_bounds};
+BufferHandle RenderScene::get_punctual_lights_buffer() const {
+    return punctual_lights_buffer;
+}
 
-        if(test_box.overlaps(primitive_box)) {
-            output.push_back(primitive);
-        }
+uint32_t RenderScene::get_num_punctual_lights() const {
+    return static_cast<uint32_t>(eastl::min(punctual_lights.size(), static_cast<size_t>(MAX_NUM_PUNCTUAL_LIGHTS)));
+}
+
+uint32_t RenderScene::add_punctual_light(const PunctualLightGPU& light) {
+    if(punctual_lights.size() == MAX_NUM_PUNCTUAL_LIGHTS) {
+        logger->warn("Scene has more than {} punctual lights. The extra lights won't be rendered", MAX_NUM_PUNCTUAL_LIGHTS);
+    }
+
+    punctual_lights.push_back(light);
+    punctual_lights_dirty = true;
+
+    return static_cast<uint32_t>(punctual_lights.size() - 1);
+}
+
+eastl::vector<PooledObject<MeshPrimitive>> RenderScene::get_primitives_in_bounds(
+    const glm::vec3& min_bounds, const glm::vec3& max_bounds
+) const {
+    auto indices = eastl::vector<uint32_t>{};
+    primitive_store.find_in_bounds(Box{.min = min_bounds, .max = max_bounds}, PRIMITIVE_TYPE_SOLID, indices);
+
+    auto output = eastl::vector<PooledObject<MeshPrimitive>>{};
+    output.reserve(indices.size());
+    for(const auto index : indices) {
+        output.push_back(mesh_primitives.make_handle(index));
     }
 
     return output;
@@ -164,13 +295,115 @@ void RenderScene::generate_emissive_point_clouds(RenderGraph& render_graph) {
         return;
     }
 
-    render_graph.begin_label("Generate emissive mesh VPLs");
-    for(auto& primitive : new_emissive_objects) {
-        primitive->emissive_points_buffer = generate_vpls_for_primitive(render_graph, primitive);
-    }
-    render_graph.end_label();
+    ZoneScoped;
 
+    emissive_primitives.insert(emissive_primitives.end(), new_emissive_objects.begin(), new_emissive_objects.end());
     new_emissive_objects.clear();
+
+    // Lay every emissive primitive's VPLs out back-to-back. The VPLs are baked in worldspace, so the range bounds are
+    // the primitive's world bounds right now
+    auto ranges = eastl::vector<EmissivePointRange>{};
+    ranges.reserve(emissive_primitives.size());
+    auto num_points = 0u;
+    for(const auto& primitive : emissive_primitives) {
+        const auto bounds = primitive_store.get_world_bounds(primitive.index);
+        ranges.emplace_back(
+            EmissivePointRange{
+                .bounds_min = bounds.min,
+                .first_point = num_points,
+                .bounds_max = bounds.max,
+                .num_points = primitive->mesh->num_points,
+                .point_cloud = primitive->mesh->point_cloud_buffer->address,
+                .primitive_id = primitive.index,
+            });
+        num_points += primitive->mesh->num_points;
+    }
+
+    auto& backend = RenderBackend::get();
+    auto& allocator = backend.get_global_allocator();
+    if(emissive_points_buffer) {
+        allocator.destroy_buffer(emissive_points_buffer);
+    }
+    if(emissive_ranges_buffer) {
+        allocator.destroy_buffer(emissive_ranges_buffer);
+    }
+
+    emissive_points_buffer = allocator.create_buffer(
+        "Emissive points",
+        num_points * sizeof(PackedVPL),
+        BufferUsage::StorageBuffer
+    );
+    emissive_ranges_buffer = allocator.create_buffer(
+        "Emissive point ranges",
+        ranges.size() * sizeof(EmissivePointRange),
+        BufferUsage::StorageBuffer
+    );
+    backend.get_upload_queue().upload_to_buffer(emissive_ranges_buffer, std::span{ranges});
+
+    struct EmissivePointCloudConstants {
+        DeviceAddress primitive_data;
+        DeviceAddress ranges;
+        DeviceAddress vpl_buffer;
+        uint32_t num_ranges;
+        uint32_t num_points;
+    };
+
+    // One dispatch for every emissive primitive. Each thread finds its primitive in the range table
+    auto buffers = BufferUsageList{
+        {
+            emissive_points_buffer,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+        },
+        {
+            emissive_ranges_buffer,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_READ_BIT
+        },
+        {
+            primitive_data_buffer,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_READ_BIT
+        },
+    };
+    for(const auto& primitive : emissive_primitives) {
+        buffers.push_back(
+            {
+                primitive->mesh->point_cloud_buffer,
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_SHADER_READ_BIT
+            });
+    }
+
+    render_graph.add_compute_dispatch(
+        ComputeDispatch<EmissivePointCloudConstants>{
+            .name = "Build emissive points",
+            .descriptor_sets = {backend.get_texture_descriptor_pool().get_descriptor_set()},
+            .buffers = buffers,
+            .push_constants = {
+                .primitive_data = primitive_data_buffer->address,
+                .ranges = emissive_ranges_buffer->address,
+                .vpl_buffer = emissive_points_buffer->address,
+                .num_ranges = static_cast<uint32_t>(ranges.size()),
+                .num_points = num_points,
+            },
+            .num_workgroups = {
+                (num_points + 95) / 96, 1, 1
+            },
+            .compute_shader = emissive_point_cloud_shader
+        });
+}
+
+BufferHandle RenderScene::get_emissive_points_buffer() const {
+    return emissive_points_buffer;
+}
+
+BufferHandle RenderScene::get_emissive_ranges_buffer() const {
+    return emissive_ranges_buffer;
+}
+
+uint32_t RenderScene::get_num_emissive_ranges() const {
+    return static_cast<uint32_t>(emissive_primitives.size());
 }
 
 void RenderScene::draw_opaque(CommandBuffer& commands, const GraphicsPipelineHandle pso) const {
@@ -198,7 +431,9 @@ void RenderScene::draw_opaque(
 
     commands.draw_indexed_indirect(
         drawbuffers.commands,
+        drawbuffers.commands_offset,
         drawbuffers.count,
+        drawbuffers.count_offset,
         static_cast<uint32_t>(solid_primitives.size()));
 
     if(solid_pso->descriptor_sets.size() > 1) {
@@ -223,7 +458,9 @@ void RenderScene::draw_masked(
 
     commands.draw_indexed_indirect(
         drawbuffers.commands,
+        drawbuffers.commands_offset,
         drawbuffers.count,
+        drawbuffers.count_offset,
         static_cast<uint32_t>(masked_primitives.size()));
 
     if (masked_pso->descriptor_sets.size() > 1) {
@@ -232,7 +469,7 @@ void RenderScene::draw_masked(
 }
 
 void RenderScene::draw_transparent(CommandBuffer& commands, GraphicsPipelineHandle pso) const {
-    draw_primitives(commands, pso, translucent_primitives);
+    draw_primitives(commands, pso, translucent_primitives, true);
 }
 
 const MeshStorage& RenderScene::get_meshes() const {
@@ -254,96 +491,110 @@ MeshStorage& RenderScene::get_mesh_storage() const {
     return meshes;
 }
 
-BufferHandle RenderScene::generate_vpls_for_primitive(
-    RenderGraph& graph, const PooledObject<MeshPrimitive>& primitive
-) {
-    auto& backend = RenderBackend::get();
-    const auto vpl_buffer_handle = backend.get_global_allocator().create_buffer(
-        "Primitive emission buffer",
-        primitive->mesh->num_points * sizeof(glm::vec4),
-        BufferUsage::StorageBuffer
-    );
+void RenderScene::draw_primitives(
+    CommandBuffer& commands, const GraphicsPipelineHandle pso, const std::span<const MeshPrimitiveHandle> primitives,
+    const bool preserve_order
+) const {
+    ZoneScoped;
 
-    struct EmissivePointCloudConstants {
-        DeviceAddress primitive_data;
-        DeviceAddress point_cloud;
-        DeviceAddress vpl_buffer;
-        uint32_t primitive_index;
-        uint32_t num_points;
-    };
+    if(primitives.empty()) {
+        return;
+    }
 
-    graph.add_compute_dispatch(
-        ComputeDispatch<EmissivePointCloudConstants>{
-            .name = "Build emissive points",
-            .descriptor_sets = {backend.get_texture_descriptor_pool().get_descriptor_set()},
-            .buffers = {
-                {
-                    vpl_buffer_handle,
-                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
-                },
-                {
-                    primitive->mesh->point_cloud_buffer,
-                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                    VK_ACCESS_2_SHADER_READ_BIT
-                },
-                {
-                    primitive_data_buffer,
-                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                    VK_ACCESS_2_SHADER_READ_BIT
-                },
-            },
-            .push_constants = {
-                .primitive_data = primitive_data_buffer->address,
-                .point_cloud = primitive->mesh->point_cloud_buffer->address,
-                .vpl_buffer = vpl_buffer_handle->address,
-                .primitive_index = primitive.index,
-                .num_points = primitive->mesh->num_points,
-            },
-            .num_workgroups = {
-                (primitive->mesh->num_points + 95) / 96, 1, 1
-            },
-            .compute_shader = emissive_point_cloud_shader
-        });
+    // We only have one pipeline per call, but keep it in the key so that callers can submit several pipelines at once
+    // later
+    auto draws = eastl::vector<SortedDraw>{};
+    draws.reserve(primitives.size());
+    for(auto i = 0u; i < primitives.size(); i++) {
+        const auto& primitive = primitives[i];
+        const auto& material = primitive->material->first;
+        draws.emplace_back(
+            SortedDraw{
+                .key = make_draw_sort_key(0, material.double_sided, material.front_face_ccw, primitive->mesh.index),
+                .draw_index = i
+            });
+    }
 
-    return vpl_buffer_handle;
-}
+    auto batches = eastl::vector<DrawBatch>{};
+    batch_draws(draws, preserve_order, batches);
+
+    // Instanced draws read their primitive IDs from a per-instance vertex stream. Write it in sorted order, so each
+    // instanced draw covers a contiguous range of it
+    const auto [primitive_ids_buffer, first_primitive_id] = allocate_draw_primitive_ids(
+        commands.get_backend(),
+        static_cast<uint32_t>(draws.size()));
+    auto* primitive_ids = commands.get_backend().get_global_allocator().map_buffer<uint32_t>(primitive_ids_buffer) +
+        first_primitive_id;
+    for(auto i = 0u; i < draws.size(); i++) {
+        primitive_ids[i] = primitives[draws[i].draw_index].index;
+    }
+    commands.flush_buffer(primitive_ids_buffer);
 
-void RenderScene::draw_primitives(
-    CommandBuffer& commands, const GraphicsPipelineHandle pso, const std::span<const MeshPrimitiveHandle> primitives
-) const {
     meshes.bind_to_commands(commands);
+    commands.bind_vertex_buffer(2, primitive_ids_buffer, first_primitive_id * sizeof(uint32_t));
 
     if(pso->descriptor_sets.size() > 1) {
         commands.bind_descriptor_set(1, commands.get_backend().get_texture_descriptor_pool().get_descriptor_set());
     }
 
     commands.bind_pipeline(pso);
-    for(const auto& primitive : primitives) {
-        const auto& mesh = primitive->mesh;
 
-        if(primitive->material->first.double_sided) {
-            commands.set_cull_mode(VK_CULL_MODE_NONE);
-        } else {
-            commands.set_cull_mode(VK_CULL_MODE_BACK_BIT);
+    auto current_cull_mode = VkCullModeFlags{VK_CULL_MODE_FLAG_BITS_MAX_ENUM};
+    auto current_front_face = VK_FRONT_FACE_MAX_ENUM;
+
+    for(const auto& batch : batches) {
+        const auto& primitive = primitives[draws[batch.first_draw].draw_index];
+        const auto& material = primitive->material->first;
+
+        const auto cull_mode = material.double_sided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+        if(cull_mode != current_cull_mode) {
+            commands.set_cull_mode(cull_mode);
+            current_cull_mode = cull_mode;
         }
 
-        if(primitive->material->first.front_face_ccw) {
-            commands.set_front_face(VK_FRONT_FACE_COUNTER_CLOCKWISE);
-        } else {
-            commands.set_front_face(VK_FRONT_FACE_CLOCKWISE);
+        const auto front_face = material.front_face_ccw ? VK_FRONT_FACE_COUNTER_CLOCKWISE : VK_FRONT_FACE_CLOCKWISE;
+        if(front_face != current_front_face) {
+            commands.set_front_face(front_face);
+            current_front_face = front_face;
         }
 
-        commands.set_push_constant(0, primitive.index);
+        const auto& mesh = primitive->mesh;
         commands.draw_indexed(
             mesh->num_indices,
-            1,
+            batch.num_draws,
             static_cast<uint32_t>(mesh->first_index),
             static_cast<uint32_t>(mesh->first_vertex),
-            0);
+            batch.first_draw);
     }
 
     if(pso->descriptor_sets.size() > 1) {
         commands.clear_descriptor_set(1);
     }
 }
+
+eastl::pair<BufferHandle, uint32_t> RenderScene::allocate_draw_primitive_ids(
+    RenderBackend& backend, const uint32_t num_ids
+) const {
+    auto& allocator = backend.get_global_allocator();
+    auto& buffer = draw_primitive_ids_buffers[backend.get_current_gpu_frame()];
+    const auto capacity = buffer != nullptr ? static_cast<uint32_t>(buffer->create_info.size / sizeof(uint32_t)) : 0;
+
+    if(num_draw_primitive_ids + num_ids > capacity) {
+        // Draws we already recorded this frame still read the old buffer. The allocator keeps it alive until the GPU
+        // is done with this frame
+        if(buffer != nullptr) {
+            allocator.destroy_buffer(buffer);
+        }
+        const auto new_capacity = eastl::max(capacity * 2, eastl::max(num_ids, MAX_NUM_PRIMITIVES));
+        buffer = allocator.create_buffer(
+            "Direct draw primitive IDs",
+            new_capacity * sizeof(uint32_t),
+            BufferUsage::StagingBuffer);
+        num_draw_primitive_ids = 0;
+    }
+
+    const auto first_id = num_draw_primitive_ids;
+    num_draw_primitive_ids += num_ids;
+
+    return {buffer, first_id};
+}
@@ -1,12 +1,18 @@
 #pragma once
 
+#include <EASTL/array.h>
+#include <EASTL/utility.h>
+
 #include "render/procedural_sky.hpp"
 #include "render/raytracing_scene.hpp"
 #include "core/object_pool.hpp"
+#include "render/backend/constants.hpp"
 #include "render/backend/handles.hpp"
 #include "render/scene_primitive.hpp"
 #include "render/backend/scatter_upload_buffer.hpp"
 #include "render/directional_light.hpp"
+#include "render/primitive_store.hpp"
+#include "shared/punctual_lights.hpp"
 
 struct IndirectDrawingBuffers;
 class MaterialStorage;
@@ -23,8 +29,33 @@ class RenderScene {
 public:
     explicit RenderScene(MeshStorage& meshes_in, MaterialStorage& materials_in);
 
-    MeshPrimitiveHandle add_primitive(RenderGraph& graph, MeshPrimitive primitive);
+    /**
+     * Adds a primitive to the scene. Its data is uploaded to the GPU in the next begin_frame
+     *
+     * \param flags PRIMITIVE_FLAG_ bits from primitive_data.hpp
+     */
+    MeshPrimitiveHandle add_primitive(
+        RenderGraph& graph, MeshPrimitive primitive, const glm::mat4& transform, uint32_t flags = 0
+    );
+
+    /**
+     * Moves a primitive. The new transform is uploaded to the GPU in the next begin_frame
+     *
+     * Primitives that move are dynamic. The first time a static primitive moves, we mark it dynamic and invalidate the
+     * cached sun shadows, since the primitive is baked into them. After that it's drawn with the dynamic casters, so
+     * moving it doesn't invalidate the cache again
+     */
+    void set_primitive_transform(const MeshPrimitiveHandle& primitive, const glm::mat4& transform);
+
+    /**
+     * Marks a primitive as dynamic, so that it's kept out of the cached sun shadows. Primitives that are known to move
+     * should be marked before they first move, or added with PRIMITIVE_FLAG_DYNAMIC already set
+     */
+    void set_primitive_dynamic(const MeshPrimitiveHandle& primitive);
 
+    /**
+     * Uploads the primitives that changed since the last frame, and updates the raytracing scene
+     */
     void begin_frame(RenderGraph& graph);
 
     const eastl::vector<MeshPrimitiveHandle>& get_solid_primitives() const;
@@ -37,12 +68,58 @@ public:
 
     uint32_t get_total_num_primitives() const;
 
+    /**
+     * Incremented whenever a primitive is added or moved. Lets caches of the scene tell when they're stale
+     */
+    uint32_t get_primitive_generation() const;
+
     DirectionalLight& get_sun_light();
 
     const DirectionalLight& get_sun_light() const;
 
     const ProceduralSky& get_sky() const;
 
+    /**
+     * Adds a point light. The light is uploaded to the GPU in the next begin_frame
+     *
+     * \param color HDR color. Luminous intensity times the color of the light
+     * \param range Distance past which the light has no effect
+     * \return The light's index. Valid for the life of the scene
+     */
+    uint32_t add_point_light(const float3& position, const float3& color, float range);
+
+    /**
+     * Adds a spot light. The light is uploaded to the GPU in the next begin_frame
+     *
+     * \param inner_angle Angle between the direction and the edge of the fully lit cone, in radians
+     * \param outer_angle Angle between the direction and the edge of the lit cone, in radians
+     * \return The light's index. Valid for the life of the scene
+     */
+    uint32_t add_spot_light(
+        const float3& position, const float3& direction, const float3& color, float range, float inner_angle,
+        float outer_angle
+    );
+
+    /**
+     * Moves a punctual light. The new position is uploaded to the GPU in the next begin_frame
+     */
+    void set_punctual_light_position(uint32_t light, const float3& position);
+
+    /**
+     * The punctual lights that are in the punctual light buffer
+     */
+    std::span<const PunctualLightGPU> get_punctual_lights() const;
+
+    /**
+     * Buffer of the PunctualLightGPUs of every point and spot light
+     */
+    BufferHandle get_punctual_lights_buffer() const;
+
+    /**
+     * Number of lights in the punctual light buffer. The buffer has a fixed size, lights past it aren't rendered
+     */
+    uint32_t get_num_punctual_lights() const;
+
     /**
      * Retrieves a list of all solid primitives that lie within the given bounds
      */
@@ -52,9 +129,24 @@ public:
 
     /**
      * \brief Generates emissive point clouds for new emissive meshes
+     *
+     * The VPLs of every emissive primitive live in one buffer. Each primitive owns a contiguous range of it, described
+     * by an EmissivePointRange. When new emissive primitives show up, we rebuild the buffer and the range table
      */
     void generate_emissive_point_clouds(RenderGraph& render_graph);
 
+    /**
+     * Buffer of the PackedVPLs of every emissive primitive
+     */
+    BufferHandle get_emissive_points_buffer() const;
+
+    /**
+     * Buffer of EmissivePointRanges, one for each emissive primitive, sorted by first point
+     */
+    BufferHandle get_emissive_ranges_buffer() const;
+
+    uint32_t get_num_emissive_ranges() const;
+
     void draw_opaque(CommandBuffer& commands, GraphicsPipelineHandle pso) const;
 
     void draw_masked(CommandBuffer& commands, GraphicsPipelineHandle pso) const;
@@ -95,30 +187,79 @@ private:
 
     ObjectPool<MeshPrimitive> mesh_primitives;
 
+    eastl::vector<PunctualLightGPU> punctual_lights;
+
+    BufferHandle punctual_lights_buffer = {};
+
+    /**
+     * Whether the punctual lights changed since they were last uploaded
+     */
+    bool punctual_lights_dirty = false;
+
+    /**
+     * Transforms, bounds, flags, and the rest of each primitive's data, in a cache-friendly layout
+     */
+    PrimitiveStore primitive_store;
+
     uint32_t total_num_primitives = 0u;
+
+    uint32_t primitive_generation = 0u;
     BufferHandle primitive_data_buffer;
 
     ScatterUploadBuffer<PrimitiveDataGPU> primitive_upload_buffer;
 
-    // TODO: Group solid primitives by front face
-
     eastl::vector<MeshPrimitiveHandle> solid_primitives;
 
-    // TODO: Group masked primitives by front face and cull mode
-
     eastl::vector<MeshPrimitiveHandle> masked_primitives;
 
     eastl::vector<MeshPrimitiveHandle> translucent_primitives;
 
     eastl::vector<MeshPrimitiveHandle> new_emissive_objects;
 
+    /**
+     * Every emissive primitive that has VPLs, in the order of their ranges
+     */
+    eastl::vector<MeshPrimitiveHandle> emissive_primitives;
+
+    BufferHandle emissive_points_buffer = {};
+
+    BufferHandle emissive_ranges_buffer = {};
+
     ComputePipelineHandle emissive_point_cloud_shader;
 
     eastl::vector<MeshPrimitiveHandle> new_primitives;
 
-    BufferHandle generate_vpls_for_primitive(RenderGraph& graph, const MeshPrimitiveHandle& primitive);
+    /**
+     * Gathers the data of the primitives that changed from the primitive store, and uploads it to the GPU
+     */
+    void upload_dirty_primitives(RenderGraph& graph);
+
+    uint32_t add_punctual_light(const PunctualLightGPU& light);
+
+    /**
+     * Primitive IDs for this frame's direct draws. One buffer per frame in flight, each draw suballocates from the
+     * current frame's buffer
+     */
+    mutable eastl::array<BufferHandle, num_in_flight_frames> draw_primitive_ids_buffers = {};
 
+    mutable uint32_t num_draw_primitive_ids = 0;
+
+    /**
+     * Draws the primitives with direct draws. Draws are sorted by their dynamic state and mesh, and draws of the same
+     * mesh are merged into one instanced draw
+     *
+     * \param preserve_order Submit the primitives in the order they're given, and only merge neighbouring draws of the
+     * same mesh. Needed for translucent draws, which blend in submission order
+     */
     void draw_primitives(
-        CommandBuffer& commands, GraphicsPipelineHandle pso, std::span<const MeshPrimitiveHandle> primitives
+        CommandBuffer& commands, GraphicsPipelineHandle pso, std::span<const MeshPrimitiveHandle> primitives,
+        bool preserve_order = false
     ) const;
+
+    /**
+     * Suballocates space for primitive IDs from the current frame's primitive ID buffer
+     *
+     * \return The buffer, and the index of the first ID in it
+     */
+    eastl::pair<BufferHandle, uint32_t> allocate_draw_primitive_ids(RenderBackend& backend, uint32_t num_ids) const;
 };
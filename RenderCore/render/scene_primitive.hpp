@@ -6,14 +6,14 @@
 #include "render/material_proxy.hpp"
 #include "shared/primitive_data.hpp"
 
+/**
+ * A mesh in the scene, with its material. Everything else about the primitive is in the scene's PrimitiveStore, at the
+ * primitive's index in the scene's primitive pool
+ */
 struct MeshPrimitive {
-    PrimitiveDataGPU data = {};
-
     MeshHandle mesh;
 
     PooledObject<BasicPbrMaterialProxy> material;
-
-    BufferHandle emissive_points_buffer = {};
 };
 
 using MeshPrimitiveHandle = PooledObject<MeshPrimitive>;
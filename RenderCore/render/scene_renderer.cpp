@@ -6,6 +6,7 @@
 #include "render/antialiasing_type.hpp"
 #include "render/indirect_drawing_utils.hpp"
 #include "render/backend/blas_build_queue.hpp"
+#include "render/backend/pipeline_cache.hpp"
 #include "render/backend/render_graph.hpp"
 #include "core/system_interface.hpp"
 #include "render/render_scene.hpp"
@@ -24,10 +25,50 @@ static auto cvar_raytrace_mesh_lights = AutoCVar_Int{
     "r.MeshLight.Raytrace", "Whether or not to raytrace mesh lights", 0
 };
 
+static auto cvar_bin_draws_by_material = AutoCVar_Int{
+    "r.GBuffer.BinDrawsByMaterial",
+    "Whether to sort the gbuffer's indirect draws by material, so that draws with the same material run together",
+    1
+};
+
 static auto cvar_anti_aliasing = AutoCVar_Enum{
     "r.AntiAliasing", "What kind of antialiasing to use", AntiAliasingType::FSR3
 };
 
+static auto cvar_dynamic_resolution = AutoCVar_Int{
+    "r.DynamicResolution.Enabled",
+    "Whether to scale the render resolution to hit a GPU frame time. Only works with an upscaler",
+    0
+};
+
+static auto cvar_dynamic_resolution_target = AutoCVar_Float{
+    "r.DynamicResolution.TargetFrameTime", "GPU frame time that dynamic resolution aims for, in milliseconds", 16.6
+};
+
+static auto cvar_dynamic_resolution_min_scale = AutoCVar_Float{
+    "r.DynamicResolution.MinScale",
+    "Smallest scale of the upscaler's optimal render resolution that we may render at. The upscaler may limit this further",
+    0.5
+};
+
+static auto cvar_dynamic_resolution_step = AutoCVar_Float{
+    "r.DynamicResolution.Step",
+    "Granularity of the resolution scale. Every change reallocates the render targets, so don't make this too fine",
+    0.05
+};
+
+static auto cvar_dynamic_resolution_p = AutoCVar_Float{
+    "r.DynamicResolution.ProportionalGain", "Proportional gain of the dynamic resolution controller", 0.3
+};
+
+static auto cvar_dynamic_resolution_i = AutoCVar_Float{
+    "r.DynamicResolution.IntegralGain", "Integral gain of the dynamic resolution controller", 0.1
+};
+
+static auto cvar_dynamic_resolution_d = AutoCVar_Float{
+    "r.DynamicResolution.DerivativeGain", "Derivative gain of the dynamic resolution controller", 0.05
+};
+
 /*
  * Quick guide to anti-aliasing quality modes:
  *
@@ -94,20 +135,55 @@ void SceneRenderer::set_scene(RenderScene& scene_in) {
     lighting_pass.set_scene(scene_in);
 }
 
-void SceneRenderer::set_render_resolution(const glm::uvec2 new_render_resolution) {
-    if(new_render_resolution == scene_render_resolution) {
+glm::uvec2 SceneRenderer::update_dynamic_resolution(const glm::uvec2 max_resolution, const glm::uvec2 min_resolution) {
+    if(cvar_dynamic_resolution.Get() == 0) {
+        dynamic_resolution.reset(1.f);
+        return max_resolution;
+    }
+
+    // The upscaler may not go as low as the cvar asks
+    const auto d_max_resolution = glm::vec2{max_resolution};
+    const auto min_scales = glm::vec2{min_resolution} / d_max_resolution;
+    const auto upscaler_min_scale = glm::max(min_scales.x, min_scales.y);
+
+    const auto settings = DynamicResolutionSettings{
+        .target_frame_time_ms = cvar_dynamic_resolution_target.GetFloat(),
+        .min_scale = glm::clamp(
+            glm::max(cvar_dynamic_resolution_min_scale.GetFloat(), upscaler_min_scale),
+            0.1f,
+            1.f),
+        .max_scale = 1.f,
+        .proportional_gain = cvar_dynamic_resolution_p.GetFloat(),
+        .integral_gain = cvar_dynamic_resolution_i.GetFloat(),
+        .derivative_gain = cvar_dynamic_resolution_d.GetFloat(),
+        .scale_step = cvar_dynamic_resolution_step.GetFloat(),
+    };
+
+    const auto scale = dynamic_resolution.update(frame_timer.get_frame_time_ms(), settings);
+    TracyPlot("Dynamic resolution scale", scale);
+
+    // Round to a multiple of 8, so the 8x8 compute dispatches don't waste threads
+    const auto scaled_resolution = glm::uvec2{glm::round(d_max_resolution * scale / 8.f) * 8.f};
+    return glm::clamp(scaled_resolution, min_resolution, max_resolution);
+}
+
+void SceneRenderer::set_render_resolution(
+    const glm::uvec2 new_render_target_resolution, const glm::uvec2 new_active_resolution
+) {
+    active_render_resolution = glm::min(new_active_resolution, new_render_target_resolution);
+    player_view.set_render_resolution(active_render_resolution, new_render_target_resolution);
+
+    if(new_render_target_resolution == scene_render_resolution) {
         return;
     }
 
-    scene_render_resolution = new_render_resolution;
+    scene_render_resolution = new_render_target_resolution;
 
     logger->info(
         "Setting resolution to {} by {}",
         scene_render_resolution.x,
         scene_render_resolution.y);
 
-    player_view.set_render_resolution(scene_render_resolution);
-
     player_view.set_perspective_projection(
         75.f,
         static_cast<float>(scene_render_resolution.x) /
@@ -135,7 +211,7 @@ void SceneRenderer::render() {
     case AntiAliasingType::None:
         vrsaa = nullptr;
         upscaler = nullptr;
-        set_render_resolution(output_resolution);
+        set_render_resolution(output_resolution, output_resolution);
         player_view.set_mip_bias(0);
         break;
 
@@ -146,7 +222,7 @@ void SceneRenderer::render() {
 
         upscaler = nullptr;
 
-        set_render_resolution(output_resolution * 2u);
+        set_render_resolution(output_resolution * 2u, output_resolution * 2u);
 
         vrsaa->init(scene_render_resolution);
         player_view.set_mip_bias(0);
@@ -178,16 +254,25 @@ void SceneRenderer::render() {
 
     cached_aa = cvar_anti_aliasing.Get();
 
+    if(AmbientOcclusionPhase::needs_motion_vectors()) {
+        needs_motion_vectors = true;
+    }
+
     if(upscaler) {
         vrsaa = nullptr;
 
         upscaler->initialize(output_resolution, frame_count);
 
+        // The scene render targets are always the upscaler's optimal size. Dynamic resolution renders into the upper
+        // left of them
         const auto optimal_render_resolution = upscaler->get_optimal_render_resolution();
-        set_render_resolution(optimal_render_resolution);
+        const auto render_resolution = update_dynamic_resolution(
+            optimal_render_resolution,
+            upscaler->get_min_render_resolution());
+        set_render_resolution(optimal_render_resolution, render_resolution);
 
         const auto d_output_resolution = glm::vec2{output_resolution};
-        const auto d_render_resolution = glm::vec2{optimal_render_resolution};
+        const auto d_render_resolution = glm::vec2{active_render_resolution};
         player_view.set_mip_bias(log2(d_render_resolution.x / d_output_resolution.x) - 1.0f);
 
         needs_motion_vectors = true;
@@ -210,6 +295,10 @@ void SceneRenderer::render() {
     }
     cached_gi_mode = cvar_gi_mode.Get();
 
+    if(cvar_gi_mode.Get() == GIMode::RT && RayTracedGlobalIllumination::needs_motion_vectors()) {
+        needs_motion_vectors = true;
+    }
+
     ui_phase.add_data_upload_passes(backend.get_upload_queue());
 
     gbuffer.depth = depth_culling_phase.get_depth_buffer();
@@ -220,7 +309,7 @@ void SceneRenderer::render() {
     player_view.update_transforms(backend.get_upload_queue());
 
     if(upscaler) {
-        upscaler->set_constants(player_view, scene_render_resolution);
+        upscaler->set_constants(player_view, active_render_resolution);
     }
 
     auto render_graph = RenderGraph{ backend };
@@ -234,6 +323,8 @@ void SceneRenderer::render() {
         }
     );
 
+    frame_timer.begin_frame(render_graph);
+
     {
         ZoneScopedN("Begin Frame");
         auto& sun = scene->get_sun_light();
@@ -287,29 +378,45 @@ void SceneRenderer::render() {
         render_graph,
         *scene,
         material_storage,
-        player_view.get_buffer());
+        player_view);
 
     const auto visible_objects_list = depth_culling_phase.get_visible_objects_buffer();
-    const auto visible_solids_buffers = translate_visibility_list_to_draw_commands(
-        render_graph,
-        visible_objects_list,
-        scene->get_primitive_buffer(),
-        scene->get_total_num_primitives(),
-        scene->get_meshes().get_draw_args_buffer(),
-        PRIMITIVE_TYPE_SOLID);
-    const auto visible_masked_buffers = translate_visibility_list_to_draw_commands(
-        render_graph,
-        visible_objects_list,
-        scene->get_primitive_buffer(),
-        scene->get_total_num_primitives(),
-        scene->get_meshes().get_draw_args_buffer(),
-        PRIMITIVE_TYPE_CUTOUT);
+    auto visible_solids_buffers = IndirectDrawingBuffers{};
+    auto visible_masked_buffers = IndirectDrawingBuffers{};
+    if(cvar_bin_draws_by_material.Get() != 0) {
+        // One pipeline bin each for solid and cutout primitives
+        const auto binned_buffers = bin_visibility_list_to_draw_commands(
+            render_graph,
+            visible_objects_list,
+            scene->get_primitive_buffer(),
+            scene->get_total_num_primitives(),
+            scene->get_meshes().get_draw_args_buffer(),
+            PRIMITIVE_TYPE_CUTOUT + 1,
+            material_storage.get_num_material_slots());
+        visible_solids_buffers = binned_buffers.get_pipeline_bin(PRIMITIVE_TYPE_SOLID);
+        visible_masked_buffers = binned_buffers.get_pipeline_bin(PRIMITIVE_TYPE_CUTOUT);
+    } else {
+        visible_solids_buffers = translate_visibility_list_to_draw_commands(
+            render_graph,
+            visible_objects_list,
+            scene->get_primitive_buffer(),
+            scene->get_total_num_primitives(),
+            scene->get_meshes().get_draw_args_buffer(),
+            PRIMITIVE_TYPE_SOLID);
+        visible_masked_buffers = translate_visibility_list_to_draw_commands(
+            render_graph,
+            visible_objects_list,
+            scene->get_primitive_buffer(),
+            scene->get_total_num_primitives(),
+            scene->get_meshes().get_draw_args_buffer(),
+            PRIMITIVE_TYPE_CUTOUT);
+    }
 
     if(needs_motion_vectors) {
         motion_vectors_phase.render(
             render_graph,
             *scene,
-            player_view.get_buffer(),
+            player_view,
             depth_culling_phase.get_depth_buffer(),
             visible_solids_buffers,
             visible_masked_buffers);
@@ -322,7 +429,7 @@ void SceneRenderer::render() {
     // Shadows
     // Render shadow pass after RSM so the shadow VS can overlap with the VPL FS
     if(DirectionalLight::get_shadow_mode() == SunShadowMode::CascadedShadowMaps) {
-        const auto& sun = scene->get_sun_light();
+        auto& sun = scene->get_sun_light();
         sun.render_shadows(render_graph, *scene);
     }
 
@@ -377,6 +484,7 @@ void SceneRenderer::render() {
             player_view,
             *scene,
             gbuffer,
+            motion_vectors_phase.get_motion_vectors(),
             stbn_3d_unitvec.layers[frame_count % stbn_3d_unitvec.num_layers]);
     }
 
@@ -387,6 +495,7 @@ void SceneRenderer::render() {
         stbn_3d_unitvec,
         gbuffer.normals,
         gbuffer.depth,
+        motion_vectors_phase.get_motion_vectors(),
         ao_handle);
 
     lighting_pass.render(
@@ -448,6 +557,8 @@ void SceneRenderer::render() {
             }
         });
 
+    frame_timer.end_frame(render_graph);
+
     render_graph.add_finish_frame_and_present_pass(
         {
             .swapchain_image = swapchain_image
@@ -460,12 +571,20 @@ void SceneRenderer::render() {
     allocator.destroy_buffer(visible_solids_buffers.commands);
     allocator.destroy_buffer(visible_solids_buffers.count);
     allocator.destroy_buffer(visible_solids_buffers.primitive_ids);
-    allocator.destroy_buffer(visible_masked_buffers.commands);
-    allocator.destroy_buffer(visible_masked_buffers.count);
-    allocator.destroy_buffer(visible_masked_buffers.primitive_ids);
+    // Binned draws keep every pipeline bin in the same buffers
+    if(visible_masked_buffers.commands != visible_solids_buffers.commands) {
+        allocator.destroy_buffer(visible_masked_buffers.commands);
+        allocator.destroy_buffer(visible_masked_buffers.count);
+        allocator.destroy_buffer(visible_masked_buffers.primitive_ids);
+    }
 
     backend.execute_graph(render_graph);
 
+    if(frame_count == 0) {
+        // Everything the first frame needs has been compiled by now
+        backend.get_pipeline_cache().report_startup_times();
+    }
+
     frame_count++;
 }
 
@@ -22,7 +22,9 @@
 #include "render/phase/lighting_phase.hpp"
 #include "render/gi/light_propagation_volume.hpp"
 #include "ui/debug_menu.hpp"
+#include "render/upscaling/dynamic_resolution_controller.hpp"
 #include "render/upscaling/upscaler.hpp"
+#include "render/backend/gpu_frame_timer.hpp"
 #include "visualizers/visualizer_type.hpp"
 
 class GltfModel;
@@ -104,8 +106,17 @@ private:
 
     glm::uvec2 output_resolution = {};
 
+    /**
+     * Size of the scene render targets
+     */
     glm::uvec2 scene_render_resolution = glm::uvec2{};
 
+    /**
+     * Size of the area of the scene render targets that we render to this frame. Smaller than the render targets when
+     * dynamic resolution lowers the resolution
+     */
+    glm::uvec2 active_render_resolution = glm::uvec2{};
+
     /**
      * Spatio-temporal blue noise texture, containing 3D vectors in a unit sphere
      */
@@ -158,9 +169,28 @@ private:
 
     AntiAliasingType cached_aa = AntiAliasingType::None;
 
+    GpuFrameTimer frame_timer;
+
+    DynamicResolutionController dynamic_resolution;
+
     uint32_t frame_count = 0;
 
-    void set_render_resolution(glm::uvec2 new_render_resolution);
+    /**
+     * Sets the size of the scene render targets, and how much of them we render to. Only reallocates the render
+     * targets when their size changes, so that dynamic resolution doesn't throw away the temporal histories
+     *
+     * \param new_render_target_resolution Size of the scene render targets
+     * \param new_active_resolution Size of the area of the render targets to render to this frame
+     */
+    void set_render_resolution(glm::uvec2 new_render_target_resolution, glm::uvec2 new_active_resolution);
+
+    /**
+     * Picks this frame's render resolution from the GPU frame time, if dynamic resolution is enabled
+     *
+     * \param max_resolution Resolution to render at when the GPU keeps up
+     * \param min_resolution Smallest resolution that we may render at
+     */
+    glm::uvec2 update_dynamic_resolution(glm::uvec2 max_resolution, glm::uvec2 min_resolution);
 
     void create_scene_render_targets();
 
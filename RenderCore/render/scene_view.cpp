@@ -30,14 +30,21 @@ SceneView::SceneView() {
     auto& backend = RenderBackend::get();
     auto& allocator = backend.get_global_allocator();
     buffer = allocator.create_buffer("Scene View Buffer", sizeof(ViewDataGPU), BufferUsage::UniformBuffer);
+
+    gpu_data.render_resolution_scale = float2{1};
 }
 
-void SceneView::set_render_resolution(const glm::uvec2 render_resolution) {
+void SceneView::set_render_resolution(const glm::uvec2 render_resolution, const glm::uvec2 render_target_resolution) {
     gpu_data.render_resolution.x = static_cast<float>(render_resolution.x);
     gpu_data.render_resolution.y = static_cast<float>(render_resolution.y);
+    gpu_data.render_resolution_scale = gpu_data.render_resolution / float2{render_target_resolution};
     is_dirty = true;
 }
 
+glm::uvec2 SceneView::get_render_resolution() const {
+    return glm::uvec2{gpu_data.render_resolution};
+}
+
 void SceneView::translate(const glm::vec3 localspace_movement) {
     const auto worldspace_movement = gpu_data.inverse_view * glm::vec4{localspace_movement, 0.f};
     position += glm::vec3{worldspace_movement};
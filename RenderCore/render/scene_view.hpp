@@ -17,7 +17,16 @@ class SceneView {
 public:
     explicit SceneView();
 
-    void set_render_resolution(glm::uvec2 render_resolution);
+    /**
+     * Sets the resolution that we render at
+     *
+     * \param render_resolution Size of the area of the render targets that we render to
+     * \param render_target_resolution Size of the render targets. Dynamic resolution renders into the upper left of
+     * them
+     */
+    void set_render_resolution(glm::uvec2 render_resolution, glm::uvec2 render_target_resolution);
+
+    glm::uvec2 get_render_resolution() const;
     
     void translate(glm::vec3 localspace_movement);
 
@@ -78,6 +78,10 @@ glm::uvec2 DLSSAdapter::get_optimal_render_resolution() const {
     return glm::uvec2{dlss_settings.optimalRenderWidth, dlss_settings.optimalRenderHeight};
 }
 
+glm::uvec2 DLSSAdapter::get_min_render_resolution() const {
+    return glm::uvec2{dlss_settings.renderWidthMin, dlss_settings.renderHeightMin};
+}
+
 void DLSSAdapter::set_constants(const SceneView& scene_transform, const glm::uvec2 render_resolution) {
     const auto& view_data = scene_transform.get_gpu_data();
 
@@ -104,6 +108,8 @@ void DLSSAdapter::set_constants(const SceneView& scene_transform, const glm::uve
         1.f / static_cast<float>(render_resolution.x), 1.f / static_cast<float>(render_resolution.y)
     };
 
+    render_extent = sl::Extent{.top = 0, .left = 0, .width = render_resolution.x, .height = render_resolution.y};
+
     constants.cameraPinholeOffset = {0, 0};
 
     const auto camera_pos = scene_transform.get_position();
@@ -205,34 +211,43 @@ void DLSSAdapter::evaluate(
                 tags.emplace_back(
                     &color_in_res,
                     sl::kBufferTypeScalingInputColor,
-                    sl::ResourceLifecycle::eValidUntilPresent);
+                    sl::ResourceLifecycle::eValidUntilPresent,
+                    &render_extent);
                 tags.emplace_back(
                     &color_out_res,
                     sl::kBufferTypeScalingOutputColor,
                     sl::ResourceLifecycle::eValidUntilPresent);
-                tags.emplace_back(&depth_in_res, sl::kBufferTypeDepth, sl::ResourceLifecycle::eValidUntilPresent);
+                tags.emplace_back(
+                    &depth_in_res,
+                    sl::kBufferTypeDepth,
+                    sl::ResourceLifecycle::eValidUntilPresent,
+                    &render_extent);
                 tags.emplace_back(
                     &motion_vectors_in_res,
                     sl::kBufferTypeMotionVectors,
-                    sl::ResourceLifecycle::eValidUntilPresent);
+                    sl::ResourceLifecycle::eValidUntilPresent,
+                    &render_extent);
 
                 if(diffuse_albedo != nullptr) {
                     tags.emplace_back(
                         &sl_diffuse_albedo,
                         sl::kBufferTypeAlbedo,
-                        sl::ResourceLifecycle::eValidUntilPresent);
+                        sl::ResourceLifecycle::eValidUntilPresent,
+                        &render_extent);
                 }
                 if(specular_albedo != nullptr) {
                     tags.emplace_back(
                         &sl_specular_albedo,
                         sl::kBufferTypeSpecularAlbedo,
-                        sl::ResourceLifecycle::eValidUntilPresent);
+                        sl::ResourceLifecycle::eValidUntilPresent,
+                        &render_extent);
                 }
                 if(packed_normals_roughness != nullptr) {
                     tags.emplace_back(
                         &sl_normals_roughness,
                         sl::kBufferTypeNormalRoughness,
-                        sl::ResourceLifecycle::eValidUntilPresent);
+                        sl::ResourceLifecycle::eValidUntilPresent,
+                        &render_extent);
                 }
 
                 slSetTag(viewport, tags.data(), static_cast<uint32_t>(tags.size()), commands.get_vk_commands());
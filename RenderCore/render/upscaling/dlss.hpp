@@ -23,6 +23,8 @@ public:
 
     glm::uvec2 get_optimal_render_resolution() const override;
 
+    glm::uvec2 get_min_render_resolution() const override;
+
     void set_constants(const SceneView& scene_transform, glm::uvec2 render_resolution) override;
 
     void evaluate(
@@ -41,6 +43,11 @@ private:
 
     sl::FrameToken* frame_token = nullptr;
 
+    /**
+     * Area of the render resolution inputs that we rendered to. Dynamic resolution makes this smaller than the inputs
+     */
+    sl::Extent render_extent = {};
+
     TextureHandle diffuse_albedo = nullptr;
     TextureHandle specular_albedo = nullptr;
     TextureHandle packed_normals_roughness = nullptr;
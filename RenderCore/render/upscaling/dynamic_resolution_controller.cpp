@@ -0,0 +1,73 @@
+#include "dynamic_resolution_controller.hpp"
+
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
+
+DynamicResolutionController::DynamicResolutionController(const float initial_scale) :
+    raw_scale{initial_scale}, quantized_scale{initial_scale} {}
+
+float DynamicResolutionController::update(const float gpu_frame_time_ms, const DynamicResolutionSettings& settings) {
+    if(gpu_frame_time_ms <= 0.f || settings.target_frame_time_ms <= 0.f) {
+        return quantized_scale;
+    }
+
+    frames_since_change++;
+
+    // Cost scales with the pixel count, so the scale that would hit the target is scale * sqrt(target / time). Turn
+    // that into a relative error in linear scale
+    auto error = glm::sqrt(settings.target_frame_time_ms / gpu_frame_time_ms) - 1.f;
+    if(glm::abs(error) < settings.dead_band) {
+        error = 0;
+    }
+
+    // Velocity form of the PID controller - we compute the change in scale, not the scale. The output is clamped to the
+    // scale bounds, so the integral can't wind up
+    const auto previous = has_previous_error ? previous_errors[0] : error;
+    const auto previous2 = has_previous_error ? previous_errors[1] : error;
+    previous_errors[1] = previous;
+    previous_errors[0] = error;
+    has_previous_error = true;
+
+    auto adjustment = settings.proportional_gain * (error - previous) + settings.integral_gain * error +
+        settings.derivative_gain * (error - 2.f * previous + previous2);
+
+    // The P and D terms push back when the error shrinks, even if the frame time is still off in the same direction.
+    // Coming back from a spike with the scale pinned at a bound, that would move the scale away from the target, and
+    // we'd wait out another cooldown to undo it. Only ever move towards the target
+    if(error > 0.f) {
+        adjustment = glm::max(adjustment, 0.f);
+    } else if(error < 0.f) {
+        adjustment = glm::min(adjustment, 0.f);
+    } else {
+        adjustment = 0.f;
+    }
+    raw_scale = glm::clamp(raw_scale * (1.f + adjustment), settings.min_scale, settings.max_scale);
+
+    const auto step = glm::max(settings.scale_step, 0.001f);
+    const auto distance = raw_scale - quantized_scale;
+    const auto can_increase = frames_since_change >= settings.increase_cooldown_frames;
+    if(distance <= -step || (distance >= step && can_increase)) {
+        quantized_scale = glm::clamp(
+            glm::round(raw_scale / step) * step,
+            settings.min_scale,
+            settings.max_scale);
+        frames_since_change = 0;
+    }
+
+    // The bounds may have changed since the last change
+    quantized_scale = glm::clamp(quantized_scale, settings.min_scale, settings.max_scale);
+
+    return quantized_scale;
+}
+
+float DynamicResolutionController::get_scale() const {
+    return quantized_scale;
+}
+
+void DynamicResolutionController::reset(const float scale) {
+    raw_scale = scale;
+    quantized_scale = scale;
+    previous_errors = {};
+    has_previous_error = false;
+    frames_since_change = 0;
+}
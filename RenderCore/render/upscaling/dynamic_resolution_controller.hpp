@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+
+#include <EASTL/array.h>
+
+/**
+ * Tuning for the dynamic resolution controller
+ */
+struct DynamicResolutionSettings {
+    /**
+     * GPU frame time that we try to hit, in milliseconds
+     */
+    float target_frame_time_ms = 16.6f;
+
+    float min_scale = 0.5f;
+
+    float max_scale = 1.f;
+
+    /**
+     * PID gains. The error is the relative change in scale that would hit the target frame time
+     */
+    float proportional_gain = 0.3f;
+    float integral_gain = 0.1f;
+    float derivative_gain = 0.05f;
+
+    /**
+     * Errors smaller than this are ignored, so that a frame time that sits near the target doesn't make the scale
+     * wander
+     */
+    float dead_band = 0.05f;
+
+    /**
+     * The scale we hand out is quantized to this step. Every change makes the temporal passes reproject their history
+     * across resolutions, so we only do that when the controller has moved a whole step away
+     */
+    float scale_step = 0.05f;
+
+    /**
+     * Number of frames to wait after a change before we raise the scale again. Lowering it is never delayed, so that
+     * we react to spikes right away
+     */
+    uint32_t increase_cooldown_frames = 30;
+};
+
+/**
+ * Picks a render resolution scale from the GPU frame time
+ *
+ * This is a PID controller on the frame time error. Render cost is roughly proportional to the number of pixels, so
+ * the error is converted to a relative change in linear scale before the gains are applied. Hysteresis comes from
+ * the dead band around the target, from quantizing the output, and from the cooldown on increases. The controller only
+ * ever moves the scale towards the target, so it doesn't hunt around it
+ *
+ * The controller doesn't know about the GPU, so it can be driven by synthetic frame time traces
+ */
+class DynamicResolutionController {
+public:
+    explicit DynamicResolutionController(float initial_scale = 1.f);
+
+    /**
+     * Feeds one frame's GPU time to the controller
+     *
+     * \return The quantized scale to render the next frame at
+     */
+    float update(float gpu_frame_time_ms, const DynamicResolutionSettings& settings);
+
+    /**
+     * Returns the quantized scale from the most recent update
+     */
+    float get_scale() const;
+
+    /**
+     * Jumps to a scale, and forgets the controller's history
+     */
+    void reset(float scale);
+
+private:
+    /**
+     * Unquantized output of the controller
+     */
+    float raw_scale;
+
+    float quantized_scale;
+
+    /**
+     * Errors from the last two frames, most recent first
+     */
+    eastl::array<float, 2> previous_errors = {};
+
+    bool has_previous_error = false;
+
+    uint32_t frames_since_change = 0;
+};
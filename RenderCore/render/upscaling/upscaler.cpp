@@ -1,5 +1,9 @@
 #include "upscaler.hpp"
 
+glm::uvec2 IUpscaler::get_min_render_resolution() const {
+    return get_optimal_render_resolution() / 2u;
+}
+
 glm::vec2 IUpscaler::get_jitter() {
     return glm::vec2{jitter_sequence_x.get_next_value(), jitter_sequence_y.get_next_value()};
 }
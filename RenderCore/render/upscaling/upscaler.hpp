@@ -17,6 +17,12 @@ public:
 
     virtual glm::uvec2 get_optimal_render_resolution() const = 0;
 
+    /**
+     * Smallest render resolution that the upscaler accepts for the current output resolution. Dynamic resolution
+     * scales between this and the optimal render resolution
+     */
+    virtual glm::uvec2 get_min_render_resolution() const;
+
     virtual void set_constants(const SceneView& scene_view, glm::uvec2 render_resolution) = 0;
 
     virtual glm::vec2 get_jitter();
@@ -164,6 +164,10 @@ glm::uvec2 XeSSAdapter::get_optimal_render_resolution() const {
     return {optimal_input_resolution.x, optimal_input_resolution.y};
 }
 
+glm::uvec2 XeSSAdapter::get_min_render_resolution() const {
+    return {min_input_resolution.x, min_input_resolution.y};
+}
+
 void XeSSAdapter::set_constants(const SceneView& scene_view, const glm::uvec2 render_resolution) {
     const auto jitter = scene_view.get_jitter();
     params.jitterOffsetX = -jitter.x;
@@ -41,6 +41,8 @@ public:
 
     glm::uvec2 get_optimal_render_resolution() const override;
 
+    glm::uvec2 get_min_render_resolution() const override;
+
     void set_constants(const SceneView& scene_view, glm::uvec2 render_resolution) override;
 
     void evaluate(
@@ -39,16 +39,8 @@ mediump vec3 blur(const vec2 uv, const float mip_level) {
 }
 
 mediump vec3 sample_bloom_chain(vec2 texcoord) {
-    vec2 texture_size = textureSize(bloom_chain, 0);
-    vec2 half_texel = vec2(1.0) / texture_size;
-    mediump vec3 result = vec3(0);
-
-    for(float mip_level = 0; mip_level < 6.0; mip_level += 1) {
-        mediump vec3 bloom_sample = blur(texcoord, mip_level);
-        result += bloom_sample;
-    }
-
-    return result;
+    // The bloom upsample chain has already added every mip into mip 0
+    return blur(texcoord, 0);
 }
 
 mediump float to_luminance(const mediump vec3 color) { return color.r * 0.2126 + color.g * 0.7152 + color.b * 0.0722; }
@@ -0,0 +1,35 @@
+#ifndef EMISSIVE_POINTS_HPP
+#define EMISSIVE_POINTS_HPP
+
+#include "shared/prelude.h"
+
+#if defined(__cplusplus)
+using PointCloudPointer = uint64_t;
+
+#elif defined(GL_core_profile)
+#define PointCloudPointer uvec2
+
+#else
+#define PointCloudPointer uint64_t
+#endif
+
+/**
+ * Where one emissive primitive's VPLs live in the scene's emissive point buffer
+ *
+ * The VPLs are in worldspace, so the bounds are the primitive's world bounds when the VPLs were generated
+ */
+struct EmissivePointRange {
+    float3 bounds_min;
+    uint first_point;
+
+    float3 bounds_max;
+    uint num_points;
+
+    // The mesh's point cloud
+    PointCloudPointer point_cloud;
+
+    uint primitive_id;
+    uint padding;
+};
+
+#endif
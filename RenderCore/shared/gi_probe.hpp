@@ -5,6 +5,13 @@
 struct ProbeCascade {
     float3 min;
     float probe_spacing;
+
+    /**
+     * Texture index of the probe at min. The probe textures wrap around, so that scrolling the cascade doesn't move
+     * any probe data
+     */
+    uint3 scroll_offset;
+    uint padding;
 };
 
 struct IrradianceProbeVolume {
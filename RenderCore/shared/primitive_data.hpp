@@ -7,6 +7,9 @@
 #define PRIMITIVE_TYPE_CUTOUT 1
 #define PRIMITIVE_TYPE_TRANSPARENT 2
 
+// The primitive may move. Dynamic primitives are kept out of cached shadows
+#define PRIMITIVE_FLAG_DYNAMIC 0x1
+
 #if defined(__cplusplus)
 using MaterialPointer = uint64_t;
 using IndexPointer = uint64_t;
@@ -42,6 +45,9 @@ struct PrimitiveDataGPU {
     uint mesh_id;
     uint type;  // See the PRIMITIVE_TYPE_ defines above
 
+    uint flags; // See the PRIMITIVE_FLAG_ defines above
+    uint material_id;   // Index of the material in MaterialStorage. Used to bin draws by material
+
     IndexPointer indices;
     VertexPositionPointer vertex_positions;
     VertexDataPointer vertex_data;
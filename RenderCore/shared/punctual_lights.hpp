@@ -0,0 +1,90 @@
+#ifndef PUNCTUAL_LIGHTS_HPP
+#define PUNCTUAL_LIGHTS_HPP
+
+#include "shared/prelude.h"
+
+#define PUNCTUAL_LIGHT_TYPE_POINT 0
+#define PUNCTUAL_LIGHT_TYPE_SPOT  1
+
+/**
+ * Size of the light cluster grid. The grid covers the view frustum. X and Y are evenly spaced in screen space, Z is
+ * spaced exponentially in view depth
+ */
+#define LIGHT_CLUSTERS_X 16
+#define LIGHT_CLUSTERS_Y 9
+#define LIGHT_CLUSTERS_Z 24
+#define NUM_LIGHT_CLUSTERS (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z)
+
+/**
+ * Most lights that can affect one cluster. Each cluster owns this many slots in the light index buffer. Lights past
+ * this are dropped
+ */
+#define MAX_LIGHTS_PER_CLUSTER 256
+
+/**
+ * A point or spot light
+ */
+struct PunctualLightGPU {
+    /**
+     * Worldspace position
+     */
+    float3 position;
+
+    /**
+     * Distance past which the light has no effect
+     */
+    float range;
+
+    /**
+     * HDR light color. Luminous intensity times the color of the light
+     */
+    float3 color;
+
+    /**
+     * See PUNCTUAL_LIGHT_TYPE_ above
+     */
+    uint type;
+
+    /**
+     * Worldspace direction of spot lights
+     */
+    float3 direction;
+
+    /**
+     * Cosine of a spot light's outer cone angle. Nothing outside the outer cone is lit
+     */
+    float cos_outer_angle;
+
+    /**
+     * Cosine of a spot light's inner cone angle. Everything inside the inner cone is fully lit
+     */
+    float cos_inner_angle;
+
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+/**
+ * Constants for culling lights to clusters, and for finding a pixel's cluster
+ */
+struct LightClusterConstants {
+    /**
+     * View depth where the first slice starts. Same as the view's near plane
+     */
+    float z_near;
+
+    /**
+     * View depth where the last slice ends. Pixels past it don't get punctual lighting
+     */
+    float z_far;
+
+    /**
+     * LIGHT_CLUSTERS_Z / log(z_far / z_near). Lets us find a depth's slice with one log and one multiply
+     */
+    float slice_scale;
+
+    uint num_lights;
+};
+
+#endif
@@ -37,6 +37,12 @@ struct ViewDataGPU {
     float2 jitter;
 
     float2 previous_jitter;
+
+    /**
+     * Fraction of the scene render targets that we render to this frame. render_resolution is the size of that area.
+     * Multiply a screen UV by this before sampling a scene render target with it
+     */
+    float2 render_resolution_scale;
 };
 
 #endif
@@ -0,0 +1,366 @@
+#include <cmath>
+
+#include <catch2/catch_test_macros.hpp>
+#include <EASTL/algorithm.h>
+#include <EASTL/vector.h>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/matrix.hpp>
+
+#include "render/clustered_light_culler.hpp"
+
+namespace {
+    constexpr auto z_near = 0.1f;
+
+    constexpr auto z_far = 50.f;
+
+    /**
+     * Number of points along each axis of a cluster that the brute force test checks
+     */
+    constexpr auto samples_per_axis = 7u;
+
+    /**
+     * A view that doesn't line up with the world axes, so that the culler has to transform the lights
+     */
+    ViewDataGPU make_view() {
+        auto view = ViewDataGPU{};
+        view.view = glm::lookAt(float3{3, 2, 5}, float3{-1, 0.5f, -10}, float3{0, 1, 0});
+        view.inverse_view = glm::inverse(view.view);
+
+        // Same projection as SceneView: infinite far plane, reversed Z
+        constexpr auto aspect = 16.f / 9.f;
+        const auto tan_half_fov_y = 1.f / std::tan(glm::radians(75.f) * 0.5f);
+        view.projection = float4x4{0.f};
+        view.projection[0][0] = tan_half_fov_y / aspect;
+        view.projection[1][1] = tan_half_fov_y;
+        view.projection[2][3] = -1.f;
+        view.projection[3][2] = z_near;
+        view.inverse_projection = glm::inverse(view.projection);
+
+        view.z_near = z_near;
+
+        return view;
+    }
+
+    LightClusterConstants make_constants(const uint32_t num_lights) {
+        return LightClusterConstants{
+            .z_near = z_near,
+            .z_far = z_far,
+            .slice_scale = static_cast<float>(LIGHT_CLUSTERS_Z) / std::log(z_far / z_near),
+            .num_lights = num_lights,
+        };
+    }
+
+    float get_slice_depth(const float slice) {
+        return z_near * std::pow(z_far / z_near, slice / LIGHT_CLUSTERS_Z);
+    }
+
+    /**
+     * Viewspace position of a point in the cluster grid. Integer coordinates are on the cluster boundaries
+     */
+    float3 get_viewspace_grid_position(const ViewDataGPU& view, const float3 grid_position) {
+        const auto ndc_xy = float2{grid_position} / float2{LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y} * 2.f - 1.f;
+        const auto view_depth = get_slice_depth(grid_position.z);
+
+        const auto viewspace_position = view.inverse_projection * float4{ndc_xy, z_near / view_depth, 1.f};
+        return float3{viewspace_position} / viewspace_position.w;
+    }
+
+    float3 get_grid_position(const ViewDataGPU& view, const float3 grid_position) {
+        return float3{view.inverse_view * float4{get_viewspace_grid_position(view, grid_position), 1.f}};
+    }
+
+    bool is_lit(const PunctualLightGPU& light, const float3& position) {
+        const auto to_position = position - light.position;
+        const auto distance = glm::length(to_position);
+        if(distance > light.range) {
+            return false;
+        }
+
+        if(light.type != PUNCTUAL_LIGHT_TYPE_SPOT) {
+            return true;
+        }
+
+        // A spot's apex has no direction from the light. A cluster that touches the cone only at its apex may or may
+        // not get the light, depending on rounding
+        if(distance == 0.f) {
+            return false;
+        }
+
+        return glm::dot(to_position / distance, light.direction) >= light.cos_outer_angle;
+    }
+
+    /**
+     * Whether any of a grid of points in the cluster is lit. Points on the cluster's boundary count, so a light that
+     * only touches the boundary between two clusters must be in both
+     */
+    bool does_light_touch_cluster(const PunctualLightGPU& light, const ViewDataGPU& view, const uint3 cluster) {
+        for(auto z = 0u; z < samples_per_axis; z++) {
+            for(auto y = 0u; y < samples_per_axis; y++) {
+                for(auto x = 0u; x < samples_per_axis; x++) {
+                    const auto offset = float3{x, y, z} / static_cast<float>(samples_per_axis - 1);
+                    if(is_lit(light, get_grid_position(view, float3{cluster} + offset))) {
+                        return true;
+                    }
+                }
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Whether the light's range reaches the cluster's viewspace bounding box. Clusters are frustum shaped, so near the
+     * edges of the screen their boxes reach a couple of tiles past them
+     */
+    bool does_light_reach_cluster_bounds(const PunctualLightGPU& light, const ViewDataGPU& view, const uint3 cluster) {
+        auto bounds_min = get_viewspace_grid_position(view, float3{cluster});
+        auto bounds_max = bounds_min;
+        for(auto corner = 1u; corner < 8; corner++) {
+            const auto offset = uint3{corner & 1, (corner >> 1) & 1, (corner >> 2) & 1};
+            const auto position = get_viewspace_grid_position(view, float3{cluster + offset});
+            bounds_min = glm::min(bounds_min, position);
+            bounds_max = glm::max(bounds_max, position);
+        }
+
+        const auto light_position = float3{view.view * float4{light.position, 1.f}};
+        const auto closest_point = glm::clamp(light_position, bounds_min, bounds_max);
+
+        // A little slack for rounding
+        return glm::length(closest_point - light_position) <= light.range * 1.001f;
+    }
+
+    uint32_t get_cluster_index(const uint3 cluster) {
+        return cluster.x + cluster.y * LIGHT_CLUSTERS_X + cluster.z * LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y;
+    }
+
+    /**
+     * Culled lights, and which clusters each light is in
+     */
+    struct CullResult {
+        eastl::vector<uint32_t> counts;
+
+        eastl::vector<uint32_t> indices;
+
+        bool contains(const uint3 cluster, const uint32_t light_index) const {
+            const auto cluster_index = get_cluster_index(cluster);
+            const auto first_slot = indices.begin() + cluster_index * MAX_LIGHTS_PER_CLUSTER;
+            const auto last_slot = first_slot + counts[cluster_index];
+            return eastl::find(first_slot, last_slot, light_index) != last_slot;
+        }
+
+        /**
+         * Clusters that hold the light
+         */
+        eastl::vector<uint3> get_clusters(const uint32_t light_index) const {
+            auto clusters = eastl::vector<uint3>{};
+            for_each_cluster(
+                [&](const uint3 cluster) {
+                    if(contains(cluster, light_index)) {
+                        clusters.push_back(cluster);
+                    }
+                });
+            return clusters;
+        }
+
+        template<typename FunctionType>
+        static void for_each_cluster(FunctionType&& function) {
+            for(auto z = 0u; z < LIGHT_CLUSTERS_Z; z++) {
+                for(auto y = 0u; y < LIGHT_CLUSTERS_Y; y++) {
+                    for(auto x = 0u; x < LIGHT_CLUSTERS_X; x++) {
+                        function(uint3{x, y, z});
+                    }
+                }
+            }
+        }
+    };
+
+    CullResult cull(const eastl::vector<PunctualLightGPU>& lights, const ViewDataGPU& view) {
+        auto result = CullResult{};
+        ClusteredLightCuller::cull_lights_cpu(
+            lights,
+            view,
+            make_constants(static_cast<uint32_t>(lights.size())),
+            result.counts,
+            result.indices);
+
+        REQUIRE(result.counts.size() == NUM_LIGHT_CLUSTERS);
+        REQUIRE(result.indices.size() == NUM_LIGHT_CLUSTERS * MAX_LIGHTS_PER_CLUSTER);
+
+        return result;
+    }
+
+    PunctualLightGPU make_point_light(const float3& position, const float range) {
+        auto light = PunctualLightGPU{};
+        light.position = position;
+        light.range = range;
+        light.color = float3{1};
+        light.type = PUNCTUAL_LIGHT_TYPE_POINT;
+        return light;
+    }
+
+    PunctualLightGPU make_spot_light(
+        const float3& position, const float range, const float3& direction, const float outer_angle_degrees
+    ) {
+        auto light = make_point_light(position, range);
+        light.type = PUNCTUAL_LIGHT_TYPE_SPOT;
+        light.direction = glm::normalize(direction);
+        light.cos_outer_angle = std::cos(glm::radians(outer_angle_degrees));
+        light.cos_inner_angle = std::cos(glm::radians(outer_angle_degrees * 0.5f));
+        return light;
+    }
+
+    /**
+     * Checks the culled clusters against the brute force test. Culling is conservative, so every cluster that the
+     * light touches must have it. It may have clusters that the light doesn't touch, but only ones whose bounding box
+     * is in the light's range
+     */
+    void check_against_brute_force(
+        const eastl::vector<PunctualLightGPU>& lights, const ViewDataGPU& view, const CullResult& result
+    ) {
+        for(auto light_index = 0u; light_index < lights.size(); light_index++) {
+            const auto& light = lights[light_index];
+
+            CullResult::for_each_cluster(
+                [&](const uint3 cluster) {
+                    if(result.contains(cluster, light_index)) {
+                        REQUIRE(does_light_reach_cluster_bounds(light, view, cluster));
+                    } else {
+                        REQUIRE_FALSE(does_light_touch_cluster(light, view, cluster));
+                    }
+                });
+        }
+    }
+}
+
+TEST_CASE("Lights on cluster edges are in every cluster they touch", "[clustered_light_culler]") {
+    const auto view = make_view();
+
+    // Grid corners and edges, where four or eight clusters meet
+    const auto corner = get_grid_position(view, float3{4, 3, 10});
+    const auto x_edge = get_grid_position(view, float3{9, 5.5f, 14});
+    const auto z_edge = get_grid_position(view, float3{12.5f, 6.5f, 7});
+    const auto frustum_edge = get_grid_position(view, float3{0, 2.5f, 12});
+
+    // Point lights much smaller than a cluster, and ones that reach a few clusters away
+    const auto small_range = glm::length(corner - get_grid_position(view, float3{4.1f, 3.1f, 10.1f}));
+    const auto large_range = small_range * 30.f;
+
+    const auto view_forward = -float3{view.inverse_view[2]};
+    const auto view_right = float3{view.inverse_view[0]};
+
+    const auto lights = eastl::vector<PunctualLightGPU>{
+        make_point_light(corner, small_range),
+        make_point_light(corner, large_range),
+        make_point_light(x_edge, small_range),
+        make_point_light(z_edge, small_range),
+        make_point_light(frustum_edge, small_range),
+        make_point_light(frustum_edge, large_range),
+
+        // Spots along the view axis, across it, and back at the camera. The cone's edge runs along cluster boundaries
+        make_spot_light(corner, large_range, view_forward, 20.f),
+        make_spot_light(corner, large_range, -view_forward, 20.f),
+        make_spot_light(x_edge, large_range, view_right, 35.f),
+        make_spot_light(z_edge, large_range, view_right + view_forward, 60.f),
+        make_spot_light(frustum_edge, large_range, view_right, 10.f),
+
+        // A narrow spot is a thin line through the clusters, and a wide one is nearly a hemisphere
+        make_spot_light(corner, large_range, view_forward + float3{0, 1, 0}, 2.f),
+        make_spot_light(z_edge, large_range, -view_right, 85.f),
+    };
+
+    const auto result = cull(lights, view);
+    check_against_brute_force(lights, view, result);
+
+    // The cone test takes clusters away. A spot pointing away from the camera doesn't light the clusters between it
+    // and the camera
+    const auto point_clusters = result.get_clusters(1);
+    const auto forward_spot_clusters = result.get_clusters(6);
+    const auto backward_spot_clusters = result.get_clusters(7);
+    REQUIRE(forward_spot_clusters.size() < point_clusters.size());
+    REQUIRE(backward_spot_clusters.size() < point_clusters.size());
+    for(const auto cluster : forward_spot_clusters) {
+        REQUIRE(cluster.z >= 9);
+    }
+    for(const auto cluster : backward_spot_clusters) {
+        REQUIRE(cluster.z <= 10);
+    }
+}
+
+TEST_CASE("Lights that overflow a cluster are dropped", "[clustered_light_culler]") {
+    const auto view = make_view();
+
+    const auto corner = get_grid_position(view, float3{4, 3, 10});
+    const auto small_range = glm::length(corner - get_grid_position(view, float3{4.1f, 3.1f, 10.1f}));
+
+    // Hundreds of lights on the same spot, so the clusters around it overflow. One more light off on its own, after
+    // them in the light list
+    constexpr auto num_overlapping_lights = MAX_LIGHTS_PER_CLUSTER + 50u;
+    auto lights = eastl::vector<PunctualLightGPU>(num_overlapping_lights, make_point_light(corner, small_range));
+    const auto lone_position = get_grid_position(view, float3{12.5f, 6.5f, 15.5f});
+    lights.push_back(make_point_light(lone_position, small_range));
+
+    const auto result = cull(lights, view);
+
+    const auto overflowing_cluster = uint3{4, 3, 10};
+    const auto overflowing_index = get_cluster_index(overflowing_cluster);
+    REQUIRE(result.counts[overflowing_index] == MAX_LIGHTS_PER_CLUSTER);
+
+    // Every slot holds a different light that touches the cluster
+    auto slots = eastl::vector<uint32_t>(
+        result.indices.begin() + overflowing_index * MAX_LIGHTS_PER_CLUSTER,
+        result.indices.begin() + (overflowing_index + 1) * MAX_LIGHTS_PER_CLUSTER);
+    eastl::sort(slots.begin(), slots.end());
+    REQUIRE(eastl::unique(slots.begin(), slots.end()) == slots.end());
+    for(const auto light_index : slots) {
+        REQUIRE(light_index < num_overlapping_lights);
+    }
+
+    // Overflowing one cluster doesn't take anything from the others
+    const auto lone_clusters = result.get_clusters(num_overlapping_lights);
+    REQUIRE(eastl::find(lone_clusters.begin(), lone_clusters.end(), uint3{12, 6, 15}) != lone_clusters.end());
+    REQUIRE_FALSE(result.contains(overflowing_cluster, num_overlapping_lights));
+    const auto lone_light = eastl::vector<PunctualLightGPU>{lights.back()};
+    check_against_brute_force(lone_light, view, cull(lone_light, view));
+    CullResult::for_each_cluster(
+        [&](const uint3 cluster) {
+            REQUIRE(result.counts[get_cluster_index(cluster)] <= MAX_LIGHTS_PER_CLUSTER);
+        });
+
+    // Without the overflow, the light is in every cluster around the corner
+    const auto single_light = eastl::vector<PunctualLightGPU>{lights[0]};
+    check_against_brute_force(single_light, view, cull(single_light, view));
+}
+
+TEST_CASE("Lights past the far plane are in no cluster", "[clustered_light_culler]") {
+    const auto view = make_view();
+
+    const auto view_forward = -float3{view.inverse_view[2]};
+    const auto camera_position = float3{view.inverse_view[3]};
+    constexpr auto range = 2.f;
+
+    // On the view axis, so the distance from the camera is the view depth
+    const auto lights = eastl::vector<PunctualLightGPU>{
+        // Entirely past the far plane
+        make_point_light(camera_position + view_forward * (z_far + range * 1.5f), range),
+        make_spot_light(camera_position + view_forward * (z_far + range * 1.5f), range * 10.f, view_forward, 30.f),
+
+        // Straddling the far plane
+        make_point_light(camera_position + view_forward * (z_far + range * 0.5f), range),
+
+        // Behind the camera
+        make_point_light(camera_position - view_forward * range * 1.5f, range),
+    };
+
+    const auto result = cull(lights, view);
+    check_against_brute_force(lights, view, result);
+
+    REQUIRE(result.get_clusters(0).empty());
+    REQUIRE(result.get_clusters(1).empty());
+    REQUIRE(result.get_clusters(3).empty());
+
+    const auto straddling_clusters = result.get_clusters(2);
+    REQUIRE_FALSE(straddling_clusters.empty());
+    for(const auto cluster : straddling_clusters) {
+        REQUIRE(cluster.z == LIGHT_CLUSTERS_Z - 1);
+    }
+}
@@ -0,0 +1,191 @@
+#include <bit>
+
+#include <catch2/catch_test_macros.hpp>
+#include <EASTL/array.h>
+
+#include "render/backend/constants.hpp"
+#include "render/backend/descriptor_set_cache.hpp"
+
+namespace {
+    template <typename VulkanType>
+    VulkanType make_fake_handle(const uint64_t value) {
+        return std::bit_cast<VulkanType>(value);
+    }
+
+    /**
+     * Hands out fake descriptor sets, and counts how often the cache asks for new sets and writes
+     */
+    class StubWriter final : public DescriptorSetWriter {
+    public:
+        VkDescriptorSetLayout layout = make_fake_handle<VkDescriptorSetLayout>(0x100);
+
+        bool should_fail_allocations = false;
+
+        uint32_t num_allocations = 0;
+
+        uint32_t num_writes = 0;
+
+        VkDescriptorSetLayout get_layout() override {
+            return layout;
+        }
+
+        VkDescriptorSet allocate_and_write() override {
+            if(should_fail_allocations) {
+                return VK_NULL_HANDLE;
+            }
+
+            num_allocations++;
+            num_writes++;
+            return make_fake_handle<VkDescriptorSet>(0x1000 + num_allocations);
+        }
+
+        void write(VkDescriptorSet) override {
+            num_writes++;
+        }
+    };
+
+    constexpr uint64_t first_resource = 0xA000;
+
+    constexpr uint64_t second_resource = 0xB000;
+
+    DescriptorSetKey make_key(const uint64_t resource) {
+        return DescriptorSetKey{static_cast<uint64_t>(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) << 32, resource};
+    }
+
+    /**
+     * Frames that a set can go unused before it's evicted, with the default r.RHI.DescriptorSetCache.MaxAge
+     */
+    constexpr uint64_t max_age = 8;
+}
+
+TEST_CASE("Descriptor sets with the same contents are only written once", "[descriptor_set_cache]") {
+    auto cache = DescriptorSetCache{};
+    auto writer = StubWriter{};
+    const auto resources = eastl::array{first_resource};
+
+    cache.begin_frame(1);
+
+    const auto first_set = cache.get_or_write(make_key(first_resource), resources, writer);
+    REQUIRE(first_set.has_value());
+    REQUIRE(writer.num_allocations == 1);
+
+    // The same contents later this frame and in the next few frames hit
+    for(auto frame = 1u; frame < 5; frame++) {
+        if(frame > 1) {
+            cache.begin_frame(frame);
+        }
+        const auto set = cache.get_or_write(make_key(first_resource), resources, writer);
+        REQUIRE(set.has_value());
+        REQUIRE(set->set == first_set->set);
+        REQUIRE(set->layout == writer.layout);
+    }
+    REQUIRE(writer.num_allocations == 1);
+    REQUIRE(writer.num_writes == 1);
+
+    // Different contents get a different set
+    const auto other_set = cache.get_or_write(make_key(second_resource), eastl::array{second_resource}, writer);
+    REQUIRE(other_set.has_value());
+    REQUIRE(other_set->set != first_set->set);
+    REQUIRE(writer.num_allocations == 2);
+
+    cache.begin_frame(5);
+    REQUIRE(cache.get_stats().num_hits == 1);
+    REQUIRE(cache.get_stats().num_misses == 1);
+    REQUIRE(cache.get_stats().num_cached_sets == 2);
+}
+
+TEST_CASE("Unused descriptor sets are evicted and recycled", "[descriptor_set_cache]") {
+    auto cache = DescriptorSetCache{};
+    auto writer = StubWriter{};
+
+    cache.begin_frame(1);
+    const auto old_set = cache.get_or_write(make_key(first_resource), eastl::array{first_resource}, writer);
+    REQUIRE(old_set.has_value());
+
+    // Still cached on the last frame of its lifetime
+    cache.begin_frame(1 + max_age);
+    REQUIRE(cache.get_stats().num_evictions == 0);
+
+    cache.begin_frame(2 + max_age);
+    REQUIRE(cache.get_stats().num_evictions == 1);
+    REQUIRE(cache.get_stats().num_cached_sets == 0);
+
+    // The GPU is long done with the evicted set, so new contents with the same layout rewrite it
+    const auto new_set = cache.get_or_write(make_key(second_resource), eastl::array{second_resource}, writer);
+    REQUIRE(new_set.has_value());
+    REQUIRE(new_set->set == old_set->set);
+    REQUIRE(writer.num_allocations == 1);
+    REQUIRE(writer.num_writes == 2);
+
+    // The old contents were evicted, so they miss
+    cache.get_or_write(make_key(first_resource), eastl::array{first_resource}, writer);
+    REQUIRE(writer.num_allocations == 2);
+}
+
+TEST_CASE("Descriptor sets are evicted when one of their resources is destroyed", "[descriptor_set_cache]") {
+    auto cache = DescriptorSetCache{};
+    auto writer = StubWriter{};
+
+    cache.begin_frame(1);
+    const auto first_set = cache.get_or_write(make_key(first_resource), eastl::array{first_resource}, writer);
+    cache.get_or_write(make_key(second_resource), eastl::array{second_resource}, writer);
+    REQUIRE(writer.num_allocations == 2);
+
+    cache.notify_resource_destroyed(first_resource);
+
+    cache.begin_frame(2);
+    REQUIRE(cache.get_stats().num_evictions == 1);
+    REQUIRE(cache.get_stats().num_cached_sets == 1);
+
+    // The set that doesn't use the destroyed resource is still cached
+    cache.get_or_write(make_key(second_resource), eastl::array{second_resource}, writer);
+    REQUIRE(writer.num_allocations == 2);
+
+    // The evicted set was used last frame, which may still be in flight. Its replacement must be a new set
+    const auto new_set = cache.get_or_write(make_key(first_resource), eastl::array{first_resource}, writer);
+    REQUIRE(new_set.has_value());
+    REQUIRE(new_set->set != first_set->set);
+    REQUIRE(writer.num_allocations == 3);
+
+    // Once every frame that might have used it has finished, the evicted set is recycled
+    cache.notify_resource_destroyed(first_resource);
+    cache.begin_frame(1 + num_in_flight_frames);
+    const auto recycled_set = cache.get_or_write(make_key(first_resource), eastl::array{first_resource}, writer);
+    REQUIRE(recycled_set.has_value());
+    REQUIRE(recycled_set->set == first_set->set);
+    REQUIRE(writer.num_allocations == 3);
+}
+
+TEST_CASE("Evicted descriptor sets are only recycled for the same layout", "[descriptor_set_cache]") {
+    auto cache = DescriptorSetCache{};
+    auto writer = StubWriter{};
+
+    cache.begin_frame(1);
+    cache.get_or_write(make_key(first_resource), eastl::array{first_resource}, writer);
+    cache.notify_resource_destroyed(first_resource);
+
+    cache.begin_frame(10);
+    REQUIRE(cache.get_stats().num_evictions == 1);
+
+    writer.layout = make_fake_handle<VkDescriptorSetLayout>(0x200);
+    cache.get_or_write(make_key(second_resource), eastl::array{second_resource}, writer);
+    REQUIRE(writer.num_allocations == 2);
+}
+
+TEST_CASE("Failed descriptor set allocations aren't cached", "[descriptor_set_cache]") {
+    auto cache = DescriptorSetCache{};
+    auto writer = StubWriter{};
+
+    cache.begin_frame(1);
+
+    writer.should_fail_allocations = true;
+    REQUIRE_FALSE(cache.get_or_write(make_key(first_resource), eastl::array{first_resource}, writer).has_value());
+
+    writer.should_fail_allocations = false;
+    REQUIRE(cache.get_or_write(make_key(first_resource), eastl::array{first_resource}, writer).has_value());
+    REQUIRE(writer.num_allocations == 1);
+
+    cache.begin_frame(2);
+    REQUIRE(cache.get_stats().num_misses == 2);
+    REQUIRE(cache.get_stats().num_cached_sets == 1);
+}
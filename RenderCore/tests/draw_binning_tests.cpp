@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <initializer_list>
+#include <numeric>
+#include <random>
+
+#include <catch2/catch_test_macros.hpp>
+#include <EASTL/algorithm.h>
+#include <EASTL/array.h>
+#include <EASTL/sort.h>
+
+#include "render/indirect_drawing_utils.hpp"
+
+namespace {
+    constexpr auto invalid_draw_bin = 0xFFFFFFFFu;
+
+    /**
+     * Workgroup size of scan_draw_bins.comp.slang
+     */
+    constexpr auto scan_group_size = 256u;
+
+    struct TestScene {
+        eastl::vector<PrimitiveDataGPU> primitives;
+
+        eastl::vector<uint32_t> visibility_list;
+
+        eastl::vector<VkDrawIndexedIndirectCommand> mesh_draw_args;
+    };
+
+    /**
+     * A scene with every kind of primitive the binning has to handle: hidden ones, ones whose type has no pipeline bin,
+     * and ones whose material is out of range
+     */
+    TestScene make_scene(const uint32_t num_primitives, const uint32_t num_materials) {
+        constexpr auto num_meshes = 50u;
+
+        auto rng = std::mt19937{13579};
+
+        auto scene = TestScene{};
+        for(auto mesh_id = 0u; mesh_id < num_meshes; mesh_id++) {
+            scene.mesh_draw_args.emplace_back(
+                VkDrawIndexedIndirectCommand{
+                    .indexCount = 3 * (mesh_id + 1),
+                    .instanceCount = 1,
+                    .firstIndex = 1000 * mesh_id,
+                    .vertexOffset = static_cast<int32_t>(500 * mesh_id),
+                    .firstInstance = 0
+                });
+        }
+
+        for(auto primitive_id = 0u; primitive_id < num_primitives; primitive_id++) {
+            auto primitive = PrimitiveDataGPU{};
+            primitive.mesh_id = rng() % num_meshes;
+            primitive.type = rng() % 4;
+            // A few materials past the end
+            primitive.material_id = rng() % (num_materials + num_materials / 10 + 1);
+            scene.primitives.push_back(primitive);
+
+            scene.visibility_list.push_back(rng() % 10 < 7 ? 1 : 0);
+        }
+
+        return scene;
+    }
+
+    uint32_t get_draw_bin(
+        const PrimitiveDataGPU& primitive, const uint32_t num_pipeline_bins, const uint32_t num_materials
+    ) {
+        if(primitive.type >= num_pipeline_bins || primitive.material_id >= num_materials) {
+            return invalid_draw_bin;
+        }
+
+        return primitive.type * num_materials + primitive.material_id;
+    }
+
+    /**
+     * Runs bin_visible_primitives, scan_draw_bins, and write_binned_draw_commands on the CPU, step by step like the GPU
+     * does. Primitives take their slots in a random order, like the atomics give them
+     */
+    BinnedDrawCommands run_binning_shaders(
+        const TestScene& scene, const uint32_t num_pipeline_bins, const uint32_t num_materials, std::mt19937& rng
+    ) {
+        const auto num_primitives = static_cast<uint32_t>(scene.primitives.size());
+
+        auto result = BinnedDrawCommands{};
+        result.commands.resize(num_primitives * num_pipeline_bins, VkDrawIndexedIndirectCommand{});
+        result.counts.resize(num_pipeline_bins, 0);
+        result.primitive_ids.resize(num_primitives * num_pipeline_bins, 0);
+        result.bin_offsets.resize(num_pipeline_bins * num_materials, 0);
+
+        // bin_visible_primitives
+        auto bin_counts = eastl::vector<uint32_t>(num_pipeline_bins * num_materials, 0);
+        auto primitive_bin_slots = eastl::vector<uint32_t>(num_primitives, 0);
+
+        auto thread_order = eastl::vector<uint32_t>(num_primitives);
+        std::iota(thread_order.begin(), thread_order.end(), 0u);
+        std::shuffle(thread_order.begin(), thread_order.end(), rng);
+
+        for(const auto primitive_id : thread_order) {
+            if(scene.visibility_list[primitive_id] == 0) {
+                continue;
+            }
+
+            const auto bin = get_draw_bin(scene.primitives[primitive_id], num_pipeline_bins, num_materials);
+            if(bin == invalid_draw_bin) {
+                continue;
+            }
+
+            primitive_bin_slots[primitive_id] = bin_counts[bin]++;
+        }
+
+        // scan_draw_bins. The threads of the workgroup run in lockstep between barriers
+        for(auto pipeline_bin = 0u; pipeline_bin < num_pipeline_bins; pipeline_bin++) {
+            const auto first_bin = pipeline_bin * num_materials;
+            auto running_total = 0u;
+
+            for(auto chunk_start = 0u; chunk_start < num_materials; chunk_start += scan_group_size) {
+                auto counts = eastl::array<uint32_t, scan_group_size>{};
+                for(auto thread = 0u; thread < scan_group_size; thread++) {
+                    const auto material_id = chunk_start + thread;
+                    counts[thread] = material_id < num_materials ? bin_counts[first_bin + material_id] : 0;
+                }
+
+                auto scan_scratch = counts;
+                for(auto stride = 1u; stride < scan_group_size; stride *= 2) {
+                    auto sums = scan_scratch;
+                    for(auto thread = stride; thread < scan_group_size; thread++) {
+                        sums[thread] += scan_scratch[thread - stride];
+                    }
+                    scan_scratch = sums;
+                }
+
+                for(auto thread = 0u; thread < scan_group_size; thread++) {
+                    const auto material_id = chunk_start + thread;
+                    if(material_id < num_materials) {
+                        const auto exclusive_sum = running_total + scan_scratch[thread] - counts[thread];
+                        result.bin_offsets[first_bin + material_id] = pipeline_bin * num_primitives + exclusive_sum;
+                    }
+                }
+
+                running_total += scan_scratch[scan_group_size - 1];
+            }
+
+            result.counts[pipeline_bin] = running_total;
+        }
+
+        // write_binned_draw_commands
+        std::shuffle(thread_order.begin(), thread_order.end(), rng);
+        for(const auto primitive_id : thread_order) {
+            if(scene.visibility_list[primitive_id] == 0) {
+                continue;
+            }
+
+            const auto& primitive = scene.primitives[primitive_id];
+            const auto bin = get_draw_bin(primitive, num_pipeline_bins, num_materials);
+            if(bin == invalid_draw_bin) {
+                continue;
+            }
+
+            const auto draw_id = result.bin_offsets[bin] + primitive_bin_slots[primitive_id];
+
+            result.primitive_ids[draw_id] = primitive_id;
+
+            result.commands[draw_id] = scene.mesh_draw_args[primitive.mesh_id];
+            result.commands[draw_id].firstInstance = draw_id;
+        }
+
+        return result;
+    }
+
+    bool is_same_command(const VkDrawIndexedIndirectCommand& a, const VkDrawIndexedIndirectCommand& b) {
+        return a.indexCount == b.indexCount && a.instanceCount == b.instanceCount && a.firstIndex == b.firstIndex &&
+            a.vertexOffset == b.vertexOffset && a.firstInstance == b.firstInstance;
+    }
+
+    /**
+     * The primitives in a material bin, sorted. The GPU fills bins in whatever order its atomics give it
+     */
+    eastl::vector<uint32_t> get_bin_primitives(
+        const BinnedDrawCommands& draws, const uint32_t first_draw, const uint32_t num_draws
+    ) {
+        auto primitive_ids = eastl::vector<uint32_t>(
+            draws.primitive_ids.begin() + first_draw,
+            draws.primitive_ids.begin() + first_draw + num_draws);
+        eastl::sort(primitive_ids.begin(), primitive_ids.end());
+        return primitive_ids;
+    }
+
+    void check_binned_draws(
+        const uint32_t num_primitives, const uint32_t num_pipeline_bins, const uint32_t num_materials
+    ) {
+        const auto scene = make_scene(num_primitives, num_materials);
+
+        const auto expected = bin_draw_commands_on_cpu(
+            scene.primitives,
+            scene.visibility_list,
+            scene.mesh_draw_args,
+            num_pipeline_bins,
+            num_materials);
+
+        auto rng = std::mt19937{num_materials};
+        const auto gpu = run_binning_shaders(scene, num_pipeline_bins, num_materials, rng);
+
+        REQUIRE(gpu.counts == expected.counts);
+        REQUIRE(gpu.bin_offsets == expected.bin_offsets);
+
+        auto num_expected_draws = 0u;
+        for(auto primitive_id = 0u; primitive_id < num_primitives; primitive_id++) {
+            if(scene.visibility_list[primitive_id] != 0 &&
+                get_draw_bin(scene.primitives[primitive_id], num_pipeline_bins, num_materials) != invalid_draw_bin) {
+                num_expected_draws++;
+            }
+        }
+        REQUIRE(std::accumulate(gpu.counts.begin(), gpu.counts.end(), 0u) == num_expected_draws);
+
+        for(auto pipeline_bin = 0u; pipeline_bin < num_pipeline_bins; pipeline_bin++) {
+            const auto pipeline_bin_end = pipeline_bin * num_primitives + gpu.counts[pipeline_bin];
+
+            for(auto material_id = 0u; material_id < num_materials; material_id++) {
+                const auto bin = pipeline_bin * num_materials + material_id;
+                const auto first_draw = gpu.bin_offsets[bin];
+                const auto end_draw = material_id + 1 < num_materials ? gpu.bin_offsets[bin + 1] : pipeline_bin_end;
+
+                REQUIRE(get_bin_primitives(gpu, first_draw, end_draw - first_draw) ==
+                    get_bin_primitives(expected, first_draw, end_draw - first_draw));
+
+                // Each draw is its primitive's mesh, with the draw ID as its instance
+                for(const auto* draws : {&gpu, &expected}) {
+                    for(auto draw_id = first_draw; draw_id < end_draw; draw_id++) {
+                        const auto& primitive = scene.primitives[draws->primitive_ids[draw_id]];
+                        REQUIRE(primitive.type == pipeline_bin);
+                        REQUIRE(primitive.material_id == material_id);
+
+                        auto expected_command = scene.mesh_draw_args[primitive.mesh_id];
+                        expected_command.firstInstance = draw_id;
+                        REQUIRE(is_same_command(draws->commands[draw_id], expected_command));
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("CPU draw binning matches the binning shaders", "[draw_binning]") {
+    SECTION("One material") {
+        check_binned_draws(500, 2, 1);
+    }
+
+    SECTION("Materials fill exactly one scan chunk") {
+        check_binned_draws(3000, 2, scan_group_size);
+    }
+
+    SECTION("Materials spill into a second scan chunk") {
+        check_binned_draws(3000, 2, scan_group_size + 1);
+    }
+
+    SECTION("Many scan chunks") {
+        check_binned_draws(5000, 3, 1000);
+    }
+}
+
+TEST_CASE("Binning nothing visible writes no draws", "[draw_binning]") {
+    auto scene = make_scene(1000, 64);
+    eastl::fill(scene.visibility_list.begin(), scene.visibility_list.end(), 0u);
+
+    const auto draws = bin_draw_commands_on_cpu(scene.primitives, scene.visibility_list, scene.mesh_draw_args, 2, 64);
+
+    REQUIRE(draws.counts == eastl::vector<uint32_t>{0, 0});
+    for(auto bin = 0u; bin < 2 * 64; bin++) {
+        REQUIRE(draws.bin_offsets[bin] == bin / 64 * 1000);
+    }
+}
@@ -0,0 +1,151 @@
+#include <random>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <EASTL/unordered_set.h>
+
+#include "render/draw_sorting.hpp"
+
+namespace {
+    /**
+     * Draws for a synthetic scene. Each primitive picks a random mesh, and each mesh has a material that's single- or
+     * double-sided and has either front face
+     */
+    eastl::vector<SortedDraw> make_scene_draws(const uint32_t num_primitives, const uint32_t num_meshes) {
+        auto rng = std::mt19937{1234};
+        auto mesh_distribution = std::uniform_int_distribution<uint32_t>{0, num_meshes - 1};
+
+        auto draws = eastl::vector<SortedDraw>{};
+        draws.reserve(num_primitives);
+        for(auto i = 0u; i < num_primitives; i++) {
+            const auto mesh = mesh_distribution(rng);
+            draws.emplace_back(
+                SortedDraw{
+                    .key = make_draw_sort_key(0, mesh % 7 == 0, mesh % 11 != 0, mesh),
+                    .draw_index = i
+                });
+        }
+
+        return draws;
+    }
+
+    struct CommandCounts {
+        uint32_t num_draws = 0;
+
+        uint32_t num_state_changes = 0;
+    };
+
+    CommandCounts count_commands(const eastl::vector<SortedDraw>& draws, const eastl::vector<DrawBatch>& batches) {
+        auto counts = CommandCounts{};
+        auto current_state = ~0u;
+        for(const auto& batch : batches) {
+            const auto state = get_draw_state(draws[batch.first_draw].key);
+            if(state != current_state) {
+                counts.num_state_changes++;
+                current_state = state;
+            }
+            counts.num_draws++;
+        }
+
+        return counts;
+    }
+}
+
+TEST_CASE("Sorted draws are merged into one instanced draw per key", "[draw_sorting]") {
+    constexpr auto num_primitives = 4000u;
+    constexpr auto num_meshes = 400u;
+
+    auto draws = make_scene_draws(num_primitives, num_meshes);
+
+    auto unique_keys = eastl::unordered_set<uint64_t>{};
+    auto unique_states = eastl::unordered_set<uint32_t>{};
+    for(const auto& draw : draws) {
+        unique_keys.insert(draw.key);
+        unique_states.insert(get_draw_state(draw.key));
+    }
+
+    auto batches = eastl::vector<DrawBatch>{};
+    batch_draws(draws, false, batches);
+
+    REQUIRE(batches.size() == unique_keys.size());
+
+    // The batches cover every draw exactly once, and each batch only has draws with the same key
+    auto num_instances = 0u;
+    auto seen_draws = eastl::vector<bool>(num_primitives, false);
+    for(const auto& batch : batches) {
+        REQUIRE(batch.first_draw == num_instances);
+        for(auto i = batch.first_draw; i < batch.first_draw + batch.num_draws; i++) {
+            REQUIRE(draws[i].key == draws[batch.first_draw].key);
+            REQUIRE_FALSE(seen_draws[draws[i].draw_index]);
+            seen_draws[draws[i].draw_index] = true;
+        }
+        num_instances += batch.num_draws;
+    }
+    REQUIRE(num_instances == num_primitives);
+
+    // Each combination of dynamic state is set once
+    const auto counts = count_commands(draws, batches);
+    REQUIRE(counts.num_state_changes == unique_states.size());
+    REQUIRE(counts.num_draws <= num_meshes);
+}
+
+TEST_CASE("Draws that preserve their order are only merged with their neighbours", "[draw_sorting]") {
+    auto draws = eastl::vector<SortedDraw>{
+        {.key = make_draw_sort_key(0, false, true, 5), .draw_index = 0},
+        {.key = make_draw_sort_key(0, false, true, 5), .draw_index = 1},
+        {.key = make_draw_sort_key(0, false, true, 2), .draw_index = 2},
+        {.key = make_draw_sort_key(0, false, true, 5), .draw_index = 3},
+        {.key = make_draw_sort_key(0, true, true, 5), .draw_index = 4},
+    };
+
+    auto batches = eastl::vector<DrawBatch>{};
+    batch_draws(draws, true, batches);
+
+    for(auto i = 0u; i < draws.size(); i++) {
+        REQUIRE(draws[i].draw_index == i);
+    }
+
+    REQUIRE(batches.size() == 4);
+    REQUIRE(batches[0].first_draw == 0);
+    REQUIRE(batches[0].num_draws == 2);
+    REQUIRE(batches[1].num_draws == 1);
+    REQUIRE(batches[2].num_draws == 1);
+    REQUIRE(batches[3].num_draws == 1);
+}
+
+TEST_CASE("Draw sorting keeps the order of draws with the same key", "[draw_sorting]") {
+    auto draws = make_scene_draws(1000, 10);
+
+    auto batches = eastl::vector<DrawBatch>{};
+    batch_draws(draws, false, batches);
+
+    for(const auto& batch : batches) {
+        for(auto i = batch.first_draw + 1; i < batch.first_draw + batch.num_draws; i++) {
+            REQUIRE(draws[i - 1].draw_index < draws[i].draw_index);
+        }
+    }
+}
+
+TEST_CASE("Draw submission command counts", "[.][benchmark][draw_sorting]") {
+    // A Sponza-sized scene: tens of thousands of primitives that share a couple thousand meshes
+    constexpr auto num_primitives = 25000u;
+    constexpr auto num_meshes = 2000u;
+
+    const auto scene_draws = make_scene_draws(num_primitives, num_meshes);
+
+    auto batches = eastl::vector<DrawBatch>{};
+    auto draws = scene_draws;
+    batch_draws(draws, false, batches);
+    const auto counts = count_commands(draws, batches);
+
+    // Without sorting, each primitive is a draw and sets its cull mode and front face
+    WARN("Unsorted: " << num_primitives << " draws, " << num_primitives * 2 << " state changes");
+    WARN("Sorted: " << counts.num_draws << " draws, " << counts.num_state_changes << " state changes");
+    CHECK(counts.num_draws < num_primitives);
+
+    BENCHMARK("Sort and batch 25k draws") {
+        draws = scene_draws;
+        batch_draws(draws, false, batches);
+        return batches.size();
+    };
+}
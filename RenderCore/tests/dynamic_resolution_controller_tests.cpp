@@ -0,0 +1,206 @@
+#include <cmath>
+#include <functional>
+
+#include <catch2/catch_test_macros.hpp>
+#include <EASTL/vector.h>
+
+#include "render/upscaling/dynamic_resolution_controller.hpp"
+
+namespace {
+    constexpr auto settings = DynamicResolutionSettings{};
+
+    /**
+     * The controller's scale and the frame time it led to, for each frame of a trace
+     */
+    struct ControllerTrace {
+        eastl::vector<float> scales;
+
+        eastl::vector<float> frame_times_ms;
+
+        /**
+         * Number of times that the scale changed between frames first_frame and end_frame
+         */
+        uint32_t count_scale_changes(const uint32_t first_frame, const uint32_t end_frame) const {
+            auto num_changes = 0u;
+            for(auto frame = first_frame + 1; frame < end_frame; frame++) {
+                if(scales[frame] != scales[frame - 1]) {
+                    num_changes++;
+                }
+            }
+            return num_changes;
+        }
+
+        /**
+         * Number of times that the scale went up after going down, or down after going up
+         */
+        uint32_t count_direction_changes(const uint32_t first_frame, const uint32_t end_frame) const {
+            auto num_reversals = 0u;
+            auto last_direction = 0.f;
+            for(auto frame = first_frame + 1; frame < end_frame; frame++) {
+                const auto delta = scales[frame] - scales[frame - 1];
+                if(delta == 0.f) {
+                    continue;
+                }
+
+                if(delta * last_direction < 0.f) {
+                    num_reversals++;
+                }
+                last_direction = delta;
+            }
+            return num_reversals;
+        }
+    };
+
+    /**
+     * Runs the controller on a synthetic GPU. Render cost is proportional to the number of pixels, so each frame takes
+     * its full resolution cost times the square of the scale that the controller picked for it
+     *
+     * \param get_full_res_cost_ms Cost of a frame at full resolution, in milliseconds, given the frame index
+     */
+    ControllerTrace run_controller(
+        const uint32_t num_frames, const std::function<float(uint32_t)>& get_full_res_cost_ms
+    ) {
+        auto controller = DynamicResolutionController{};
+        auto trace = ControllerTrace{};
+
+        auto scale = controller.get_scale();
+        for(auto frame = 0u; frame < num_frames; frame++) {
+            const auto frame_time_ms = get_full_res_cost_ms(frame) * scale * scale;
+            trace.scales.push_back(scale);
+            trace.frame_times_ms.push_back(frame_time_ms);
+
+            scale = controller.update(frame_time_ms, settings);
+            REQUIRE(scale >= settings.min_scale);
+            REQUIRE(scale <= settings.max_scale);
+        }
+
+        return trace;
+    }
+
+    /**
+     * Whether a frame time is close enough to the target. The dead band lets the frame time sit a little off the
+     * target, and the quantized scale can land up to half a step further away
+     */
+    bool is_near_target(const float frame_time_ms) {
+        const auto error = std::sqrt(settings.target_frame_time_ms / frame_time_ms) - 1.f;
+        return std::abs(error) <= settings.dead_band + settings.scale_step;
+    }
+}
+
+TEST_CASE("Dynamic resolution settles after a step in GPU load", "[dynamic_resolution]") {
+    constexpr auto step_frame = 200u;
+    constexpr auto num_frames = 1000u;
+
+    // The light load fits at full resolution. The heavy load needs about 0.74 scale
+    constexpr auto light_cost_ms = 12.f;
+    constexpr auto heavy_cost_ms = 30.f;
+    const auto trace = run_controller(
+        num_frames,
+        [&](const uint32_t frame) {
+            return frame < step_frame ? light_cost_ms : heavy_cost_ms;
+        });
+
+    // Nothing to do before the step
+    for(auto frame = 0u; frame < step_frame; frame++) {
+        REQUIRE(trace.scales[frame] == settings.max_scale);
+    }
+
+    // The scale drops on the first slow frame, without waiting for a cooldown
+    REQUIRE(trace.scales[step_frame + 1] < settings.max_scale);
+
+    // It settles within a few cooldowns, and stays put from then on
+    constexpr auto settled_frame = step_frame + settings.increase_cooldown_frames * 4;
+    REQUIRE(trace.count_scale_changes(settled_frame, num_frames) == 0);
+    for(auto frame = settled_frame; frame < num_frames; frame++) {
+        REQUIRE(is_near_target(trace.frame_times_ms[frame]));
+    }
+
+    // Getting there may overshoot once, but it doesn't hunt back and forth
+    REQUIRE(trace.count_direction_changes(step_frame, num_frames) <= 1);
+}
+
+TEST_CASE("Dynamic resolution recovers from a one frame spike", "[dynamic_resolution]") {
+    constexpr auto spike_frame = 300u;
+    constexpr auto num_frames = 600u;
+
+    constexpr auto base_cost_ms = 12.f;
+    const auto trace = run_controller(
+        num_frames,
+        [&](const uint32_t frame) {
+            return frame == spike_frame ? base_cost_ms * 5.f : base_cost_ms;
+        });
+
+    // The spike lowers the scale right away
+    REQUIRE(trace.scales[spike_frame + 1] < settings.max_scale);
+
+    // The scale doesn't go up again until the cooldown has passed, then goes straight back to full resolution
+    for(auto frame = spike_frame + 1; frame <= spike_frame + settings.increase_cooldown_frames; frame++) {
+        REQUIRE(trace.scales[frame] <= trace.scales[spike_frame + 1]);
+    }
+
+    constexpr auto recovered_frame = spike_frame + settings.increase_cooldown_frames * 3;
+    for(auto frame = recovered_frame; frame < num_frames; frame++) {
+        REQUIRE(trace.scales[frame] == settings.max_scale);
+    }
+
+    REQUIRE(trace.count_direction_changes(spike_frame, num_frames) <= 1);
+}
+
+TEST_CASE("Dynamic resolution follows a ramp in GPU load", "[dynamic_resolution]") {
+    constexpr auto ramp_start_frame = 100u;
+    constexpr auto ramp_end_frame = 700u;
+    constexpr auto num_frames = 1200u;
+
+    // From comfortably fitting at full resolution to needing about 0.74 scale
+    constexpr auto start_cost_ms = 10.f;
+    constexpr auto end_cost_ms = 30.f;
+    const auto trace = run_controller(
+        num_frames,
+        [&](const uint32_t frame) {
+            if(frame < ramp_start_frame) {
+                return start_cost_ms;
+            }
+            if(frame >= ramp_end_frame) {
+                return end_cost_ms;
+            }
+            const auto t = static_cast<float>(frame - ramp_start_frame) /
+                static_cast<float>(ramp_end_frame - ramp_start_frame);
+            return start_cost_ms + (end_cost_ms - start_cost_ms) * t;
+        });
+
+    // While the load rises, the scale only ever goes down
+    for(auto frame = ramp_start_frame + 1; frame < ramp_end_frame; frame++) {
+        REQUIRE(trace.scales[frame] <= trace.scales[frame - 1]);
+    }
+
+    // It keeps up with the ramp, so the frame time never strays far from the target
+    for(auto frame = ramp_start_frame; frame < num_frames; frame++) {
+        REQUIRE(trace.frame_times_ms[frame] <= settings.target_frame_time_ms * 1.2f);
+    }
+
+    // Once the load stops rising, the scale settles
+    constexpr auto settled_frame = ramp_end_frame + settings.increase_cooldown_frames * 4;
+    REQUIRE(trace.count_scale_changes(settled_frame, num_frames) == 0);
+    for(auto frame = settled_frame; frame < num_frames; frame++) {
+        REQUIRE(is_near_target(trace.frame_times_ms[frame]));
+    }
+
+    REQUIRE(trace.count_direction_changes(ramp_start_frame, num_frames) <= 1);
+}
+
+TEST_CASE("Frame time noise inside the dead band doesn't move the scale", "[dynamic_resolution]") {
+    constexpr auto num_frames = 500u;
+
+    // A load that needs 0.8 scale, with a few percent of frame to frame noise
+    constexpr auto base_cost_ms = settings.target_frame_time_ms / (0.8f * 0.8f);
+    const auto trace = run_controller(
+        num_frames,
+        [&](const uint32_t frame) {
+            const auto noise = static_cast<float>((frame * 7919u) % 7u) / 6.f * 0.06f - 0.03f;
+            return base_cost_ms * (1.f + noise);
+        });
+
+    constexpr auto settled_frame = settings.increase_cooldown_frames * 4;
+    REQUIRE(trace.count_scale_changes(settled_frame, num_frames) == 0);
+    REQUIRE(trace.count_direction_changes(0, num_frames) <= 1);
+}
@@ -0,0 +1,150 @@
+#include <random>
+#include <unordered_map>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <EASTL/sort.h>
+
+#include "core/object_pool.hpp"
+
+namespace {
+    struct TestObject {
+        uint64_t value = 0;
+    };
+
+    using TestHandle = PooledObject<TestObject>;
+}
+
+TEST_CASE("ObjectPool matches std::unordered_map under random adds and frees", "[object_pool]") {
+    auto pool = ObjectPool<TestObject>{};
+
+    // Expected contents, keyed by the handle's index and generation
+    auto expected = std::unordered_map<TestHandle, uint64_t>{};
+    auto live_handles = eastl::vector<TestHandle>{};
+    auto stale_handles = eastl::vector<TestHandle>{};
+
+    auto rng = std::mt19937{42};
+    auto next_value = 1ull;
+
+    for(auto step = 0u; step < 20000; step++) {
+        const auto operation = rng() % 10;
+
+        if(operation < 6 || live_handles.empty()) {
+            const auto value = next_value++;
+            const auto handle = pool.add_object(TestObject{.value = value});
+            REQUIRE(handle.is_valid());
+            REQUIRE_FALSE(expected.contains(handle));
+            expected.emplace(handle, value);
+            live_handles.push_back(handle);
+
+        } else if(operation < 9) {
+            const auto position = rng() % live_handles.size();
+            const auto handle = live_handles[position];
+            live_handles[position] = live_handles.back();
+            live_handles.pop_back();
+
+            const auto object = pool.free_object(handle);
+            REQUIRE(object.value == expected.at(handle));
+            expected.erase(handle);
+            stale_handles.push_back(handle);
+
+        } else if(!stale_handles.empty()) {
+            // Freeing a stale handle must not touch whatever object reused its slot
+            const auto handle = stale_handles[rng() % stale_handles.size()];
+            const auto num_live = pool.get_num_live_objects();
+            const auto object = pool.free_object(handle);
+            REQUIRE(object.value == 0);
+            REQUIRE(pool.get_num_live_objects() == num_live);
+        }
+
+        if(step % 500 == 0) {
+            REQUIRE(pool.get_num_live_objects() == expected.size());
+
+            for(const auto& [handle, value] : expected) {
+                REQUIRE(pool.is_live(handle));
+                REQUIRE(handle->value == value);
+            }
+
+            for(const auto& handle : stale_handles) {
+                REQUIRE_FALSE(pool.is_live(handle));
+                REQUIRE_FALSE(handle.is_valid());
+            }
+
+            // The dense live list has every live slot exactly once
+            auto live_indices = eastl::vector<uint32_t>(pool.get_live_indices().begin(), pool.get_live_indices().end());
+            eastl::sort(live_indices.begin(), live_indices.end());
+            auto expected_indices = eastl::vector<uint32_t>{};
+            for(const auto& [handle, value] : expected) {
+                expected_indices.push_back(handle.index);
+            }
+            eastl::sort(expected_indices.begin(), expected_indices.end());
+            REQUIRE(live_indices == expected_indices);
+        }
+    }
+}
+
+TEST_CASE("Stale handles don't alias the object that reuses their slot", "[object_pool]") {
+    auto pool = ObjectPool<TestObject>{};
+
+    const auto first = pool.add_object(TestObject{.value = 1});
+    pool.free_object(first);
+    const auto second = pool.add_object(TestObject{.value = 2});
+
+    REQUIRE(first.index == second.index);
+    REQUIRE_FALSE(first.is_valid());
+    REQUIRE(second.is_valid());
+    REQUIRE(first != second);
+    REQUIRE(pool.make_handle(second.index) == second);
+}
+
+TEST_CASE("Handle ordering agrees with handle equality", "[object_pool]") {
+    auto pool_a = ObjectPool<TestObject>{};
+    auto pool_b = ObjectPool<TestObject>{};
+
+    const auto a = pool_a.add_object(TestObject{.value = 1});
+    const auto b = pool_b.add_object(TestObject{.value = 1});
+
+    // Same index and generation, different pools
+    REQUIRE(a.index == b.index);
+    REQUIRE(a.generation == b.generation);
+    REQUIRE(a != b);
+    REQUIRE((a <=> b) != std::strong_ordering::equal);
+    REQUIRE((a <=> a) == std::strong_ordering::equal);
+    REQUIRE(((a < b) != (b < a)));
+}
+
+TEST_CASE("ObjectPool add/free churn", "[.][benchmark][object_pool]") {
+    constexpr auto num_objects = 65536u;
+
+    BENCHMARK("ObjectPool") {
+        auto pool = ObjectPool<TestObject>{};
+        auto handles = eastl::vector<TestHandle>{};
+        handles.reserve(num_objects);
+        for(auto i = 0u; i < num_objects; i++) {
+            handles.push_back(pool.add_object(TestObject{.value = i}));
+        }
+        for(auto i = 0u; i < num_objects; i += 2) {
+            pool.free_object(handles[i]);
+        }
+        auto sum = 0ull;
+        for(const auto index : pool.get_live_indices()) {
+            sum += pool[index].value;
+        }
+        return sum;
+    };
+
+    BENCHMARK("std::unordered_map") {
+        auto map = std::unordered_map<uint32_t, TestObject>{};
+        for(auto i = 0u; i < num_objects; i++) {
+            map.emplace(i, TestObject{.value = i});
+        }
+        for(auto i = 0u; i < num_objects; i += 2) {
+            map.erase(i);
+        }
+        auto sum = 0ull;
+        for(const auto& [key, object] : map) {
+            sum += object.value;
+        }
+        return sum;
+    };
+}
@@ -0,0 +1,263 @@
+#include <random>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <EASTL/array.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/matrix.hpp>
+
+#include "render/primitive_store.hpp"
+#include "shared/primitive_data.hpp"
+
+namespace {
+    struct TestPrimitive {
+        glm::mat4 transform = glm::mat4{1.f};
+
+        Box local_bounds = {};
+
+        uint8_t type = PRIMITIVE_TYPE_SOLID;
+    };
+
+    glm::mat4 make_random_transform(std::mt19937& rng, const float scene_size) {
+        auto position_distribution = std::uniform_real_distribution<float>{-scene_size, scene_size};
+        auto angle_distribution = std::uniform_real_distribution<float>{0.f, 6.2831853f};
+        auto scale_distribution = std::uniform_real_distribution<float>{0.5f, 2.f};
+
+        auto transform = glm::translate(
+            glm::mat4{1.f},
+            glm::vec3{position_distribution(rng), position_distribution(rng), position_distribution(rng)});
+        transform = glm::rotate(transform, angle_distribution(rng), glm::normalize(glm::vec3{1.f, 2.f, 3.f}));
+        return glm::scale(transform, glm::vec3{scale_distribution(rng)});
+    }
+
+    /**
+     * Primitives scattered through a cube scene_size meters across, with a mix of types like a real scene
+     */
+    eastl::vector<TestPrimitive> make_primitives(const uint32_t num_primitives, const float scene_size) {
+        auto rng = std::mt19937{5678};
+        auto extent_distribution = std::uniform_real_distribution<float>{0.1f, 4.f};
+
+        auto primitives = eastl::vector<TestPrimitive>{};
+        primitives.reserve(num_primitives);
+        for(auto i = 0u; i < num_primitives; i++) {
+            const auto extents = glm::vec3{
+                extent_distribution(rng), extent_distribution(rng), extent_distribution(rng)
+            };
+            primitives.emplace_back(
+                TestPrimitive{
+                    .transform = make_random_transform(rng, scene_size),
+                    .local_bounds = Box{.min = -extents, .max = extents},
+                    .type = static_cast<uint8_t>(i % 8 == 0 ? PRIMITIVE_TYPE_TRANSPARENT : PRIMITIVE_TYPE_SOLID)
+                });
+        }
+
+        return primitives;
+    }
+
+    PrimitiveStore make_store(const eastl::vector<TestPrimitive>& primitives) {
+        auto store = PrimitiveStore{};
+        for(auto i = 0u; i < primitives.size(); i++) {
+            store.add_primitive(
+                i,
+                PrimitiveCreateInfo{
+                    .transform = primitives[i].transform,
+                    .local_bounds = primitives[i].local_bounds,
+                    .type = primitives[i].type,
+                });
+        }
+        store.clear_dirty();
+
+        return store;
+    }
+
+    /**
+     * The eight corners of a primitive's bounds in world space. The world bounds must contain all of them
+     */
+    eastl::array<glm::vec3, 8> get_world_corners(const TestPrimitive& primitive) {
+        auto corners = eastl::array<glm::vec3, 8>{};
+        for(auto corner = 0u; corner < 8; corner++) {
+            const auto local_corner = glm::vec3{
+                (corner & 1) != 0 ? primitive.local_bounds.max.x : primitive.local_bounds.min.x,
+                (corner & 2) != 0 ? primitive.local_bounds.max.y : primitive.local_bounds.min.y,
+                (corner & 4) != 0 ? primitive.local_bounds.max.z : primitive.local_bounds.min.z,
+            };
+            corners[corner] = glm::vec3{primitive.transform * glm::vec4{local_corner, 1.f}};
+        }
+
+        return corners;
+    }
+
+    bool contains(const Box& box, const glm::vec3& point) {
+        constexpr auto epsilon = 1e-3f;
+        return glm::all(glm::greaterThanEqual(point, box.min - epsilon)) &&
+            glm::all(glm::lessThanEqual(point, box.max + epsilon));
+    }
+}
+
+TEST_CASE("World bounds contain the transformed local bounds", "[primitive_store]") {
+    const auto primitives = make_primitives(1000, 100.f);
+    const auto store = make_store(primitives);
+
+    for(auto i = 0u; i < primitives.size(); i++) {
+        const auto world_bounds = store.get_world_bounds(i);
+        for(const auto& corner : get_world_corners(primitives[i])) {
+            REQUIRE(contains(world_bounds, corner));
+        }
+    }
+}
+
+TEST_CASE("find_in_bounds matches a brute-force overlap test", "[primitive_store]") {
+    auto primitives = make_primitives(4000, 100.f);
+    auto store = make_store(primitives);
+
+    auto rng = std::mt19937{91011};
+
+    // Move some primitives, so that the query sees updated bounds
+    for(auto i = 0u; i < primitives.size(); i += 3) {
+        primitives[i].transform = make_random_transform(rng, 100.f);
+        store.set_transform(i, primitives[i].transform);
+    }
+
+    auto query_distribution = std::uniform_real_distribution<float>{-120.f, 120.f};
+    for(auto query = 0u; query < 64; query++) {
+        const auto a = glm::vec3{query_distribution(rng), query_distribution(rng), query_distribution(rng)};
+        const auto b = glm::vec3{query_distribution(rng), query_distribution(rng), query_distribution(rng)};
+        const auto query_box = Box{.min = glm::min(a, b), .max = glm::max(a, b)};
+
+        for(const auto type : {PRIMITIVE_TYPE_SOLID, PRIMITIVE_TYPE_TRANSPARENT}) {
+            auto expected = eastl::vector<uint32_t>{};
+            for(auto i = 0u; i < primitives.size(); i++) {
+                if(primitives[i].type == type && store.get_world_bounds(i).overlaps(query_box)) {
+                    expected.push_back(i);
+                }
+            }
+
+            auto found = eastl::vector<uint32_t>{};
+            store.find_in_bounds(query_box, static_cast<uint8_t>(type), found);
+
+            REQUIRE(found == expected);
+        }
+    }
+}
+
+TEST_CASE("Only changed primitives are dirty", "[primitive_store]") {
+    const auto primitives = make_primitives(100, 10.f);
+    auto store = make_store(primitives);
+    REQUIRE(store.get_dirty_indices().empty());
+
+    store.set_transform(7, glm::mat4{1.f});
+    store.set_transform(3, glm::mat4{1.f});
+    store.set_transform(7, glm::mat4{2.f});
+    store.mark_dirty(3);
+
+    REQUIRE(store.get_dirty_indices() == eastl::vector<uint32_t>{7, 3});
+
+    store.clear_dirty();
+    REQUIRE(store.get_dirty_indices().empty());
+
+    store.mark_dirty(7);
+    REQUIRE(store.get_dirty_indices() == eastl::vector<uint32_t>{7});
+
+    // Setting the flags that a primitive already has doesn't dirty it
+    store.clear_dirty();
+    store.set_flags(5, 0);
+    REQUIRE(store.get_dirty_indices().empty());
+    store.set_flags(5, PRIMITIVE_FLAG_DYNAMIC);
+    REQUIRE(store.get_dirty_indices() == eastl::vector<uint32_t>{5});
+}
+
+TEST_CASE("GPU data is gathered from the store's arrays", "[primitive_store]") {
+    auto rng = std::mt19937{1213};
+    const auto transform = make_random_transform(rng, 10.f);
+    const auto local_bounds = Box{.min = glm::vec3{-1.f, -2.f, -3.f}, .max = glm::vec3{1.f, 2.f, 5.f}};
+
+    auto store = PrimitiveStore{};
+    store.add_primitive(
+        4,
+        PrimitiveCreateInfo{
+            .transform = transform,
+            .local_bounds = local_bounds,
+            .type = PRIMITIVE_TYPE_CUTOUT,
+            .mesh_id = 12,
+            .material_id = 34,
+            .addresses = {.material = 0x1000, .indices = 0x2000, .vertex_positions = 0x3000, .vertex_data = 0x4000},
+        });
+    REQUIRE(store.get_num_slots() == 5);
+
+    auto data = store.get_gpu_data(4);
+    REQUIRE(data.model == transform);
+    REQUIRE(data.inverse_model == glm::inverse(transform));
+    REQUIRE(data.bounds_min_and_radius == glm::vec4{local_bounds.min, 8.f});
+    REQUIRE(data.bounds_max == glm::vec4{local_bounds.max, 0.f});
+    REQUIRE(data.mesh_id == 12);
+    REQUIRE(data.type == PRIMITIVE_TYPE_CUTOUT);
+    REQUIRE(data.flags == 0);
+    REQUIRE(data.material_id == 34);
+    REQUIRE(data.material == 0x1000);
+    REQUIRE(data.indices == 0x2000);
+    REQUIRE(data.vertex_positions == 0x3000);
+    REQUIRE(data.vertex_data == 0x4000);
+
+    // Moves and flag changes show up in the next gather
+    const auto new_transform = make_random_transform(rng, 10.f);
+    store.set_transform(4, new_transform);
+    store.set_flags(4, PRIMITIVE_FLAG_DYNAMIC);
+
+    data = store.get_gpu_data(4);
+    REQUIRE(data.model == new_transform);
+    REQUIRE(data.inverse_model == glm::inverse(new_transform));
+    REQUIRE(data.flags == PRIMITIVE_FLAG_DYNAMIC);
+    REQUIRE(data.mesh_id == 12);
+}
+
+TEST_CASE("Primitive store with 65k primitives", "[.][benchmark][primitive_store]") {
+    constexpr auto num_primitives = 65536u;
+    const auto primitives = make_primitives(num_primitives, 500.f);
+    auto store = make_store(primitives);
+
+    // Roughly what the VPL and cascade code ask for: a region around the camera
+    const auto query_box = Box{.min = glm::vec3{-50.f}, .max = glm::vec3{50.f}};
+
+    BENCHMARK("find_in_bounds") {
+        auto indices = eastl::vector<uint32_t>{};
+        store.find_in_bounds(query_box, PRIMITIVE_TYPE_SOLID, indices);
+        return indices.size();
+    };
+
+    // What get_primitives_in_bounds did before the store: transform each primitive's bounds while testing it
+    BENCHMARK("Array-of-structs bounds test") {
+        auto indices = eastl::vector<uint32_t>{};
+        for(auto i = 0u; i < primitives.size(); i++) {
+            const auto& primitive = primitives[i];
+            if(primitive.type != PRIMITIVE_TYPE_SOLID) {
+                continue;
+            }
+            const auto primitive_box = Box{
+                .min = glm::vec3{primitive.transform * glm::vec4{primitive.local_bounds.min, 1.f}},
+                .max = glm::vec3{primitive.transform * glm::vec4{primitive.local_bounds.max, 1.f}}
+            };
+            if(primitive_box.overlaps(query_box)) {
+                indices.push_back(i);
+            }
+        }
+        return indices.size();
+    };
+
+    // What upload_dirty_primitives does when every primitive changed
+    BENCHMARK("Gather every primitive's GPU data") {
+        auto checksum = 0u;
+        for(auto i = 0u; i < num_primitives; i++) {
+            checksum += store.get_gpu_data(i).mesh_id;
+        }
+        return checksum;
+    };
+
+    BENCHMARK("Move every primitive") {
+        for(auto i = 0u; i < primitives.size(); i++) {
+            store.set_transform(i, primitives[i].transform);
+        }
+        const auto num_dirty = store.get_dirty_indices().size();
+        store.clear_dirty();
+        return num_dirty;
+    };
+}
@@ -0,0 +1,250 @@
+#include <catch2/catch_test_macros.hpp>
+#include <EASTL/algorithm.h>
+#include <EASTL/array.h>
+#include <EASTL/vector.h>
+
+#include "console/cvars.hpp"
+#include "render/gi/probe_update_scheduler.hpp"
+
+namespace {
+    constexpr auto grid_size = uint3{8, 4, 8};
+
+    constexpr auto probes_per_cascade = grid_size.x * grid_size.y * grid_size.z;
+
+    /**
+     * Same priorities as the irradiance cache's cascades
+     */
+    constexpr auto cascade_priorities = eastl::array{0.1f, 0.02f, 0.02f, 0.02f};
+
+    constexpr auto num_probes = probes_per_cascade * static_cast<uint32_t>(cascade_priorities.size());
+
+    constexpr auto never_updated = 0xFFFFFFFFu;
+
+    const auto camera_positions = eastl::array{
+        float3{grid_size} * 0.5f, float3{grid_size} * 0.5f, float3{grid_size} * 0.5f, float3{grid_size} * 0.5f
+    };
+
+    ProbeUpdateScheduler make_scheduler() {
+        return ProbeUpdateScheduler{grid_size, cascade_priorities};
+    }
+
+    uint32_t get_cascade(const uint3 probe) {
+        return probe.y / grid_size.y;
+    }
+
+    /**
+     * Converts a probe from the scheduler's output to an index into the test's per-probe arrays
+     */
+    uint32_t get_probe_index(const uint3 probe) {
+        return get_cascade(probe) * probes_per_cascade + probe.x + (probe.y % grid_size.y) * grid_size.x +
+            probe.z * grid_size.x * grid_size.y;
+    }
+
+    /**
+     * Tracks when each probe was last updated, and the longest any probe went between updates
+     */
+    struct UpdateHistory {
+        eastl::vector<uint32_t> last_update_frame = eastl::vector<uint32_t>(num_probes, never_updated);
+
+        eastl::vector<uint32_t> num_updates = eastl::vector<uint32_t>(num_probes, 0);
+
+        uint32_t max_age = 0;
+
+        /**
+         * Pulls one frame's probes and records them. Checks that the scheduler used the whole budget, and didn't
+         * pull any probe twice
+         */
+        void pull(ProbeUpdateScheduler& scheduler, const uint32_t frame, const uint32_t budget) {
+            auto probes = eastl::vector<uint3>{};
+            scheduler.pull_probes_to_update(frame, budget, camera_positions, probes);
+            REQUIRE(probes.size() == eastl::min(budget, num_probes));
+
+            for(const auto& probe : probes) {
+                REQUIRE(get_cascade(probe) < cascade_priorities.size());
+
+                const auto probe_index = get_probe_index(probe);
+                REQUIRE(last_update_frame[probe_index] != frame);
+
+                if(last_update_frame[probe_index] != never_updated) {
+                    max_age = eastl::max(max_age, frame - last_update_frame[probe_index]);
+                }
+                last_update_frame[probe_index] = frame;
+                num_updates[probe_index]++;
+            }
+        }
+
+        /**
+         * Longest that any probe has gone without an update, as of the given frame. Covers the probes that are still
+         * waiting, not just the ones that were updated
+         */
+        uint32_t get_max_current_age(const uint32_t frame) const {
+            auto age = 0u;
+            for(const auto last_frame : last_update_frame) {
+                REQUIRE(last_frame != never_updated);
+                age = eastl::max(age, frame - last_frame);
+            }
+            return age;
+        }
+
+        float get_average_updates(const uint32_t cascade) const {
+            auto total = 0u;
+            for(auto probe = 0u; probe < probes_per_cascade; probe++) {
+                total += num_updates[cascade * probes_per_cascade + probe];
+            }
+            return static_cast<float>(total) / static_cast<float>(probes_per_cascade);
+        }
+    };
+
+    void set_max_probe_age(const int32_t max_age) {
+        CVarSystem::Get()->SetIntCVar("r.GI.Cache.MaxProbeAge", max_age);
+    }
+
+    /**
+     * Default value of r.GI.Cache.MaxProbeAge
+     */
+    constexpr auto default_max_probe_age = 600;
+}
+
+TEST_CASE("Every probe is updated before any probe is updated twice", "[probe_update_scheduler]") {
+    auto scheduler = make_scheduler();
+    auto history = UpdateHistory{};
+
+    constexpr auto budget = 100u;
+    for(auto frame = 0u; frame * budget < num_probes; frame++) {
+        history.pull(scheduler, frame, budget);
+    }
+
+    const auto last_full_frame = num_probes / budget - 1;
+    for(auto probe = 0u; probe < num_probes; probe++) {
+        // The last frame finishes the new probes, and spends the rest of its budget on the most urgent valid probes
+        if(history.last_update_frame[probe] <= last_full_frame) {
+            REQUIRE(history.num_updates[probe] == 1);
+        } else {
+            REQUIRE(history.num_updates[probe] >= 1);
+        }
+    }
+}
+
+TEST_CASE("Probe updates are deterministic", "[probe_update_scheduler]") {
+    auto first_scheduler = make_scheduler();
+    auto second_scheduler = make_scheduler();
+
+    for(auto frame = 0u; frame < 100; frame++) {
+        auto first_probes = eastl::vector<uint3>{};
+        first_scheduler.pull_probes_to_update(frame, 37, camera_positions, first_probes);
+
+        auto second_probes = eastl::vector<uint3>{};
+        second_scheduler.pull_probes_to_update(frame, 37, camera_positions, second_probes);
+
+        REQUIRE(first_probes == second_probes);
+    }
+}
+
+TEST_CASE("No probe waits much longer than MaxProbeAge", "[probe_update_scheduler]") {
+    constexpr auto max_probe_age = 16u;
+    set_max_probe_age(max_probe_age);
+
+    SECTION("The budget covers every probe's schedule") {
+        // Every probe is due at least every max_probe_age frames, and the budget has room for all of them
+        constexpr auto budget = num_probes / max_probe_age * 2;
+
+        auto scheduler = make_scheduler();
+        auto history = UpdateHistory{};
+
+        // The first pass updates every probe in a burst, so their first intervals all come due together. Give the
+        // schedule a few max ages to spread out
+        constexpr auto num_warmup_frames = max_probe_age * 6;
+        auto frame = 0u;
+        for(; frame < num_warmup_frames; frame++) {
+            history.pull(scheduler, frame, budget);
+        }
+        history.max_age = 0;
+
+        for(; frame < 1000; frame++) {
+            history.pull(scheduler, frame, budget);
+        }
+
+        REQUIRE(history.max_age <= max_probe_age);
+        REQUIRE(history.get_max_current_age(999) <= max_probe_age);
+    }
+
+    SECTION("The budget is too small for the schedule") {
+        // The probes that are due take up the whole budget every frame, so every probe is late. Once a probe is due,
+        // every other probe can go ahead of it at most once, which bounds how late it gets
+        constexpr auto budget = 20u;
+        constexpr auto max_lateness = (num_probes - 1) / budget;
+
+        auto scheduler = make_scheduler();
+        auto history = UpdateHistory{};
+        for(auto frame = 0u; frame < 1000; frame++) {
+            history.pull(scheduler, frame, budget);
+        }
+
+        REQUIRE(history.max_age > max_probe_age);
+        REQUIRE(history.max_age <= max_probe_age + max_lateness);
+        REQUIRE(history.get_max_current_age(999) <= max_probe_age + max_lateness);
+    }
+
+    set_max_probe_age(default_max_probe_age);
+}
+
+TEST_CASE("Probe updates are shared out by priority", "[probe_update_scheduler]") {
+    auto scheduler = make_scheduler();
+    auto history = UpdateHistory{};
+
+    constexpr auto budget = 64u;
+    constexpr auto num_frames = 2000u;
+    for(auto frame = 0u; frame < num_frames; frame++) {
+        history.pull(scheduler, frame, budget);
+    }
+
+    // Nothing starves, even in the least important cascades
+    REQUIRE(history.get_max_current_age(num_frames - 1) <= default_max_probe_age);
+    for(const auto num_updates : history.num_updates) {
+        REQUIRE(num_updates > 1);
+    }
+
+    // The first cascade has five times the priority of the others, so its probes are updated about five times as
+    // often. Cascades with the same priority get about the same share
+    const auto first_cascade_updates = history.get_average_updates(0);
+    for(auto cascade = 1u; cascade < cascade_priorities.size(); cascade++) {
+        const auto ratio = first_cascade_updates / history.get_average_updates(cascade);
+        REQUIRE(ratio > 4.f);
+        REQUIRE(ratio < 6.f);
+
+        const auto relative_share = history.get_average_updates(cascade) / history.get_average_updates(1);
+        REQUIRE(relative_share > 0.95f);
+        REQUIRE(relative_share < 1.05f);
+    }
+
+    // Within a cascade, the probes near the camera are updated more often than the probes in the corners
+    const auto center_probe = get_probe_index(grid_size / 2u);
+    const auto corner_probe = get_probe_index(uint3{0});
+    REQUIRE(history.num_updates[center_probe] > history.num_updates[corner_probe]);
+}
+
+TEST_CASE("Probes that scroll into a cascade are updated first", "[probe_update_scheduler]") {
+    auto scheduler = make_scheduler();
+    auto history = UpdateHistory{};
+
+    constexpr auto budget = 128u;
+    auto frame = 0u;
+    for(; frame < 50; frame++) {
+        history.pull(scheduler, frame, budget);
+    }
+
+    // The cascade's min moved two probes along +X. The probes that scrolled out at the low end of the textures are
+    // reused for the probes that scrolled in at the high end
+    constexpr auto cascade = 2u;
+    scheduler.scroll_cascade(cascade, int3{-2, 0, 0}, uint3{2, 0, 0}, camera_positions[cascade]);
+
+    auto probes = eastl::vector<uint3>{};
+    scheduler.pull_probes_to_update(frame, budget, camera_positions, probes);
+
+    constexpr auto num_scrolled_in = 2 * grid_size.y * grid_size.z;
+    for(auto i = 0u; i < budget; i++) {
+        const auto& probe = probes[i];
+        const auto is_scrolled_in = get_cascade(probe) == cascade && probe.x < 2;
+        REQUIRE(is_scrolled_in == (i < num_scrolled_in));
+    }
+}
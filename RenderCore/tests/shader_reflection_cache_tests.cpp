@@ -0,0 +1,284 @@
+#include <cstring>
+#include <initializer_list>
+#include <string_view>
+
+#include <catch2/catch_test_macros.hpp>
+#include <EASTL/algorithm.h>
+
+#include "render/backend/shader_reflection_cache.hpp"
+
+namespace {
+    /**
+     * Assembles a minimal vertex shader module, so that the tests don't need a shader compiler
+     *
+     * The module has a read-only storage buffer at set 0 and the given binding, a uniform buffer at set 1 binding 0, a
+     * push constant block, and a vec4 input named "position" at location 0
+     */
+    class TestShaderBuilder {
+    public:
+        static eastl::vector<std::byte> build(const uint32_t storage_buffer_binding) {
+            auto builder = TestShaderBuilder{};
+
+            enum Id : uint32_t {
+                Main = 1,
+                Position,
+                BufferType,
+                Buffer,
+                ConstantsType,
+                Constants,
+                UboType,
+                Ubo,
+                Void,
+                FunctionType,
+                Float,
+                Float4,
+                InputFloat4Pointer,
+                BufferPointer,
+                ConstantsPointer,
+                UboPointer,
+                Label,
+                Bound
+            };
+
+            builder.words = {0x07230203, 0x00010300, 0, Bound, 0};
+
+            builder.emit(OpCapability, {CapabilityShader});
+            builder.emit(OpMemoryModel, {AddressingModelLogical, MemoryModelGlsl450});
+            builder.emit(OpEntryPoint, {ExecutionModelVertex, Main}, "main", {Position});
+
+            builder.emit(OpName, {Position}, "position");
+
+            builder.emit(OpDecorate, {Position, DecorationLocation, 0});
+            builder.emit(OpDecorate, {BufferType, DecorationBlock});
+            builder.emit(OpMemberDecorate, {BufferType, 0, DecorationOffset, 0});
+            builder.emit(OpDecorate, {Buffer, DecorationDescriptorSet, 0});
+            builder.emit(OpDecorate, {Buffer, DecorationBinding, storage_buffer_binding});
+            builder.emit(OpDecorate, {Buffer, DecorationNonWritable});
+            builder.emit(OpDecorate, {ConstantsType, DecorationBlock});
+            builder.emit(OpMemberDecorate, {ConstantsType, 0, DecorationOffset, 0});
+            builder.emit(OpDecorate, {UboType, DecorationBlock});
+            builder.emit(OpMemberDecorate, {UboType, 0, DecorationOffset, 0});
+            builder.emit(OpDecorate, {Ubo, DecorationDescriptorSet, 1});
+            builder.emit(OpDecorate, {Ubo, DecorationBinding, 0});
+
+            builder.emit(OpTypeVoid, {Void});
+            builder.emit(OpTypeFunction, {FunctionType, Void});
+            builder.emit(OpTypeFloat, {Float, 32});
+            builder.emit(OpTypeVector, {Float4, Float, 4});
+
+            builder.emit(OpTypePointer, {InputFloat4Pointer, StorageClassInput, Float4});
+            builder.emit(OpVariable, {InputFloat4Pointer, Position, StorageClassInput});
+
+            builder.emit(OpTypeStruct, {BufferType, Float});
+            builder.emit(OpTypePointer, {BufferPointer, StorageClassStorageBuffer, BufferType});
+            builder.emit(OpVariable, {BufferPointer, Buffer, StorageClassStorageBuffer});
+
+            builder.emit(OpTypeStruct, {ConstantsType, Float});
+            builder.emit(OpTypePointer, {ConstantsPointer, StorageClassPushConstant, ConstantsType});
+            builder.emit(OpVariable, {ConstantsPointer, Constants, StorageClassPushConstant});
+
+            builder.emit(OpTypeStruct, {UboType, Float4});
+            builder.emit(OpTypePointer, {UboPointer, StorageClassUniform, UboType});
+            builder.emit(OpVariable, {UboPointer, Ubo, StorageClassUniform});
+
+            builder.emit(OpFunction, {Void, Main, FunctionControlNone, FunctionType});
+            builder.emit(OpLabel, {Label});
+            builder.emit(OpReturn, {});
+            builder.emit(OpFunctionEnd, {});
+
+            auto spirv = eastl::vector<std::byte>(builder.words.size() * sizeof(uint32_t));
+            std::memcpy(spirv.data(), builder.words.data(), spirv.size());
+            return spirv;
+        }
+
+    private:
+        enum : uint32_t {
+            OpName = 5,
+            OpMemoryModel = 14,
+            OpEntryPoint = 15,
+            OpCapability = 17,
+            OpTypeVoid = 19,
+            OpTypeFloat = 22,
+            OpTypeVector = 23,
+            OpTypeStruct = 30,
+            OpTypePointer = 32,
+            OpTypeFunction = 33,
+            OpFunction = 54,
+            OpFunctionEnd = 56,
+            OpVariable = 59,
+            OpDecorate = 71,
+            OpMemberDecorate = 72,
+            OpLabel = 248,
+            OpReturn = 253,
+
+            CapabilityShader = 1,
+            AddressingModelLogical = 0,
+            MemoryModelGlsl450 = 1,
+            ExecutionModelVertex = 0,
+            FunctionControlNone = 0,
+
+            DecorationBlock = 2,
+            DecorationNonWritable = 24,
+            DecorationLocation = 30,
+            DecorationBinding = 33,
+            DecorationDescriptorSet = 34,
+            DecorationOffset = 35,
+
+            StorageClassInput = 1,
+            StorageClassUniform = 2,
+            StorageClassPushConstant = 9,
+            StorageClassStorageBuffer = 12,
+        };
+
+        eastl::vector<uint32_t> words;
+
+        /**
+         * Appends an instruction. `string` is a literal string operand that goes between `operands` and
+         * `trailing_operands`
+         */
+        void emit(
+            const uint32_t opcode, const std::initializer_list<uint32_t> operands, const std::string_view string = {},
+            const std::initializer_list<uint32_t> trailing_operands = {}
+        ) {
+            // Strings are nul-terminated and padded to a whole word
+            const auto num_string_words = string.empty() ? 0u : static_cast<uint32_t>(string.size() / 4 + 1);
+            const auto num_words = 1 + static_cast<uint32_t>(operands.size() + trailing_operands.size()) +
+                num_string_words;
+
+            words.push_back(num_words << 16 | opcode);
+            words.insert(words.end(), operands.begin(), operands.end());
+
+            const auto first_string_word = words.size();
+            words.resize(words.size() + num_string_words, 0);
+            std::memcpy(words.data() + first_string_word, string.data(), string.size());
+
+            words.insert(words.end(), trailing_operands.begin(), trailing_operands.end());
+        }
+    };
+}
+
+TEST_CASE("Shader reflection finds bindings, push constants, and vertex inputs", "[shader_reflection]") {
+    const auto spirv = TestShaderBuilder::build(3);
+    const auto reflection = reflect_shader(spirv);
+
+    REQUIRE(reflection.bindings.size() == 2);
+
+    const auto storage_buffer = eastl::find_if(
+        reflection.bindings.begin(),
+        reflection.bindings.end(),
+        [](const ShaderReflection::Binding& binding) { return binding.set == 0; });
+    REQUIRE(storage_buffer != reflection.bindings.end());
+    REQUIRE(storage_buffer->binding == 3);
+    REQUIRE(storage_buffer->type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    REQUIRE(storage_buffer->count == 1);
+
+    const auto uniform_buffer = eastl::find_if(
+        reflection.bindings.begin(),
+        reflection.bindings.end(),
+        [](const ShaderReflection::Binding& binding) { return binding.set == 1; });
+    REQUIRE(uniform_buffer != reflection.bindings.end());
+    REQUIRE(uniform_buffer->binding == 0);
+    REQUIRE(uniform_buffer->type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+
+    REQUIRE(reflection.push_constants.size() == 1);
+    REQUIRE(reflection.push_constants[0].offset == 0);
+
+    REQUIRE(reflection.inputs.size() == 1);
+    REQUIRE(reflection.inputs[0].name == "position");
+    REQUIRE(reflection.inputs[0].location == 0);
+}
+
+TEST_CASE("Reflection cache hits return the same data as reflecting the shader", "[shader_reflection]") {
+    const auto spirv = TestShaderBuilder::build(0);
+
+    auto cache = ShaderReflectionCache{};
+    REQUIRE(cache.get_reflection(spirv) == reflect_shader(spirv));
+    REQUIRE(cache.get_num_misses() == 1);
+
+    REQUIRE(cache.get_reflection(spirv) == reflect_shader(spirv));
+    REQUIRE(cache.get_num_hits() == 1);
+    REQUIRE(cache.get_num_misses() == 1);
+}
+
+TEST_CASE("Reflection cache survives a serialize/deserialize round trip", "[shader_reflection]") {
+    const auto first_spirv = TestShaderBuilder::build(0);
+    const auto second_spirv = TestShaderBuilder::build(5);
+
+    auto cache = ShaderReflectionCache{};
+    const auto first_reflection = cache.get_reflection(first_spirv);
+    const auto second_reflection = cache.get_reflection(second_spirv);
+    REQUIRE_FALSE(first_reflection == second_reflection);
+
+    const auto data = cache.serialize();
+
+    auto loaded_cache = ShaderReflectionCache{};
+    REQUIRE(loaded_cache.deserialize(data));
+
+    REQUIRE(loaded_cache.get_reflection(first_spirv) == first_reflection);
+    REQUIRE(loaded_cache.get_reflection(second_spirv) == second_reflection);
+    REQUIRE(loaded_cache.get_num_hits() == 2);
+    REQUIRE(loaded_cache.get_num_misses() == 0);
+
+    // Both entries were used, so saving the loaded cache writes the same amount of data
+    REQUIRE(loaded_cache.serialize().size() == data.size());
+}
+
+TEST_CASE("Reflection cache only saves entries that were used", "[shader_reflection]") {
+    const auto used_spirv = TestShaderBuilder::build(0);
+    const auto unused_spirv = TestShaderBuilder::build(5);
+
+    auto cache = ShaderReflectionCache{};
+    cache.get_reflection(used_spirv);
+    cache.get_reflection(unused_spirv);
+
+    auto next_run_cache = ShaderReflectionCache{};
+    REQUIRE(next_run_cache.deserialize(cache.serialize()));
+    next_run_cache.get_reflection(used_spirv);
+
+    auto final_cache = ShaderReflectionCache{};
+    REQUIRE(final_cache.deserialize(next_run_cache.serialize()));
+
+    final_cache.get_reflection(used_spirv);
+    REQUIRE(final_cache.get_num_hits() == 1);
+
+    final_cache.get_reflection(unused_spirv);
+    REQUIRE(final_cache.get_num_misses() == 1);
+}
+
+TEST_CASE("Malformed reflection cache data is rejected", "[shader_reflection]") {
+    const auto spirv = TestShaderBuilder::build(0);
+
+    auto cache = ShaderReflectionCache{};
+    cache.get_reflection(spirv);
+    const auto data = cache.serialize();
+
+    SECTION("Truncated") {
+        auto loaded_cache = ShaderReflectionCache{};
+        REQUIRE_FALSE(loaded_cache.deserialize(std::span{data}.first(data.size() - 1)));
+
+        // Nothing from the partial data is kept
+        loaded_cache.get_reflection(spirv);
+        REQUIRE(loaded_cache.get_num_misses() == 1);
+    }
+
+    SECTION("Trailing data") {
+        auto padded_data = data;
+        padded_data.push_back(0);
+
+        auto loaded_cache = ShaderReflectionCache{};
+        REQUIRE_FALSE(loaded_cache.deserialize(padded_data));
+    }
+
+    SECTION("Wrong version") {
+        auto old_data = data;
+        old_data[4]++;
+
+        auto loaded_cache = ShaderReflectionCache{};
+        REQUIRE_FALSE(loaded_cache.deserialize(old_data));
+    }
+
+    SECTION("Empty") {
+        auto loaded_cache = ShaderReflectionCache{};
+        REQUIRE_FALSE(loaded_cache.deserialize({}));
+    }
+}
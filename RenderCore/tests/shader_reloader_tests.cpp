@@ -0,0 +1,350 @@
+#include <chrono>
+#include <sstream>
+
+#include <catch2/catch_test_macros.hpp>
+#include <EASTL/algorithm.h>
+#include <EASTL/string.h>
+#include <EASTL/unordered_map.h>
+#include <EASTL/vector.h>
+
+#include "render/backend/shader_reloader.hpp"
+
+namespace {
+    const auto source_dir = std::filesystem::path{"/project/shaders"};
+
+    const auto output_dir = std::filesystem::path{"/project/build/shaders"};
+
+    const auto compile_command = std::string{"compile_shaders.py"};
+
+    std::filesystem::path source(const char* name) {
+        return source_dir / name;
+    }
+
+    std::filesystem::path output(const char* name) {
+        return output_dir / name;
+    }
+
+    /**
+     * A shader that the fake compile script builds
+     */
+    struct FakeShader {
+        std::filesystem::path source;
+
+        std::filesystem::path output;
+    };
+
+    struct FakeFile {
+        std::filesystem::path path;
+
+        std::string contents;
+
+        std::filesystem::file_time_type write_time;
+    };
+
+    /**
+     * Files in memory, with a clock that ticks on every write, and a compile script that works like the real one. It
+     * recompiles the shaders that are older than their source or one of its includes, and writes a .deps file for each.
+     * A shader fails to compile, and keeps its old output, if its source or one of its includes contains "error"
+     *
+     * Sources include other files with lines of the form "#include <absolute path>"
+     */
+    class FakeShaderEnvironment final : public ShaderReloadEnvironment {
+    public:
+        eastl::vector<FakeShader> shaders;
+
+        uint32_t num_compiles = 0;
+
+        void write(const std::filesystem::path& path, const std::string& contents) {
+            now += std::chrono::seconds{1};
+            files[normalize_shader_path(path)] = FakeFile{.path = path, .contents = contents, .write_time = now};
+        }
+
+        tl::optional<std::filesystem::file_time_type> get_write_time(const std::filesystem::path& path) const {
+            if(const auto itr = files.find(normalize_shader_path(path)); itr != files.end()) {
+                return itr->second.write_time;
+            }
+            return tl::nullopt;
+        }
+
+        eastl::vector<ShaderFileInfo> find_files(const std::filesystem::path& directory) override {
+            const auto prefix = normalize_shader_path(directory) + "/";
+
+            auto found_files = eastl::vector<ShaderFileInfo>{};
+            for(const auto& [name, file] : files) {
+                if(name.compare(0, prefix.size(), prefix) == 0) {
+                    found_files.emplace_back(ShaderFileInfo{.path = file.path, .write_time = file.write_time});
+                }
+            }
+            return found_files;
+        }
+
+        tl::optional<std::string> read_file(const std::filesystem::path& file) override {
+            if(const auto itr = files.find(normalize_shader_path(file)); itr != files.end()) {
+                return itr->second.contents;
+            }
+            return tl::nullopt;
+        }
+
+        int run_compile_command(const std::string& command) override {
+            REQUIRE(command == compile_command);
+            num_compiles++;
+
+            auto exit_code = 0;
+            for(const auto& shader : shaders) {
+                const auto dependencies = get_dependencies(shader.source);
+
+                const auto output_time = get_write_time(shader.output);
+                const auto is_up_to_date = output_time && eastl::all_of(
+                    dependencies.begin(),
+                    dependencies.end(),
+                    [&](const std::filesystem::path& dependency) {
+                        const auto dependency_time = get_write_time(dependency);
+                        return dependency_time && *dependency_time < *output_time;
+                    });
+                if(is_up_to_date) {
+                    continue;
+                }
+
+                const auto has_error = eastl::any_of(
+                    dependencies.begin(),
+                    dependencies.end(),
+                    [&](const std::filesystem::path& dependency) {
+                        return read_file(dependency).value_or("").find("error") != std::string::npos;
+                    });
+                if(has_error) {
+                    exit_code = 1;
+                    continue;
+                }
+
+                write(shader.output, "SPIR-V");
+
+                auto deps = std::string{};
+                for(const auto& dependency : dependencies) {
+                    deps += dependency.string() + "\n";
+                }
+                write(std::filesystem::path{shader.output}.replace_extension(".deps"), deps);
+            }
+
+            return exit_code;
+        }
+
+    private:
+        eastl::unordered_map<eastl::string, FakeFile> files;
+
+        std::filesystem::file_time_type now = std::filesystem::file_time_type{};
+
+        /**
+         * The source file and everything that it includes, directly or not
+         */
+        eastl::vector<std::filesystem::path> get_dependencies(const std::filesystem::path& source_file) {
+            auto dependencies = eastl::vector<std::filesystem::path>{source_file};
+            for(auto i = 0u; i < dependencies.size(); i++) {
+                auto stream = std::istringstream{read_file(dependencies[i]).value_or("")};
+                auto line = std::string{};
+                while(std::getline(stream, line)) {
+                    if(!line.starts_with("#include ")) {
+                        continue;
+                    }
+
+                    const auto include = std::filesystem::path{line.substr(9)};
+                    if(eastl::find(dependencies.begin(), dependencies.end(), include) == dependencies.end()) {
+                        dependencies.push_back(include);
+                    }
+                }
+            }
+            return dependencies;
+        }
+    };
+
+    eastl::vector<eastl::string> normalize(const eastl::vector<std::filesystem::path>& paths) {
+        auto names = eastl::vector<eastl::string>{};
+        for(const auto& path : paths) {
+            names.push_back(normalize_shader_path(path));
+        }
+        eastl::sort(names.begin(), names.end());
+        return names;
+    }
+
+    eastl::vector<eastl::string> sorted(eastl::vector<eastl::string> names) {
+        eastl::sort(names.begin(), names.end());
+        return names;
+    }
+
+    /**
+     * A shadow shader and a masked variant with a similar name, which share an include, and a sky shader that uses
+     * neither
+     */
+    FakeShaderEnvironment make_environment() {
+        auto environment = FakeShaderEnvironment{};
+        environment.write(source("common.glsl"), "");
+        environment.write(source("shadow.vert"), "#include /project/shaders/common.glsl\n");
+        environment.write(source("shadow_masked.vert"), "#include /project/shaders/common.glsl\n");
+        environment.write(source("sky.frag"), "");
+
+        environment.shaders = {
+            FakeShader{.source = source("shadow.vert"), .output = output("shadow.vert.spv")},
+            FakeShader{.source = source("shadow_masked.vert"), .output = output("shadow_masked.vert.spv")},
+            FakeShader{.source = source("sky.frag"), .output = output("sky.frag.spv")},
+        };
+
+        // Shaders are built before the reloader starts
+        environment.run_compile_command(compile_command);
+        environment.num_compiles = 0;
+
+        return environment;
+    }
+
+    /**
+     * Polls until the scheduler recompiles, or gives up after a few polls
+     */
+    ShaderRecompileResult poll_until_recompiled(ShaderReloadScheduler& scheduler) {
+        for(auto i = 0u; i < 4; i++) {
+            if(auto result = scheduler.poll()) {
+                return *result;
+            }
+        }
+
+        FAIL("The scheduler didn't recompile");
+        return {};
+    }
+}
+
+TEST_CASE("ShaderDependencyGraph replaces an output's old dependencies", "[shader_reloader]") {
+    auto graph = ShaderDependencyGraph{output_dir};
+
+    graph.set_dependencies(output("shadow.vert.spv"), {source("shadow.vert"), source("old_include.glsl")});
+    REQUIRE(graph.get_affected_outputs(source("old_include.glsl")) == normalize({output("shadow.vert.spv")}));
+
+    graph.set_dependencies(output("shadow.vert.spv"), {source("shadow.vert"), source("new_include.glsl")});
+    REQUIRE(graph.get_affected_outputs(source("old_include.glsl")).empty());
+    REQUIRE(graph.get_affected_outputs(source("new_include.glsl")) == normalize({output("shadow.vert.spv")}));
+    REQUIRE(graph.get_affected_outputs(source("shadow.vert")) == normalize({output("shadow.vert.spv")}));
+
+    // Listing a file twice doesn't list the output twice
+    graph.set_dependencies(output("shadow.vert.spv"), {source("shadow.vert"), source("shadow.vert")});
+    REQUIRE(graph.get_affected_outputs(source("shadow.vert")) == normalize({output("shadow.vert.spv")}));
+}
+
+TEST_CASE("ShaderDependencyGraph finds the outputs of sources and includes", "[shader_reloader]") {
+    auto environment = make_environment();
+    auto graph = ShaderDependencyGraph{output_dir};
+    graph.rebuild(environment);
+
+    SECTION("An include affects every shader that includes it") {
+        REQUIRE(
+            sorted(graph.get_affected_outputs(source("common.glsl"))) ==
+            normalize({output("shadow.vert.spv"), output("shadow_masked.vert.spv")}));
+    }
+
+    SECTION("A source only affects the shaders compiled from it, not ones whose names start the same") {
+        REQUIRE(graph.get_affected_outputs(source("shadow.vert")) == normalize({output("shadow.vert.spv")}));
+        REQUIRE(
+            graph.get_affected_outputs(source("shadow_masked.vert")) ==
+            normalize({output("shadow_masked.vert.spv")}));
+        REQUIRE(graph.get_affected_outputs(source("sky.frag")) == normalize({output("sky.frag.spv")}));
+    }
+
+    SECTION("Files that nothing depends on affect nothing") {
+        REQUIRE(graph.get_affected_outputs(source("unused.glsl")).empty());
+        REQUIRE(graph.get_affected_outputs(source("shadow")).empty());
+    }
+
+    SECTION("Windows line endings in .deps files are ignored") {
+        environment.write(
+            output("sky.frag.deps"),
+            normalize_shader_path(source("sky.frag")).c_str() + std::string{"\r\n"});
+        graph.rebuild(environment);
+        REQUIRE(graph.get_affected_outputs(source("sky.frag")) == normalize({output("sky.frag.spv")}));
+    }
+}
+
+TEST_CASE("ShaderReloadScheduler waits for changes to settle, then compiles once", "[shader_reloader]") {
+    auto environment = make_environment();
+    auto scheduler = ShaderReloadScheduler{source_dir, output_dir, compile_command, environment};
+    scheduler.start();
+
+    // Nothing changed since the start
+    REQUIRE_FALSE(scheduler.poll());
+    REQUIRE_FALSE(scheduler.poll());
+    REQUIRE(environment.num_compiles == 0);
+
+    // An editor that writes the file several times while saving it
+    environment.write(source("common.glsl"), "// First write");
+    REQUIRE_FALSE(scheduler.poll());
+    environment.write(source("common.glsl"), "// Second write");
+    REQUIRE_FALSE(scheduler.poll());
+    REQUIRE(environment.num_compiles == 0);
+
+    const auto result = scheduler.poll();
+    REQUIRE(result);
+    REQUIRE(environment.num_compiles == 1);
+    REQUIRE(result->compile_exit_code == 0);
+    REQUIRE(normalize(result->modified_sources) == normalize({source("common.glsl")}));
+    REQUIRE(
+        sorted(result->rewritten_shaders) ==
+        normalize({output("shadow.vert.spv"), output("shadow_masked.vert.spv")}));
+
+    // And nothing more until the next change
+    REQUIRE_FALSE(scheduler.poll());
+    REQUIRE(environment.num_compiles == 1);
+}
+
+TEST_CASE("ShaderReloadScheduler only reports the shaders that the compile script rewrote", "[shader_reloader]") {
+    auto environment = make_environment();
+    auto scheduler = ShaderReloadScheduler{source_dir, output_dir, compile_command, environment};
+    scheduler.start();
+
+    SECTION("Changing a source reports the shaders compiled from it") {
+        environment.write(source("shadow.vert"), "#include /project/shaders/common.glsl\n// Changed");
+        const auto result = poll_until_recompiled(scheduler);
+        REQUIRE(result.rewritten_shaders == normalize({output("shadow.vert.spv")}));
+    }
+
+    SECTION("Shaders that fail to compile aren't reported") {
+        environment.write(source("common.glsl"), "syntax error");
+        auto result = poll_until_recompiled(scheduler);
+        REQUIRE(result.compile_exit_code != 0);
+        REQUIRE(result.rewritten_shaders.empty());
+
+        // Fixing the error reports them
+        environment.write(source("common.glsl"), "// Fixed");
+        result = poll_until_recompiled(scheduler);
+        REQUIRE(result.compile_exit_code == 0);
+        REQUIRE(
+            sorted(result.rewritten_shaders) ==
+            normalize({output("shadow.vert.spv"), output("shadow_masked.vert.spv")}));
+    }
+
+    SECTION("Only the variant that compiled is reported when another fails") {
+        environment.write(source("shadow_masked.vert"), "#include /project/shaders/common.glsl\nerror");
+        environment.write(source("common.glsl"), "// Changed");
+        const auto result = poll_until_recompiled(scheduler);
+        REQUIRE(result.compile_exit_code != 0);
+        REQUIRE(result.rewritten_shaders == normalize({output("shadow.vert.spv")}));
+    }
+
+    SECTION("New shaders are reported") {
+        environment.shaders.push_back(FakeShader{.source = source("fog.comp"), .output = output("fog.comp.spv")});
+        environment.write(source("fog.comp"), "");
+        const auto result = poll_until_recompiled(scheduler);
+        REQUIRE(result.rewritten_shaders == normalize({output("fog.comp.spv")}));
+    }
+
+    SECTION("New includes are tracked after the recompile") {
+        environment.write(source("noise.glsl"), "");
+        environment.write(source("sky.frag"), "#include /project/shaders/noise.glsl\n");
+        auto result = poll_until_recompiled(scheduler);
+        REQUIRE(result.rewritten_shaders == normalize({output("sky.frag.spv")}));
+
+        environment.write(source("noise.glsl"), "// Changed");
+        result = poll_until_recompiled(scheduler);
+        REQUIRE(result.rewritten_shaders == normalize({output("sky.frag.spv")}));
+    }
+
+    SECTION("Files that no shader uses don't report anything") {
+        environment.write(source("readme.txt"), "");
+        const auto result = poll_until_recompiled(scheduler);
+        REQUIRE(environment.num_compiles == 1);
+        REQUIRE(result.rewritten_shaders.empty());
+    }
+}
@@ -0,0 +1,25 @@
+# CPU-side unit tests for SahCore. None of these need a GPU
+
+include(FetchContent)
+
+FetchContent_Declare(
+        catch2
+        GIT_REPOSITORY  https://github.com/catchorg/Catch2.git
+        GIT_TAG         v3.7.1
+)
+FetchContent_MakeAvailable(catch2)
+
+file(GLOB_RECURSE SAH_TEST_SOURCES CONFIGURE_DEPENDS ${CMAKE_CURRENT_LIST_DIR}/*.cpp ${CMAKE_CURRENT_LIST_DIR}/*.hpp)
+
+add_executable(SahCoreTests ${SAH_TEST_SOURCES})
+
+target_link_libraries(SahCoreTests PRIVATE
+        SahCore
+        Catch2::Catch2WithMain
+        )
+
+enable_testing()
+
+list(APPEND CMAKE_MODULE_PATH ${catch2_SOURCE_DIR}/extras)
+include(Catch)
+catch_discover_tests(SahCoreTests)
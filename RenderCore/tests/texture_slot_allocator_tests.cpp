@@ -0,0 +1,205 @@
+#include <bit>
+#include <random>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <EASTL/array.h>
+#include <EASTL/unordered_map.h>
+#include <EASTL/unordered_set.h>
+
+#include "render/backend/texture_slot_allocator.hpp"
+
+namespace {
+    struct TestSrv {
+        VkImageView image_view = VK_NULL_HANDLE;
+
+        VkSampler sampler = VK_NULL_HANDLE;
+    };
+
+    /**
+     * SRVs for num_views image views, each with one of two samplers
+     */
+    eastl::vector<TestSrv> make_srvs(const uint32_t num_views) {
+        auto srvs = eastl::vector<TestSrv>{};
+        for(auto view = 0u; view < num_views; view++) {
+            for(auto sampler = 0u; sampler < 2; sampler++) {
+                srvs.emplace_back(
+                    TestSrv{
+                        .image_view = std::bit_cast<VkImageView>(uint64_t{0x1000} + view),
+                        .sampler = std::bit_cast<VkSampler>(uint64_t{0x100} + sampler)
+                    });
+            }
+        }
+
+        return srvs;
+    }
+
+    uint32_t acquire(TextureSlotAllocator& allocator, const TestSrv& srv, bool& is_new_slot) {
+        return allocator.acquire(srv.image_view, srv.sampler, is_new_slot);
+    }
+}
+
+TEST_CASE("Texture slots are shared by identical SRVs", "[texture_slot_allocator]") {
+    auto allocator = TextureSlotAllocator{16};
+    const auto srvs = make_srvs(2);
+
+    auto is_new_slot = false;
+    const auto slot = acquire(allocator, srvs[0], is_new_slot);
+    REQUIRE(is_new_slot);
+
+    REQUIRE(acquire(allocator, srvs[0], is_new_slot) == slot);
+    REQUIRE_FALSE(is_new_slot);
+
+    // Same image view with a different sampler is a different SRV
+    REQUIRE(acquire(allocator, srvs[1], is_new_slot) != slot);
+    REQUIRE(is_new_slot);
+
+    REQUIRE(allocator.get_num_used_slots() == 2);
+    REQUIRE(allocator.get_num_shared_slots() == 1);
+
+    // The slot lives until its last reference is released
+    REQUIRE_FALSE(allocator.release(slot, 0));
+    REQUIRE(allocator.is_allocated(slot));
+    REQUIRE(allocator.release(slot, 0));
+    REQUIRE_FALSE(allocator.is_allocated(slot));
+
+    // Releasing it again is an error, and doesn't free anything twice
+    REQUIRE_FALSE(allocator.release(slot, 0));
+    REQUIRE(allocator.get_num_used_slots() == 1);
+    REQUIRE(allocator.get_num_pending_free_slots() == 1);
+}
+
+TEST_CASE("Freed texture slots aren't reused until their frame has finished", "[texture_slot_allocator]") {
+    constexpr auto num_slots = 4u;
+    auto allocator = TextureSlotAllocator{num_slots};
+    const auto srvs = make_srvs(4);
+
+    auto is_new_slot = false;
+    auto slots = eastl::vector<uint32_t>{};
+    for(auto i = 0u; i < num_slots; i++) {
+        slots.push_back(acquire(allocator, srvs[i], is_new_slot));
+    }
+    REQUIRE_THROWS(acquire(allocator, srvs[num_slots], is_new_slot));
+
+    // Released during frame 1. Frame 0 finishing doesn't make it available
+    allocator.release(slots[2], 1);
+    allocator.free_slots_for_frame(0);
+    REQUIRE(allocator.get_num_pending_free_slots() == 1);
+    REQUIRE_THROWS(acquire(allocator, srvs[num_slots], is_new_slot));
+
+    // An SRV that still has a slot doesn't need a free one
+    REQUIRE(acquire(allocator, srvs[0], is_new_slot) == slots[0]);
+
+    allocator.free_slots_for_frame(1);
+    REQUIRE(allocator.get_num_pending_free_slots() == 0);
+    REQUIRE(acquire(allocator, srvs[num_slots], is_new_slot) == slots[2]);
+    REQUIRE(is_new_slot);
+
+    // The old SRV lost its slot, so it needs a new one
+    REQUIRE_THROWS(acquire(allocator, srvs[2], is_new_slot));
+}
+
+TEST_CASE("Texture slots stay consistent under random SRV churn", "[texture_slot_allocator]") {
+    constexpr auto num_slots = 96u;
+    auto allocator = TextureSlotAllocator{num_slots};
+
+    // More SRVs than slots, so that only the recycling keeps us going
+    const auto srvs = make_srvs(64);
+
+    // Expected state: each live SRV's slot and reference count, and the slots that each frame freed
+    struct LiveSrv {
+        uint32_t slot = 0;
+
+        uint32_t ref_count = 0;
+    };
+    auto live_srvs = eastl::unordered_map<uint32_t, LiveSrv>{};
+    auto references = eastl::vector<uint32_t>{};
+    auto pending_free_slots = eastl::array<eastl::unordered_set<uint32_t>, num_in_flight_frames>{};
+
+    auto rng = std::mt19937{2468};
+    auto frame_idx = 0u;
+
+    for(auto step = 0u; step < 50000; step++) {
+        if(step % 64 == 0) {
+            frame_idx = (frame_idx + 1) % num_in_flight_frames;
+            allocator.free_slots_for_frame(frame_idx);
+            pending_free_slots[frame_idx].clear();
+        }
+
+        const auto num_pending = pending_free_slots[0].size() + pending_free_slots[1].size();
+        const auto is_full = live_srvs.size() + num_pending == num_slots;
+
+        if(rng() % 2 == 0 && !is_full) {
+            const auto srv_idx = static_cast<uint32_t>(rng() % srvs.size());
+
+            auto is_new_slot = false;
+            const auto slot = acquire(allocator, srvs[srv_idx], is_new_slot);
+            REQUIRE(slot < num_slots);
+
+            if(const auto itr = live_srvs.find(srv_idx); itr != live_srvs.end()) {
+                REQUIRE_FALSE(is_new_slot);
+                REQUIRE(slot == itr->second.slot);
+                itr->second.ref_count++;
+            } else {
+                REQUIRE(is_new_slot);
+                // A new slot must not belong to another SRV, or be readable by a frame in flight
+                for(const auto& [other_idx, other_srv] : live_srvs) {
+                    REQUIRE(other_srv.slot != slot);
+                }
+                for(const auto& frame_slots : pending_free_slots) {
+                    REQUIRE(frame_slots.find(slot) == frame_slots.end());
+                }
+                live_srvs.emplace(srv_idx, LiveSrv{.slot = slot, .ref_count = 1});
+            }
+            references.push_back(srv_idx);
+
+        } else if(!references.empty()) {
+            const auto position = rng() % references.size();
+            const auto srv_idx = references[position];
+            references[position] = references.back();
+            references.pop_back();
+
+            auto& live_srv = live_srvs.at(srv_idx);
+            const auto slot = live_srv.slot;
+            live_srv.ref_count--;
+
+            const auto was_freed = allocator.release(slot, frame_idx);
+            REQUIRE(was_freed == (live_srv.ref_count == 0));
+            if(was_freed) {
+                live_srvs.erase(srv_idx);
+                pending_free_slots[frame_idx].insert(slot);
+            }
+        }
+
+        REQUIRE(allocator.get_num_used_slots() == live_srvs.size());
+        REQUIRE(
+            allocator.get_num_pending_free_slots() == pending_free_slots[0].size() + pending_free_slots[1].size());
+    }
+}
+
+TEST_CASE("Texture slot churn", "[.][benchmark][texture_slot_allocator]") {
+    // Roughly what streaming in a few thousand materials does: every material asks for four slots, and most of them are
+    // the shared default textures
+    constexpr auto num_materials = 4096u;
+    const auto srvs = make_srvs(1024);
+
+    BENCHMARK("Acquire and release 16k SRVs") {
+        auto allocator = TextureSlotAllocator{65536};
+        auto slots = eastl::vector<uint32_t>{};
+        slots.reserve(num_materials * 4);
+
+        auto is_new_slot = false;
+        for(auto material = 0u; material < num_materials; material++) {
+            slots.push_back(acquire(allocator, srvs[material % srvs.size()], is_new_slot));
+            for(auto i = 0u; i < 3; i++) {
+                slots.push_back(acquire(allocator, srvs[i], is_new_slot));
+            }
+        }
+        for(const auto slot : slots) {
+            allocator.release(slot, 0);
+        }
+        allocator.free_slots_for_frame(0);
+
+        return allocator.get_num_shared_slots();
+    };
+}
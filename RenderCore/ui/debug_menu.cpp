@@ -248,7 +248,7 @@ void DebugUI::create_font_texture() {
         }
     );
 
-    font_atlas_descriptor_set = *vkutil::DescriptorBuilder::begin(
+    font_atlas_descriptor_set = vkutil::DescriptorBuilder::begin(
                                      backend,
                                      backend.get_persistent_descriptor_allocator()
                                  )
@@ -262,7 +262,7 @@ void DebugUI::create_font_texture() {
                                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                                      VK_SHADER_STAGE_FRAGMENT_BIT
                                  )
-                                 .build();
+                                 .build().value_or(VK_NULL_HANDLE);
 
     io.Fonts->TexID = reinterpret_cast<ImTextureID>(font_atlas_descriptor_set);
 }
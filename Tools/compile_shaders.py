@@ -5,6 +5,7 @@ Basic usage: compile_slang_shaders.py <input_directory> <output_directory>
 
 
 import os
+import re
 import subprocess
 import sys
 from pathlib import Path
@@ -13,32 +14,78 @@ from pathlib import Path
 glsl_extensions = ['.vert', '.geom', '.frag', '.comp']
 
 
-def are_dependencies_modified(depfile_path, last_compile_time):    
+def read_dependencies(depfile_path):
+    '''Reads the files listed in a .deps file, one per line
+    '''
     with open(depfile_path, 'r') as depfile:
-        for dependency in depfile:
-            dependency_path = Path(dependency.strip())
-            if not dependency_path.exists():
-                print(f"Dependency {dependency_path} does not exist, recompiling shader")
-                return True
-            
-            if dependency_path.stat().st_mtime >= last_compile_time:
-                print(f"Dependency {dependency_path} has been modified, recompiling shader")
-                return True
+        return [Path(line.strip()) for line in depfile if line.strip()]
+
+
+def write_dependencies(depfile_path, input_file, dependencies):
+    '''Writes a .deps file that lists the shader's source file and every file that it includes, one absolute path per
+    line. The shader reloader reads these to find the shaders that a changed file affects
+    '''
+    paths = {Path(input_file).resolve()} | {Path(dependency).resolve() for dependency in dependencies}
+    with open(depfile_path, 'w') as f:
+        for path in sorted(paths):
+            f.write(f"{path}\n")
+
+
+def read_makefile_dependencies(makefile_path):
+    '''Reads the prerequisites of the rule in a Makefile-style depfile, like the ones that glslangValidator writes
+    '''
+    with open(makefile_path, 'r') as makefile:
+        contents = makefile.read().replace('\\\r\n', ' ').replace('\\\n', ' ')
+
+    # The rule's target is the compiled shader. Windows paths have a colon after the drive letter, so look for a colon
+    # that's followed by whitespace
+    separator = re.search(r':\s', contents)
+    if separator is None:
+        return []
+
+    # Spaces in paths are escaped with a backslash
+    prerequisites = re.split(r'(?<!\\)\s+', contents[separator.end():])
+    return [prerequisite.replace('\\ ', ' ') for prerequisite in prerequisites if prerequisite]
+
+
+def are_dependencies_modified(depfile_path, last_compile_time):    
+    for dependency_path in read_dependencies(depfile_path):
+        if not dependency_path.exists():
+            print(f"Dependency {dependency_path} does not exist, recompiling shader")
+            return True
+        
+        if dependency_path.stat().st_mtime >= last_compile_time:
+            print(f"Dependency {dependency_path} has been modified, recompiling shader")
+            return True
 
     print("All dependencies are up-to-date")
     return False
 
 
-def compile_slang_shader(input_file, output_file, include_directories, defines=[], entry_point='main'):
+def is_output_up_to_date(input_file, output_file):
+    '''Checks if the output was compiled after the last change to its source file and to every file that the source
+    includes
+
+    Outputs without a .deps file, or with one that doesn't list the source file, are always recompiled. Older versions
+    of this script wrote neither for GLSL shaders
+    '''
     depfile_path = output_file.with_suffix('.deps')
-    if output_file.exists():
-        # If the input file is older than the output file, don't recompile
-        if input_file.stat().st_mtime < output_file.stat().st_mtime:
-            return
+    if not output_file.exists() or not depfile_path.exists():
+        return False
+
+    last_compile_time = output_file.stat().st_mtime
+    if input_file.stat().st_mtime >= last_compile_time:
+        return False
+
+    if Path(input_file).resolve() not in read_dependencies(depfile_path):
+        return False
+
+    return not are_dependencies_modified(depfile_path, last_compile_time)
 
-        # If the dependencies in the dependency file are older than the output file, don't recompile
-        if depfile_path.exists() and not are_dependencies_modified(depfile_path, output_file.stat().st_mtime):
-            return
+
+def compile_slang_shader(input_file, output_file, include_directories, defines=[], entry_point='main'):
+    if is_output_up_to_date(input_file, output_file):
+        return
 
     command = [str(slang_exe), str(input_file), '-profile', 'glsl_460', '-target', 'spirv', '-entry', entry_point, '-fvk-use-scalar-layout', '-g', '-O0', '-o', str(output_file)]
     for dir in include_directories:
@@ -65,10 +112,7 @@ def compile_slang_shader(input_file, output_file, include_directories, defines=[
         if stringline.startswith('(0): note: include'):
             dependencies.add(stringline[19:].strip()[1:-1])
     
-    dependencies_filename = output_file.with_suffix('.deps')
-    with open(dependencies_filename, 'w') as f:
-        for dependency in dependencies:
-            f.write(f"{dependency}\n")
+    write_dependencies(output_file.with_suffix('.deps'), input_file, dependencies)
 
 
 def compile_sky_pipeline(input_file, output_file, include_directories):
@@ -183,10 +227,11 @@ def compile_rt_pipeline(input_file, output_file, include_directories):
 
 
 def compile_glsl_shader(input_file, output_file, include_directories):
-    if output_file.exists() and input_file.stat().st_mtime < output_file.stat().st_mtime:
+    if is_output_up_to_date(input_file, output_file):
         return
-        
-    command = [glslang_exe, "--target-env", "vulkan1.3", "-V", "-g", "-o", "-Od"]
+
+    makefile_path = output_file.with_suffix('.d')
+    command = [glslang_exe, "--target-env", "vulkan1.3", "-V", "-g", "-o", "-Od", "--depfile", makefile_path]
     for dir in include_directories:
         command.append(f"-I{dir}")
 
@@ -198,6 +243,12 @@ def compile_glsl_shader(input_file, output_file, include_directories):
     print(f"output_file={output_file}")
     subprocess.run(command)
 
+    # glslangValidator writes the shader's includes as a Makefile rule. Convert it to the same .deps format as the
+    # Slang shaders use
+    if makefile_path.exists():
+        write_dependencies(output_file.with_suffix('.deps'), input_file, read_makefile_dependencies(makefile_path))
+        makefile_path.unlink()
+
 
 def compile_shaders_in_path(path, root_dir, output_dir):
     include_paths = [root_dir, root_dir.parent, 'D:\\Source\\SahRenderer\\RenderCore\\extern']